@@ -30,7 +30,10 @@ namespace UnrealBuildTool.Rules
 
             PublicDependencyModuleNames.AddRange(new string[] {
                 "Core",
+                "CoreUObject",
+                "Engine",
                 "External",
+                "UMG",
                 //"NeuralInteractionClient",
                 // ... add private dependencies that you statically link with here ...
             });
@@ -42,11 +45,15 @@ namespace UnrealBuildTool.Rules
 
                     "Core",
                     "InputCore",
+                    "ImageWrapper",
+                    "DeveloperSettings",
             });
 
             // Since the PCL module needs this, we also have to use these flags here
             bUseRTTI = true;
             bEnableExceptions = true;
+            // The message handlers of the client are specialized with if constexpr
+            CppStandard = CppStandardVersion.Cpp17;
             //bEnableUndefinedIdentifierWarnings = false;
         }
     }
@@ -0,0 +1,144 @@
+/*
+This file NeuralCommandRegistry.cpp is part of NeuralVisUAL.
+
+NeuralVisUAL is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+NeuralVisUAL is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with NeuralVisUAL.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "NeuralCommandRegistry.h"
+#include "NeuralInteractionClientLog.h"
+#include "Misc/ScopeLock.h"
+
+FNeuralCommandRegistry& FNeuralCommandRegistry::Get()
+{
+	static FNeuralCommandRegistry Instance;
+	return Instance;
+}
+
+FNeuralCommandHandle FNeuralCommandRegistry::Register(const FString& Command)
+{
+	FScopeLock ScopeLock(&Lock);
+	FNeuralCommandHandle Handle;
+	Handle.Id = NextId++;
+	Handle.Command = Command;
+	Entries.Add(Handle.Id).Command = Command;
+	return Handle;
+}
+
+void FNeuralCommandRegistry::Unregister(const FNeuralCommandHandle& Handle)
+{
+	FScopeLock ScopeLock(&Lock);
+	Entries.Remove(Handle.Id);
+}
+
+void FNeuralCommandRegistry::SetCanceller(const FNeuralCommandHandle& Handle, TFunction<void()>&& Canceller)
+{
+	FScopeLock ScopeLock(&Lock);
+	if (FEntry* Entry = Entries.Find(Handle.Id)) {
+		Entry->Canceller = MoveTemp(Canceller);
+	}
+}
+
+void FNeuralCommandRegistry::CancelEntry(FEntry& Entry)
+{
+	if (Entry.bCancelled) {
+		return;
+	}
+	UE_LOG(NeuralInteractionClient, Log, TEXT("Cancelling \"%s\"."), *Entry.Command);
+	Entry.bCancelled = true;
+	// Without a canceller, the connection checks IsCancelled before its next attempt
+	if (Entry.Canceller) {
+		Entry.Canceller();
+	}
+}
+
+bool FNeuralCommandRegistry::Cancel(const FNeuralCommandHandle& Handle)
+{
+	FScopeLock ScopeLock(&Lock);
+	FEntry* Entry = Entries.Find(Handle.Id);
+	if (!Entry) {
+		return false;
+	}
+	CancelEntry(*Entry);
+	return true;
+}
+
+int32 FNeuralCommandRegistry::CancelCommand(const FString& Command)
+{
+	FScopeLock ScopeLock(&Lock);
+	int32 Cancelled = 0;
+	for (TPair<int32, FEntry>& Pair : Entries) {
+		if (Pair.Value.Command == Command) {
+			CancelEntry(Pair.Value);
+			Cancelled++;
+		}
+	}
+	return Cancelled;
+}
+
+int32 FNeuralCommandRegistry::CancelAll()
+{
+	FScopeLock ScopeLock(&Lock);
+	for (TPair<int32, FEntry>& Pair : Entries) {
+		CancelEntry(Pair.Value);
+	}
+	return Entries.Num();
+}
+
+bool FNeuralCommandRegistry::IsCancelled(const FNeuralCommandHandle& Handle) const
+{
+	FScopeLock ScopeLock(&Lock);
+	const FEntry* Entry = Entries.Find(Handle.Id);
+	return Entry && Entry->bCancelled;
+}
+
+TArray<FNeuralCommandHandle> FNeuralCommandRegistry::GetRunningCommands() const
+{
+	FScopeLock ScopeLock(&Lock);
+	TArray<FNeuralCommandHandle> Result;
+	for (const TPair<int32, FEntry>& Pair : Entries) {
+		FNeuralCommandHandle& Handle = Result.AddDefaulted_GetRef();
+		Handle.Id = Pair.Key;
+		Handle.Command = Pair.Value.Command;
+	}
+	return Result;
+}
+
+TArray<FNeuralCommandHandle> FNeuralCommandRegistry::Find(const FString& Command) const
+{
+	TArray<FNeuralCommandHandle> Result = GetRunningCommands();
+	Result.RemoveAll([&Command](const FNeuralCommandHandle& Handle) {
+		return Handle.Command != Command;
+	});
+	return Result;
+}
+
+int32 UNeuralCommandRegistryBPLibrary::CancelCommand(const FString& Command)
+{
+	return FNeuralCommandRegistry::Get().CancelCommand(Command);
+}
+
+bool UNeuralCommandRegistryBPLibrary::CancelCommandByHandle(const FNeuralCommandHandle& Handle)
+{
+	return FNeuralCommandRegistry::Get().Cancel(Handle);
+}
+
+int32 UNeuralCommandRegistryBPLibrary::CancelAllCommands()
+{
+	return FNeuralCommandRegistry::Get().CancelAll();
+}
+
+TArray<FNeuralCommandHandle> UNeuralCommandRegistryBPLibrary::GetRunningCommands()
+{
+	return FNeuralCommandRegistry::Get().GetRunningCommands();
+}
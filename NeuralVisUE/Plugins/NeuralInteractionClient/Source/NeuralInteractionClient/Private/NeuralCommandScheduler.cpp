@@ -0,0 +1,190 @@
+/*
+This file NeuralCommandScheduler.cpp is part of NeuralVisUAL.
+
+NeuralVisUAL is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+NeuralVisUAL is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with NeuralVisUAL.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "NeuralCommandScheduler.h"
+#include "NeuralConnection.h"
+#include "NeuralEndpointRouter.h"
+#include "NeuralInteractionClientLog.h"
+#include "NeuralLinkTelemetry.h"
+#include "Async/Async.h"
+#include "Misc/QueuedThreadPool.h"
+#include "Misc/ScopeLock.h"
+
+namespace
+{
+	// Runs a scheduled command on one of the workers of FNeuralCommandScheduler
+	class FScheduledCommandWork : public IQueuedWork
+	{
+	public:
+		explicit FScheduledCommandWork(TFunction<void()>&& InWork)
+			: Work(MoveTemp(InWork))
+		{
+		}
+
+		virtual void DoThreadedWork() override
+		{
+			Work();
+			delete this;
+		}
+
+		// Only happens when the pool is destroyed
+		virtual void Abandon() override
+		{
+			delete this;
+		}
+
+	private:
+		TFunction<void()> Work;
+	};
+}
+
+FNeuralCommandScheduler& FNeuralCommandScheduler::Get()
+{
+	static FNeuralCommandScheduler Instance;
+	return Instance;
+}
+
+FNeuralCommandHandle FNeuralCommandScheduler::Schedule(const FString& Command, FOnFinished&& OnFinished)
+{
+	return Schedule(Command, FNeuralResponseCallbacks(), MoveTemp(OnFinished));
+}
+
+FNeuralCommandHandle FNeuralCommandScheduler::Schedule(const FString& Command, const FNeuralResponseCallbacks& Callbacks,
+	FOnFinished&& OnFinished)
+{
+	// Classified without the server name, which only selects the server
+	const ENeuralCommandPriority Priority =
+		GetDefault<UNeuralInteractionClientSettings>()->GetCommandPriority(FNeuralEndpointRouter::RemoveEndpointName(Command));
+	return Schedule(Command, Priority, Callbacks, MoveTemp(OnFinished));
+}
+
+FNeuralCommandHandle FNeuralCommandScheduler::Schedule(const FString& Command, ENeuralCommandPriority Priority,
+	FOnFinished&& OnFinished)
+{
+	return Schedule(Command, Priority, FNeuralResponseCallbacks(), MoveTemp(OnFinished));
+}
+
+FNeuralCommandHandle FNeuralCommandScheduler::Schedule(const FString& Command, ENeuralCommandPriority Priority,
+	const FNeuralResponseCallbacks& Callbacks, FOnFinished&& OnFinished)
+{
+	FQueuedCommand Queued;
+	Queued.Handle = FNeuralCommandRegistry::Get().Register(Command);
+	Queued.Callbacks = Callbacks;
+	Queued.OnFinished = MoveTemp(OnFinished);
+	const FNeuralCommandHandle Handle = Queued.Handle;
+
+	FScopeLock ScopeLock(&Lock);
+	Lanes[(int32)Priority].Queue.Add(MoveTemp(Queued));
+	StartQueued(Priority);
+	return Handle;
+}
+
+int32 FNeuralCommandScheduler::GetCapacity(ENeuralCommandPriority Priority)
+{
+	const UNeuralInteractionClientSettings* Settings = GetDefault<UNeuralInteractionClientSettings>();
+	switch (Priority) {
+	case ENeuralCommandPriority::Interactive:
+		return FMath::Max(Settings->MaxConcurrentInteractiveCommands, 1);
+	case ENeuralCommandPriority::Normal:
+		return FMath::Max(Settings->MaxConcurrentNormalCommands, 1);
+	case ENeuralCommandPriority::Bulk:
+		// Fewer bulk transfers while the link is congested, so that interactive commands get through
+		return FNeuralLinkTelemetry::Get().GetBulkWindow(FMath::Max(Settings->MaxConcurrentBulkCommands, 1));
+	default:
+		return 1;
+	}
+}
+
+void FNeuralCommandScheduler::StartQueued(ENeuralCommandPriority Priority)
+{
+	FLane& Lane = Lanes[(int32)Priority];
+	const int32 Capacity = GetCapacity(Priority);
+	while (Lane.Running < Capacity && Lane.Queue.Num() > 0) {
+		// First in, first out
+		FQueuedCommand Queued = MoveTemp(Lane.Queue[0]);
+		Lane.Queue.RemoveAt(0, 1, false);
+		Lane.Running++;
+		Execute(Priority, MoveTemp(Queued));
+	}
+	FNeuralLinkTelemetry::Get().SetQueueDepth(Priority, Lane.Queue.Num(), Lane.Running);
+}
+
+void FNeuralCommandScheduler::Execute(ENeuralCommandPriority Priority, FQueuedCommand&& Queued)
+{
+	// Not the global thread pool, as the command blocks on its connection for as long as the response takes
+	if (!Workers) {
+		const UNeuralInteractionClientSettings* Settings = GetDefault<UNeuralInteractionClientSettings>();
+		const uint32 NumberOfWorkers = FMath::Max(Settings->MaxConcurrentInteractiveCommands, 1) +
+			FMath::Max(Settings->MaxConcurrentNormalCommands, 1) + FMath::Max(Settings->MaxConcurrentBulkCommands, 1);
+		Workers = FQueuedThreadPool::Allocate();
+		verify(Workers->Create(NumberOfWorkers, 128 * 1024, TPri_Normal, TEXT("NeuralCommandScheduler")));
+	}
+	Workers->AddQueuedWork(new FScheduledCommandWork([this, Priority, Command = MoveTemp(Queued)]() mutable
+	{
+		bool bClosedGracefully = false;
+		FNeuralCommandRegistry& Registry = FNeuralCommandRegistry::Get();
+		if (Registry.IsCancelled(Command.Handle)) {
+			// Cancelled while queued, it never reaches the server
+			Registry.Unregister(Command.Handle);
+		} else {
+			bClosedGracefully = ExecuteNeuralCommand(Command.Handle, Priority, Command.Callbacks);
+		}
+
+		if (Command.OnFinished) {
+			AsyncTask(ENamedThreads::GameThread, [OnFinished = MoveTemp(Command.OnFinished), bClosedGracefully]()
+			{
+				OnFinished(!bClosedGracefully);
+			});
+		}
+
+		FScopeLock ScopeLock(&Lock);
+		Lanes[(int32)Priority].Running--;
+		StartQueued(Priority);
+	}));
+}
+
+int32 FNeuralCommandScheduler::GetNumberOfQueued(ENeuralCommandPriority Priority) const
+{
+	FScopeLock ScopeLock(&Lock);
+	return Lanes[(int32)Priority].Queue.Num();
+}
+
+int32 FNeuralCommandScheduler::GetNumberOfRunning(ENeuralCommandPriority Priority) const
+{
+	FScopeLock ScopeLock(&Lock);
+	return Lanes[(int32)Priority].Running;
+}
+
+FNeuralCommandHandle UNeuralCommandSchedulerBPLibrary::ScheduleCommand(const FString& Command,
+	ENeuralCommandPriority Priority, const FFoundAtomString& OnString, const FEndOfConnection& OnFinished)
+{
+	return FNeuralCommandScheduler::Get().Schedule(Command, Priority, FNeuralResponseCallbacks::FromDelegateOnGameThread(OnString),
+		[Command, OnFinished](bool bForciblyClosed)
+	{
+		OnFinished.ExecuteIfBound(Command, bForciblyClosed);
+	});
+}
+
+ENeuralCommandPriority UNeuralCommandSchedulerBPLibrary::GetCommandPriority(const FString& Command)
+{
+	return GetDefault<UNeuralInteractionClientSettings>()->GetCommandPriority(FNeuralEndpointRouter::RemoveEndpointName(Command));
+}
+
+int32 UNeuralCommandSchedulerBPLibrary::GetNumberOfQueuedCommands(ENeuralCommandPriority Priority)
+{
+	return FNeuralCommandScheduler::Get().GetNumberOfQueued(Priority);
+}
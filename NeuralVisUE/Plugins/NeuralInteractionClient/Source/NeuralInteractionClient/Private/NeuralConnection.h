@@ -0,0 +1,29 @@
+/*
+This file NeuralConnection.h is part of NeuralVisUAL.
+
+NeuralVisUAL is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+NeuralVisUAL is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with NeuralVisUAL.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "NeuralCommandRegistry.h"
+#include "NeuralInteractionClientSettings.h"
+#include "NeuralResponseCallbacks.h"
+
+// Executes the command of the registered Handle on the calling thread, blocking until the server closed
+// the connection. Responses reach the Callbacks and the native listeners of FNeuralInteractionEvents.
+// Returns false if the connection was closed forcibly or the command has been cancelled
+bool ExecuteNeuralCommand(const FNeuralCommandHandle& Handle, ENeuralCommandPriority Priority,
+	const FNeuralResponseCallbacks& Callbacks);
@@ -0,0 +1,281 @@
+/*
+This file NeuralConsole.cpp is part of NeuralVisUAL.
+
+NeuralVisUAL is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+NeuralVisUAL is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with NeuralVisUAL.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "NeuralConsole.h"
+#include "NeuralInteractionClientSettings.h"
+#include "Misc/ScopeLock.h"
+
+namespace
+{
+	FLinearColor GetBasicColor(int32 Index, bool bBright)
+	{
+		static const FColor Normal[8] = {
+			FColor(0, 0, 0), FColor(205, 49, 49), FColor(13, 188, 121), FColor(229, 229, 16),
+			FColor(36, 114, 200), FColor(188, 63, 188), FColor(17, 168, 205), FColor(229, 229, 229),
+		};
+		static const FColor Bright[8] = {
+			FColor(102, 102, 102), FColor(241, 76, 76), FColor(35, 209, 139), FColor(245, 245, 67),
+			FColor(59, 142, 234), FColor(214, 112, 214), FColor(41, 184, 219), FColor(255, 255, 255),
+		};
+		return FLinearColor(bBright ? Bright[Index] : Normal[Index]);
+	}
+
+	// 256 color palette of "38;5;n", as used by special() and grayscale() in beautifulDebug.py
+	FLinearColor GetPaletteColor(int32 Code)
+	{
+		if (Code < 16) {
+			return GetBasicColor(Code % 8, Code >= 8);
+		}
+		if (Code < 232) {
+			Code -= 16;
+			auto Level = [](int32 Value) { return (uint8)(Value == 0 ? 0 : 55 + Value * 40); };
+			return FLinearColor(FColor(Level(Code / 36), Level(Code / 6 % 6), Level(Code % 6)));
+		}
+		const uint8 Gray = (uint8)(8 + (Code - 232) * 10);
+		return FLinearColor(FColor(Gray, Gray, Gray));
+	}
+
+	// Applies the parameters of a "select graphic rendition" sequence, only the foreground matters
+	void ApplyGraphicRendition(TArrayView<const int32> Parameters, FLinearColor& Color)
+	{
+		if (Parameters.Num() == 0) {
+			Color = FLinearColor::White;
+			return;
+		}
+		for (int32 Index = 0; Index < Parameters.Num(); Index++) {
+			const int32 Code = Parameters[Index];
+			const bool bExtended = (Code == 38 || Code == 48) && Index + 1 < Parameters.Num();
+			if (Code == 0 || Code == 39) {
+				Color = FLinearColor::White;
+			} else if (Code >= 30 && Code <= 37) {
+				Color = GetBasicColor(Code - 30, false);
+			} else if (Code >= 90 && Code <= 97) {
+				Color = GetBasicColor(Code - 90, true);
+			} else if (bExtended && Parameters[Index + 1] == 5 && Index + 2 < Parameters.Num()) {
+				if (Code == 38) {
+					Color = GetPaletteColor(FMath::Clamp(Parameters[Index + 2], 0, 255));
+				}
+				Index += 2;
+			} else if (bExtended && Parameters[Index + 1] == 2 && Index + 4 < Parameters.Num()) {
+				if (Code == 38) {
+					Color = FLinearColor(FColor((uint8)Parameters[Index + 2], (uint8)Parameters[Index + 3], (uint8)Parameters[Index + 4]));
+				}
+				Index += 4;
+			}
+		}
+	}
+
+	// Splits Text into lines without escape sequences and calls OnLine(Line, Color) for each of them.
+	// The color of a line is the one of its first visible character
+	template <typename FunctorType>
+	void ParseAnsi(const FString& Text, FunctorType&& OnLine)
+	{
+		const TCHAR* Chars = *Text;
+		const int32 Length = Text.Len();
+		FLinearColor Color = FLinearColor::White;
+		FLinearColor LineColor = Color;
+		bool bLineHasText = false;
+		FString Line;
+		Line.Reserve(Length);
+		for (int32 Index = 0; Index < Length; Index++) {
+			const TCHAR Char = Chars[Index];
+			if (Char == TEXT('\x1b') && Index + 1 < Length && Chars[Index + 1] == TEXT('[')) {
+				int32 End = Index + 2;
+				// USE_ALTERNATIVE_ANSI_CODE_WORKAROUND of the server: " \033[\b...m"
+				if (End < Length && Chars[End] == TEXT('\b')) {
+					End++;
+					if (Line.Len() > 0 && Line[Line.Len() - 1] == TEXT(' ')) {
+						Line.LeftChopInline(1, false);
+					}
+				}
+				TArray<int32, TInlineAllocator<8>> Parameters;
+				int32 Value = 0;
+				bool bHasValue = false;
+				for (; End < Length && (FChar::IsDigit(Chars[End]) || Chars[End] == TEXT(';')); End++) {
+					if (Chars[End] == TEXT(';')) {
+						Parameters.Add(Value);
+						Value = 0;
+						bHasValue = false;
+					} else {
+						Value = FMath::Min(Value * 10 + (Chars[End] - TEXT('0')), 9999);
+						bHasValue = true;
+					}
+				}
+				if (bHasValue || Parameters.Num() > 0) {
+					Parameters.Add(Value);
+				}
+				if (End < Length && Chars[End] == TEXT('m')) {
+					ApplyGraphicRendition(Parameters, Color);
+				}
+				// Other sequences are dropped, as are incomplete ones at the end
+				Index = End;
+				continue;
+			}
+			if (Char == TEXT('\n')) {
+				OnLine(Line, bLineHasText ? LineColor : Color);
+				Line.Reset();
+				bLineHasText = false;
+				continue;
+			}
+			if (Char == TEXT('\r')) {
+				continue;
+			}
+			if (!bLineHasText && !FChar::IsWhitespace(Char)) {
+				LineColor = Color;
+				bLineHasText = true;
+			}
+			Line.AppendChar(Char);
+		}
+		OnLine(Line, bLineHasText ? LineColor : Color);
+	}
+}
+
+FNeuralConsole& FNeuralConsole::Get()
+{
+	static FNeuralConsole Instance;
+	return Instance;
+}
+
+FString FNeuralConsole::StripAnsi(const FString& Text, FLinearColor* OutColor)
+{
+	FString Result;
+	bool bFirst = true;
+	ParseAnsi(Text, [&](const FString& Line, const FLinearColor& Color) {
+		if (bFirst && OutColor) {
+			*OutColor = Color;
+		}
+		if (!bFirst) {
+			Result += TEXT("\n");
+		}
+		Result += Line;
+		bFirst = false;
+	});
+	return Result;
+}
+
+void FNeuralConsole::AddMessage(ENeuralConsoleLineKind Kind, int32 Level, const FString& Command, const char* Utf8Text, int32 Size)
+{
+	FUTF8ToTCHAR Converted(Utf8Text, Size);
+	AddMessage(Kind, Level, Command, FString(Converted.Length(), Converted.Get()));
+}
+
+void FNeuralConsole::AddMessage(ENeuralConsoleLineKind Kind, int32 Level, const FString& Command, const FString& Text)
+{
+	if (GetDefault<UNeuralInteractionClientSettings>()->ConsoleCapacity <= 0) {
+		return;
+	}
+	ParseAnsi(Text, [&](const FString& LineText, const FLinearColor& Color) {
+		TSharedRef<FNeuralConsoleLine, ESPMode::ThreadSafe> Line = MakeShared<FNeuralConsoleLine, ESPMode::ThreadSafe>();
+		Line->Kind = Kind;
+		Line->Level = Level;
+		Line->Text = LineText;
+		Line->Color = Color;
+		Line->Command = Command;
+		AddLine(MoveTemp(Line));
+	});
+}
+
+void FNeuralConsole::AddLine(TSharedRef<FNeuralConsoleLine, ESPMode::ThreadSafe>&& Line)
+{
+	const int32 Capacity = GetDefault<UNeuralInteractionClientSettings>()->ConsoleCapacity;
+	if (Capacity <= 0) {
+		return;
+	}
+	FScopeLock ScopeLock(&Lock);
+	Line->Sequence = ++LastSequence;
+	if (Lines.Num() < Capacity && Head == 0) {
+		Lines.Add(MoveTemp(Line));
+		return;
+	}
+	// The capacity changed, rotate the oldest line to the front first
+	if (Lines.Num() != Capacity) {
+		TArray<FNeuralConsoleLinePtr> Ordered;
+		Ordered.Reserve(Capacity);
+		for (int32 Index = FMath::Max(Lines.Num() - Capacity + 1, 0); Index < Lines.Num(); Index++) {
+			Ordered.Add(Lines[(Head + Index) % Lines.Num()]);
+		}
+		Lines = MoveTemp(Ordered);
+		Head = 0;
+		Lines.Add(MoveTemp(Line));
+		return;
+	}
+	Lines[Head] = MoveTemp(Line);
+	Head = (Head + 1) % Lines.Num();
+}
+
+uint64 FNeuralConsole::GetLinesSince(uint64 Sequence, TArray<FNeuralConsoleLinePtr>& OutLines) const
+{
+	FScopeLock ScopeLock(&Lock);
+	const uint64 FirstSequence = LastSequence - Lines.Num() + 1;
+	const int32 Skip = Sequence >= FirstSequence ? (int32)FMath::Min<uint64>(Sequence - FirstSequence + 1, Lines.Num()) : 0;
+	OutLines.Reserve(OutLines.Num() + FMath::Max(Lines.Num() - Skip, 0));
+	for (int32 Index = Skip; Index < Lines.Num(); Index++) {
+		OutLines.Add(Lines[(Head + Index) % Lines.Num()]);
+	}
+	return LastSequence;
+}
+
+uint64 FNeuralConsole::GetFirstSequence() const
+{
+	FScopeLock ScopeLock(&Lock);
+	return LastSequence - Lines.Num() + 1;
+}
+
+uint64 FNeuralConsole::GetLastSequence() const
+{
+	FScopeLock ScopeLock(&Lock);
+	return LastSequence;
+}
+
+void FNeuralConsole::Clear()
+{
+	FScopeLock ScopeLock(&Lock);
+	Lines.Empty();
+	Head = 0;
+}
+
+FString FNeuralConsole::GetText() const
+{
+	TArray<FNeuralConsoleLinePtr> Copy;
+	GetLinesSince(0, Copy);
+	FString Text;
+	for (const FNeuralConsoleLinePtr& Line : Copy) {
+		Text += Line->Text;
+		Text += TEXT("\n");
+	}
+	return Text;
+}
+
+void UNeuralConsoleBPLibrary::AddConsoleLine(const FString& Text)
+{
+	FNeuralConsole::Get().AddMessage(ENeuralConsoleLineKind::Local, 0, FString(), Text);
+}
+
+void UNeuralConsoleBPLibrary::ClearConsole()
+{
+	FNeuralConsole::Get().Clear();
+}
+
+FString UNeuralConsoleBPLibrary::GetConsoleText()
+{
+	return FNeuralConsole::Get().GetText();
+}
+
+FString UNeuralConsoleBPLibrary::StripAnsiEscapeSequences(const FString& Text)
+{
+	return FNeuralConsole::StripAnsi(Text);
+}
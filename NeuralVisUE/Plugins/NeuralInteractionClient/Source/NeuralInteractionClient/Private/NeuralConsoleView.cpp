@@ -0,0 +1,72 @@
+/*
+This file NeuralConsoleView.cpp is part of NeuralVisUAL.
+
+NeuralVisUAL is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+NeuralVisUAL is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with NeuralVisUAL.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "NeuralConsoleView.h"
+#include "SNeuralConsoleView.h"
+
+void UNeuralConsoleView::SetFontSize(int32 InFontSize)
+{
+	FontSize = FMath::Max(InFontSize, 1);
+	if (ConsoleView.IsValid()) {
+		ConsoleView->SetFontSize(FontSize);
+	}
+}
+
+void UNeuralConsoleView::SetAutoScroll(bool bInAutoScroll)
+{
+	bAutoScroll = bInAutoScroll;
+	if (ConsoleView.IsValid()) {
+		ConsoleView->SetAutoScroll(bAutoScroll);
+	}
+}
+
+void UNeuralConsoleView::ScrollToEnd()
+{
+	if (ConsoleView.IsValid()) {
+		ConsoleView->ScrollToEnd();
+	}
+}
+
+void UNeuralConsoleView::SynchronizeProperties()
+{
+	Super::SynchronizeProperties();
+	if (ConsoleView.IsValid()) {
+		ConsoleView->SetFontSize(FontSize);
+		ConsoleView->SetAutoScroll(bAutoScroll);
+	}
+}
+
+void UNeuralConsoleView::ReleaseSlateResources(bool bReleaseChildren)
+{
+	Super::ReleaseSlateResources(bReleaseChildren);
+	ConsoleView.Reset();
+}
+
+#if WITH_EDITOR
+const FText UNeuralConsoleView::GetPaletteCategory()
+{
+	return NSLOCTEXT("NeuralInteractionClient", "PaletteCategory", "NeuralVisUAL");
+}
+#endif
+
+TSharedRef<SWidget> UNeuralConsoleView::RebuildWidget()
+{
+	ConsoleView = SNew(SNeuralConsoleView)
+		.FontSize(FontSize)
+		.AutoScroll(bAutoScroll);
+	return ConsoleView.ToSharedRef();
+}
@@ -0,0 +1,251 @@
+/*
+This file NeuralEndpointRouter.cpp is part of NeuralVisUAL.
+
+NeuralVisUAL is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+NeuralVisUAL is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with NeuralVisUAL.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "NeuralEndpointRouter.h"
+#include "NeuralInteractionClientLog.h"
+#include "Misc/ScopeLock.h"
+
+FNeuralEndpointRouter& FNeuralEndpointRouter::Get()
+{
+	static FNeuralEndpointRouter Instance;
+	return Instance;
+}
+
+FString FNeuralEndpointRouter::GetKey(const FNeuralServerEndpoint& Endpoint)
+{
+	return FString::Printf(TEXT("%s:%d"), *Endpoint.Host.ToLower(), Endpoint.Port);
+}
+
+bool FNeuralEndpointRouter::SplitEndpointName(const FString& Command, FString& OutName, FString& OutCommand)
+{
+	const FString Trimmed = Command.TrimStart();
+	if (!Trimmed.StartsWith(TEXT("@"))) {
+		return false;
+	}
+	if (!Trimmed.Split(TEXT(" "), &OutName, &OutCommand)) {
+		OutName = Trimmed;
+		OutCommand.Empty();
+	}
+	OutName.RightChopInline(1);
+	OutCommand.TrimStartInline();
+	return true;
+}
+
+FString FNeuralEndpointRouter::RemoveEndpointName(const FString& Command)
+{
+	FString Name, Rest;
+	return SplitEndpointName(Command, Name, Rest) ? Rest : Command;
+}
+
+const TArray<FNeuralServerEndpoint>& FNeuralEndpointRouter::GetEndpointsLocked() const
+{
+	return Overrides.IsSet() ? Overrides.GetValue() : GetDefault<UNeuralInteractionClientSettings>()->Endpoints;
+}
+
+FNeuralRoute FNeuralEndpointRouter::Select(const FString& Command, FString& OutStickyKey) const
+{
+	const TArray<FNeuralServerEndpoint>& Endpoints = GetEndpointsLocked();
+	FNeuralRoute Route;
+	Route.Command = Command;
+
+	FString Name, Rest;
+	if (SplitEndpointName(Command, Name, Rest)) {
+		Route.Command = Rest;
+		const FNeuralServerEndpoint* Named = Endpoints.FindByPredicate([&](const FNeuralServerEndpoint& Endpoint) {
+			return Endpoint.Name.Equals(Name, ESearchCase::IgnoreCase);
+		});
+		if (Named) {
+			Route.Endpoint = *Named;
+			return Route;
+		}
+		UE_LOG(NeuralInteractionClient, Warning, TEXT("There is no server endpoint named %s, routing \"%s\" by its command."),
+			*Name, *Rest);
+	}
+	if (Endpoints.Num() == 0) {
+		return Route;
+	}
+
+	FString FirstPart;
+	if (!Route.Command.Split(TEXT("&"), &FirstPart, nullptr)) {
+		FirstPart = Route.Command;
+	}
+	const FString Normalized = UNeuralInteractionClientSettings::NormalizeCommand(FirstPart);
+	int32 BestLength = -1;
+	TArray<const FNeuralServerEndpoint*, TInlineAllocator<4>> Candidates;
+	for (const FNeuralServerEndpoint& Endpoint : Endpoints) {
+		int32 Length = Endpoint.Commands.Num() == 0 ? 0 : -1;
+		for (const FString& Prefix : Endpoint.Commands) {
+			const FString NormalizedPrefix = UNeuralInteractionClientSettings::NormalizeCommand(Prefix);
+			if (Normalized.StartsWith(NormalizedPrefix)) {
+				Length = FMath::Max(Length, NormalizedPrefix.Len());
+			}
+		}
+		if (Length > BestLength) {
+			BestLength = Length;
+			Candidates.Reset();
+		}
+		if (Length == BestLength && Length >= 0) {
+			Candidates.Add(&Endpoint);
+		}
+	}
+	if (Candidates.Num() == 0) {
+		Candidates.Add(&Endpoints[0]);
+	}
+
+	if (Candidates.Num() == 1) {
+		Route.Endpoint = *Candidates[0];
+		return Route;
+	}
+
+	const bool bStateless = GetDefault<UNeuralInteractionClientSettings>()->IsStatelessCommand(Route.Command);
+	FString CandidatesKey;
+	for (const FNeuralServerEndpoint* Candidate : Candidates) {
+		CandidatesKey += GetKey(*Candidate) + TEXT(" ");
+	}
+	if (!bStateless) {
+		if (const FString* Sticky = StickyEndpoints.Find(CandidatesKey)) {
+			for (const FNeuralServerEndpoint* Candidate : Candidates) {
+				if (GetKey(*Candidate) == *Sticky) {
+					Route.Endpoint = *Candidate;
+					return Route;
+				}
+			}
+		}
+	}
+
+	const FNeuralServerEndpoint* Least = Candidates[0];
+	int32 LeastRunning = MAX_int32;
+	for (const FNeuralServerEndpoint* Candidate : Candidates) {
+		const int32* Count = Running.Find(GetKey(*Candidate));
+		const int32 NumRunning = Count ? *Count : 0;
+		if (NumRunning < LeastRunning) {
+			Least = Candidate;
+			LeastRunning = NumRunning;
+		}
+	}
+	Route.Endpoint = *Least;
+	if (!bStateless) {
+		OutStickyKey = CandidatesKey;
+	}
+	return Route;
+}
+
+FNeuralRoute FNeuralEndpointRouter::Acquire(const FString& Command)
+{
+	FScopeLock ScopeLock(&Lock);
+	FString StickyKey;
+	FNeuralRoute Route = Select(Command, StickyKey);
+	if (!StickyKey.IsEmpty()) {
+		StickyEndpoints.Add(StickyKey, GetKey(Route.Endpoint));
+	}
+	Running.FindOrAdd(GetKey(Route.Endpoint))++;
+	return Route;
+}
+
+void FNeuralEndpointRouter::Release(const FNeuralRoute& Route)
+{
+	FScopeLock ScopeLock(&Lock);
+	const FString Key = GetKey(Route.Endpoint);
+	int32* Count = Running.Find(Key);
+	if (Count && --(*Count) <= 0) {
+		Running.Remove(Key);
+	}
+}
+
+FNeuralRoute FNeuralEndpointRouter::Route(const FString& Command) const
+{
+	FScopeLock ScopeLock(&Lock);
+	FString StickyKey;
+	return Select(Command, StickyKey);
+}
+
+TArray<FNeuralServerEndpoint> FNeuralEndpointRouter::GetEndpoints() const
+{
+	FScopeLock ScopeLock(&Lock);
+	return GetEndpointsLocked();
+}
+
+void FNeuralEndpointRouter::SetEndpoints(const TArray<FNeuralServerEndpoint>& InEndpoints)
+{
+	FScopeLock ScopeLock(&Lock);
+	Overrides = InEndpoints;
+}
+
+void FNeuralEndpointRouter::AddEndpoint(const FNeuralServerEndpoint& Endpoint)
+{
+	FScopeLock ScopeLock(&Lock);
+	TArray<FNeuralServerEndpoint> Endpoints = GetEndpointsLocked();
+	FNeuralServerEndpoint* Existing = Endpoints.FindByPredicate([&](const FNeuralServerEndpoint& Other) {
+		return Other.Name.Equals(Endpoint.Name, ESearchCase::IgnoreCase);
+	});
+	if (Existing) {
+		*Existing = Endpoint;
+	} else {
+		Endpoints.Add(Endpoint);
+	}
+	Overrides = MoveTemp(Endpoints);
+}
+
+bool FNeuralEndpointRouter::RemoveEndpoint(const FString& Name)
+{
+	FScopeLock ScopeLock(&Lock);
+	TArray<FNeuralServerEndpoint> Endpoints = GetEndpointsLocked();
+	const int32 NumRemoved = Endpoints.RemoveAll([&](const FNeuralServerEndpoint& Endpoint) {
+		return Endpoint.Name.Equals(Name, ESearchCase::IgnoreCase);
+	});
+	if (NumRemoved == 0) {
+		return false;
+	}
+	Overrides = MoveTemp(Endpoints);
+	return true;
+}
+
+void FNeuralEndpointRouter::ResetEndpoints()
+{
+	FScopeLock ScopeLock(&Lock);
+	Overrides.Reset();
+}
+
+TArray<FNeuralServerEndpoint> UNeuralEndpointRouterBPLibrary::GetServerEndpoints()
+{
+	return FNeuralEndpointRouter::Get().GetEndpoints();
+}
+
+void UNeuralEndpointRouterBPLibrary::SetServerEndpoints(const TArray<FNeuralServerEndpoint>& Endpoints)
+{
+	FNeuralEndpointRouter::Get().SetEndpoints(Endpoints);
+}
+
+void UNeuralEndpointRouterBPLibrary::AddServerEndpoint(const FNeuralServerEndpoint& Endpoint)
+{
+	FNeuralEndpointRouter::Get().AddEndpoint(Endpoint);
+}
+
+bool UNeuralEndpointRouterBPLibrary::RemoveServerEndpoint(const FString& Name)
+{
+	return FNeuralEndpointRouter::Get().RemoveEndpoint(Name);
+}
+
+void UNeuralEndpointRouterBPLibrary::ResetServerEndpoints()
+{
+	FNeuralEndpointRouter::Get().ResetEndpoints();
+}
+
+FNeuralServerEndpoint UNeuralEndpointRouterBPLibrary::GetServerEndpointForCommand(const FString& Command)
+{
+	return FNeuralEndpointRouter::Get().Route(Command).Endpoint;
+}
@@ -19,16 +19,41 @@ along with NeuralVisUAL.  If not, see <https://www.gnu.org/licenses/>.
 // https://www.boost.org/doc/libs/1_75_0/libs/beast/example/websocket/client/async/websocket_client_async.cpp
 
 #include "INeuralInteractionClient.h"
+#include "NeuralCommandRegistry.h"
+#include "NeuralConnection.h"
+#include "NeuralConsole.h"
+#include "NeuralEndpointRouter.h"
+#include "NeuralInteractionClientLog.h"
+#include "NeuralInteractionClientSettings.h"
+#include "NeuralInteractionEvents.h"
+#include "NeuralLayerGraphBuilder.h"
+#include "NeuralLayoutCache.h"
+#include "NeuralLinkTelemetry.h"
+#include "NeuralMessageCompression.h"
+#include "NeuralMessageFilter.h"
+#include "NeuralModelContext.h"
+#include "NeuralPackedParser.h"
+#include "NeuralPackedReader.h"
+#include "NeuralResponseCache.h"
+#include "NeuralResponseCallbacks.h"
+#include "NeuralSharedMemory.h"
+#include "NeuralTextureCache.h"
 #include "CoreMinimal.h"
+#include "CoreGlobals.h"
+#include "HAL/PlatformProcess.h"
 #include "Modules/ModuleManager.h"
 
+#include <cstdio>
+
 //#define LOCTEXT_NAMESPACE "FNeuralInteractionClient"
 THIRD_PARTY_INCLUDES_START
 #pragma push_macro("check")
 #undef check
 #include <boost/beast/core.hpp>
 #include <boost/beast/websocket.hpp>
+#include <boost/asio/steady_timer.hpp>
 #include <boost/asio/strand.hpp>
+#include <boost/asio/local/stream_protocol.hpp>
 #include <boost/thread/thread.hpp>
 #include <msgpack.hpp>
 #pragma pop_macro("check")
@@ -40,7 +65,6 @@ namespace websocket = beast::websocket; // from <boost/beast/websocket.hpp>
 namespace net = boost::asio;            // from <boost/asio.hpp>
 using tcp = boost::asio::ip::tcp;       // from <boost/asio/ip/tcp.hpp>
 
-DECLARE_LOG_CATEGORY_EXTERN(NeuralInteractionClient, Log, All);
 DEFINE_LOG_CATEGORY(NeuralInteractionClient);
 
 // Report a failure
@@ -73,38 +97,297 @@ print(std::string what)
 	//UE_LOG(LogTemp, Log, TEXT(tmp));
 }
 
+int connect_to_websocket_server(char* text, char* host, char* port, bool interactive);
+
+// Text the server expects while it executes a command to cancel it, see runCancellable in websocketServer.py
+const char* const cancelFrame = "#CANCEL#";
+// Seconds the server has to close the connection after the cancel frame
+const int cancelTimeoutSeconds = 2;
+// Handshake header with the lane of the command, see ENeuralCommandPriority
+const char* const priorityHeader = "X-NeuralVisUAL-Priority";
+// Handshake header with the fragment size the client suggests for bulk responses
+const char* const fragmentSizeHeader = "X-NeuralVisUAL-Fragment-Size";
+// First line of the frame with the handshake headers, which local socket clients send before the command
+const char* const headerFrame = "#HEADERS#";
+// Handshake header with the id of this client process. The server only references files this id has
+// received before, see sendfile in serverCommands.py
+const char* const clientIdHeader = "X-NeuralVisUAL-Client";
+
+const std::string& get_client_id()
+{
+	static const std::string clientId = TCHAR_TO_UTF8(*FGuid::NewGuid().ToString(EGuidFormats::Digits));
+	return clientId;
+}
+
+// Types of messages with native handling, see session::message_handler.
+// The type is the first string of a message, its tag
+enum class message_tag : uint8 {
+	other,
+	status,
+	debug,
+	model_epoch,
+	file,
+	file_ref,
+	tensor,
+	tensor_frame,
+	tf_structure,
+	tf_layout,
+	spawn_image,
+	spawn_cuboid,
+	spawn_cuboid_batch,
+	spawn_connections,
+	scene_redraw,
+};
+
+const struct {
+	const char* name;
+	message_tag tag;
+} messageTags[] = {
+	{ "STATUS", message_tag::status },
+	{ "DEBUG", message_tag::debug },
+	{ "MODEL EPOCH", message_tag::model_epoch },
+	{ "FILE", message_tag::file },
+	{ "FILE REF", message_tag::file_ref },
+	{ "TENSOR", message_tag::tensor },
+	{ "TENSOR FRAME", message_tag::tensor_frame },
+	{ "TF STRUCTURE", message_tag::tf_structure },
+	{ "TF LAYOUT", message_tag::tf_layout },
+	{ "SPAWN IMAGE path pos size rot", message_tag::spawn_image },
+	{ "SPAWN CUBOID pos size color opacity rot", message_tag::spawn_cuboid },
+	{ "SPAWN CUBOID BATCH", message_tag::spawn_cuboid_batch },
+	{ "SPAWN CONNECTIONS", message_tag::spawn_connections },
+	{ "SCENE REDRAW", message_tag::scene_redraw },
+};
+
+// Looked up once per message, everything after that is dispatched at compile time
+message_tag
+find_message_tag(const uint8* tag, int64 length)
+{
+	for (const auto& entry : messageTags) {
+		if (length == (int64)std::strlen(entry.name) && std::memcmp(tag, entry.name, length) == 0)
+			return entry.tag;
+	}
+	return message_tag::other;
+}
+
 // Sends a WebSocket message and prints the response
 class session : public std::enable_shared_from_this<session>
 {
 	tcp::resolver resolver_;
 	websocket::stream<beast::tcp_stream> ws_;
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+	// Used instead of ws_ for the LocalSocket transport, see UNeuralInteractionClientSettings
+	net::local::stream_protocol::socket local_;
+	uint32_t frameHeader_ = 0;
+	// Frame with the handshake headers, see handshake_headers
+	std::string headerFrame_;
+	uint32_t headerFrameHeader_ = 0;
+#endif
 	beast::flat_buffer buffer_;
 	std::string host_;
+	// Server of the command, see FNeuralEndpointRouter
+	std::string server_;
+	std::string port_;
+	// Shared memory file announced to the server, empty if not used
+	FString sharedMemoryPath_;
+	// Responses update the model context of the server
+	FNeuralModelContext* context_ = nullptr;
 	std::string text_;
-	FReadResponse sessionCallback;
-	bool sessionCallbackSet = false;
-	FEndOfConnection sessionCallbackEndOfConnection;
-	FStartOrEndOfResponse sessionCallbackStartOrEndOfResponse;
-	FParseError sessionCallbackParseError;
-	FStartOrEndOfMap sessionCallbackStartOrEndOfMap;
-	FStartOrEndOfArray sessionCallbackStartOrEndOfArray;
-	FFoundAtomNil sessionCallbackFoundAtomNil;
-	FFoundAtomString sessionCallbackFoundAtomString;
-	FFoundAtomBinary sessionCallbackFoundAtomBinary;
-	FFoundAtomExternal sessionCallbackFoundAtomExternal;
-	FFoundAtomBoolean sessionCallbackFoundAtomBoolean;
-	FFoundAtomInteger sessionCallbackFoundAtomInteger;
-	FFoundAtomInteger64 sessionCallbackFoundAtomInteger64;
-	FFoundAtomFloat sessionCallbackFoundAtomFloat;
-	bool sessionCallbacksCompletelySet = false;
+	// The Blueprint delegates are adapted to these, see FNeuralResponseCallbacks
+	FNeuralResponseCallbacks callbacks_;
+	// Raw messages of responses to cacheable commands, stored in FNeuralResponseCache on close
+	bool recording_ = false;
+	TArray<TArray<uint8>> recordedMessages_;
+	FString responseEpoch_;
+	// Replayed epochs say nothing about the server, see FNeuralResponseCache
+	bool replaying_ = false;
+	// ["FILE REF", filename, sha1] of files missing in the texture cache, requested once the connection
+	// is over. The end of the connection is only reported afterwards
+	TArray<TPair<FString, FString>> missingFiles_;
+	bool endDeferred_ = false;
+	bool endForciblyClosed_ = false;
+	// Coalescing of the progress statuses of this command, see FNeuralMessageFilter
+	FNeuralMessageFilter::FConnectionState messageFilter_;
+	// Number of the reconnect attempt, see run_with_reconnect
+	int attempt_;
+	// Messages received on this connection, and how many of them earlier attempts already delivered
+	int receivedMessages_ = 0;
+	int skippedMessages_ = 0;
+	// Retrying waits, which is never done on the game thread
+	bool mayRetry_ = false;
+	// Set once the connection to the server is established
+	bool connected_ = false;
+	// Set once the server may have received the command
+	bool commandSent_ = false;
+	bool retry_ = false;
+	bool closedGracefully_ = false;
+	// Lane of the command, taken from the settings unless set explicitly, see FNeuralCommandScheduler
+	TOptional<ENeuralCommandPriority> priority_;
+	// Cancellation, see FNeuralCommandRegistry. Only a cancel frame may be written while reading responses
+	bool reading_ = false;
+	bool cancelled_ = false;
+	uint32_t cancelFrameHeader_ = 0;
+	net::steady_timer cancelTimer_;
+	// Keepalive pings while waiting for responses, see FNeuralLinkTelemetry
+	net::steady_timer pingTimer_;
+	double lastActivity_ = 0.0;
+	double pingSentAt_ = 0.0;
+	bool pingPending_ = false;
+	double connectStartedAt_ = 0.0;
+	// Set once the connection is over, so that the ping timer does not keep the io_context running
+	bool ended_ = false;
 
 public:
 	// Resolver and socket require an io_context
 	explicit
-		session(net::io_context& ioc)
+		session(net::io_context& ioc, int attempt = 0)
 		: resolver_(net::make_strand(ioc))
 		, ws_(net::make_strand(ioc))
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+		, local_(ioc)
+#endif
+		, attempt_(attempt)
+		, cancelTimer_(ioc)
+		, pingTimer_(ioc)
+		, visitor_(callbacks_)
+	{
+	}
+
+	// Thread-safe, called by FNeuralCommandRegistry while the io_context is alive
+	void
+		post_cancel()
+	{
+		net::post(ws_.get_executor(),
+			beast::bind_front_handler(
+				&session::cancel,
+				shared_from_this()));
+	}
+
+	void
+		cancel()
+	{
+		if (cancelled_)
+			return;
+		cancelled_ = true;
+		// Nothing of the response is delivered or cached from now on
+		recording_ = false;
+		recordedMessages_.Empty();
+
+		if (!reading_) {
+			// Not sent completely yet, the server drops the command with the connection
+			close_transport();
+			return;
+		}
+		const UNeuralInteractionClientSettings* settings = GetDefault<UNeuralInteractionClientSettings>();
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+		if (settings->Transport == ENeuralTransport::LocalSocket) {
+			cancelFrameHeader_ = (uint32_t)std::strlen(cancelFrame);
+			std::array<net::const_buffer, 2> frame = {
+				net::buffer(&cancelFrameHeader_, sizeof(cancelFrameHeader_)),
+				net::buffer(cancelFrame, cancelFrameHeader_)
+			};
+			net::async_write(local_, frame,
+				beast::bind_front_handler(
+					&session::on_cancel_write,
+					shared_from_this()));
+		} else
+#endif
+		{
+			ws_.async_write(
+				net::buffer(cancelFrame, std::strlen(cancelFrame)),
+				beast::bind_front_handler(
+					&session::on_cancel_write,
+					shared_from_this()));
+		}
+		// Servers which do not know the cancel frame, or are stuck, are disconnected after the timeout
+		cancelTimer_.expires_after(std::chrono::seconds(cancelTimeoutSeconds));
+		cancelTimer_.async_wait(
+			beast::bind_front_handler(
+				&session::on_cancel_timeout,
+				shared_from_this()));
+	}
+
+	void
+		on_cancel_write(beast::error_code ec, std::size_t bytes_transferred)
+	{
+		boost::ignore_unused(bytes_transferred);
+		if (ec)
+			close_transport();
+	}
+
+	void
+		on_cancel_timeout(beast::error_code ec)
+	{
+		if (ec != net::error::operation_aborted)
+			close_transport();
+	}
+
+	// Aborts all pending operations, their handlers end the connection
+	void
+		close_transport()
+	{
+		resolver_.cancel();
+		beast::get_lowest_layer(ws_).close();
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+		beast::error_code ec;
+		local_.close(ec);
+#endif
+	}
+
+	// Reports the end of a command that has been cancelled between two reconnect attempts
+	void
+		notify_cancelled()
+	{
+		if (callbacks_.OnEndOfConnection) {
+			callbacks_.OnEndOfConnection(UTF8_TO_TCHAR(text_.c_str()), true);
+		}
+	}
+
+	// Whether the connection failed and the command should be sent again on a new connection
+	bool
+		retry_requested() const
+	{
+		return retry_;
+	}
+
+	// Whether the server closed the connection after the complete response
+	bool
+		closed_gracefully() const
+	{
+		return closedGracefully_;
+	}
+
+	void
+		set_may_retry(bool mayRetry)
+	{
+		mayRetry_ = mayRetry;
+	}
+
+	// A retried command gets the same response again. Its first messages reached the callbacks
+	// before the connection dropped and are not delivered twice
+	void
+		set_skipped_messages(int skippedMessages)
+	{
+		skippedMessages_ = skippedMessages;
+	}
+
+	int
+		received_messages() const
 	{
+		return receivedMessages_;
+	}
+
+	void
+		set_priority(ENeuralCommandPriority priority)
+	{
+		priority_ = priority;
+	}
+
+	ENeuralCommandPriority
+		get_priority() const
+	{
+		return priority_.IsSet() ? priority_.GetValue() :
+			GetDefault<UNeuralInteractionClientSettings>()->GetCommandPriority(UTF8_TO_TCHAR(text_.c_str()));
 	}
 
 	// Start the asynchronous operation
@@ -116,34 +399,97 @@ public:
 	{
 		debug("run called");
 		// Save these for later
-		host_ = host;
+		set_server(host, port);
 		text_ = text;
 
-		// Look up the domain name
-		resolver_.async_resolve(
-			host,
-			port,
-			beast::bind_front_handler(
-				&session::on_resolve,
-				shared_from_this()));
+		if (replayFromCache())
+			return;
+
+		connect(host, port);
 	}
 
 	// Start the asynchronous operation
 	void
-		runAdvanced(
-			const FReadResponse& Callback,
+		runWithCallbacks(
+			const FNeuralResponseCallbacks& callbacks,
 			char const* host,
 			char const* port,
 			char const* text)
 	{
 		debug("run called");
 		// Save these for later
-		host_ = host;
+		set_server(host, port);
 		text_ = text;
-		sessionCallback = Callback;
-		sessionCallbackSet = true;
+		callbacks_ = callbacks;
+
+		if (replayFromCache())
+			return;
 
-		//sessionCallback.Execute(TEXT("Delegate was just called from sessionCallback."));
+		connect(host, port);
+	}
+
+	// The local socket and the shared memory file of the server depend on its port
+	void
+		set_server(char const* host, char const* port)
+	{
+		host_ = host;
+		server_ = host;
+		port_ = port;
+		const UNeuralInteractionClientSettings* settings = GetDefault<UNeuralInteractionClientSettings>();
+		sharedMemoryPath_ = settings->bUseSharedMemory ? settings->GetSharedMemoryPath(std::atoi(port)) : FString();
+		context_ = &FNeuralModelContexts::Get().FindOrAddForServer(UTF8_TO_TCHAR(host), std::atoi(port));
+	}
+
+	// "host:port", like FNeuralResponseCache keys the responses
+	FString
+		get_server() const
+	{
+		return UTF8_TO_TCHAR((server_ + ':' + port_).c_str());
+	}
+
+	// Replays a cached response through the callbacks instead of connecting, see FNeuralResponseCache.
+	// Otherwise prepares recording the response if the command is cacheable
+	bool
+		replayFromCache()
+	{
+		FString command = UTF8_TO_TCHAR(text_.c_str());
+		FNeuralResponseCache& cache = FNeuralResponseCache::Get();
+		cache.NotifyCommandSent(command);
+		TArray<TArray<uint8>> messages;
+		if (!cache.Find(get_server(), command, messages)) {
+			recording_ = cache.IsCacheable(command);
+			return false;
+		}
+		UE_LOG(NeuralInteractionClient, Verbose, TEXT("Replaying cached response to \"%s\"."), *command);
+		replaying_ = true;
+		for (const TArray<uint8>& message : messages) {
+			parsemsgpack((const char*)message.GetData(), message.Num());
+			resolve_file_references();
+		}
+		replaying_ = false;
+		closedGracefully_ = true;
+		notify_end_of_connection(false);
+		return true;
+	}
+
+	// Connects with the transport selected in the project settings
+	void
+		connect(char const* host, char const* port)
+	{
+		const UNeuralInteractionClientSettings* settings = GetDefault<UNeuralInteractionClientSettings>();
+		if (settings->Transport == ENeuralTransport::LocalSocket) {
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+			local_.async_connect(
+				net::local::stream_protocol::endpoint(TCHAR_TO_UTF8(*settings->GetLocalSocketPath(std::atoi(port)))),
+				beast::bind_front_handler(
+					&session::on_local_connect,
+					shared_from_this()));
+			return;
+#else
+			UE_LOG(NeuralInteractionClient, Warning, TEXT("Unix domain sockets are not available on this platform, "
+				"connecting via websocket instead."));
+#endif
+		}
 
 		// Look up the domain name
 		resolver_.async_resolve(
@@ -154,68 +500,226 @@ public:
 				shared_from_this()));
 	}
 
-	// Start the asynchronous operation
+	// Caches complete responses and notifies the callbacks once the server closed the connection.
+	// Failed connections are retried without notifying the callbacks, as long as attempts are left.
+	// A server that could not be reached at all is usually not running, so the first connect is only
+	// retried if bRetryFailedConnect is set
 	void
-		runWithAllDelegates(
-			const FEndOfConnection& CallbackEndOfConnection,
-			const FStartOrEndOfResponse& CallbackStartOrEndOfResponse,
-			const FParseError& CallbackParseError,
-			const FStartOrEndOfMap& CallbackStartOrEndOfMap,
-			const FStartOrEndOfArray& CallbackStartOrEndOfArray,
-			const FFoundAtomNil& CallbackFoundAtomNil,
-			const FFoundAtomString& CallbackFoundAtomString,
-			const FFoundAtomBinary& CallbackFoundAtomBinary,
-			const FFoundAtomExternal& CallbackFoundAtomExternal,
-			const FFoundAtomBoolean& CallbackFoundAtomBoolean,
-			const FFoundAtomInteger& CallbackFoundAtomInteger,
-			const FFoundAtomInteger64& CallbackFoundAtomInteger64,
-			const FFoundAtomFloat& CallbackFoundAtomFloat,
-			char const* host,
-			char const* port,
-			char const* text)
+		on_end_of_connection(bool closedGracefully)
 	{
-		debug("run called");
-		// Save these for later
-		host_ = host;
-		text_ = text;
-		
-		sessionCallbackEndOfConnection = CallbackEndOfConnection;
-		sessionCallbackStartOrEndOfResponse = CallbackStartOrEndOfResponse;
-		sessionCallbackParseError = CallbackParseError;
-		sessionCallbackStartOrEndOfMap = CallbackStartOrEndOfMap;
-		sessionCallbackStartOrEndOfArray = CallbackStartOrEndOfArray;
-		sessionCallbackFoundAtomNil = CallbackFoundAtomNil;
-		sessionCallbackFoundAtomString = CallbackFoundAtomString;
-		sessionCallbackFoundAtomBinary = CallbackFoundAtomBinary;
-		sessionCallbackFoundAtomExternal = CallbackFoundAtomExternal;
-		sessionCallbackFoundAtomBoolean = CallbackFoundAtomBoolean;
-		sessionCallbackFoundAtomInteger = CallbackFoundAtomInteger;
-		sessionCallbackFoundAtomInteger64 = CallbackFoundAtomInteger64;
-		sessionCallbackFoundAtomFloat = CallbackFoundAtomFloat;
-		sessionCallbacksCompletelySet = true;
+		const FString command = UTF8_TO_TCHAR(text_.c_str());
+		ended_ = true;
+		pingTimer_.cancel();
+		if (cancelled_) {
+			cancelTimer_.cancel();
+			missingFiles_.Reset();
+			UE_LOG(NeuralInteractionClient, Log, TEXT("Cancelled \"%s\"."), *command);
+			if (callbacks_.OnEndOfConnection) {
+				callbacks_.OnEndOfConnection(command, true);
+			}
+			return;
+		}
+		const UNeuralInteractionClientSettings* settings = GetDefault<UNeuralInteractionClientSettings>();
+		const bool reachedServer = connected_ || attempt_ > 0;
+		if (!closedGracefully && mayRetry_ && settings->bReconnect && attempt_ < settings->ReconnectAttempts &&
+			(reachedServer || settings->bRetryFailedConnect) &&
+			(!commandSent_ || settings->IsIdempotentCommand(command))) {
+			UE_LOG(NeuralInteractionClient, Log, TEXT("Connection for \"%s\" failed, reconnecting (attempt %d of %d)."),
+				*command, attempt_ + 1, settings->ReconnectAttempts);
+			retry_ = true;
+			return;
+		}
+		closedGracefully_ = closedGracefully;
+		if (recording_ && closedGracefully) {
+			// Only complete responses are cached
+			FNeuralResponseCache::Get().Store(get_server(), command, responseEpoch_, MoveTemp(recordedMessages_));
+		}
+		notify_end_of_connection(!closedGracefully);
+	}
 
-		// Look up the domain name
-		resolver_.async_resolve(
-			host,
-			port,
+	// Deferred while referenced files are missing, see fetch_missing_files
+	void
+		notify_end_of_connection(bool forciblyClosed)
+	{
+		if (missingFiles_.Num() > 0) {
+			endDeferred_ = true;
+			endForciblyClosed_ = forciblyClosed;
+			return;
+		}
+		if (callbacks_.OnEndOfConnection) {
+			callbacks_.OnEndOfConnection(UTF8_TO_TCHAR(text_.c_str()), forciblyClosed);
+		}
+	}
+
+	// Requests the referenced files missing in the texture cache again and delivers them, then reports
+	// the end of the connection. Blocks, so it is called by run_with_reconnect once the I/O of this
+	// session is over, instead of opening another connection while parsing
+	void
+		fetch_missing_files()
+	{
+		FNeuralTextureCache& cache = FNeuralTextureCache::Get();
+		TArray<TPair<FString, FString>> missing = MoveTemp(missingFiles_);
+		missingFiles_.Reset();
+		for (const TPair<FString, FString>& reference : missing) {
+			UE_LOG(NeuralInteractionClient, Log, TEXT("Referenced file %s is not cached, requesting it again."), *reference.Key);
+			std::string command = TCHAR_TO_UTF8(*(TEXT("get file ") + reference.Key));
+			std::string host = server_;
+			std::string port = port_;
+			connect_to_websocket_server(&command[0], &host[0], &port[0], false);
+			TArray<uint8> data;
+			if (!cache.LoadFile(reference.Value, data)) {
+				UE_LOG(NeuralInteractionClient, Warning, TEXT("Referenced file %s could not be retrieved."), *reference.Key);
+				continue;
+			}
+			parse_as_file(reference.Key, data);
+		}
+		if (endDeferred_) {
+			endDeferred_ = false;
+			notify_end_of_connection(endForciblyClosed_);
+		}
+	}
+
+	// Headers the server negotiates the features of the connection with, sent with the websocket
+	// handshake or in the first frame of a local socket
+	std::vector<std::pair<std::string, std::string>>
+		handshake_headers() const
+	{
+		std::vector<std::pair<std::string, std::string>> headers;
+		// The codecs the server may compress messages with
+		const std::string codecs = TCHAR_TO_UTF8(*FNeuralMessageCompression::Get().GetAcceptedCodecs());
+		if (!codecs.empty()) {
+			headers.emplace_back(FNeuralMessageCompression::CodecsHeader, codecs);
+		}
+		// The shared memory file, which the server only uses if it writes the same file
+		if (!sharedMemoryPath_.IsEmpty()) {
+			headers.emplace_back(FNeuralSharedMemory::HandshakeHeader, TCHAR_TO_UTF8(*sharedMemoryPath_));
+		}
+		const ENeuralCommandPriority priority = get_priority();
+		headers.emplace_back(priorityHeader, priority == ENeuralCommandPriority::Interactive ? "interactive" :
+			priority == ENeuralCommandPriority::Bulk ? "bulk" : "normal");
+		headers.emplace_back(clientIdHeader, get_client_id());
+		// Whether scene instructions are applied natively, see FNeuralInteractionEvents::NativeSceneHeader
+		if (FNeuralInteractionEvents::HasSceneListeners()) {
+			headers.emplace_back(FNeuralInteractionEvents::NativeSceneHeader, "1");
+		}
+		// Lets the server fill one round trip with each fragment of a bulk response
+		const int32 fragmentSize = FNeuralLinkTelemetry::Get().GetFragmentSize();
+		if (fragmentSize > 0) {
+			headers.emplace_back(fragmentSizeHeader, std::to_string(fragmentSize));
+		}
+		return headers;
+	}
+
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+	// LOCAL SOCKET TRANSPORT: every message is a frame of uint32 length and payload in both directions,
+	// see localTransport.py on the server. The handshake headers are sent in the first frame
+	void
+		on_local_connect(beast::error_code ec)
+	{
+		debug("on local connect called");
+		if (ec) {
+			UE_LOG(NeuralInteractionClient, Warning, TEXT("Could not connect to the local socket: %s"),
+				UTF8_TO_TCHAR(ec.message().c_str()));
+			on_end_of_connection(false);
+			return fail(ec, "local connect");
+		}
+		connected_ = true;
+
+		// The same headers as the websocket handshake, so that both transports negotiate the same way
+		headerFrame_ = headerFrame;
+		headerFrame_ += "\r\n";
+		for (const auto& header : handshake_headers()) {
+			headerFrame_ += header.first + ": " + header.second + "\r\n";
+		}
+		headerFrameHeader_ = (uint32_t)headerFrame_.size();
+
+		// Headers and command in a single write. The protocol is little endian, like all platforms the client runs on
+		commandSent_ = true;
+		frameHeader_ = (uint32_t)text_.size();
+		std::array<net::const_buffer, 4> frame = {
+			net::buffer(&headerFrameHeader_, sizeof(headerFrameHeader_)),
+			net::buffer(headerFrame_),
+			net::buffer(&frameHeader_, sizeof(frameHeader_)),
+			net::buffer(text_)
+		};
+		net::async_write(local_, frame,
 			beast::bind_front_handler(
-				&session::on_resolve,
+				&session::on_local_write,
+				shared_from_this()));
+	}
+
+	void
+		on_local_write(beast::error_code ec, std::size_t bytes_transferred)
+	{
+		debug("on local write called");
+		FNeuralLinkTelemetry::Get().AddBytesSent(bytes_transferred);
+		if (ec) {
+			on_end_of_connection(false);
+			return fail(ec, "local write");
+		}
+		reading_ = true;
+		read_local_frame();
+	}
+
+	void
+		read_local_frame()
+	{
+		net::async_read(local_, net::buffer(&frameHeader_, sizeof(frameHeader_)),
+			beast::bind_front_handler(
+				&session::on_local_frame_header,
+				shared_from_this()));
+	}
+
+	void
+		on_local_frame_header(beast::error_code ec, std::size_t bytes_transferred)
+	{
+		boost::ignore_unused(bytes_transferred);
+		if (ec) {
+			// The server closes the connection between two frames once the command is done
+			on_end_of_connection(ec == net::error::eof);
+			return fail(ec, "local read");
+		}
+		// Reads the payload directly into the buffer the websocket transport uses as well
+		net::async_read(local_, buffer_.prepare(frameHeader_),
+			beast::bind_front_handler(
+				&session::on_local_frame,
 				shared_from_this()));
 	}
 
+	void
+		on_local_frame(beast::error_code ec, std::size_t bytes_transferred)
+	{
+		debug("on local read called");
+		if (ec) {
+			on_end_of_connection(false);
+			return fail(ec, "local read");
+		}
+		FNeuralLinkTelemetry::Get().AddBytesReceived(bytes_transferred + sizeof(frameHeader_));
+		buffer_.commit(bytes_transferred);
+		unpackmsgpack();
+		buffer_.clear();
+		if (cancelled_)
+			buffer_.shrink_to_fit();
+		read_local_frame();
+	}
+#endif
+
 	void
 		on_resolve(
 			beast::error_code ec,
 			tcp::resolver::results_type results)
 	{
 		debug("on resolve called");
-		if (ec)
+		if (ec) {
+			on_end_of_connection(false);
 			return fail(ec, "resolve");
+		}
 
 		// Set the timeout for the operation
 		beast::get_lowest_layer(ws_).expires_after(std::chrono::seconds(30));
 
 		// Make the connection on the IP address we get from a lookup
+		connectStartedAt_ = FPlatformTime::Seconds();
 		beast::get_lowest_layer(ws_).async_connect(
 			results,
 			beast::bind_front_handler(
@@ -227,25 +731,42 @@ public:
 		on_connect(beast::error_code ec, tcp::resolver::results_type::endpoint_type ep)
 	{
 		debug("on connect called");
-		if (ec)
+		if (ec) {
+			on_end_of_connection(false);
 			return fail(ec, "connect");
+		}
+		connected_ = true;
 
 		// Turn off the timeout on the tcp_stream, because
 		// the websocket stream has its own timeout system.
 		beast::get_lowest_layer(ws_).expires_never();
 
+		// The TCP handshake takes one round trip
+		FNeuralLinkTelemetry& telemetry = FNeuralLinkTelemetry::Get();
+		telemetry.AddRoundTripSample(FPlatformTime::Seconds() - connectStartedAt_);
+
+		// Interactive commands are tiny and should not wait for acknowledgements of previous segments
+		const ENeuralCommandPriority priority = get_priority();
+		if (priority == ENeuralCommandPriority::Interactive) {
+			beast::error_code optionError;
+			beast::get_lowest_layer(ws_).socket().set_option(tcp::no_delay(true), optionError);
+		}
+
 		// Set suggested timeout settings for the websocket
 		ws_.set_option(
 			websocket::stream_base::timeout::suggested(
 				beast::role_type::client));
 
-		// Set a decorator to change the User-Agent of the handshake
+		// Set a decorator to change the User-Agent of the handshake and to add the headers of the command
 		ws_.set_option(websocket::stream_base::decorator(
-			[](websocket::request_type& req)
+			[headers = handshake_headers()](websocket::request_type& req)
 		{
 			req.set(http::field::user_agent,
 				std::string(BOOST_BEAST_VERSION_STRING) +
 				" websocket-client-async");
+			for (const auto& header : headers) {
+				req.set(header.first, header.second);
+			}
 		}));
 
 		// Update the host_ string. This will provide the value of the
@@ -264,10 +785,25 @@ public:
 		on_handshake(beast::error_code ec)
 	{
 		debug("on handshake called");
-		if (ec)
+		if (ec) {
+			on_end_of_connection(false);
 			return fail(ec, "handshake");
+		}
+
+		// Pongs to our keepalive pings are round trip samples
+		ws_.control_callback(
+			[this](websocket::frame_type kind, beast::string_view payload)
+		{
+			boost::ignore_unused(payload);
+			if (kind == websocket::frame_type::pong && pingPending_) {
+				pingPending_ = false;
+				FNeuralLinkTelemetry::Get().AddRoundTripSample(FPlatformTime::Seconds() - pingSentAt_);
+			}
+			lastActivity_ = FPlatformTime::Seconds();
+		});
 
 		// Send the message
+		commandSent_ = true;
 		ws_.async_write(
 			net::buffer(text_),
 			beast::bind_front_handler(
@@ -281,12 +817,17 @@ public:
 			std::size_t bytes_transferred)
 	{
 		debug("on write called");
-		boost::ignore_unused(bytes_transferred);
+		FNeuralLinkTelemetry::Get().AddBytesSent(bytes_transferred);
 
-		if (ec)
+		if (ec) {
+			on_end_of_connection(false);
 			return fail(ec, "write");
+		}
 
 		// Read a message into our buffer
+		reading_ = true;
+		lastActivity_ = FPlatformTime::Seconds();
+		start_ping_timer();
 		ws_.async_read(
 			buffer_,
 			beast::bind_front_handler(
@@ -300,28 +841,21 @@ public:
 			std::size_t bytes_transferred)
 	{
 		debug("on read called");
-		boost::ignore_unused(bytes_transferred);
+		FNeuralLinkTelemetry::Get().AddBytesReceived(bytes_transferred);
+		lastActivity_ = FPlatformTime::Seconds();
 
 		if (ec) {
-			if (sessionCallbacksCompletelySet) {
-				if (ec.value() == 1) {
-					// The WebSocket stream was gracefully closed at both endpoints
-					sessionCallbackEndOfConnection.Execute(UTF8_TO_TCHAR(text_.c_str()), false);
-				} else if (ec.value() == 10054) {
-					// An existing connection was forcibly closed by the remote host
-					sessionCallbackEndOfConnection.Execute(UTF8_TO_TCHAR(text_.c_str()), true);
-				} else {
-					// Any other unidentified error
-					sessionCallbackEndOfConnection.Execute(UTF8_TO_TCHAR(text_.c_str()), true);
-				}
-			}
+			// Otherwise, e.g. 10054, an existing connection was forcibly closed by the remote host
+			// or any other unidentified error
+			on_end_of_connection(ec == websocket::error::closed);
 			return fail(ec, "read");
 		}
 
-		std::string response;
 		unpackmsgpack();
 
 		buffer_.clear();
+		if (cancelled_)
+			buffer_.shrink_to_fit();
 
 		// PATIENT CLIENT / KEEP READING:
 		// Read next message into our buffer or check for closed connection
@@ -348,6 +882,45 @@ public:
 				shared_from_this()));*/
 	}
 
+	// Pings the server whenever no message arrived for KeepAliveInterval while waiting for the response
+	void
+		start_ping_timer()
+	{
+		const float interval = GetDefault<UNeuralInteractionClientSettings>()->KeepAliveInterval;
+		if (interval <= 0.f)
+			return;
+		pingTimer_.expires_after(std::chrono::milliseconds((int64)(interval * 1000.f)));
+		pingTimer_.async_wait(
+			beast::bind_front_handler(
+				&session::on_ping_timer,
+				shared_from_this()));
+	}
+
+	void
+		on_ping_timer(beast::error_code ec)
+	{
+		if (ec == net::error::operation_aborted || ended_)
+			return;
+		const float interval = GetDefault<UNeuralInteractionClientSettings>()->KeepAliveInterval;
+		if (!pingPending_ && !cancelled_ && FPlatformTime::Seconds() - lastActivity_ >= interval) {
+			pingPending_ = true;
+			pingSentAt_ = FPlatformTime::Seconds();
+			ws_.async_ping({},
+				beast::bind_front_handler(
+					&session::on_ping,
+					shared_from_this()));
+		}
+		start_ping_timer();
+	}
+
+	void
+		on_ping(beast::error_code ec)
+	{
+		// The connection is closing, which the pending read reports
+		if (ec)
+			pingPending_ = false;
+	}
+
 	void
 		on_close(beast::error_code ec)
 	{
@@ -356,9 +929,7 @@ public:
 			return fail(ec, "close");
 
 		// If we get here then the connection is closed gracefully
-		if (sessionCallbacksCompletelySet) {
-			sessionCallbackEndOfConnection.Execute(UTF8_TO_TCHAR(text_.c_str()), false);
-		}
+		notify_end_of_connection(false);
 
 		// The make_printable() function helps print a ConstBufferSequence
 		//std::cout << beast::make_printable(buffer_.data()) << std::endl;
@@ -372,196 +943,335 @@ public:
 
 		// response is in: buffer_
 
-		std::string response = beast::buffers_to_string(buffer_.data());
-		msgpack::sbuffer buffer;
-		buffer.write(&response[0], buffer_.size());
-
-		// deserializes these objects using msgpack::unpacker.
-		msgpack::unpacker unpacker;
-
-		// feeds the buffer.
-		unpacker.reserve_buffer(buffer.size());
-		memcpy(unpacker.buffer(), buffer.data(), buffer.size());
-		unpacker.buffer_consumed(buffer.size());
-
-		// deserialize and print received packed at once:
-		/*msgpack::object_handle oh;
-		oh = msgpack::unpack(response.data(), response.size());
-		std::cout << oh.get() << std::endl;*/
-		// alternative:
-		/*while (unpacker.next(oh)) {
-			std::cout << oh.get() << std::endl;
-		}*/
-		//std::cout << std::endl;
-		print("\n");
-
-		// apply visitor, unpack everything
-		{
-			msgpack_visitor visitor;
-			if (sessionCallbackSet) {
-				visitor.setCallbackFunction(sessionCallback);
+		// Responses that arrive after cancelling are dropped unparsed
+		if (cancelled_)
+			return;
+
+		// Parsed in place, the flat buffer holds the message contiguously
+		const std::size_t receivedSize = buffer_.size();
+		const char* data = static_cast<const char*>(buffer_.data().data());
+		std::size_t size = receivedSize;
+		FNeuralMessageCompression& compression = FNeuralMessageCompression::Get();
+		TArray<uint8> decompressed;
+		const double decompressionStart = FPlatformTime::Seconds();
+		if (FNeuralMessageCompression::IsEnvelope((const uint8*)data, size)) {
+			decompressed = compression.AcquireBuffer();
+			if (!compression.Decompress((const uint8*)data, size, decompressed)) {
+				compression.ReleaseBuffer(MoveTemp(decompressed));
+				return;
 			}
-			if (sessionCallbacksCompletelySet) {
-				visitor.setCallbackFunctionsCompletely(
-					sessionCallbackEndOfConnection,
-					sessionCallbackStartOrEndOfResponse,
-					sessionCallbackParseError,
-					sessionCallbackStartOrEndOfMap,
-					sessionCallbackStartOrEndOfArray,
-					sessionCallbackFoundAtomNil,
-					sessionCallbackFoundAtomString,
-					sessionCallbackFoundAtomBinary,
-					sessionCallbackFoundAtomExternal,
-					sessionCallbackFoundAtomBoolean,
-					sessionCallbackFoundAtomInteger,
-					sessionCallbackFoundAtomInteger64,
-					sessionCallbackFoundAtomFloat
-				);
-				visitor.setOriginalCommand(text_);
+			data = (const char*)decompressed.GetData();
+			size = decompressed.Num();
+		}
+		const double decompressionSeconds = FPlatformTime::Seconds() - decompressionStart;
+		// Cached uncompressed, so that replaying does not depend on the codec
+		if (recording_) {
+			recordedMessages_.Emplace((const uint8*)data, (int32)size);
+		}
+		// Recorded nevertheless, as the cache needs the complete response
+		if (receivedMessages_++ < skippedMessages_) {
+			if (decompressed.Max() > 0) {
+				compression.ReleaseBuffer(MoveTemp(decompressed));
 			}
+			return;
+		}
+		const FString& messageType = parsemsgpack(data, size);
+		compression.RecordMessage(messageType, receivedSize, size, decompressionSeconds);
+		if (decompressed.Max() > 0) {
+			compression.ReleaseBuffer(MoveTemp(decompressed));
+		}
+		resolve_file_references();
+	}
 
-			if (sessionCallbacksCompletelySet) {
-				sessionCallbackStartOrEndOfResponse.Execute(visitor.originalCommand, FString(""), false);
+	// Delivers the files of the ["FILE REF", filename, sha1] messages parsed last like FILE messages,
+	// so that the callbacks and the Blueprint delegates get their content. Not done by the parser,
+	// as this parses another message
+	void resolve_file_references() {
+		if (visitor_.fileReferences.Num() == 0) {
+			return;
+		}
+		TArray<TPair<FString, FString>> references = MoveTemp(visitor_.fileReferences);
+		visitor_.fileReferences.Reset();
+		FNeuralTextureCache& cache = FNeuralTextureCache::Get();
+		TArray<uint8> data;
+		for (const TPair<FString, FString>& reference : references) {
+			if (cache.LoadFile(reference.Value, data)) {
+				parse_as_file(reference.Key, data);
+			} else {
+				missingFiles_.Add(reference);
 			}
+		}
+	}
 
-			msgpack::parse(response.data(), response.size(), visitor);
+	// Parses ["FILE", filename, data] as if the server had sent it
+	void parse_as_file(const FString& fileName, const TArray<uint8>& data) {
+		msgpack::sbuffer buffer(data.Num() + 64);
+		msgpack::packer<msgpack::sbuffer> packer(buffer);
+		packer.pack_array(3);
+		packer.pack(std::string("FILE"));
+		packer.pack(std::string(TCHAR_TO_UTF8(*fileName)));
+		packer.pack_bin((uint32_t)data.Num());
+		packer.pack_bin_body((const char*)data.GetData(), (uint32_t)data.Num());
+		parsemsgpack(buffer.data(), buffer.size());
+	}
 
-			if (sessionCallbacksCompletelySet) {
-				sessionCallbackStartOrEndOfResponse.Execute(visitor.originalCommand, visitor.FfirstString, true);
+	// apply visitor, unpack everything. Returns the first string of the message,
+	// or FILTERED for status and debug messages dropped by FNeuralMessageFilter
+	const FString& parsemsgpack(const char* data, std::size_t size) {
+		static const FString filtered(TEXT("FILTERED"));
+		if (!FNeuralMessageFilter::Get().Accept((const uint8*)data, (int64)size, messageFilter_)) {
+			return filtered;
+		}
+		msgpack_visitor& visitor = visitor_;
+		if (!visitorConfigured_) {
+			configureVisitor();
+		}
+		visitor.reset();
+		FNeuralModelContexts::FResponseScope responseScope(context_);
+
+		// The tag is read once, the rest of the message is parsed by the handler of its type
+		FNeuralPackedReader reader{ (const uint8*)data, (int64)size };
+		uint64 elements = 0;
+		const uint8* tag = nullptr;
+		int64 tagLength = 0;
+		message_tag messageTag = message_tag::other;
+		if (reader.ReadArrayHeader(elements) && elements > 0 && reader.ReadString(tag, tagLength)) {
+			msgpack_visitor::assignUtf8(visitor.FfirstString, (const char*)tag, (uint32_t)tagLength);
+			messageTag = find_message_tag(tag, tagLength);
+		}
+
+		if (callbacks_.OnStartOrEndOfResponse) {
+			callbacks_.OnStartOrEndOfResponse(visitor.originalCommand, FString(), false);
+		}
+
+		switch (messageTag) {
+		case message_tag::status: parse_as<message_tag::status>(data, size); break;
+		case message_tag::debug: parse_as<message_tag::debug>(data, size); break;
+		case message_tag::model_epoch: parse_as<message_tag::model_epoch>(data, size); break;
+		case message_tag::file: parse_as<message_tag::file>(data, size); break;
+		case message_tag::file_ref: parse_as<message_tag::file_ref>(data, size); break;
+		case message_tag::tensor: parse_as<message_tag::tensor>(data, size); break;
+		case message_tag::tensor_frame: parse_as<message_tag::tensor_frame>(data, size); break;
+		case message_tag::tf_structure: parse_as<message_tag::tf_structure>(data, size); break;
+		case message_tag::tf_layout: parse_as<message_tag::tf_layout>(data, size); break;
+		case message_tag::spawn_image: parse_as<message_tag::spawn_image>(data, size); break;
+		case message_tag::spawn_cuboid: parse_as<message_tag::spawn_cuboid>(data, size); break;
+		case message_tag::spawn_cuboid_batch: parse_as<message_tag::spawn_cuboid_batch>(data, size); break;
+		case message_tag::spawn_connections: parse_as<message_tag::spawn_connections>(data, size); break;
+		case message_tag::scene_redraw: parse_as<message_tag::scene_redraw>(data, size); break;
+		default: parse_as<message_tag::other>(data, size); break;
+		}
+		if (!visitor.modelEpoch.IsEmpty()) {
+			responseEpoch_ = visitor.modelEpoch;
+			if (!replaying_) {
+				FNeuralResponseCache::Get().ObserveEpoch(get_server(), responseEpoch_);
 			}
-			//std::cout << std::endl;
-			print("\n");
 		}
+
+		if (callbacks_.OnStartOrEndOfResponse) {
+			callbacks_.OnStartOrEndOfResponse(visitor.originalCommand, visitor.FfirstString, true);
+		}
+		return visitor.FfirstString;
 	}
 
-	static void createLayer(int layerNumber, int size_x, int size_y, int size_z, std::string name) {
-		//std::cout << std::endl << "Creating layer number " << layerNumber << " with name " <<
-		//	name << " of size " << size_x << ", " << size_y << ", " << size_z << ".";
-		/*std::string strr;
-		strr << "Creating layer number " << layerNumber << " with name " <<
-			name << " of size " << size_x << ", " << size_y << ", " << size_z << ".";
-		print(strr);*/
+	template <message_tag Tag>
+	void parse_as(const char* data, std::size_t size) {
+		if constexpr (message_handler<Tag>::isSceneMessage) {
+			visitor_.sceneListeners = FNeuralInteractionEvents::HasSceneListeners();
+		}
+		message_handler<Tag> handler(visitor_);
+		TNeuralPackedParser<message_handler<Tag>> parser((const uint8*)data, (int64)size, handler, visitor_.numericValues);
+		parser.Parse();
+	}
+
+	// The visitor lives as long as the session, so that the command is only converted once
+	// and its buffers keep their capacity from one message to the next
+	void configureVisitor() {
+		msgpack_visitor& visitor = visitor_;
+		visitor.elementCallbacks = callbacks_.HasElementCallbacks();
+		// Also needed by native listeners, see FNeuralInteractionEvents
+		visitor.setOriginalCommand(text_);
+		visitor.setServer(sharedMemoryPath_, context_);
+		visitorConfigured_ = true;
 	}
 
+	// One per session, reset before each message. Strings are assigned in place, so that once the
+	// buffers have grown to the size of the messages, parsing does not allocate anymore
 	struct msgpack_visitor : msgpack::null_visitor {
 		int depth = 0;
 		const std::string indent = "  ";
 		const std::string indentBeforeEveryLine = "    ";
 		bool startWithNewLine = false;
 		const bool showArrayBrackets = false;
+		// Prints every visited element with print. The text is not even built otherwise
+		static constexpr bool printVisitedElements = false;
 		bool processing_map_key = false;
 		bool processing_map_value = false;
 		std::string printThisAfterNextWhitespace = "";
-		std::string firstString = "";
+		// Tag of the message, read before parsing, see message_handler
 		FString FfirstString = "";
-		int tmpArrayLength;
-		int tmpX, tmpY, tmpZ, tmpCount;
-		bool tmpReading = false;
-		std::string tmpStr = "";
-		FReadResponse visitorCallback;
-		bool visitorCallbackSet = false;
+		// "TF STRUCTURE" responses are turned into a native layer graph while parsing.
+		// layerField is the index within [name, type, shape, params, connectedTo, vars]
+		FNeuralLayerGraphBuilder layerGraphBuilder;
+		int layerField = -1;
+		// "TF LAYOUT" responses ["TF LAYOUT", key, [[x, y]*]] are stored in the client side layout cache
+		FString layoutKey;
+		TArray<FVector2D> layoutPositions;
+		// ["MODEL EPOCH", epoch] is sent after each command, see FNeuralResponseCache
+		FString modelEpoch;
+		// ["FILE", filename, data] and ["SPAWN IMAGE path pos size rot", [path, values*]]
+		// are also passed to native listeners, see FNeuralInteractionEvents.
+		// Files also go into the texture cache, from which ["FILE REF", filename, sha1] is resolved
+		// after parsing, see session::resolve_file_references. Pairs of filename and hash
+		FString fileName;
+		TArray<TPair<FString, FString>> fileReferences;
+		FString imagePath;
+		TArray<float> imageValues;
+		// ["TENSOR", name, tensor] and ["TENSOR FRAME", name, frame] with extension types,
+		// see FNeuralTensor and FNeuralTensorStreams
+		FString tensorName;
+		// ["SCENE REDRAW", phase, [scope*]], ["SPAWN CUBOID pos size color opacity rot", values, identity]
+		// and ["SPAWN CUBOID BATCH", [cuboid*]] are collected for native scene listeners, if there are any
+		bool sceneListeners = false;
+		bool redrawBegins = false;
+		TArray<FString> redrawScopes;
+		TArray<FNeuralCuboidInstruction> cuboids;
+		// ["SPAWN CONNECTIONS", [strength, r, g, b, opacity], [parent, child]*]
+		TArray<float> connectionStyle;
+		TArray<int32> connectionEdges;
+		// ["STATUS", level, text] and ["DEBUG", level, text] go into the console, see FNeuralConsole
+		int consoleLevel = 0;
+		// Those of the session
+		const FNeuralResponseCallbacks& callbacks;
+		bool elementCallbacks = false;
 		FString originalCommand = "";
+		// Server of the response, which places payloads in shared memory of its own
+		FString serverSharedMemoryPath;
+		FNeuralModelContext* modelContext = nullptr;
 		std::string arrayPosition = "";
+		// Only kept up to date for the element callbacks
 		FString FarrayPosition = "";
+		// Arrays of numbers decoded in bulk, see TNeuralPackedParser
+		TArray<float> numericValues;
+
+		explicit msgpack_visitor(const FNeuralResponseCallbacks& inCallbacks) : callbacks(inCallbacks) {}
 
-		FEndOfConnection visitorCallbackEndOfConnection;
-		FStartOrEndOfResponse visitorCallbackStartOrEndOfResponse;
-		FParseError visitorCallbackParseError;
-		FStartOrEndOfMap visitorCallbackStartOrEndOfMap;
-		FStartOrEndOfArray visitorCallbackStartOrEndOfArray;
-		FFoundAtomNil visitorCallbackFoundAtomNil;
-		FFoundAtomString visitorCallbackFoundAtomString;
-		FFoundAtomBinary visitorCallbackFoundAtomBinary;
-		FFoundAtomExternal visitorCallbackFoundAtomExternal;
-		FFoundAtomBoolean visitorCallbackFoundAtomBoolean;
-		FFoundAtomInteger visitorCallbackFoundAtomInteger;
-		FFoundAtomInteger64 visitorCallbackFoundAtomInteger64;
-		FFoundAtomFloat visitorCallbackFoundAtomFloat;
-		bool visitorCallbacksCompletelySet = false;
-
-		void setCallbackFunction(const FReadResponse& Callback) {
-			visitorCallback = Callback;
-			visitorCallbackSet = true;
-		}
-
-		void setCallbackFunctionsCompletely(
-			const FEndOfConnection& CallbackEndOfConnection,
-			const FStartOrEndOfResponse& CallbackStartOrEndOfResponse,
-			const FParseError& CallbackParseError,
-			const FStartOrEndOfMap& CallbackStartOrEndOfMap,
-			const FStartOrEndOfArray& CallbackStartOrEndOfArray,
-			const FFoundAtomNil& CallbackFoundAtomNil,
-			const FFoundAtomString& CallbackFoundAtomString,
-			const FFoundAtomBinary& CallbackFoundAtomBinary,
-			const FFoundAtomExternal& CallbackFoundAtomExternal,
-			const FFoundAtomBoolean& CallbackFoundAtomBoolean,
-			const FFoundAtomInteger& CallbackFoundAtomInteger,
-			const FFoundAtomInteger64& CallbackFoundAtomInteger64,
-			const FFoundAtomFloat& CallbackFoundAtomFloat
-		) {
-			visitorCallbackEndOfConnection = CallbackEndOfConnection;
-			visitorCallbackStartOrEndOfResponse = CallbackStartOrEndOfResponse;
-			visitorCallbackParseError = CallbackParseError;
-			visitorCallbackStartOrEndOfMap = CallbackStartOrEndOfMap;
-			visitorCallbackStartOrEndOfArray = CallbackStartOrEndOfArray;
-			visitorCallbackFoundAtomNil = CallbackFoundAtomNil;
-			visitorCallbackFoundAtomString = CallbackFoundAtomString;
-			visitorCallbackFoundAtomBinary = CallbackFoundAtomBinary;
-			visitorCallbackFoundAtomExternal = CallbackFoundAtomExternal;
-			visitorCallbackFoundAtomBoolean = CallbackFoundAtomBoolean;
-			visitorCallbackFoundAtomInteger = CallbackFoundAtomInteger;
-			visitorCallbackFoundAtomInteger64 = CallbackFoundAtomInteger64;
-			visitorCallbackFoundAtomFloat = CallbackFoundAtomFloat;
-			visitorCallbacksCompletelySet = true;
-		}
-
-		void setOriginalCommand(std::string command) {
+		void setOriginalCommand(const std::string& command) {
 			originalCommand = UTF8_TO_TCHAR(command.c_str());
 		}
 
+		// Forgets the previous message, keeps the callbacks, the command, the server and all allocations
+		void reset() {
+			depth = 0;
+			startWithNewLine = false;
+			processing_map_key = false;
+			processing_map_value = false;
+			printThisAfterNextWhitespace.clear();
+			FfirstString.Reset();
+			layerField = -1;
+			layoutKey.Reset();
+			layoutPositions.Reset();
+			modelEpoch.Reset();
+			fileName.Reset();
+			imagePath.Reset();
+			imageValues.Reset();
+			tensorName.Reset();
+			sceneListeners = false;
+			redrawBegins = false;
+			redrawScopes.Reset();
+			cuboids.Reset();
+			connectionStyle.Reset();
+			connectionEdges.Reset();
+			consoleLevel = 0;
+			arrayPosition.clear();
+			FarrayPosition.Reset();
+		}
+
+		// Replace the contents of out without giving up its allocation
+		static void assignUtf8(FString& out, const char* v, uint32_t size) {
+			FUTF8ToTCHAR converted(v, size);
+			out.Reset();
+			out.AppendChars(converted.Get(), converted.Length());
+		}
+		static void assignBytes(FString& out, const char* v, uint32_t size) {
+			out.Reset(size);
+			for (uint32_t i = 0; i < size; i++) {
+				out.AppendChar((TCHAR)(uint8)v[i]);
+			}
+		}
+		void updateFArrayPosition() {
+			if (elementCallbacks) {
+				assignBytes(FarrayPosition, arrayPosition.data(), arrayPosition.size());
+			}
+		}
+
+		void setServer(const FString& sharedMemoryPath, FNeuralModelContext* context) {
+			serverSharedMemoryPath = sharedMemoryPath;
+			modelContext = context;
+		}
+
 		void enterArray() {
-			if (arrayPosition == "") {
-				arrayPosition = "-1";
+			if (arrayPosition.empty()) {
+				arrayPosition.append("-1");
 			}
 			else {
-				arrayPosition += ".-1";
+				arrayPosition.append(".-1");
 			}
-			FarrayPosition = UTF8_TO_TCHAR(arrayPosition.c_str());
+			updateFArrayPosition();
 			//std::cout << "                      Enter: " << arrayPosition;
 			depth++;
 		}
 		void leaveArray() {
-			if (arrayPosition.find(".") == std::string::npos) {
-				arrayPosition = "";
+			const std::size_t dotpos = arrayPosition.rfind('.');
+			if (dotpos == std::string::npos) {
+				arrayPosition.clear();
 			}
 			else {
-				arrayPosition.erase(arrayPosition.rfind("."));
+				arrayPosition.erase(dotpos);
 			}
-			FarrayPosition = UTF8_TO_TCHAR(arrayPosition.c_str());
+			updateFArrayPosition();
 			//std::cout << "                      Leave: " << arrayPosition;
 			depth--;
 		}
 		void incrementArrayPosition() {
-			if (arrayPosition.find(".") == std::string::npos) {
-				int value = atoi(arrayPosition.c_str());
-				value++;
-				arrayPosition = std::to_string(value);
-			}
-			else {
-				int dotpos = arrayPosition.find_last_of(".");
-				std::string parentArrayPos = arrayPosition.substr(0, dotpos);
-				int value = atoi(arrayPosition.substr(dotpos+1).c_str());
-				value++;
-				arrayPosition = parentArrayPos + "." + std::to_string(value);
-			}
-			FarrayPosition = UTF8_TO_TCHAR(arrayPosition.c_str());
+			const std::size_t dotpos = arrayPosition.rfind('.');
+			const std::size_t start = dotpos == std::string::npos ? 0 : dotpos + 1;
+			const int value = atoi(arrayPosition.c_str() + start) + 1;
+			char digits[16];
+			const int length = std::snprintf(digits, sizeof(digits), "%d", value);
+			arrayPosition.erase(start);
+			arrayPosition.append(digits, length);
+			updateFArrayPosition();
 			//std::cout << "                      Incr.: " << arrayPosition;
 		}
 		void debugPrintArrayPosition() {
 			//std::cout << " \033[90m" << "(" << arrayPosition << ")\033[0m";
 		}
 
-		void debugvisitor(std::string debugmsg, bool closeArray = false) {
+		// Bytes of binary data and extension types, only copied if printed
+		struct printablebytes {
+			const char* data;
+			uint32_t size;
+		};
+		static void appendprintable(std::string& out, const char* part) { out += part; }
+		static void appendprintable(std::string& out, const std::string& part) { out += part; }
+		static void appendprintable(std::string& out, const printablebytes& part) { out.append(part.data, part.size); }
+		template <typename T>
+		static void appendprintable(std::string& out, T part) { out += std::to_string(part); }
+
+		template <typename... Parts>
+		void debugvisitor(const Parts&... parts) {
+			if (!printVisitedElements)
+				return;
+			std::string debugmsg;
+			(void)std::initializer_list<int>{ (appendprintable(debugmsg, parts), 0)... };
+			printvisitor(debugmsg, false);
+		}
+		void debugvisitorclosearray(const char* debugmsg) {
+			if (printVisitedElements)
+				printvisitor(debugmsg, true);
+		}
+		void printvisitor(std::string debugmsg, bool closeArray) {
 			debugmsg += "\033[0m";
 			//return; // to disable debug output
 			if (closeArray) {
@@ -595,8 +1305,8 @@ public:
 			debugvisitor(debugstr);*/
 			debugvisitor("\033[94mmap");
 			debugPrintArrayPosition();
-			if (visitorCallbacksCompletelySet) {
-				visitorCallbackStartOrEndOfMap.Execute(originalCommand, FfirstString, FarrayPosition, false);
+			if (callbacks.OnStartOrEndOfMap) {
+				callbacks.OnStartOrEndOfMap(originalCommand, FfirstString, FarrayPosition, false);
 			}
 			enterArray();
 			return true;
@@ -631,25 +1341,17 @@ public:
 		bool end_map() {
 			leaveArray();
 			//debugvisitor("end map.");
-			if (visitorCallbacksCompletelySet) {
-				visitorCallbackStartOrEndOfMap.Execute(originalCommand, FfirstString, FarrayPosition, true);
+			if (callbacks.OnStartOrEndOfMap) {
+				callbacks.OnStartOrEndOfMap(originalCommand, FfirstString, FarrayPosition, true);
 			}
 			return true;
 		}
 
 		bool start_array(uint32_t size) {
-			debugvisitor("\033[94marray (size " + std::to_string(size) + ")" +
-				(showArrayBrackets ? indent + "[" : ""));
+			debugvisitor("\033[94marray (size ", size, ")", showArrayBrackets ? "  [" : "");
 			debugPrintArrayPosition();
-			if (firstString == "TF STRUCTURE") {
-				if (depth == 1) { // initializations
-					tmpArrayLength = size; // storing number of layers
-					tmpCount = 0;
-					tmpX = 0; tmpY = 0; tmpZ = 0;
-				}
-			}
-			if (visitorCallbacksCompletelySet) {
-				visitorCallbackStartOrEndOfArray.Execute(originalCommand, FfirstString, FarrayPosition, false);
+			if (callbacks.OnStartOrEndOfArray) {
+				callbacks.OnStartOrEndOfArray(originalCommand, FfirstString, FarrayPosition, false);
 			}
 			enterArray();
 			return true;
@@ -665,22 +1367,10 @@ public:
 			return true;
 		}
 		bool end_array() {
-			if (firstString == "TF STRUCTURE") {
-				if (depth == 4) {
-					// finished dimensions array of layer # tmpCount
-					if (tmpX == 0) tmpX = 1;
-					if (tmpY == 0) tmpY = 1;
-					if (tmpZ == 0) tmpZ = 1;
-					createLayer(tmpCount, tmpX, tmpY, tmpZ, tmpStr);
-					tmpX = 0; tmpY = 0; tmpZ = 0;
-					tmpStr = "";
-					tmpCount++;
-				}
-			}
 			leaveArray();
-			debugvisitor("\033[94m]", true);
-			if (visitorCallbacksCompletelySet) {
-				visitorCallbackStartOrEndOfArray.Execute(originalCommand, FfirstString, FarrayPosition, true);
+			debugvisitorclosearray("\033[94m]");
+			if (callbacks.OnStartOrEndOfArray) {
+				callbacks.OnStartOrEndOfArray(originalCommand, FfirstString, FarrayPosition, true);
 			}
 			return true;
 		}
@@ -688,8 +1378,8 @@ public:
 		bool visit_nil() {
 			debugvisitor("\033[35mnil.");
 			debugPrintArrayPosition();
-			if (visitorCallbacksCompletelySet) {
-				visitorCallbackFoundAtomNil.Execute(originalCommand, FfirstString, FarrayPosition);
+			if (callbacks.OnNil) {
+				callbacks.OnNil(originalCommand, FfirstString, FarrayPosition);
 			}
 			return true;
 		}
@@ -699,215 +1389,526 @@ public:
 			else
 				debugvisitor("\033[91mfalse");
 			debugPrintArrayPosition();
-			if (visitorCallbacksCompletelySet) {
-				visitorCallbackFoundAtomBoolean.Execute(originalCommand, FfirstString, FarrayPosition, v);
+			if (callbacks.OnBoolean) {
+				callbacks.OnBoolean(originalCommand, FfirstString, FarrayPosition, v);
 			}
 			return true;
 		}
 		bool visit_positive_integer(uint64_t v) {
-			debugvisitor("int: \033[96m" + std::to_string(v));
-			if (firstString == "TF STRUCTURE") {
-				if (depth == 4) {
-					if (tmpX == 0) tmpX = v;
-					else if (tmpY == 0) tmpY = v;
-					else if (tmpZ == 0) tmpZ = v;
-					//else std::cout << "Too many dimensions! Value " << v << " of layer " << tmpCount << " cannot be visualized!";
-					else ;//print("Too many dimensions! Value " + std::string(v) + " of layer " + std::string(tmpCount) + " cannot be visualized!");
-				}
-			}
+			debugvisitor("int: \033[96m", v);
 			debugPrintArrayPosition();
-			if (visitorCallbacksCompletelySet) {
-				if (v-INT_MIN <= (uint64_t)INT_MAX-INT_MIN) {
-					visitorCallbackFoundAtomInteger.Execute(originalCommand, FfirstString, FarrayPosition, v);
-				} else {
-					visitorCallbackFoundAtomInteger64.Execute(originalCommand, FfirstString, FarrayPosition, v);
-				}
+			if (callbacks.OnInteger) {
+				callbacks.OnInteger(originalCommand, FfirstString, FarrayPosition, (int64)v);
 			}
 			return true;
 		}
 		bool visit_negative_integer(int64_t v) {
-			debugvisitor("neg int: \033[96m" + std::to_string(v));
+			debugvisitor("neg int: \033[96m", v);
 			debugPrintArrayPosition();
-			if (visitorCallbacksCompletelySet) {
-				if (v >= INT_MIN && v <= INT_MAX) {
-					visitorCallbackFoundAtomInteger.Execute(originalCommand, FfirstString, FarrayPosition, v);
-				} else {
-					visitorCallbackFoundAtomInteger64.Execute(originalCommand, FfirstString, FarrayPosition, v);
-				}
+			if (callbacks.OnInteger) {
+				callbacks.OnInteger(originalCommand, FfirstString, FarrayPosition, v);
 			}
 			return true;
 		}
+		void addLayoutCoordinate(double v) {
+			// x and y alternate within each [x, y] pair
+			if (arrayPosition.back() == '0') {
+				layoutPositions.Emplace((float)v, 0.f);
+			} else if (layoutPositions.Num() > 0) {
+				layoutPositions.Last().Y = (float)v;
+			}
+		}
 		bool visit_float32(float v) {
-			debugvisitor("float: \033[92m" + std::to_string(v));
+			debugvisitor("float: \033[92m", v);
 			debugPrintArrayPosition();
-			if (visitorCallbacksCompletelySet) {
-				visitorCallbackFoundAtomFloat.Execute(originalCommand, FfirstString, FarrayPosition, v);
+			if (callbacks.OnFloat) {
+				callbacks.OnFloat(originalCommand, FfirstString, FarrayPosition, v);
 			}
 			return true;
 		}
 		bool visit_float64(double v) {
-			debugvisitor("double: \033[92m" + std::to_string(v));
+			debugvisitor("double: \033[92m", v);
 			debugPrintArrayPosition();
-			if (visitorCallbacksCompletelySet) {
-				visitorCallbackFoundAtomFloat.Execute(originalCommand, FfirstString, FarrayPosition, v);
+			if (callbacks.OnFloat) {
+				callbacks.OnFloat(originalCommand, FfirstString, FarrayPosition, v);
 			}
 			return true;
 		}
 		bool visit_str(const char* v, uint32_t size) {
-			debugvisitor("\"\033[95m" + std::string(v, size) + "\033[0m\"");
-			if (firstString == "" && depth == 1 && arrayPosition == "0") {
-				firstString = std::string(v, size);
-				FfirstString = UTF8_TO_TCHAR(firstString.c_str());
-			} else if (firstString == "TF STRUCTURE") {
-				if (depth == 3) {
-					if (tmpStr == "")
-						tmpStr = std::string(v, size);
-				}
-			}
+			debugvisitor("\"\033[95m", printablebytes{ v, size }, "\033[0m\"");
 			debugPrintArrayPosition();
-			if (visitorCallbackSet) {
-				FString output(v);
-				visitorCallback.Execute(output);
-			}
-			if (visitorCallbacksCompletelySet) {
-				FString output(size, v);
-				visitorCallbackFoundAtomString.Execute(originalCommand, FfirstString, FarrayPosition, output);
+			if (callbacks.OnString) {
+				callbacks.OnString(originalCommand, FfirstString, FarrayPosition, TArrayView<const uint8>((const uint8*)v, size));
 			}
 			return true;
 		}
 		bool visit_bin(const char* data, uint32_t size) {
-			std::string sdata(data, size);
-			debugvisitor("binary: \033[93m" + sdata);
+			debugvisitor("binary: \033[93m", printablebytes{ data, size });
 			debugPrintArrayPosition();
-			if (visitorCallbacksCompletelySet) {
-				FString output(size, data);
-				visitorCallbackFoundAtomBinary.Execute(originalCommand, FfirstString, FarrayPosition, output);
+			if (callbacks.OnBinary) {
+				callbacks.OnBinary(originalCommand, FfirstString, FarrayPosition, TArrayView<const uint8>((const uint8*)data, size));
 			}
 			return true;
 		}
-		bool visit_ext(const char* data, uint32_t size) {
-			std::string sdata(data, size);
-			debugvisitor("ext: \033[33m" + sdata);
+		// The handler of the message type gets the payload as handleBinary or handleExtension
+		template <typename Handler>
+		bool visit_ext(Handler& handler, const char* data, uint32_t size) {
+			debugvisitor("ext: \033[33m", printablebytes{ data, size });
 			debugPrintArrayPosition();
-			if (visitorCallbacksCompletelySet) {
-				FString output(size, data);
-				visitorCallbackFoundAtomExternal.Execute(originalCommand, FfirstString, FarrayPosition, output);
+			// The first byte is the extension type. Payloads in shared memory are handled
+			// like the binary data or extension type they replace, see FNeuralSharedMemory
+			if (size > 0 && data[0] == FNeuralSharedMemory::ExtensionType && depth == 1) {
+				FNeuralSharedMemoryRegionPtr region = FNeuralSharedMemory::Get().Resolve(serverSharedMemoryPath, (const uint8*)data + 1, size - 1);
+				if (region.IsValid() && region->GetInnerType() == 0) {
+					handler.handleBinary(region->GetView().GetData(), region->GetView().Num());
+				} else if (region.IsValid()) {
+					handler.handleExtension(region->GetInnerType(), region->GetView().GetData(), region->GetView().Num(), region);
+				} else if (callbacks.OnParseError) {
+					// The payload is lost, e.g. the server wrote another file than the one announced
+					callbacks.OnParseError(originalCommand, FfirstString, FarrayPosition, false);
+				}
+			} else if (size > 0) {
+				handler.handleExtension(data[0], (const uint8*)data + 1, size - 1, nullptr);
+			}
+			if (callbacks.OnExtension) {
+				callbacks.OnExtension(originalCommand, FfirstString, FarrayPosition, TArrayView<const uint8>((const uint8*)data, size));
+			}
+			return true;
+		}
+		// Arrays of numbers can be passed as a whole, unless the element callbacks need every number
+		bool accepts_numeric_array() const {
+			return !callbacks.OnFloat && !callbacks.OnInteger && !callbacks.OnStartOrEndOfArray;
+		}
+		bool visit_numeric_array(const TArray<float>& values) {
+			debugvisitor("numbers: \033[92m", values.Num());
+			debugPrintArrayPosition();
+			if (callbacks.OnFloatArray) {
+				callbacks.OnFloatArray(originalCommand, FfirstString, FarrayPosition, values);
 			}
 			return true;
 		}
-
 		void parse_error(size_t x, size_t y) {
 			debugvisitor("\033[31m\033[7mPARSE ERROR!");
 			debugPrintArrayPosition();
-			if (visitorCallbacksCompletelySet) {
-				visitorCallbackParseError.Execute(originalCommand, FfirstString, FarrayPosition, false);
+			if (callbacks.OnParseError) {
+				callbacks.OnParseError(originalCommand, FfirstString, FarrayPosition, false);
 			}
 		}
 		void insufficient_bytes(size_t x, size_t y) {
 			debugvisitor("\033[31m\033[7mINSUFFICIENT BYTES!");
 			debugPrintArrayPosition();
-			if (visitorCallbacksCompletelySet) {
-				visitorCallbackParseError.Execute(originalCommand, FfirstString, FarrayPosition, true);
+			if (callbacks.OnParseError) {
+				callbacks.OnParseError(originalCommand, FfirstString, FarrayPosition, true);
 			}
 		}
 	};
-};
 
-int connect_to_websocket_server(
-	char* text = _strdup("help"),
-	char* host = _strdup("localhost"),
-	char* port = _strdup("80"),
-	bool interactive = false
-) {
-	//std::cout << "\n\nConnecting to execute command " << text << "\n";
-	//print("\n\nConnecting to execute command " + text);
+	// Parses a message with the given tag. What is specific to the type of the message is selected
+	// at compile time, so that no element is compared with the tag while parsing. Everything else,
+	// the position within the message and the element callbacks, is left to msgpack_visitor.
+	// Types without native handling only go to the element callbacks
+	template <message_tag Tag>
+	struct message_handler : msgpack::null_visitor {
+		msgpack_visitor& visitor;
 
-	std::string arguments;
-	while (true) {
-		// The io_context is required for all I/O
-		net::io_context ioc;
-		// Launch the asynchronous operation
-		std::make_shared<session>(ioc)->run(host, port, text);
+		explicit message_handler(msgpack_visitor& inVisitor) : visitor(inVisitor) {}
 
-		// Run the I/O service. The call will return when
-		// the socket is closed.
-		ioc.run();
-		
-		if (!interactive)
-			return EXIT_SUCCESS;
+		// ["STATUS", level, text] and ["DEBUG", level, text]
+		static constexpr bool isConsoleMessage = Tag == message_tag::status || Tag == message_tag::debug;
 
-		// Do it all again with user input
-		/*std::cout << "\nClient inactive>";
-		getline(std::cin, arguments);
-		text = &arguments[0];*/
-		print("Waiting for new user input.\n");
-		//text = "console";
-		text = "help";
+		// Responses whose numbers are handled one by one, see visit_float
+		static constexpr bool hasNumericElements =
+			Tag == message_tag::tf_structure || Tag == message_tag::tf_layout || Tag == message_tag::spawn_image;
 
-		// If user doesn't specify input, terminate interactive loop
-		/*if (arguments.length() == 0)
-			return EXIT_SUCCESS;*/
-		/*bool QUIT = true;
-		if (QUIT == true)
-			return EXIT_SUCCESS;*/
-	}
-}
+		// Messages for FNeuralInteractionEvents::HasSceneListeners, ignored natively while nobody listens
+		static constexpr bool isSceneMessage = Tag == message_tag::spawn_cuboid ||
+			Tag == message_tag::spawn_cuboid_batch || Tag == message_tag::spawn_connections || Tag == message_tag::scene_redraw;
 
-int connect_to_websocket_serverAdvanced(
-	const FReadResponse& Callback,
-	char* text = _strdup("help"),
-	char* host = _strdup("localhost"),
-	char* port = _strdup("80"),
-	bool interactive = false
-) {
-	//std::cout << "\n\nConnecting to execute command " << text << "\n";
-	//print("\n\nConnecting to execute command " + text);
+		// Depth of the array of a single cuboid, a whole message or an element of a batch
+		static constexpr int cuboidDepth = Tag == message_tag::spawn_cuboid ? 1 : 3;
 
-	std::string arguments;
-	while (true) {
+		// ["TAG", second, ...]
+		bool isSecondElement() const { return visitor.depth == 1 && visitor.arrayPosition == "1"; }
+
+		// Numbers of ["SPAWN CONNECTIONS", style, edges], one by one or as numeric array
+		void addConnectionValue(double v) {
+			if (!visitor.sceneListeners || visitor.depth != 2) {
+				return;
+			}
+			if (visitor.arrayPosition[0] == '1') {
+				visitor.connectionStyle.Add((float)v);
+			} else if (visitor.arrayPosition[0] == '2') {
+				visitor.connectionEdges.Add((int32)v);
+			}
+		}
+
+		// Whether the current element is the third one of its array, e.g. "2" or "1.5.2"
+		bool isThirdOfArray() const {
+			const std::string& position = visitor.arrayPosition;
+			return !position.empty() && position.back() == '2' &&
+				(position.size() == 1 || position[position.size() - 2] == '.');
+		}
+
+		bool start_map(uint32_t num_kv_pairs) { return visitor.start_map(num_kv_pairs); }
+		bool start_map_key() { return visitor.start_map_key(); }
+		bool end_map_key() { return visitor.end_map_key(); }
+		bool start_map_value() { return visitor.start_map_value(); }
+		bool end_map_value() { return visitor.end_map_value(); }
+		bool end_map() { return visitor.end_map(); }
+
+		bool start_array(uint32_t size) {
+			if constexpr (Tag == message_tag::spawn_cuboid || Tag == message_tag::spawn_cuboid_batch) {
+				if (visitor.sceneListeners && visitor.depth == cuboidDepth - 1) {
+					visitor.cuboids.AddDefaulted();
+				}
+			}
+			if constexpr (Tag == message_tag::tf_structure) {
+				if (visitor.depth == 1) { // array of all layers
+					visitor.layerGraphBuilder.Reset(size);
+				} else if (visitor.depth == 2) { // array of one layer
+					visitor.layerGraphBuilder.BeginLayer();
+					visitor.layerField = -1;
+				}
+			}
+			return visitor.start_array(size);
+		}
+		bool start_array_item() {
+			if constexpr (Tag == message_tag::tf_structure) {
+				if (visitor.depth == 3) {
+					visitor.layerField++;
+				}
+			}
+			return visitor.start_array_item();
+		}
+		bool end_array_item() { return visitor.end_array_item(); }
+		bool end_array() {
+			if constexpr (Tag == message_tag::tf_structure) {
+				if (visitor.depth == 3) { // finished one layer
+					visitor.layerGraphBuilder.EndLayer();
+				} else if (visitor.depth == 2) { // finished all layers
+					TSharedPtr<const FNeuralLayerGraph, ESPMode::ThreadSafe> graph = visitor.layerGraphBuilder.Build();
+					if (visitor.modelContext) {
+						visitor.modelContext->SetLayerGraph(graph);
+					}
+					FNeuralLayerGraph::SetCurrent(graph);
+					if (visitor.callbacks.OnLayerGraph) {
+						visitor.callbacks.OnLayerGraph(graph);
+					}
+				}
+			} else if constexpr (Tag == message_tag::tf_layout) {
+				if (visitor.depth == 2) { // finished all positions
+					FNeuralLayoutCache::StorePositions(visitor.layoutKey, visitor.layoutPositions);
+					FNeuralLayoutCache::SetLastLayoutKey(visitor.layoutKey);
+					if (visitor.modelContext) {
+						visitor.modelContext->SetLayoutKey(visitor.layoutKey);
+					}
+					if (visitor.callbacks.OnLayout) {
+						visitor.callbacks.OnLayout(visitor.layoutKey, visitor.layoutPositions);
+					}
+				}
+			} else if constexpr (Tag == message_tag::spawn_cuboid || Tag == message_tag::spawn_cuboid_batch) {
+				if (visitor.depth == 1 && visitor.cuboids.Num() > 0) {
+					FNeuralInteractionEvents::BroadcastCuboidsSpawned(visitor.originalCommand, visitor.cuboids);
+				}
+			} else if constexpr (Tag == message_tag::spawn_connections) {
+				if (visitor.depth == 1 && visitor.sceneListeners) {
+					FNeuralInteractionEvents::BroadcastConnectionsSpawned(visitor.originalCommand,
+						visitor.connectionStyle, visitor.connectionEdges);
+				}
+			} else if constexpr (Tag == message_tag::scene_redraw) {
+				if (visitor.depth == 1 && visitor.sceneListeners) {
+					FNeuralInteractionEvents::BroadcastSceneRedraw(visitor.originalCommand, visitor.redrawBegins, visitor.redrawScopes);
+				}
+			} else if constexpr (Tag == message_tag::spawn_image) {
+				if (visitor.depth == 2) {
+					FNeuralInteractionEvents::BroadcastImageSpawned(visitor.originalCommand, visitor.imagePath, visitor.imageValues);
+					FTransform transform;
+					if (visitor.callbacks.OnImageSpawned && FNeuralInteractionEvents::GetImageTransform(visitor.imageValues, transform)) {
+						visitor.callbacks.OnImageSpawned(visitor.imagePath, transform);
+					}
+				}
+			}
+			return visitor.end_array();
+		}
+
+		bool visit_nil() { return visitor.visit_nil(); }
+		bool visit_boolean(bool v) { return visitor.visit_boolean(v); }
+		bool visit_positive_integer(uint64_t v) {
+			if constexpr (isConsoleMessage) {
+				if (isSecondElement()) {
+					visitor.consoleLevel = (int)v;
+				}
+			} else if constexpr (Tag == message_tag::spawn_connections) {
+				addConnectionValue((double)v);
+			} else if constexpr (Tag == message_tag::tf_structure) {
+				if (visitor.layerField == 2 && visitor.depth >= 4) { // shape, possibly nested for multiple outputs
+					visitor.layerGraphBuilder.AddDimension(v);
+				} else if (visitor.layerField == 3 && visitor.depth == 3) {
+					visitor.layerGraphBuilder.SetParameterCount(v);
+				}
+			}
+			return visitor.visit_positive_integer(v);
+		}
+		bool visit_negative_integer(int64_t v) {
+			if constexpr (isConsoleMessage) {
+				if (isSecondElement()) {
+					visitor.consoleLevel = (int)v;
+				}
+			}
+			return visitor.visit_negative_integer(v);
+		}
+		void visit_float(double v) {
+			if constexpr (Tag == message_tag::tf_layout) {
+				if (visitor.depth == 3) {
+					visitor.addLayoutCoordinate(v);
+				}
+			} else if constexpr (Tag == message_tag::spawn_image) {
+				if (visitor.depth == 2) {
+					visitor.imageValues.Add((float)v);
+				}
+			} else if constexpr (Tag == message_tag::spawn_cuboid || Tag == message_tag::spawn_cuboid_batch) {
+				if (visitor.depth == cuboidDepth + 1 && visitor.cuboids.Num() > 0) {
+					visitor.cuboids.Last().Properties.Add((float)v);
+				}
+			} else if constexpr (Tag == message_tag::spawn_connections) {
+				addConnectionValue(v);
+			}
+		}
+		bool visit_float32(float v) {
+			visit_float(v);
+			return visitor.visit_float32(v);
+		}
+		bool visit_float64(double v) {
+			visit_float(v);
+			return visitor.visit_float64(v);
+		}
+		bool visit_str(const char* v, uint32_t size) {
+			if constexpr (isConsoleMessage) {
+				if (visitor.depth == 1 && visitor.arrayPosition == "2") {
+					FNeuralConsole::Get().AddMessage(Tag == message_tag::status ? ENeuralConsoleLineKind::Status : ENeuralConsoleLineKind::Debug,
+						visitor.consoleLevel, visitor.originalCommand, v, size);
+					const auto& callback = Tag == message_tag::status ? visitor.callbacks.OnStatus : visitor.callbacks.OnDebug;
+					if (callback) {
+						FUTF8ToTCHAR text(v, size);
+						callback(visitor.consoleLevel, FString(text.Length(), text.Get()));
+					}
+				}
+			} else if constexpr (Tag == message_tag::model_epoch) {
+				if (isSecondElement()) {
+					msgpack_visitor::assignUtf8(visitor.modelEpoch, v, size);
+				}
+			} else if constexpr (Tag == message_tag::file || Tag == message_tag::file_ref) {
+				if (isSecondElement()) {
+					msgpack_visitor::assignUtf8(visitor.fileName, v, size);
+				} else if (Tag == message_tag::file_ref && visitor.depth == 1 && visitor.arrayPosition == "2") {
+					FUTF8ToTCHAR hash(v, size);
+					visitor.fileReferences.Emplace(visitor.fileName, FString(hash.Length(), hash.Get()));
+				}
+			} else if constexpr (Tag == message_tag::tensor || Tag == message_tag::tensor_frame) {
+				if (isSecondElement()) {
+					msgpack_visitor::assignUtf8(visitor.tensorName, v, size);
+				}
+			} else if constexpr (Tag == message_tag::spawn_image) {
+				if (visitor.depth == 2 && visitor.arrayPosition == "1.0") {
+					msgpack_visitor::assignUtf8(visitor.imagePath, v, size);
+				}
+			} else if constexpr (Tag == message_tag::spawn_cuboid || Tag == message_tag::spawn_cuboid_batch) {
+				if (visitor.depth == cuboidDepth && visitor.cuboids.Num() > 0 && isThirdOfArray()) {
+					msgpack_visitor::assignUtf8(visitor.cuboids.Last().Identity, v, size);
+				}
+			} else if constexpr (Tag == message_tag::scene_redraw) {
+				if (isSecondElement()) {
+					visitor.redrawBegins = size == 5 && std::memcmp(v, "begin", 5) == 0;
+				} else if (visitor.sceneListeners && (visitor.depth == 2 || (visitor.depth == 1 && isThirdOfArray()))) {
+					FUTF8ToTCHAR scope(v, size);
+					visitor.redrawScopes.Emplace(scope.Length(), scope.Get());
+				}
+			} else if constexpr (Tag == message_tag::tf_layout) {
+				if (isSecondElement()) {
+					msgpack_visitor::assignUtf8(visitor.layoutKey, v, size);
+				}
+			} else if constexpr (Tag == message_tag::tf_structure) {
+				if (visitor.depth == 3 && visitor.layerField == 0) {
+					visitor.layerGraphBuilder.SetName(v, size);
+				} else if (visitor.depth == 3 && visitor.layerField == 1) {
+					visitor.layerGraphBuilder.SetType(v, size);
+				} else if (visitor.depth == 4 && visitor.layerField == 4) {
+					visitor.layerGraphBuilder.AddParentName(v, size);
+				}
+			}
+			return visitor.visit_str(v, size);
+		}
+		bool visit_bin(const char* data, uint32_t size) {
+			handleBinary((const uint8*)data, size);
+			return visitor.visit_bin(data, size);
+		}
+		bool visit_ext(const char* data, uint32_t size) {
+			return visitor.visit_ext(*this, data, size);
+		}
+		bool accepts_numeric_array() const {
+			return !hasNumericElements && visitor.accepts_numeric_array();
+		}
+		bool visit_numeric_array(const TArray<float>& values) {
+			if constexpr (Tag == message_tag::spawn_cuboid || Tag == message_tag::spawn_cuboid_batch) {
+				// Reported in place of the array, so at the depth of the cuboid
+				if (visitor.depth == cuboidDepth && visitor.cuboids.Num() > 0) {
+					visitor.cuboids.Last().Properties.Append(values);
+				}
+			} else if constexpr (Tag == message_tag::spawn_connections) {
+				// Large edge lists, reported at the position of the array within the message
+				if (visitor.sceneListeners && visitor.depth == 1 && visitor.arrayPosition == "2") {
+					for (float value : values) {
+						visitor.connectionEdges.Add((int32)value);
+					}
+				} else if (visitor.sceneListeners && visitor.depth == 1 && visitor.arrayPosition == "1") {
+					visitor.connectionStyle.Append(values);
+				}
+			}
+			return visitor.visit_numeric_array(values);
+		}
+
+		void handleBinary(const uint8* data, uint32_t size) {
+			if constexpr (Tag == message_tag::file) {
+				if (visitor.depth == 1) {
+					FNeuralTextureCache::Get().StoreFile(visitor.fileName, FNeuralTextureCache::HashContent(data, size), data, size);
+					if (visitor.callbacks.OnFile) {
+						visitor.callbacks.OnFile(visitor.fileName, TArrayView<const uint8>(data, size));
+					}
+					if (FNeuralInteractionEvents::HasFileListeners()) {
+						FNeuralInteractionEvents::BroadcastFileReceived(visitor.originalCommand, visitor.fileName, TArray<uint8>(data, size));
+					}
+				}
+			}
+		}
+		// region is set if the payload is in shared memory
+		void handleExtension(int8 type, const uint8* payload, uint32_t size, const FNeuralSharedMemoryRegionPtr& region) {
+			if constexpr (Tag == message_tag::tensor) {
+				if (visitor.depth == 1 && type == FNeuralTensor::ExtensionType && (visitor.callbacks.OnTensor || FNeuralInteractionEvents::HasTensorListeners())) {
+					FNeuralTensor tensor;
+					tensor.Name = visitor.tensorName;
+					if (region.IsValid() ? FNeuralTensor::Parse(region, tensor) : FNeuralTensor::Parse(payload, size, tensor)) {
+						receiveTensor(tensor);
+					}
+				}
+			} else if constexpr (Tag == message_tag::tensor_frame) {
+				// Frames are always applied, even without listeners, so that the stream stays in sync.
+				// The listeners get the values of the stream itself, the next frame is applied to them
+				if (visitor.depth == 1 && type == FNeuralTensorStreams::ExtensionType) {
+					FNeuralTensorStreams& streams = visitor.modelContext ? visitor.modelContext->GetTensorStreams() : FNeuralTensorStreams::Get();
+					streams.ApplyFrame(visitor.tensorName, payload, size, [this](const FNeuralTensor& tensor)
+					{
+						receiveTensor(tensor);
+					});
+				}
+			}
+		}
+		void receiveTensor(const FNeuralTensor& tensor) {
+			if (visitor.callbacks.OnTensor) {
+				visitor.callbacks.OnTensor(tensor);
+			}
+			if (FNeuralInteractionEvents::HasTensorListeners()) {
+				FNeuralInteractionEvents::BroadcastTensorReceived(visitor.originalCommand, tensor);
+			}
+		}
+
+		void parse_error(size_t x, size_t y) { visitor.parse_error(x, y); }
+		void insufficient_bytes(size_t x, size_t y) { visitor.insufficient_bytes(x, y); }
+	};
+
+private:
+	msgpack_visitor visitor_;
+	bool visitorConfigured_ = false;
+};
+
+// Runs a session per attempt until one does not request a retry, waiting with exponential backoff
+// in between. Commands executed on the game thread are never retried, as waiting would block it.
+// Messages delivered by an attempt are skipped by the following ones, see set_skipped_messages.
+// start launches the asynchronous operation of the session.
+// The command is registered in FNeuralCommandRegistry meanwhile, so that it can be cancelled,
+// unless a registered handle is passed. Returns whether the last session closed gracefully
+template <typename StartSession>
+bool run_with_reconnect(char const* text, StartSession start, FNeuralCommandHandle handle = FNeuralCommandHandle())
+{
+	FNeuralCommandRegistry& registry = FNeuralCommandRegistry::Get();
+	if (!handle.IsValid())
+		handle = registry.Register(UTF8_TO_TCHAR(text));
+	bool closedGracefully = false;
+	int deliveredMessages = 0;
+	for (int attempt = 0; ; attempt++) {
 		// The io_context is required for all I/O
 		net::io_context ioc;
-		// Launch the asynchronous operation
-		std::make_shared<session>(ioc)->runAdvanced(Callback, host, port, text);
+		std::shared_ptr<session> s = std::make_shared<session>(ioc, attempt);
+		s->set_may_retry(!IsInGameThread());
+		s->set_skipped_messages(deliveredMessages);
+		std::weak_ptr<session> weak = s;
+		registry.SetCanceller(handle, [weak]() {
+			if (std::shared_ptr<session> self = weak.lock())
+				self->post_cancel();
+		});
+		start(*s);
+		// Cancelled before the canceller was set, e.g. while waiting for the reconnect
+		if (registry.IsCancelled(handle))
+			s->post_cancel();
 
 		// Run the I/O service. The call will return when
 		// the socket is closed.
 		ioc.run();
-		
-		if (!interactive)
-			return EXIT_SUCCESS;
+		// Waits for a running canceller, nothing is posted to the io_context afterwards
+		registry.SetCanceller(handle, nullptr);
+		closedGracefully = s->closed_gracefully();
+		deliveredMessages = FMath::Max(deliveredMessages, s->received_messages());
+
+		if (!s->retry_requested() || IsEngineExitRequested()) {
+			s->fetch_missing_files();
+			break;
+		}
+		FPlatformProcess::Sleep(GetDefault<UNeuralInteractionClientSettings>()->GetReconnectDelay(attempt));
+		if (registry.IsCancelled(handle)) {
+			s->notify_cancelled();
+			break;
+		}
+	}
+	registry.Unregister(handle);
+	return closedGracefully;
+}
 
-		// Do it all again with user input
-		/*std::cout << "\nClient inactive>";
-		getline(std::cin, arguments);
-		text = &arguments[0];*/
-		print("Waiting for new user input.\n");
-		//text = "console";
-		text = "help";
+// Server a command is sent to, see FNeuralEndpointRouter. Keeps the strings the session is started
+// with and counts the command as running on the server for as long as it exists
+struct routed_command
+{
+	FNeuralRoute route;
+	std::string text;
+	std::string host;
+	std::string port;
+
+	explicit routed_command(const FString& command)
+		: route(FNeuralEndpointRouter::Get().Acquire(command))
+		, text(TCHAR_TO_UTF8(*route.Command))
+		, host(TCHAR_TO_UTF8(*route.Endpoint.Host))
+		, port(std::to_string(route.Endpoint.Port))
+	{
+	}
 
-		// If user doesn't specify input, terminate interactive loop
-		/*if (arguments.length() == 0)
-			return EXIT_SUCCESS;*/
-		/*bool QUIT = true;
-		if (QUIT == true)
-			return EXIT_SUCCESS;*/
+	routed_command(const routed_command&) = delete;
+	routed_command& operator=(const routed_command&) = delete;
+
+	~routed_command()
+	{
+		FNeuralEndpointRouter::Get().Release(route);
 	}
+};
+
+bool ExecuteNeuralCommand(const FNeuralCommandHandle& Handle, ENeuralCommandPriority Priority,
+	const FNeuralResponseCallbacks& Callbacks)
+{
+	routed_command routed(Handle.Command);
+	return run_with_reconnect(routed.text.c_str(), [&](session& s) {
+		s.set_priority(Priority);
+		s.runWithCallbacks(Callbacks, routed.host.c_str(), routed.port.c_str(), routed.text.c_str());
+	}, Handle);
 }
 
-int connect_to_websocket_serverWithAllDelegates(
-	const FEndOfConnection& CallbackEndOfConnection,
-	const FStartOrEndOfResponse& CallbackStartOrEndOfResponse,
-	const FParseError& CallbackParseError,
-	const FStartOrEndOfMap& CallbackStartOrEndOfMap,
-	const FStartOrEndOfArray& CallbackStartOrEndOfArray,
-	const FFoundAtomNil& CallbackFoundAtomNil,
-	const FFoundAtomString& CallbackFoundAtomString,
-	const FFoundAtomBinary& CallbackFoundAtomBinary,
-	const FFoundAtomExternal& CallbackFoundAtomExternal,
-	const FFoundAtomBoolean& CallbackFoundAtomBoolean,
-	const FFoundAtomInteger& CallbackFoundAtomInteger,
-	const FFoundAtomInteger64& CallbackFoundAtomInteger64,
-	const FFoundAtomFloat& CallbackFoundAtomFloat,
+int connect_to_websocket_server(
 	char* text = _strdup("help"),
 	char* host = _strdup("localhost"),
 	char* port = _strdup("80"),
@@ -918,28 +1919,10 @@ int connect_to_websocket_serverWithAllDelegates(
 
 	std::string arguments;
 	while (true) {
-		// The io_context is required for all I/O
-		net::io_context ioc;
 		// Launch the asynchronous operation
-		std::make_shared<session>(ioc)->runWithAllDelegates(
-			CallbackEndOfConnection,
-			CallbackStartOrEndOfResponse,
-			CallbackParseError,
-			CallbackStartOrEndOfMap,
-			CallbackStartOrEndOfArray,
-			CallbackFoundAtomNil,
-			CallbackFoundAtomString,
-			CallbackFoundAtomBinary,
-			CallbackFoundAtomExternal,
-			CallbackFoundAtomBoolean,
-			CallbackFoundAtomInteger,
-			CallbackFoundAtomInteger64,
-			CallbackFoundAtomFloat,
-			host, port, text);
-
-		// Run the I/O service. The call will return when
-		// the socket is closed.
-		ioc.run();
+		run_with_reconnect(text, [&](session& s) {
+			s.run(host, port, text);
+		});
 		
 		if (!interactive)
 			return EXIT_SUCCESS;
@@ -1022,6 +2005,7 @@ public:
 		const FFoundAtomInteger64& CallbackFoundAtomInteger64,
 		const FFoundAtomFloat& CallbackFoundAtomFloat
 	);
+	virtual bool ExecuteCommand(const FString& Command, const FNeuralResponseCallbacks& Callbacks) override;
 
 private:
 	;
@@ -1032,14 +2016,8 @@ IMPLEMENT_MODULE(FNeuralInteractionClient, NeuralInteractionClient)
 //int FNeuralInteractionClient::LoadClient() {
 int FNeuralInteractionClient::LoadClient(FString command) {
 	UE_LOG(NeuralInteractionClient, Log, TEXT("Loading client."));
-	char* host;
-	char* port;
-	char* text;
-	host = _strdup("localhost");
-	port = _strdup("80");
-	//text = _strdup("console");
-	text = TCHAR_TO_ANSI(*command);
-	connect_to_websocket_server(text, host, port, false);
+	routed_command routed(command);
+	connect_to_websocket_server(&routed.text[0], &routed.host[0], &routed.port[0], false);
 
 	int returnValue = 1;
 	return returnValue;
@@ -1062,14 +2040,7 @@ int FNeuralInteractionClient::LoadClientWithAllDelegates(FString command,
 	const FFoundAtomFloat& CallbackFoundAtomFloat
 ) {
 	UE_LOG(NeuralInteractionClient, Log, TEXT("Loading full delegate client."));
-	char* host;
-	char* port;
-	char* text;
-	host = _strdup("localhost");
-	port = _strdup("80");
-	//text = _strdup("console");
-	text = TCHAR_TO_ANSI(*command);
-	connect_to_websocket_serverWithAllDelegates(
+	ExecuteCommand(command, FNeuralResponseCallbacks::FromDelegates(
 		CallbackEndOfConnection,
 		CallbackStartOrEndOfResponse,
 		CallbackParseError,
@@ -1082,8 +2053,7 @@ int FNeuralInteractionClient::LoadClientWithAllDelegates(FString command,
 		CallbackFoundAtomBoolean,
 		CallbackFoundAtomInteger,
 		CallbackFoundAtomInteger64,
-		CallbackFoundAtomFloat,
-		text, host, port, false);
+		CallbackFoundAtomFloat));
 
 	int returnValue = 1;
 	return returnValue;
@@ -1092,19 +2062,19 @@ int FNeuralInteractionClient::LoadClientWithAllDelegates(FString command,
 //int FNeuralInteractionClient::LoadClient() {
 int FNeuralInteractionClient::LoadClientAdvanced(FString command, const FReadResponse& Callback) {
 	UE_LOG(NeuralInteractionClient, Log, TEXT("Loading advanced client."));
-	char* host;
-	char* port;
-	char* text;
-	host = _strdup("localhost");
-	port = _strdup("80");
-	//text = _strdup("console");
-	text = TCHAR_TO_ANSI(*command);
-	connect_to_websocket_serverAdvanced(Callback, text, host, port, false);
+	ExecuteCommand(command, FNeuralResponseCallbacks::FromDelegate(Callback));
 
 	int returnValue = 1;
 	return returnValue;
 }
 
+bool FNeuralInteractionClient::ExecuteCommand(const FString& Command, const FNeuralResponseCallbacks& Callbacks) {
+	routed_command routed(Command);
+	return run_with_reconnect(routed.text.c_str(), [&](session& s) {
+		s.runWithCallbacks(Callbacks, routed.host.c_str(), routed.port.c_str(), routed.text.c_str());
+	});
+}
+
 void FNeuralInteractionClient::StartupModule()
 {
 	// This code will execute after your module is loaded into memory; the exact timing is specified in the .uplugin file per-module
@@ -0,0 +1,117 @@
+/*
+This file NeuralInteractionClientSettings.cpp is part of NeuralVisUAL.
+
+NeuralVisUAL is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+NeuralVisUAL is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with NeuralVisUAL.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "NeuralInteractionClientSettings.h"
+#include "HAL/PlatformProcess.h"
+#include "Misc/Paths.h"
+
+namespace
+{
+	// Like portSpecificName in serverSettings.py, in the same directory as tempfile.gettempdir() of the server
+	FString GetDefaultPath(const TCHAR* Extension, int32 Port)
+	{
+		const FString Name = Port == 80 ? FString(TEXT("NeuralVisUAL")) : FString::Printf(TEXT("NeuralVisUAL-%d"), Port);
+		return FPaths::Combine(FPlatformProcess::UserTempDir(), Name + Extension);
+	}
+}
+
+FString UNeuralInteractionClientSettings::GetLocalSocketPath(int32 Port) const
+{
+	if (!LocalSocketPath.IsEmpty()) {
+		return LocalSocketPath;
+	}
+	return GetDefaultPath(TEXT(".sock"), Port);
+}
+
+FString UNeuralInteractionClientSettings::GetSharedMemoryPath(int32 Port) const
+{
+	const FString Path = SharedMemoryPath.IsEmpty() ? GetDefaultPath(TEXT(".shm"), Port) : SharedMemoryPath;
+	// The server compares it with its own path
+	return FPaths::ConvertRelativePathToFull(Path);
+}
+
+FString UNeuralInteractionClientSettings::NormalizeCommand(const FString& Command)
+{
+	FString Normalized = Command.ToLower();
+	Normalized.ReplaceInline(TEXT(" "), TEXT(""));
+	Normalized.ReplaceInline(TEXT("\t"), TEXT(""));
+	return Normalized;
+}
+
+bool UNeuralInteractionClientSettings::MatchesAnyPrefix(const FString& Command, const TArray<FString>& Prefixes)
+{
+	const FString Normalized = NormalizeCommand(Command);
+	return Prefixes.ContainsByPredicate([&](const FString& Prefix) {
+		return Normalized.StartsWith(NormalizeCommand(Prefix));
+	});
+}
+
+bool UNeuralInteractionClientSettings::IsIdempotentCommand(const FString& Command) const
+{
+	TArray<FString> Parts;
+	Command.ParseIntoArray(Parts, TEXT("&"));
+	if (Parts.Num() == 0) {
+		return false;
+	}
+	for (const FString& Part : Parts) {
+		if (!MatchesAnyPrefix(Part, IdempotentCommands)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+bool UNeuralInteractionClientSettings::IsStatelessCommand(const FString& Command) const
+{
+	TArray<FString> Parts;
+	Command.ParseIntoArray(Parts, TEXT("&"));
+	if (Parts.Num() == 0) {
+		return false;
+	}
+	for (const FString& Part : Parts) {
+		if (!MatchesAnyPrefix(Part, StatelessCommands)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+ENeuralCommandPriority UNeuralInteractionClientSettings::GetCommandPriority(const FString& Command) const
+{
+	TArray<FString> Parts;
+	Command.ParseIntoArray(Parts, TEXT("&"));
+	bool bInteractive = Parts.Num() > 0;
+	for (const FString& Part : Parts) {
+		if (MatchesAnyPrefix(Part, BulkCommands)) {
+			return ENeuralCommandPriority::Bulk;
+		}
+		bInteractive &= MatchesAnyPrefix(Part, InteractiveCommands);
+	}
+	return bInteractive ? ENeuralCommandPriority::Interactive : ENeuralCommandPriority::Normal;
+}
+
+float UNeuralInteractionClientSettings::GetReconnectDelay(int32 Attempt) const
+{
+	const float Delay = FMath::Min(ReconnectInitialDelay * FMath::Pow(2.0f, (float)FMath::Min(Attempt, 16)), ReconnectMaxDelay);
+	// Jitter, so that several clients do not hit a restarting server at the same moment
+	return Delay * FMath::FRandRange(0.5f, 1.0f);
+}
+
+FName UNeuralInteractionClientSettings::GetCategoryName() const
+{
+	return TEXT("Plugins");
+}
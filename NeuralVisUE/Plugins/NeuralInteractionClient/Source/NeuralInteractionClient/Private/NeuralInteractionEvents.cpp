@@ -0,0 +1,156 @@
+/*
+This file NeuralInteractionEvents.cpp is part of NeuralVisUAL.
+
+NeuralVisUAL is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+NeuralVisUAL is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with NeuralVisUAL.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "NeuralInteractionEvents.h"
+#include "NeuralInteractionClientLog.h"
+#include "Misc/ScopeLock.h"
+
+namespace
+{
+	// Commands run on arbitrary threads, so (un)binding and broadcasting are serialized
+	FCriticalSection EventsLock;
+	FOnNeuralFileReceived FileReceived;
+	FOnNeuralImageSpawned ImageSpawned;
+	FOnNeuralTensorReceived TensorReceived;
+	FOnNeuralSceneRedraw SceneRedraw;
+	FOnNeuralCuboidsSpawned CuboidsSpawned;
+	FOnNeuralConnectionsSpawned ConnectionsSpawned;
+}
+
+const char* FNeuralInteractionEvents::NativeSceneHeader = "X-NeuralVisUAL-Native-Scene";
+
+FDelegateHandle FNeuralInteractionEvents::AddFileListener(FOnNeuralFileReceived::FDelegate&& Listener)
+{
+	FScopeLock Lock(&EventsLock);
+	return FileReceived.Add(MoveTemp(Listener));
+}
+
+FDelegateHandle FNeuralInteractionEvents::AddImageSpawnListener(FOnNeuralImageSpawned::FDelegate&& Listener)
+{
+	FScopeLock Lock(&EventsLock);
+	return ImageSpawned.Add(MoveTemp(Listener));
+}
+
+FDelegateHandle FNeuralInteractionEvents::AddTensorListener(FOnNeuralTensorReceived::FDelegate&& Listener)
+{
+	FScopeLock Lock(&EventsLock);
+	return TensorReceived.Add(MoveTemp(Listener));
+}
+
+FDelegateHandle FNeuralInteractionEvents::AddSceneRedrawListener(FOnNeuralSceneRedraw::FDelegate&& Listener)
+{
+	FScopeLock Lock(&EventsLock);
+	return SceneRedraw.Add(MoveTemp(Listener));
+}
+
+FDelegateHandle FNeuralInteractionEvents::AddCuboidSpawnListener(FOnNeuralCuboidsSpawned::FDelegate&& Listener)
+{
+	FScopeLock Lock(&EventsLock);
+	return CuboidsSpawned.Add(MoveTemp(Listener));
+}
+
+FDelegateHandle FNeuralInteractionEvents::AddConnectionSpawnListener(FOnNeuralConnectionsSpawned::FDelegate&& Listener)
+{
+	FScopeLock Lock(&EventsLock);
+	return ConnectionsSpawned.Add(MoveTemp(Listener));
+}
+
+void FNeuralInteractionEvents::RemoveListener(FDelegateHandle Handle)
+{
+	FScopeLock Lock(&EventsLock);
+	FileReceived.Remove(Handle);
+	ImageSpawned.Remove(Handle);
+	TensorReceived.Remove(Handle);
+	SceneRedraw.Remove(Handle);
+	CuboidsSpawned.Remove(Handle);
+	ConnectionsSpawned.Remove(Handle);
+}
+
+bool FNeuralInteractionEvents::HasFileListeners()
+{
+	FScopeLock Lock(&EventsLock);
+	return FileReceived.IsBound();
+}
+
+bool FNeuralInteractionEvents::HasTensorListeners()
+{
+	FScopeLock Lock(&EventsLock);
+	return TensorReceived.IsBound();
+}
+
+bool FNeuralInteractionEvents::HasSceneListeners()
+{
+	FScopeLock Lock(&EventsLock);
+	return SceneRedraw.IsBound() || CuboidsSpawned.IsBound() || ConnectionsSpawned.IsBound();
+}
+
+void FNeuralInteractionEvents::BroadcastFileReceived(const FString& OriginalCommand, const FString& Filename,
+	const TArray<uint8>& Data)
+{
+	FScopeLock Lock(&EventsLock);
+	FileReceived.Broadcast(OriginalCommand, Filename, Data);
+}
+
+void FNeuralInteractionEvents::BroadcastImageSpawned(const FString& OriginalCommand, const FString& Path,
+	const TArray<float>& Values)
+{
+	FTransform Transform;
+	if (!GetImageTransform(Values, Transform)) {
+		UE_LOG(NeuralInteractionClient, Warning, TEXT("Image instruction for \"%s\" only has %d instead of 9 values."),
+			*Path, Values.Num());
+		return;
+	}
+	FScopeLock Lock(&EventsLock);
+	ImageSpawned.Broadcast(OriginalCommand, Path, Transform);
+}
+
+void FNeuralInteractionEvents::BroadcastTensorReceived(const FString& OriginalCommand, const FNeuralTensor& Tensor)
+{
+	FScopeLock Lock(&EventsLock);
+	TensorReceived.Broadcast(OriginalCommand, Tensor);
+}
+
+void FNeuralInteractionEvents::BroadcastSceneRedraw(const FString& OriginalCommand, bool bBegin, const TArray<FString>& Scopes)
+{
+	FScopeLock Lock(&EventsLock);
+	SceneRedraw.Broadcast(OriginalCommand, bBegin, Scopes);
+}
+
+void FNeuralInteractionEvents::BroadcastCuboidsSpawned(const FString& OriginalCommand,
+	const TArray<FNeuralCuboidInstruction>& Cuboids)
+{
+	FScopeLock Lock(&EventsLock);
+	CuboidsSpawned.Broadcast(OriginalCommand, Cuboids);
+}
+
+void FNeuralInteractionEvents::BroadcastConnectionsSpawned(const FString& OriginalCommand, const TArray<float>& Style,
+	const TArray<int32>& Edges)
+{
+	FScopeLock Lock(&EventsLock);
+	ConnectionsSpawned.Broadcast(OriginalCommand, Style, Edges);
+}
+
+bool FNeuralInteractionEvents::GetImageTransform(const TArray<float>& Values, FTransform& OutTransform)
+{
+	if (Values.Num() < 9) {
+		return false;
+	}
+	const float* P = Values.GetData();
+	// Same rotator order as cuboids, see ANeuralSceneManager::ApplyCuboidInstruction
+	OutTransform = FTransform(FRotator(P[7], P[8], P[6]), FVector(P[0], P[1], P[2]), FVector(P[3], P[4], P[5]));
+	return true;
+}
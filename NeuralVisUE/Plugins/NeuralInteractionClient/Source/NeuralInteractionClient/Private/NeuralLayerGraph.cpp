@@ -0,0 +1,327 @@
+/*
+This file NeuralLayerGraph.cpp is part of NeuralVisUAL.
+
+NeuralVisUAL is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+NeuralVisUAL is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with NeuralVisUAL.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "NeuralLayerGraph.h"
+#include "NeuralLayerGraphBuilder.h"
+#include "NeuralInteractionClientLog.h"
+#include "Misc/ScopeLock.h"
+
+namespace
+{
+	FCriticalSection CurrentGraphLock;
+	TSharedPtr<const FNeuralLayerGraph, ESPMode::ThreadSafe> CurrentGraph;
+
+	FString Utf8ToString(const char* Data, uint32 Size)
+	{
+		FUTF8ToTCHAR Converted(Data, Size);
+		return FString(Converted.Length(), Converted.Get());
+	}
+}
+
+TSharedPtr<const FNeuralLayerGraph, ESPMode::ThreadSafe> FNeuralLayerGraph::GetCurrent()
+{
+	FScopeLock Lock(&CurrentGraphLock);
+	return CurrentGraph;
+}
+
+void FNeuralLayerGraph::SetCurrent(TSharedPtr<const FNeuralLayerGraph, ESPMode::ThreadSafe> Graph)
+{
+	FScopeLock Lock(&CurrentGraphLock);
+	CurrentGraph = Graph;
+}
+
+int32 FNeuralLayerGraph::FindLayer(const FString& Name) const
+{
+	const int32* Index = IndexOfName.Find(Name);
+	return Index ? *Index : INDEX_NONE;
+}
+
+void FNeuralLayerGraph::GetEdges(TArray<int32>& OutEdges) const
+{
+	OutEdges.Reset(ParentIndices.Num() * 2);
+	for (int32 Layer = 0; Layer < Num(); Layer++) {
+		for (int32 Parent : GetParents(Layer)) {
+			OutEdges.Add(Parent);
+			OutEdges.Add(Layer);
+		}
+	}
+}
+
+void FNeuralLayerGraph::CollectBits(const TArray<uint64>& Bits, int32 Row, TArray<int32>& OutLayers) const
+{
+	OutLayers.Reset();
+	if (!IsValidLayer(Row)) {
+		return;
+	}
+	const uint64* Words = Bits.GetData() + Row * WordsPerRow;
+	for (int32 Word = 0; Word < WordsPerRow; Word++) {
+		uint64 Remaining = Words[Word];
+		while (Remaining) {
+			const int32 Bit = (int32)FMath::CountTrailingZeros64(Remaining);
+			OutLayers.Add(Word * 64 + Bit);
+			Remaining &= Remaining - 1;
+		}
+	}
+}
+
+void FNeuralLayerGraphBuilder::Reset(int32 ExpectedLayers)
+{
+	Graph = MakeShared<FNeuralLayerGraph, ESPMode::ThreadSafe>();
+	Graph->Names.Reserve(ExpectedLayers);
+	Graph->Types.Reserve(ExpectedLayers);
+	Graph->Dimensions.Reserve(ExpectedLayers);
+	Graph->ParameterCounts.Reserve(ExpectedLayers);
+	ParentNames.Reset(ExpectedLayers);
+}
+
+void FNeuralLayerGraphBuilder::BeginLayer()
+{
+	Graph->Names.AddDefaulted();
+	Graph->Types.AddDefaulted();
+	Graph->Dimensions.Add(FIntVector(1, 1, 1));
+	Graph->ParameterCounts.Add(0);
+	ParentNames.AddDefaulted();
+	NumberOfDimensions = 0;
+}
+
+void FNeuralLayerGraphBuilder::SetName(const char* Data, uint32 Size)
+{
+	Graph->Names.Last() = Utf8ToString(Data, Size);
+}
+
+void FNeuralLayerGraphBuilder::SetType(const char* Data, uint32 Size)
+{
+	Graph->Types.Last() = Utf8ToString(Data, Size);
+}
+
+void FNeuralLayerGraphBuilder::AddDimension(uint64 Value)
+{
+	// Same rule as sizeFromLayerDimensions() of the server: the first three positive dimensions
+	if (Value == 0 || NumberOfDimensions >= 3) {
+		return;
+	}
+	Graph->Dimensions.Last()[NumberOfDimensions++] = (int32)FMath::Min<uint64>(Value, MAX_int32);
+}
+
+void FNeuralLayerGraphBuilder::SetParameterCount(int64 Value)
+{
+	Graph->ParameterCounts.Last() = Value;
+}
+
+void FNeuralLayerGraphBuilder::AddParentName(const char* Data, uint32 Size)
+{
+	// The first layer is "connected to" an empty name
+	if (Size > 0) {
+		ParentNames.Last().Add(Utf8ToString(Data, Size));
+	}
+}
+
+void FNeuralLayerGraphBuilder::EndLayer()
+{
+	Graph->IndexOfName.Add(Graph->Names.Last(), Graph->Names.Num() - 1);
+}
+
+TSharedRef<const FNeuralLayerGraph, ESPMode::ThreadSafe> FNeuralLayerGraphBuilder::Build()
+{
+	FNeuralLayerGraph& G = *Graph;
+	const int32 N = G.Num();
+
+	// Parents in CSR form, unknown and duplicate names are dropped
+	G.ParentOffsets.SetNumUninitialized(N + 1);
+	G.ParentIndices.Reset();
+	TArray<int32> NumberOfChildren;
+	NumberOfChildren.SetNumZeroed(N);
+	for (int32 Layer = 0; Layer < N; Layer++) {
+		G.ParentOffsets[Layer] = G.ParentIndices.Num();
+		for (const FString& Name : ParentNames[Layer]) {
+			const int32 Parent = G.FindLayer(Name);
+			if (Parent == INDEX_NONE || Parent == Layer) {
+				UE_LOG(NeuralInteractionClient, Verbose, TEXT("Layer %s is connected to unknown layer %s."), *G.Names[Layer], *Name);
+				continue;
+			}
+			bool bDuplicate = false;
+			for (int32 i = G.ParentOffsets[Layer]; i < G.ParentIndices.Num(); i++) {
+				bDuplicate |= G.ParentIndices[i] == Parent;
+			}
+			if (!bDuplicate) {
+				G.ParentIndices.Add(Parent);
+				NumberOfChildren[Parent]++;
+			}
+		}
+	}
+	G.ParentOffsets[N] = G.ParentIndices.Num();
+
+	// Children by transposing the parent table
+	G.ChildOffsets.SetNumUninitialized(N + 1);
+	G.ChildOffsets[0] = 0;
+	for (int32 Layer = 0; Layer < N; Layer++) {
+		G.ChildOffsets[Layer + 1] = G.ChildOffsets[Layer] + NumberOfChildren[Layer];
+	}
+	G.ChildIndices.SetNumUninitialized(G.ParentIndices.Num());
+	TArray<int32> Fill(G.ChildOffsets.GetData(), N);
+	for (int32 Layer = 0; Layer < N; Layer++) {
+		for (int32 Parent : G.GetParents(Layer)) {
+			G.ChildIndices[Fill[Parent]++] = Layer;
+		}
+	}
+
+	// Topological order (Kahn), keras summaries are usually ordered already, but don't rely on it
+	TArray<int32> Order;
+	Order.Reserve(N);
+	TArray<int32> MissingParents;
+	MissingParents.SetNumUninitialized(N);
+	for (int32 Layer = 0; Layer < N; Layer++) {
+		MissingParents[Layer] = G.GetParents(Layer).Num();
+		if (MissingParents[Layer] == 0) {
+			Order.Add(Layer);
+		}
+	}
+	for (int32 i = 0; i < Order.Num(); i++) {
+		for (int32 Child : G.GetChildren(Order[i])) {
+			if (--MissingParents[Child] == 0) {
+				Order.Add(Child);
+			}
+		}
+	}
+	if (Order.Num() != N) {
+		UE_LOG(NeuralInteractionClient, Warning, TEXT("Layer graph contains cycles, ancestry of %d layers is incomplete."),
+			N - Order.Num());
+	}
+
+	// Ancestor rows in topological order, descendant rows in reverse order
+	G.WordsPerRow = FMath::Max(1, (N + 63) / 64);
+	const int32 W = G.WordsPerRow;
+	G.AncestorBits.SetNumZeroed(N * W);
+	G.DescendantBits.SetNumZeroed(N * W);
+	for (int32 Layer : Order) {
+		uint64* Row = G.AncestorBits.GetData() + Layer * W;
+		for (int32 Parent : G.GetParents(Layer)) {
+			const uint64* ParentRow = G.AncestorBits.GetData() + Parent * W;
+			for (int32 Word = 0; Word < W; Word++) {
+				Row[Word] |= ParentRow[Word];
+			}
+			Row[Parent >> 6] |= uint64(1) << (Parent & 63);
+		}
+	}
+	for (int32 i = Order.Num() - 1; i >= 0; i--) {
+		const int32 Layer = Order[i];
+		uint64* Row = G.DescendantBits.GetData() + Layer * W;
+		for (int32 Child : G.GetChildren(Layer)) {
+			const uint64* ChildRow = G.DescendantBits.GetData() + Child * W;
+			for (int32 Word = 0; Word < W; Word++) {
+				Row[Word] |= ChildRow[Word];
+			}
+			Row[Child >> 6] |= uint64(1) << (Child & 63);
+		}
+	}
+
+	UE_LOG(NeuralInteractionClient, Log, TEXT("Built layer graph with %d layers and %d connections."), N, G.ParentIndices.Num());
+
+	TSharedRef<const FNeuralLayerGraph, ESPMode::ThreadSafe> Result = Graph;
+	Graph = MakeShared<FNeuralLayerGraph, ESPMode::ThreadSafe>();
+	ParentNames.Reset();
+	return Result;
+}
+
+bool UNeuralLayerGraphBPLibrary::HasLayerGraph()
+{
+	return FNeuralLayerGraph::GetCurrent().IsValid();
+}
+
+int32 UNeuralLayerGraphBPLibrary::GetLayerCount()
+{
+	TSharedPtr<const FNeuralLayerGraph, ESPMode::ThreadSafe> Graph = FNeuralLayerGraph::GetCurrent();
+	return Graph.IsValid() ? Graph->Num() : 0;
+}
+
+FString UNeuralLayerGraphBPLibrary::GetLayerName(int32 Layer)
+{
+	TSharedPtr<const FNeuralLayerGraph, ESPMode::ThreadSafe> Graph = FNeuralLayerGraph::GetCurrent();
+	return Graph.IsValid() && Graph->IsValidLayer(Layer) ? Graph->GetName(Layer) : FString();
+}
+
+FString UNeuralLayerGraphBPLibrary::GetLayerType(int32 Layer)
+{
+	TSharedPtr<const FNeuralLayerGraph, ESPMode::ThreadSafe> Graph = FNeuralLayerGraph::GetCurrent();
+	return Graph.IsValid() && Graph->IsValidLayer(Layer) ? Graph->GetType(Layer) : FString();
+}
+
+FIntVector UNeuralLayerGraphBPLibrary::GetLayerDimensions(int32 Layer)
+{
+	TSharedPtr<const FNeuralLayerGraph, ESPMode::ThreadSafe> Graph = FNeuralLayerGraph::GetCurrent();
+	return Graph.IsValid() && Graph->IsValidLayer(Layer) ? Graph->GetDimensions(Layer) : FIntVector::ZeroValue;
+}
+
+int64 UNeuralLayerGraphBPLibrary::GetLayerParameterCount(int32 Layer)
+{
+	TSharedPtr<const FNeuralLayerGraph, ESPMode::ThreadSafe> Graph = FNeuralLayerGraph::GetCurrent();
+	return Graph.IsValid() && Graph->IsValidLayer(Layer) ? Graph->GetParameterCount(Layer) : 0;
+}
+
+int32 UNeuralLayerGraphBPLibrary::FindLayerByName(const FString& Name)
+{
+	TSharedPtr<const FNeuralLayerGraph, ESPMode::ThreadSafe> Graph = FNeuralLayerGraph::GetCurrent();
+	return Graph.IsValid() ? Graph->FindLayer(Name) : INDEX_NONE;
+}
+
+TArray<int32> UNeuralLayerGraphBPLibrary::GetLayerParents(int32 Layer)
+{
+	TSharedPtr<const FNeuralLayerGraph, ESPMode::ThreadSafe> Graph = FNeuralLayerGraph::GetCurrent();
+	return Graph.IsValid() && Graph->IsValidLayer(Layer) ? TArray<int32>(Graph->GetParents(Layer)) : TArray<int32>();
+}
+
+TArray<int32> UNeuralLayerGraphBPLibrary::GetLayerChildren(int32 Layer)
+{
+	TSharedPtr<const FNeuralLayerGraph, ESPMode::ThreadSafe> Graph = FNeuralLayerGraph::GetCurrent();
+	return Graph.IsValid() && Graph->IsValidLayer(Layer) ? TArray<int32>(Graph->GetChildren(Layer)) : TArray<int32>();
+}
+
+bool UNeuralLayerGraphBPLibrary::IsLayerAncestorOf(int32 Ancestor, int32 Descendant)
+{
+	TSharedPtr<const FNeuralLayerGraph, ESPMode::ThreadSafe> Graph = FNeuralLayerGraph::GetCurrent();
+	return Graph.IsValid() && Graph->IsAncestorOf(Ancestor, Descendant);
+}
+
+TArray<int32> UNeuralLayerGraphBPLibrary::GetLayerAncestors(int32 Layer)
+{
+	TArray<int32> Result;
+	TSharedPtr<const FNeuralLayerGraph, ESPMode::ThreadSafe> Graph = FNeuralLayerGraph::GetCurrent();
+	if (Graph.IsValid()) {
+		Graph->GetAncestors(Layer, Result);
+	}
+	return Result;
+}
+
+TArray<int32> UNeuralLayerGraphBPLibrary::GetLayerDescendants(int32 Layer)
+{
+	TArray<int32> Result;
+	TSharedPtr<const FNeuralLayerGraph, ESPMode::ThreadSafe> Graph = FNeuralLayerGraph::GetCurrent();
+	if (Graph.IsValid()) {
+		Graph->GetDescendants(Layer, Result);
+	}
+	return Result;
+}
+
+TArray<int32> UNeuralLayerGraphBPLibrary::GetLayerEdges()
+{
+	TArray<int32> Result;
+	TSharedPtr<const FNeuralLayerGraph, ESPMode::ThreadSafe> Graph = FNeuralLayerGraph::GetCurrent();
+	if (Graph.IsValid()) {
+		Graph->GetEdges(Result);
+	}
+	return Result;
+}
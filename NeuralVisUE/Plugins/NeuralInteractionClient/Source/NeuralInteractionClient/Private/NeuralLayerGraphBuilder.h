@@ -0,0 +1,47 @@
+/*
+This file NeuralLayerGraphBuilder.h is part of NeuralVisUAL.
+
+NeuralVisUAL is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+NeuralVisUAL is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with NeuralVisUAL.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "NeuralLayerGraph.h"
+
+// Collects the layers one by one while the msgpack visitor walks through
+// a "TF STRUCTURE" response, then resolves the parent names and builds the
+// adjacency and ancestry tables of an FNeuralLayerGraph
+class FNeuralLayerGraphBuilder
+{
+public:
+	void Reset(int32 ExpectedLayers);
+
+	void BeginLayer();
+	void SetName(const char* Data, uint32 Size);
+	void SetType(const char* Data, uint32 Size);
+	void AddDimension(uint64 Value);
+	void SetParameterCount(int64 Value);
+	void AddParentName(const char* Data, uint32 Size);
+	void EndLayer();
+
+	int32 Num() const { return Graph->Names.Num(); }
+
+	TSharedRef<const FNeuralLayerGraph, ESPMode::ThreadSafe> Build();
+
+private:
+	TSharedRef<FNeuralLayerGraph, ESPMode::ThreadSafe> Graph = MakeShared<FNeuralLayerGraph, ESPMode::ThreadSafe>();
+	TArray<TArray<FString>> ParentNames;
+	int32 NumberOfDimensions = 0;
+};
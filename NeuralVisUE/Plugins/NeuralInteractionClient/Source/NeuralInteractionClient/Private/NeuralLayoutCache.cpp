@@ -0,0 +1,146 @@
+/*
+This file NeuralLayoutCache.cpp is part of NeuralVisUAL.
+
+NeuralVisUAL is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+NeuralVisUAL is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with NeuralVisUAL.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "NeuralLayoutCache.h"
+#include "NeuralInteractionClientLog.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Misc/ScopeLock.h"
+#include "Serialization/MemoryReader.h"
+#include "Serialization/MemoryWriter.h"
+
+namespace
+{
+	// Bump whenever the file layout changes, older files are ignored then
+	const int32 LayoutCacheVersion = 1;
+
+	FCriticalSection LayoutCacheLock;
+
+	// In-memory copy of LastLayoutKey.txt, loaded on first use
+	FString LastLayoutKey;
+	bool bLastLayoutKeyLoaded = false;
+
+	template <typename T>
+	bool WriteCacheFile(const FString& Filename, T& Data)
+	{
+		TArray<uint8> Bytes;
+		FMemoryWriter Writer(Bytes);
+		int32 Version = LayoutCacheVersion;
+		Writer << Version << Data;
+		FScopeLock Lock(&LayoutCacheLock);
+		return FFileHelper::SaveArrayToFile(Bytes, *Filename);
+	}
+
+	template <typename T>
+	bool ReadCacheFile(const FString& Filename, T& OutData)
+	{
+		TArray<uint8> Bytes;
+		{
+			FScopeLock Lock(&LayoutCacheLock);
+			if (!FFileHelper::LoadFileToArray(Bytes, *Filename, FILEREAD_Silent)) {
+				return false;
+			}
+		}
+		FMemoryReader Reader(Bytes);
+		int32 Version = 0;
+		Reader << Version;
+		if (Version != LayoutCacheVersion) {
+			return false;
+		}
+		Reader << OutData;
+		return !Reader.IsError();
+	}
+}
+
+FString FNeuralLayoutCache::GetCacheDirectory()
+{
+	return FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("NeuralVisUAL"), TEXT("LayoutCache"));
+}
+
+bool FNeuralLayoutCache::IsValidKey(const FString& Key)
+{
+	// Keys are hex digests, anything else must not end up in a file path
+	if (Key.IsEmpty() || Key.Len() > 64) {
+		return false;
+	}
+	for (TCHAR Character : Key) {
+		if (!FChar::IsHexDigit(Character)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+FString FNeuralLayoutCache::GetFilename(const FString& Key, const TCHAR* Extension)
+{
+	return FPaths::Combine(GetCacheDirectory(), Key + Extension);
+}
+
+bool FNeuralLayoutCache::StorePositions(const FString& Key, const TArray<FVector2D>& Positions)
+{
+	if (!IsValidKey(Key)) {
+		UE_LOG(NeuralInteractionClient, Warning, TEXT("Invalid layout key \"%s\", layout is not cached."), *Key);
+		return false;
+	}
+	TArray<FVector2D> Data = Positions;
+	return WriteCacheFile(GetFilename(Key, TEXT(".positions")), Data);
+}
+
+bool FNeuralLayoutCache::LoadPositions(const FString& Key, TArray<FVector2D>& OutPositions)
+{
+	return IsValidKey(Key) && ReadCacheFile(GetFilename(Key, TEXT(".positions")), OutPositions);
+}
+
+bool FNeuralLayoutCache::StoreSnapshot(const FString& Key, const FNeuralLayoutSnapshot& Snapshot)
+{
+	if (!IsValidKey(Key)) {
+		return false;
+	}
+	FNeuralLayoutSnapshot Data = Snapshot;
+	return WriteCacheFile(GetFilename(Key, TEXT(".scene")), Data);
+}
+
+bool FNeuralLayoutCache::LoadSnapshot(const FString& Key, FNeuralLayoutSnapshot& OutSnapshot)
+{
+	return IsValidKey(Key) && ReadCacheFile(GetFilename(Key, TEXT(".scene")), OutSnapshot);
+}
+
+FString FNeuralLayoutCache::GetLastLayoutKey()
+{
+	FScopeLock Lock(&LayoutCacheLock);
+	if (!bLastLayoutKeyLoaded) {
+		FFileHelper::LoadFileToString(LastLayoutKey, *FPaths::Combine(GetCacheDirectory(), TEXT("LastLayoutKey.txt")));
+		if (!IsValidKey(LastLayoutKey)) {
+			LastLayoutKey.Empty();
+		}
+		bLastLayoutKeyLoaded = true;
+	}
+	return LastLayoutKey;
+}
+
+void FNeuralLayoutCache::SetLastLayoutKey(const FString& Key)
+{
+	if (!IsValidKey(Key)) {
+		return;
+	}
+	FScopeLock Lock(&LayoutCacheLock);
+	bLastLayoutKeyLoaded = true;
+	if (LastLayoutKey != Key) {
+		LastLayoutKey = Key;
+		FFileHelper::SaveStringToFile(Key, *FPaths::Combine(GetCacheDirectory(), TEXT("LastLayoutKey.txt")));
+	}
+}
@@ -0,0 +1,183 @@
+/*
+This file NeuralLinkTelemetry.cpp is part of NeuralVisUAL.
+
+NeuralVisUAL is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+NeuralVisUAL is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with NeuralVisUAL.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "NeuralLinkTelemetry.h"
+#include "HAL/PlatformTime.h"
+#include "Misc/ScopeLock.h"
+#include "Stats/Stats.h"
+
+DECLARE_STATS_GROUP(TEXT("NeuralInteractionClient"), STATGROUP_NeuralInteractionClient, STATCAT_Advanced);
+DECLARE_FLOAT_ACCUMULATOR_STAT(TEXT("Round trip (ms)"), STAT_NeuralRoundTrip, STATGROUP_NeuralInteractionClient);
+DECLARE_FLOAT_ACCUMULATOR_STAT(TEXT("Received (KB/s)"), STAT_NeuralReceived, STATGROUP_NeuralInteractionClient);
+DECLARE_FLOAT_ACCUMULATOR_STAT(TEXT("Sent (KB/s)"), STAT_NeuralSent, STATGROUP_NeuralInteractionClient);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Queued interactive commands"), STAT_NeuralQueuedInteractive, STATGROUP_NeuralInteractionClient);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Queued normal commands"), STAT_NeuralQueuedNormal, STATGROUP_NeuralInteractionClient);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Queued bulk commands"), STAT_NeuralQueuedBulk, STATGROUP_NeuralInteractionClient);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Running commands"), STAT_NeuralRunning, STATGROUP_NeuralInteractionClient);
+
+namespace
+{
+	// Minimum round trip times older than this are replaced, in case the route changed
+	const double MinRoundTripLifetime = 60.0;
+	// Round trip time above which the link counts as congested, relative to the minimum plus a margin
+	const double CongestionFactor = 2.0;
+	const double CongestionMargin = 0.005;
+	const int32 MinFragmentSize = 64 * 1024;
+	const int32 MaxFragmentSize = 4 * 1024 * 1024;
+}
+
+FNeuralLinkTelemetry& FNeuralLinkTelemetry::Get()
+{
+	static FNeuralLinkTelemetry Instance;
+	return Instance;
+}
+
+void FNeuralLinkTelemetry::FRate::Add(int64 InBytes, double Now)
+{
+	const int64 Index = (int64)(Now / BucketSeconds);
+	const int32 Slot = (int32)(Index % NumberOfBuckets);
+	if (BucketIndex[Slot] != Index) {
+		BucketIndex[Slot] = Index;
+		Bytes[Slot] = 0;
+	}
+	Bytes[Slot] += InBytes;
+	Total += InBytes;
+}
+
+double FNeuralLinkTelemetry::FRate::GetPerSecond(double Now) const
+{
+	const int64 Index = (int64)(Now / BucketSeconds);
+	int64 Sum = 0;
+	for (int32 Slot = 0; Slot < NumberOfBuckets; Slot++) {
+		if (Index - BucketIndex[Slot] < NumberOfBuckets) {
+			Sum += Bytes[Slot];
+		}
+	}
+	return Sum / (NumberOfBuckets * BucketSeconds);
+}
+
+void FNeuralLinkTelemetry::AddRoundTripSample(double Seconds)
+{
+	FScopeLock ScopeLock(&Lock);
+	const double Now = FPlatformTime::Seconds();
+	// Smoothed like the retransmission timer of TCP (RFC 6298)
+	if (SmoothedRoundTrip == 0.0) {
+		SmoothedRoundTrip = Seconds;
+		RoundTripVariation = Seconds / 2.0;
+	} else {
+		RoundTripVariation = 0.75 * RoundTripVariation + 0.25 * FMath::Abs(SmoothedRoundTrip - Seconds);
+		SmoothedRoundTrip = 0.875 * SmoothedRoundTrip + 0.125 * Seconds;
+	}
+	if (MinRoundTrip == 0.0 || Seconds <= MinRoundTrip || Now - MinRoundTripTime > MinRoundTripLifetime) {
+		MinRoundTrip = Seconds;
+		MinRoundTripTime = Now;
+	}
+	UpdateStats();
+}
+
+void FNeuralLinkTelemetry::AddBytesReceived(int64 Bytes)
+{
+	FScopeLock ScopeLock(&Lock);
+	Received.Add(Bytes, FPlatformTime::Seconds());
+	UpdateStats();
+}
+
+void FNeuralLinkTelemetry::AddBytesSent(int64 Bytes)
+{
+	FScopeLock ScopeLock(&Lock);
+	Sent.Add(Bytes, FPlatformTime::Seconds());
+	UpdateStats();
+}
+
+void FNeuralLinkTelemetry::SetQueueDepth(ENeuralCommandPriority Priority, int32 InQueued, int32 InRunning)
+{
+	FScopeLock ScopeLock(&Lock);
+	Queued[(int32)Priority] = InQueued;
+	Running[(int32)Priority] = InRunning;
+	UpdateStats();
+}
+
+void FNeuralLinkTelemetry::UpdateStats() const
+{
+	const double Now = FPlatformTime::Seconds();
+	SET_FLOAT_STAT(STAT_NeuralRoundTrip, SmoothedRoundTrip * 1000.0);
+	SET_FLOAT_STAT(STAT_NeuralReceived, Received.GetPerSecond(Now) / 1024.0);
+	SET_FLOAT_STAT(STAT_NeuralSent, Sent.GetPerSecond(Now) / 1024.0);
+	SET_DWORD_STAT(STAT_NeuralQueuedInteractive, Queued[(int32)ENeuralCommandPriority::Interactive]);
+	SET_DWORD_STAT(STAT_NeuralQueuedNormal, Queued[(int32)ENeuralCommandPriority::Normal]);
+	SET_DWORD_STAT(STAT_NeuralQueuedBulk, Queued[(int32)ENeuralCommandPriority::Bulk]);
+	SET_DWORD_STAT(STAT_NeuralRunning, Running[0] + Running[1] + Running[2]);
+}
+
+FNeuralLinkStatistics FNeuralLinkTelemetry::GetStatistics() const
+{
+	FScopeLock ScopeLock(&Lock);
+	const double Now = FPlatformTime::Seconds();
+	FNeuralLinkStatistics Statistics;
+	Statistics.RoundTripMs = SmoothedRoundTrip * 1000.0;
+	Statistics.RoundTripVariationMs = RoundTripVariation * 1000.0;
+	Statistics.MinRoundTripMs = MinRoundTrip * 1000.0;
+	Statistics.ReceivedBytesPerSecond = Received.GetPerSecond(Now);
+	Statistics.SentBytesPerSecond = Sent.GetPerSecond(Now);
+	Statistics.TotalBytesReceived = Received.Total;
+	Statistics.TotalBytesSent = Sent.Total;
+	Statistics.QueuedCommands = TArray<int32>(Queued, 3);
+	Statistics.RunningCommands = TArray<int32>(Running, 3);
+	return Statistics;
+}
+
+int32 FNeuralLinkTelemetry::GetBulkWindow(int32 MaxWindow) const
+{
+	FScopeLock ScopeLock(&Lock);
+	if (MinRoundTrip == 0.0) {
+		return MaxWindow;
+	}
+	const bool bCongested = SmoothedRoundTrip > MinRoundTrip * CongestionFactor + CongestionMargin;
+	return bCongested ? 1 : MaxWindow;
+}
+
+int32 FNeuralLinkTelemetry::GetFragmentSize() const
+{
+	FScopeLock ScopeLock(&Lock);
+	const double BytesPerRoundTrip = Received.GetPerSecond(FPlatformTime::Seconds()) * SmoothedRoundTrip;
+	if (BytesPerRoundTrip <= 0.0) {
+		return 0;
+	}
+	return (int32)FMath::Clamp(BytesPerRoundTrip, (double)MinFragmentSize, (double)MaxFragmentSize);
+}
+
+void FNeuralLinkTelemetry::Reset()
+{
+	FScopeLock ScopeLock(&Lock);
+	SmoothedRoundTrip = 0.0;
+	RoundTripVariation = 0.0;
+	MinRoundTrip = 0.0;
+	MinRoundTripTime = 0.0;
+	Received = FRate();
+	Sent = FRate();
+	UpdateStats();
+}
+
+FNeuralLinkStatistics UNeuralLinkTelemetryBPLibrary::GetLinkStatistics()
+{
+	return FNeuralLinkTelemetry::Get().GetStatistics();
+}
+
+void UNeuralLinkTelemetryBPLibrary::ResetLinkStatistics()
+{
+	FNeuralLinkTelemetry::Get().Reset();
+}
@@ -0,0 +1,166 @@
+/*
+This file NeuralMessageCompression.cpp is part of NeuralVisUAL.
+
+NeuralVisUAL is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+NeuralVisUAL is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with NeuralVisUAL.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "NeuralMessageCompression.h"
+#include "NeuralInteractionClientLog.h"
+#include "Misc/Compression.h"
+#include "Misc/ScopeLock.h"
+
+namespace
+{
+	// Codec ids of messageCompression.py
+	const uint8 CodecZlib = 1;
+	const uint8 CodecLZ4 = 2;
+
+	bool IsSupportedCodec(const FString& Codec)
+	{
+		return Codec == TEXT("lz4") || Codec == TEXT("zlib");
+	}
+}
+
+const char* FNeuralMessageCompression::CodecsHeader = "X-NeuralVisUAL-Compression";
+
+FNeuralMessageCompression& FNeuralMessageCompression::Get()
+{
+	static FNeuralMessageCompression Instance;
+	return Instance;
+}
+
+FNeuralMessageCompression::FNeuralMessageCompression()
+{
+	// lz4 first, it decompresses several times faster than zlib
+	AcceptedCodecs = { TEXT("lz4"), TEXT("zlib") };
+}
+
+bool FNeuralMessageCompression::IsEnvelope(const uint8* Data, int64 Size)
+{
+	return Size >= EnvelopeHeaderSize && Data[0] == EnvelopeMarker;
+}
+
+FString FNeuralMessageCompression::GetAcceptedCodecs() const
+{
+	FScopeLock ScopeLock(&Lock);
+	return FString::Join(AcceptedCodecs, TEXT(", "));
+}
+
+void FNeuralMessageCompression::SetAcceptedCodecs(const TArray<FString>& Codecs)
+{
+	FScopeLock ScopeLock(&Lock);
+	AcceptedCodecs.Reset();
+	for (const FString& Codec : Codecs) {
+		const FString Name = Codec.TrimStartAndEnd().ToLower();
+		if (IsSupportedCodec(Name)) {
+			AcceptedCodecs.AddUnique(Name);
+		}
+		else {
+			UE_LOG(NeuralInteractionClient, Warning, TEXT("Compression codec %s is not supported by the client."), *Codec);
+		}
+	}
+}
+
+TArray<uint8> FNeuralMessageCompression::AcquireBuffer()
+{
+	FScopeLock ScopeLock(&Lock);
+	return BufferPool.Num() > 0 ? BufferPool.Pop(false) : TArray<uint8>();
+}
+
+void FNeuralMessageCompression::ReleaseBuffer(TArray<uint8>&& Buffer)
+{
+	FScopeLock ScopeLock(&Lock);
+	if (BufferPool.Num() < MaxPooledBuffers) {
+		BufferPool.Add(MoveTemp(Buffer));
+	}
+}
+
+bool FNeuralMessageCompression::Decompress(const uint8* Data, int64 Size, TArray<uint8>& OutBuffer)
+{
+	if (!IsEnvelope(Data, Size)) {
+		return false;
+	}
+	const uint8 Codec = Data[1];
+	uint32 UncompressedSize;
+	FMemory::Memcpy(&UncompressedSize, Data + 2, sizeof(UncompressedSize));
+	const int64 CompressedSize = Size - EnvelopeHeaderSize;
+	if (UncompressedSize > (uint32)MAX_int32 || CompressedSize > MAX_int32) {
+		return false;
+	}
+	FName Format;
+	if (Codec == CodecZlib) {
+		Format = NAME_Zlib;
+	}
+	else if (Codec == CodecLZ4) {
+		Format = NAME_LZ4;
+	}
+	else {
+		UE_LOG(NeuralInteractionClient, Warning, TEXT("Received message with unsupported compression codec %d."), Codec);
+		return false;
+	}
+	// Keeps its allocation, so that pooled buffers only grow to the largest message
+	OutBuffer.SetNumUninitialized(UncompressedSize, false);
+	if (!FCompression::UncompressMemory(Format, OutBuffer.GetData(), UncompressedSize, Data + EnvelopeHeaderSize, CompressedSize)) {
+		UE_LOG(NeuralInteractionClient, Warning, TEXT("Could not decompress message of %lld bytes."), Size);
+		return false;
+	}
+	return true;
+}
+
+void FNeuralMessageCompression::RecordMessage(const FString& MessageType, int64 ReceivedBytes, int64 Bytes,
+	double DecompressionSeconds)
+{
+	FScopeLock ScopeLock(&Lock);
+	FMessageStatistics& Entry = Statistics.FindOrAdd(MessageType.IsEmpty() ? TEXT("other") : MessageType);
+	Entry.Messages++;
+	Entry.CompressedMessages += ReceivedBytes != Bytes;
+	Entry.ReceivedBytes += ReceivedBytes;
+	Entry.Bytes += Bytes;
+	Entry.DecompressionSeconds += DecompressionSeconds;
+}
+
+FString FNeuralMessageCompression::GetStatistics() const
+{
+	FScopeLock ScopeLock(&Lock);
+	FString Result;
+	for (const TPair<FString, FMessageStatistics>& Entry : Statistics) {
+		const FMessageStatistics& Stats = Entry.Value;
+		Result += FString::Printf(TEXT("%s: %lld messages, %lld compressed, %lld -> %lld bytes (ratio %.2f), "
+			"%.2f ms decompressing (%.0f us per message)\n"), *Entry.Key, Stats.Messages, Stats.CompressedMessages,
+			Stats.ReceivedBytes, Stats.Bytes, Stats.ReceivedBytes > 0 ? (double)Stats.Bytes / Stats.ReceivedBytes : 1.0,
+			Stats.DecompressionSeconds * 1000, Stats.DecompressionSeconds * 1e6 / Stats.Messages);
+	}
+	return Result;
+}
+
+void FNeuralMessageCompression::ResetStatistics()
+{
+	FScopeLock ScopeLock(&Lock);
+	Statistics.Empty();
+}
+
+void UNeuralMessageCompressionBPLibrary::SetAcceptedCompressionCodecs(const TArray<FString>& Codecs)
+{
+	FNeuralMessageCompression::Get().SetAcceptedCodecs(Codecs);
+}
+
+FString UNeuralMessageCompressionBPLibrary::GetCompressionStatistics()
+{
+	return FNeuralMessageCompression::Get().GetStatistics();
+}
+
+void UNeuralMessageCompressionBPLibrary::ResetCompressionStatistics()
+{
+	FNeuralMessageCompression::Get().ResetStatistics();
+}
@@ -0,0 +1,146 @@
+/*
+This file NeuralMessageFilter.cpp is part of NeuralVisUAL.
+
+NeuralVisUAL is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+NeuralVisUAL is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with NeuralVisUAL.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "NeuralMessageFilter.h"
+#include "NeuralInteractionClientSettings.h"
+#include "NeuralPackedReader.h"
+#include "HAL/PlatformTime.h"
+#include "Misc/Crc.h"
+#include "Misc/ScopeLock.h"
+
+namespace
+{
+	// Status levels of the server, see sendstatus in serverCommands.py
+	const int64 StatusCompleted = -30;
+	const int64 FirstImportantLevel = 1;
+
+	bool Equals(const uint8* String, int64 Length, const char* Literal)
+	{
+		return Length == (int64)FCStringAnsi::Strlen(Literal) && FMemory::Memcmp(String, Literal, Length) == 0;
+	}
+}
+
+FNeuralMessageFilter& FNeuralMessageFilter::Get()
+{
+	static FNeuralMessageFilter Instance;
+	return Instance;
+}
+
+bool FNeuralMessageFilter::Peek(const uint8* Data, int64 Size, ENeuralConsoleLineKind& OutKind, int64& OutLevel,
+	const uint8*& OutText, int64& OutTextSize)
+{
+	FNeuralPackedReader Reader{ Data, Size };
+	uint64 Num = 0;
+	const uint8* Type = nullptr;
+	int64 TypeLength = 0;
+	if (!Reader.ReadArrayHeader(Num) || Num != 3 || !Reader.ReadString(Type, TypeLength)) {
+		return false;
+	}
+	if (Equals(Type, TypeLength, "STATUS")) {
+		OutKind = ENeuralConsoleLineKind::Status;
+	} else if (Equals(Type, TypeLength, "DEBUG")) {
+		OutKind = ENeuralConsoleLineKind::Debug;
+	} else {
+		return false;
+	}
+	return Reader.ReadInteger(OutLevel) && Reader.ReadString(OutText, OutTextSize);
+}
+
+bool FNeuralMessageFilter::Accept(const uint8* Data, int64 Size, FConnectionState& Connection)
+{
+	const UNeuralInteractionClientSettings* Settings = GetDefault<UNeuralInteractionClientSettings>();
+	ENeuralConsoleLineKind Kind;
+	int64 Level = 0;
+	const uint8* Text = nullptr;
+	int64 TextSize = 0;
+	if (!Settings->bFilterMessages || !Peek(Data, Size, Kind, Level, Text, TextSize)) {
+		return true;
+	}
+	const double Now = FPlatformTime::Seconds();
+	FScopeLock ScopeLock(&Lock);
+	if (Kind == ENeuralConsoleLineKind::Debug) {
+		if (Level < Settings->MinDebugLevel) {
+			Statistics.DroppedBelowLevel++;
+			return false;
+		}
+		if (Level < FirstImportantLevel && !DebugRate.TryTake(Settings->MaxDebugMessagesPerSecond, Now)) {
+			Statistics.DroppedOverRate++;
+			return false;
+		}
+		Statistics.PassedMessages++;
+		return true;
+	}
+
+	if (Level <= StatusCompleted || Level >= 0) {
+		Connection.bHasStatus = false;
+		Statistics.PassedMessages++;
+		return true;
+	}
+	const uint32 Hash = FCrc::MemCrc32(Text, (int32)TextSize);
+	if (Connection.bHasStatus && Connection.LastStatusLevel == Level &&
+		(Connection.LastStatusHash == Hash || Now - Connection.LastStatusTime < Settings->StatusCoalescingInterval)) {
+		Statistics.CoalescedStatuses++;
+		return false;
+	}
+	if (!StatusRate.TryTake(Settings->MaxStatusMessagesPerSecond, Now)) {
+		Statistics.DroppedOverRate++;
+		return false;
+	}
+	Connection.bHasStatus = true;
+	Connection.LastStatusLevel = Level;
+	Connection.LastStatusHash = Hash;
+	Connection.LastStatusTime = Now;
+	Statistics.PassedMessages++;
+	return true;
+}
+
+bool FNeuralMessageFilter::FRateLimit::TryTake(double Rate, double Now)
+{
+	// 0 is unlimited
+	if (Rate <= 0.0) {
+		return true;
+	}
+	Tokens = FMath::Min(Tokens + (Now - LastRefill) * Rate, FMath::Max(Rate, 1.0));
+	LastRefill = Now;
+	if (Tokens < 1.0) {
+		return false;
+	}
+	Tokens -= 1.0;
+	return true;
+}
+
+FNeuralMessageFilterStatistics FNeuralMessageFilter::GetStatistics() const
+{
+	FScopeLock ScopeLock(&Lock);
+	return Statistics;
+}
+
+void FNeuralMessageFilter::ResetStatistics()
+{
+	FScopeLock ScopeLock(&Lock);
+	Statistics = FNeuralMessageFilterStatistics();
+}
+
+FNeuralMessageFilterStatistics UNeuralMessageFilterBPLibrary::GetMessageFilterStatistics()
+{
+	return FNeuralMessageFilter::Get().GetStatistics();
+}
+
+void UNeuralMessageFilterBPLibrary::ResetMessageFilterStatistics()
+{
+	FNeuralMessageFilter::Get().ResetStatistics();
+}
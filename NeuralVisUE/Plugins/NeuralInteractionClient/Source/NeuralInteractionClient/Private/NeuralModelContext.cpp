@@ -0,0 +1,176 @@
+/*
+This file NeuralModelContext.cpp is part of NeuralVisUAL.
+
+NeuralVisUAL is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+NeuralVisUAL is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with NeuralVisUAL.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "NeuralModelContext.h"
+#include "NeuralCommandScheduler.h"
+#include "NeuralEndpointRouter.h"
+#include "Misc/ScopeLock.h"
+
+namespace
+{
+	thread_local FNeuralModelContext* ResponseContext = nullptr;
+}
+
+TSharedPtr<const FNeuralLayerGraph, ESPMode::ThreadSafe> FNeuralModelContext::GetLayerGraph() const
+{
+	FScopeLock ScopeLock(&Lock);
+	return LayerGraph;
+}
+
+void FNeuralModelContext::SetLayerGraph(TSharedPtr<const FNeuralLayerGraph, ESPMode::ThreadSafe> Graph)
+{
+	FScopeLock ScopeLock(&Lock);
+	LayerGraph = Graph;
+}
+
+FString FNeuralModelContext::GetLayoutKey() const
+{
+	FScopeLock ScopeLock(&Lock);
+	return LayoutKey;
+}
+
+void FNeuralModelContext::SetLayoutKey(const FString& Key)
+{
+	FScopeLock ScopeLock(&Lock);
+	LayoutKey = Key;
+}
+
+void FNeuralModelContext::Reset()
+{
+	{
+		FScopeLock ScopeLock(&Lock);
+		LayerGraph.Reset();
+		LayoutKey.Empty();
+	}
+	TensorStreams.Clear();
+}
+
+FNeuralModelContexts& FNeuralModelContexts::Get()
+{
+	static FNeuralModelContexts Instance;
+	return Instance;
+}
+
+FNeuralModelContext& FNeuralModelContexts::FindOrAdd(const FString& Name)
+{
+	FScopeLock ScopeLock(&Lock);
+	TUniquePtr<FNeuralModelContext>& Context = Contexts.FindOrAdd(Name);
+	if (!Context.IsValid()) {
+		Context = MakeUnique<FNeuralModelContext>(Name);
+	}
+	return *Context;
+}
+
+FNeuralModelContext* FNeuralModelContexts::Find(const FString& Name) const
+{
+	FScopeLock ScopeLock(&Lock);
+	const TUniquePtr<FNeuralModelContext>* Context = Contexts.Find(Name);
+	return Context ? Context->Get() : nullptr;
+}
+
+FNeuralModelContext& FNeuralModelContexts::FindOrAddForServer(const FString& Host, int32 Port)
+{
+	for (const FNeuralServerEndpoint& Endpoint : FNeuralEndpointRouter::Get().GetEndpoints()) {
+		if (Endpoint.Port == Port && Endpoint.Host.Equals(Host, ESearchCase::IgnoreCase)) {
+			return FindOrAdd(Endpoint.Name);
+		}
+	}
+	return FindOrAdd(FString::Printf(TEXT("%s:%d"), *Host, Port));
+}
+
+FNeuralModelContext& FNeuralModelContexts::GetDefault()
+{
+	const TArray<FNeuralServerEndpoint> Endpoints = FNeuralEndpointRouter::Get().GetEndpoints();
+	return FindOrAdd(Endpoints.Num() > 0 ? Endpoints[0].Name : FNeuralServerEndpoint().Name);
+}
+
+TArray<FString> FNeuralModelContexts::GetNames() const
+{
+	FScopeLock ScopeLock(&Lock);
+	TArray<FString> Names;
+	Contexts.GetKeys(Names);
+	return Names;
+}
+
+FNeuralModelContext* FNeuralModelContexts::GetContextOfResponse()
+{
+	return ResponseContext;
+}
+
+FNeuralModelContexts::FResponseScope::FResponseScope(FNeuralModelContext* Context)
+	: Previous(ResponseContext)
+{
+	ResponseContext = Context;
+}
+
+FNeuralModelContexts::FResponseScope::~FResponseScope()
+{
+	ResponseContext = Previous;
+}
+
+TArray<FString> UNeuralModelContextBPLibrary::GetModelContexts()
+{
+	return FNeuralModelContexts::Get().GetNames();
+}
+
+FNeuralCommandHandle UNeuralModelContextBPLibrary::ExecuteCommandInModelContext(const FString& Context,
+	const FString& Command, const FFoundAtomString& OnString, const FEndOfConnection& OnFinished)
+{
+	const FString Routed = FNeuralModelContexts::Get().FindOrAdd(Context).MakeCommand(Command);
+	return FNeuralCommandScheduler::Get().Schedule(Routed, FNeuralResponseCallbacks::FromDelegateOnGameThread(OnString),
+		[Command, OnFinished](bool bForciblyClosed)
+	{
+		OnFinished.ExecuteIfBound(Command, bForciblyClosed);
+	});
+}
+
+bool UNeuralModelContextBPLibrary::HasModelContextLayerGraph(const FString& Context)
+{
+	const FNeuralModelContext* ModelContext = FNeuralModelContexts::Get().Find(Context);
+	return ModelContext && ModelContext->GetLayerGraph().IsValid();
+}
+
+int32 UNeuralModelContextBPLibrary::GetModelContextLayerCount(const FString& Context)
+{
+	const FNeuralModelContext* ModelContext = FNeuralModelContexts::Get().Find(Context);
+	TSharedPtr<const FNeuralLayerGraph, ESPMode::ThreadSafe> Graph = ModelContext ? ModelContext->GetLayerGraph() : nullptr;
+	return Graph.IsValid() ? Graph->Num() : 0;
+}
+
+TArray<int32> UNeuralModelContextBPLibrary::GetModelContextLayerEdges(const FString& Context)
+{
+	TArray<int32> Edges;
+	const FNeuralModelContext* ModelContext = FNeuralModelContexts::Get().Find(Context);
+	TSharedPtr<const FNeuralLayerGraph, ESPMode::ThreadSafe> Graph = ModelContext ? ModelContext->GetLayerGraph() : nullptr;
+	if (Graph.IsValid()) {
+		Graph->GetEdges(Edges);
+	}
+	return Edges;
+}
+
+FString UNeuralModelContextBPLibrary::GetModelContextLayoutKey(const FString& Context)
+{
+	const FNeuralModelContext* ModelContext = FNeuralModelContexts::Get().Find(Context);
+	return ModelContext ? ModelContext->GetLayoutKey() : FString();
+}
+
+void UNeuralModelContextBPLibrary::ResetModelContext(const FString& Context)
+{
+	if (FNeuralModelContext* ModelContext = FNeuralModelContexts::Get().Find(Context)) {
+		ModelContext->Reset();
+	}
+}
@@ -0,0 +1,306 @@
+/*
+This file NeuralPackedParser.h is part of NeuralVisUAL.
+
+NeuralVisUAL is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+NeuralVisUAL is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with NeuralVisUAL.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Misc/ByteSwap.h"
+
+// Parses a msgpack message like msgpack::parse, calling the same functions of the visitor, see
+// msgpack::null_visitor. In addition, arrays of numbers of one type are decoded in a single pass
+// into a float array and reported as a whole with visit_numeric_array, in place of start_array,
+// their elements and end_array, as long as the visitor accepts_numeric_array.
+// Used for all messages, see the message handlers in NeuralInteractionClient.cpp
+template <typename VisitorType>
+class TNeuralPackedParser
+{
+public:
+	// Shorter arrays are parsed element by element, they are not worth checking
+	static constexpr uint32 BulkNumericMinimum = 16;
+	static constexpr int32 MaxDepth = 64;
+
+	// NumericValues receives the arrays decoded in bulk, it keeps its allocation from one to the next
+	TNeuralPackedParser(const uint8* InData, int64 InSize, VisitorType& InVisitor, TArray<float>& InNumericValues)
+		: Data(InData), Size(InSize), Visitor(InVisitor), NumericValues(InNumericValues)
+	{
+	}
+
+	// Parses one object. Returns false if the visitor stopped or got a parse error
+	bool Parse()
+	{
+		return ParseObject(0);
+	}
+
+private:
+	const uint8* Data;
+	int64 Size;
+	VisitorType& Visitor;
+	TArray<float>& NumericValues;
+	int64 Position = 0;
+
+	bool InsufficientBytes()
+	{
+		Visitor.insufficient_bytes((size_t)Position, (size_t)Size);
+		return false;
+	}
+
+	bool ParseError()
+	{
+		Visitor.parse_error((size_t)Position, (size_t)Position);
+		return false;
+	}
+
+	// Big endian
+	bool ReadUnsigned(int32 Bytes, uint64& OutValue)
+	{
+		if (Bytes > Size - Position) {
+			return InsufficientBytes();
+		}
+		OutValue = 0;
+		for (int32 Index = 0; Index < Bytes; Index++) {
+			OutValue = (OutValue << 8) | Data[Position++];
+		}
+		return true;
+	}
+
+	// Returns the bytes and skips them, null if there are not enough
+	const char* ReadBytes(uint64 Length)
+	{
+		if ((int64)Length > Size - Position) {
+			InsufficientBytes();
+			return nullptr;
+		}
+		const char* Bytes = (const char*)Data + Position;
+		Position += (int64)Length;
+		return Bytes;
+	}
+
+	bool ParseObject(int32 Depth)
+	{
+		if (Position >= Size) {
+			return InsufficientBytes();
+		}
+		const uint8 Type = Data[Position++];
+		if (Type <= 0x7f) {
+			return Visitor.visit_positive_integer(Type);
+		}
+		if (Type >= 0xe0) {
+			return Visitor.visit_negative_integer((int8)Type);
+		}
+		if ((Type & 0xf0) == 0x80) {
+			return ParseMap(Type & 0x0f, Depth);
+		}
+		if ((Type & 0xf0) == 0x90) {
+			return ParseArray(Type & 0x0f, Depth);
+		}
+		if ((Type & 0xe0) == 0xa0) {
+			return ParseString(Type & 0x1f);
+		}
+		uint64 Value = 0;
+		switch (Type) {
+		case 0xc0:
+			return Visitor.visit_nil();
+		case 0xc2:
+			return Visitor.visit_boolean(false);
+		case 0xc3:
+			return Visitor.visit_boolean(true);
+		case 0xc4: case 0xc5: case 0xc6: { // bin 8, 16, 32
+			if (!ReadUnsigned(1 << (Type - 0xc4), Value)) {
+				return false;
+			}
+			const char* Bytes = ReadBytes(Value);
+			return Bytes && Visitor.visit_bin(Bytes, (uint32)Value);
+		}
+		case 0xc7: case 0xc8: case 0xc9: // ext 8, 16, 32
+			return ReadUnsigned(1 << (Type - 0xc7), Value) && ParseExtension(Value);
+		case 0xca: {
+			if (!ReadUnsigned(4, Value)) {
+				return false;
+			}
+			const uint32 Bits = (uint32)Value;
+			float Float;
+			FMemory::Memcpy(&Float, &Bits, sizeof(Float));
+			return Visitor.visit_float32(Float);
+		}
+		case 0xcb: {
+			if (!ReadUnsigned(8, Value)) {
+				return false;
+			}
+			double Double;
+			FMemory::Memcpy(&Double, &Value, sizeof(Double));
+			return Visitor.visit_float64(Double);
+		}
+		case 0xcc: case 0xcd: case 0xce: case 0xcf: // uint 8, 16, 32, 64
+			return ReadUnsigned(1 << (Type - 0xcc), Value) && Visitor.visit_positive_integer(Value);
+		case 0xd0: case 0xd1: case 0xd2: case 0xd3: { // int 8, 16, 32, 64
+			const int32 Bytes = 1 << (Type - 0xd0);
+			if (!ReadUnsigned(Bytes, Value)) {
+				return false;
+			}
+			// Sign extension. Like msgpack::parse, only negative values are reported as such
+			const int32 Shift = 64 - Bytes * 8;
+			const int64 Signed = (int64)(Value << Shift) >> Shift;
+			return Signed < 0 ? Visitor.visit_negative_integer(Signed) : Visitor.visit_positive_integer((uint64)Signed);
+		}
+		case 0xd4: case 0xd5: case 0xd6: case 0xd7: case 0xd8: // fixext 1, 2, 4, 8, 16
+			return ParseExtension(1ull << (Type - 0xd4));
+		case 0xd9: case 0xda: case 0xdb: // str 8, 16, 32
+			return ReadUnsigned(1 << (Type - 0xd9), Value) && ParseString(Value);
+		case 0xdc: case 0xdd: // array 16, 32
+			return ReadUnsigned(2 << (Type - 0xdc), Value) && ParseArray(Value, Depth);
+		case 0xde: case 0xdf: // map 16, 32
+			return ReadUnsigned(2 << (Type - 0xde), Value) && ParseMap(Value, Depth);
+		default: // 0xc1 is never used
+			Position--;
+			return ParseError();
+		}
+	}
+
+	bool ParseString(uint64 Length)
+	{
+		const char* Bytes = ReadBytes(Length);
+		return Bytes && Visitor.visit_str(Bytes, (uint32)Length);
+	}
+
+	// Like msgpack::parse, the extension type is passed as the first byte of the data
+	bool ParseExtension(uint64 Length)
+	{
+		const char* Bytes = ReadBytes(Length + 1);
+		return Bytes && Visitor.visit_ext(Bytes, (uint32)(Length + 1));
+	}
+
+	bool ParseArray(uint64 Num, int32 Depth)
+	{
+		if (Depth >= MaxDepth) {
+			return ParseError();
+		}
+		// Every element takes at least one byte
+		if ((int64)Num > Size - Position) {
+			return InsufficientBytes();
+		}
+		if (Num >= BulkNumericMinimum && Visitor.accepts_numeric_array() && ParseNumericArray((uint32)Num)) {
+			return Visitor.visit_numeric_array(NumericValues);
+		}
+		if (!Visitor.start_array((uint32)Num)) {
+			return false;
+		}
+		for (uint64 Index = 0; Index < Num; Index++) {
+			if (!Visitor.start_array_item() || !ParseObject(Depth + 1) || !Visitor.end_array_item()) {
+				return false;
+			}
+		}
+		return Visitor.end_array();
+	}
+
+	bool ParseMap(uint64 Num, int32 Depth)
+	{
+		if (Depth >= MaxDepth) {
+			return ParseError();
+		}
+		if ((int64)Num > (Size - Position) / 2) {
+			return InsufficientBytes();
+		}
+		if (!Visitor.start_map((uint32)Num)) {
+			return false;
+		}
+		for (uint64 Index = 0; Index < Num; Index++) {
+			if (!Visitor.start_map_key() || !ParseObject(Depth + 1) || !Visitor.end_map_key() ||
+				!Visitor.start_map_value() || !ParseObject(Depth + 1) || !Visitor.end_map_value()) {
+				return false;
+			}
+		}
+		return Visitor.end_map();
+	}
+
+	// Decodes an array whose elements are all float64, all float32 or all integers into NumericValues.
+	// Returns false without consuming anything if it holds anything else, it is parsed element by element then.
+	// Floats are checked first and then converted in a loop without branches, one byte swap per value.
+	// The type byte in front of each value keeps the values from being loaded as vectors, though
+	bool ParseNumericArray(uint32 Num)
+	{
+		const uint8* In = Data + Position;
+		const int64 Available = Size - Position;
+		if (In[0] == 0xcb || In[0] == 0xca) {
+			const uint8 Type = In[0];
+			const int64 Stride = Type == 0xcb ? 9 : 5;
+			if ((int64)Num * Stride > Available) {
+				return false;
+			}
+			for (uint32 Index = 0; Index < Num; Index++) {
+				if (In[Index * Stride] != Type) {
+					return false;
+				}
+			}
+			NumericValues.SetNumUninitialized(Num, false);
+			float* Out = NumericValues.GetData();
+			if (Type == 0xcb) {
+				for (uint32 Index = 0; Index < Num; Index++) {
+					uint64 Bits;
+					FMemory::Memcpy(&Bits, In + Index * 9 + 1, sizeof(Bits));
+					Bits = BYTESWAP_ORDER64(Bits);
+					double Double;
+					FMemory::Memcpy(&Double, &Bits, sizeof(Double));
+					Out[Index] = (float)Double;
+				}
+			} else {
+				for (uint32 Index = 0; Index < Num; Index++) {
+					uint32 Bits;
+					FMemory::Memcpy(&Bits, In + Index * 5 + 1, sizeof(Bits));
+					Bits = BYTESWAP_ORDER32(Bits);
+					FMemory::Memcpy(&Out[Index], &Bits, sizeof(Bits));
+				}
+			}
+			Position += (int64)Num * Stride;
+			return true;
+		}
+
+		// Integers are packed as small as they fit, so their sizes differ. Checked while decoding
+		NumericValues.SetNumUninitialized(Num, false);
+		float* Out = NumericValues.GetData();
+		int64 Offset = 0;
+		for (uint32 Index = 0; Index < Num; Index++) {
+			if (Offset >= Available) {
+				return false;
+			}
+			const uint8 Type = In[Offset++];
+			if (Type <= 0x7f) {
+				Out[Index] = (float)Type;
+				continue;
+			}
+			if (Type >= 0xe0) {
+				Out[Index] = (float)(int8)Type;
+				continue;
+			}
+			const bool bSigned = Type >= 0xd0 && Type <= 0xd3;
+			if (!bSigned && !(Type >= 0xcc && Type <= 0xcf)) {
+				return false;
+			}
+			const int32 Bytes = 1 << (Type - (bSigned ? 0xd0 : 0xcc));
+			if (Bytes > Available - Offset) {
+				return false;
+			}
+			uint64 Value = 0;
+			for (int32 Byte = 0; Byte < Bytes; Byte++) {
+				Value = (Value << 8) | In[Offset++];
+			}
+			const int32 Shift = 64 - Bytes * 8;
+			Out[Index] = bSigned ? (float)((int64)(Value << Shift) >> Shift) : (float)Value;
+		}
+		Position += Offset;
+		return true;
+	}
+};
@@ -0,0 +1,107 @@
+/*
+This file NeuralPackedReader.h is part of NeuralVisUAL.
+
+NeuralVisUAL is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+NeuralVisUAL is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with NeuralVisUAL.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+// Reads big endian msgpack headers from the front of a message, without unpacking it.
+// Used to look at the type of a message before it is parsed, see FNeuralMessageFilter and
+// the message handlers in NeuralInteractionClient.cpp
+struct FNeuralPackedReader
+{
+	const uint8* Data;
+	int64 Size;
+	int64 Position = 0;
+
+	bool ReadUnsigned(int32 Bytes, uint64& OutValue)
+	{
+		if (Position + Bytes > Size) {
+			return false;
+		}
+		OutValue = 0;
+		for (int32 Index = 0; Index < Bytes; Index++) {
+			OutValue = (OutValue << 8) | Data[Position++];
+		}
+		return true;
+	}
+
+	bool ReadArrayHeader(uint64& OutNum)
+	{
+		if (Position >= Size) {
+			return false;
+		}
+		const uint8 Type = Data[Position++];
+		if ((Type & 0xf0) == 0x90) {
+			OutNum = Type & 0x0f;
+			return true;
+		}
+		return (Type == 0xdc && ReadUnsigned(2, OutNum)) || (Type == 0xdd && ReadUnsigned(4, OutNum));
+	}
+
+	bool ReadString(const uint8*& OutString, int64& OutLength)
+	{
+		if (Position >= Size) {
+			return false;
+		}
+		const uint8 Type = Data[Position++];
+		uint64 Length = 0;
+		if ((Type & 0xe0) == 0xa0) {
+			Length = Type & 0x1f;
+		} else if (!(Type == 0xd9 && ReadUnsigned(1, Length)) && !(Type == 0xda && ReadUnsigned(2, Length)) &&
+			!(Type == 0xdb && ReadUnsigned(4, Length))) {
+			return false;
+		}
+		if ((int64)Length > Size - Position) {
+			return false;
+		}
+		OutString = Data + Position;
+		OutLength = (int64)Length;
+		Position += OutLength;
+		return true;
+	}
+
+	bool ReadInteger(int64& OutValue)
+	{
+		if (Position >= Size) {
+			return false;
+		}
+		const uint8 Type = Data[Position++];
+		uint64 Value = 0;
+		if (Type <= 0x7f) {
+			OutValue = Type;
+		} else if (Type >= 0xe0) {
+			OutValue = (int8)Type;
+		} else if (Type >= 0xcc && Type <= 0xcf) {
+			if (!ReadUnsigned(1 << (Type - 0xcc), Value)) {
+				return false;
+			}
+			OutValue = (int64)FMath::Min<uint64>(Value, MAX_int64);
+		} else if (Type >= 0xd0 && Type <= 0xd3) {
+			const int32 Bytes = 1 << (Type - 0xd0);
+			if (!ReadUnsigned(Bytes, Value)) {
+				return false;
+			}
+			// Sign extension
+			const int32 Shift = 64 - Bytes * 8;
+			OutValue = (int64)(Value << Shift) >> Shift;
+		} else {
+			return false;
+		}
+		return true;
+	}
+};
@@ -0,0 +1,356 @@
+/*
+This file NeuralResponseCache.cpp is part of NeuralVisUAL.
+
+NeuralVisUAL is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+NeuralVisUAL is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with NeuralVisUAL.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "NeuralResponseCache.h"
+#include "NeuralEndpointRouter.h"
+#include "NeuralInteractionClientLog.h"
+#include "Async/Async.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Misc/ScopeLock.h"
+#include "Serialization/MemoryReader.h"
+#include "Serialization/MemoryWriter.h"
+
+namespace
+{
+	// Bump whenever the file layout changes, older files are ignored then
+	const int32 ResponseCacheVersion = 3;
+}
+
+FNeuralResponseCache& FNeuralResponseCache::Get()
+{
+	static FNeuralResponseCache Instance;
+	return Instance;
+}
+
+FNeuralResponseCache::FNeuralResponseCache()
+{
+	// Answers to these only change with another model epoch. Status, server info and
+	// variables change without one, so they are never cached
+	CacheablePrefixes = {
+		NormalizeCommand(TEXT("tf get structure")),
+		NormalizeCommand(TEXT("tf get layers")),
+		NormalizeCommand(TEXT("tf get version")),
+		NormalizeCommand(TEXT("tf get kernel")),
+	};
+	// Sent by this client, these change the epoch before the server can tell us
+	InvalidatingPrefixes = {
+		NormalizeCommand(TEXT("nn load")),
+		NormalizeCommand(TEXT("tf reset structure")),
+		NormalizeCommand(TEXT("server reset")),
+		NormalizeCommand(TEXT("server restart")),
+		NormalizeCommand(TEXT("server reload")),
+	};
+}
+
+FString FNeuralResponseCache::NormalizeCommand(const FString& Command)
+{
+	FString Normalized = Command.ToLower();
+	Normalized.ReplaceInline(TEXT(" "), TEXT(""));
+	Normalized.ReplaceInline(TEXT("\t"), TEXT(""));
+	return Normalized;
+}
+
+FString FNeuralResponseCache::GetFilename()
+{
+	return FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("NeuralVisUAL"), TEXT("ResponseCache.bin"));
+}
+
+bool FNeuralResponseCache::IsCacheable(const FString& Command) const
+{
+	// Chained commands could contain anything
+	if (Command.Contains(TEXT("&"))) {
+		return false;
+	}
+	const FString Normalized = NormalizeCommand(Command);
+	FScopeLock ScopeLock(&Lock);
+	if (!bEnabled) {
+		return false;
+	}
+	for (const FString& Prefix : CacheablePrefixes) {
+		if (Normalized.StartsWith(Prefix)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+void FNeuralResponseCache::NotifyCommandSent(const FString& Command)
+{
+	// Every part of a chain may invalidate
+	bool bInvalidates = false;
+	TArray<FString> Parts;
+	Command.ToLower().ParseIntoArray(Parts, TEXT("&"));
+	for (const FString& Part : Parts) {
+		const FString NormalizedPart = NormalizeCommand(Part);
+		for (const FString& Prefix : InvalidatingPrefixes) {
+			bInvalidates |= NormalizedPart.StartsWith(Prefix);
+		}
+	}
+	if (bInvalidates) {
+		UE_LOG(NeuralInteractionClient, Verbose, TEXT("\"%s\" invalidates the response cache."), *Command);
+		FScopeLock ScopeLock(&Lock);
+		Entries.Empty();
+		LiveEpochs.Empty();
+		CurrentEpoch.Empty();
+		MarkDirty();
+	}
+}
+
+void FNeuralResponseCache::ObserveEpoch(const FString& Server, const FString& Epoch)
+{
+	FScopeLock ScopeLock(&Lock);
+	CurrentEpoch = Epoch;
+	FLiveEpoch& LiveEpoch = LiveEpochs.FindOrAdd(Server.ToLower());
+	LiveEpoch.ReceivedAt = FPlatformTime::Seconds();
+	if (Epoch == LiveEpoch.Epoch) {
+		return;
+	}
+	LiveEpoch.Epoch = Epoch;
+	const int32 NumberBefore = Entries.Num();
+	for (auto It = Entries.CreateIterator(); It; ++It) {
+		if (It.Value().Server == Server.ToLower() && It.Value().Epoch != Epoch) {
+			It.RemoveCurrent();
+		}
+	}
+	if (NumberBefore != Entries.Num()) {
+		UE_LOG(NeuralInteractionClient, Log, TEXT("Model epoch changed to %s, dropped %d cached responses."),
+			*Epoch, NumberBefore - Entries.Num());
+		MarkDirty();
+	}
+}
+
+FString FNeuralResponseCache::GetCurrentEpoch() const
+{
+	FScopeLock ScopeLock(&Lock);
+	return CurrentEpoch;
+}
+
+const FString* FNeuralResponseCache::FindLiveEpoch(const FString& Server) const
+{
+	const FLiveEpoch* LiveEpoch = LiveEpochs.Find(Server.ToLower());
+	if (!LiveEpoch || FPlatformTime::Seconds() - LiveEpoch->ReceivedAt > EpochValiditySeconds) {
+		return nullptr;
+	}
+	return &LiveEpoch->Epoch;
+}
+
+FString FNeuralResponseCache::GetKey(const FString& Server, const FString& Command)
+{
+	// Normalized commands contain no spaces
+	return Server.ToLower() + TEXT(" ") + NormalizeCommand(Command);
+}
+
+bool FNeuralResponseCache::Find(const FString& Server, const FString& Command, TArray<TArray<uint8>>& OutMessages) const
+{
+	if (!IsCacheable(Command)) {
+		return false;
+	}
+	FScopeLock ScopeLock(&Lock);
+	const FEntry* Entry = Entries.Find(GetKey(Server, Command));
+	const FString* LiveEpoch = FindLiveEpoch(Server);
+	if (!Entry || !LiveEpoch || Entry->Epoch != *LiveEpoch) {
+		return false;
+	}
+	OutMessages = *Entry->Messages;
+	return true;
+}
+
+void FNeuralResponseCache::Store(const FString& Server, const FString& Command, const FString& Epoch,
+	TArray<TArray<uint8>>&& Messages)
+{
+	FScopeLock ScopeLock(&Lock);
+	// Responses recorded before an epoch change are already outdated
+	const FLiveEpoch* LiveEpoch = LiveEpochs.Find(Server.ToLower());
+	if (!bEnabled || Epoch.IsEmpty() || !LiveEpoch || Epoch != LiveEpoch->Epoch) {
+		return;
+	}
+	FEntry& Entry = Entries.FindOrAdd(GetKey(Server, Command));
+	Entry.Server = Server.ToLower();
+	Entry.Epoch = Epoch;
+	Entry.Messages = MakeShared<const TArray<TArray<uint8>>, ESPMode::ThreadSafe>(MoveTemp(Messages));
+	MarkDirty();
+}
+
+void FNeuralResponseCache::Clear()
+{
+	FScopeLock ScopeLock(&Lock);
+	Entries.Empty();
+	MarkDirty();
+}
+
+void FNeuralResponseCache::SetEnabled(bool bInEnabled)
+{
+	FScopeLock ScopeLock(&Lock);
+	bEnabled = bInEnabled;
+	if (!bEnabled) {
+		Entries.Empty();
+	}
+}
+
+bool FNeuralResponseCache::IsEnabled() const
+{
+	FScopeLock ScopeLock(&Lock);
+	return bEnabled;
+}
+
+void FNeuralResponseCache::SetEpochValidity(double Seconds)
+{
+	FScopeLock ScopeLock(&Lock);
+	EpochValiditySeconds = FMath::Max(Seconds, 0.0);
+}
+
+double FNeuralResponseCache::GetEpochValidity() const
+{
+	FScopeLock ScopeLock(&Lock);
+	return EpochValiditySeconds;
+}
+
+void FNeuralResponseCache::SetPersistent(bool bInPersistent)
+{
+	FScopeLock ScopeLock(&Lock);
+	if (bPersistent == bInPersistent) {
+		return;
+	}
+	bPersistent = bInPersistent;
+	if (bPersistent) {
+		LoadFromDisk();
+	}
+}
+
+bool FNeuralResponseCache::IsPersistent() const
+{
+	FScopeLock ScopeLock(&Lock);
+	return bPersistent;
+}
+
+int32 FNeuralResponseCache::Num() const
+{
+	FScopeLock ScopeLock(&Lock);
+	return Entries.Num();
+}
+
+void FNeuralResponseCache::LoadFromDisk()
+{
+	TArray<uint8> Bytes;
+	if (!FFileHelper::LoadFileToArray(Bytes, *GetFilename(), FILEREAD_Silent)) {
+		return;
+	}
+	FMemoryReader Reader(Bytes);
+	int32 Version = 0;
+	TMap<FString, FString> Epochs;
+	TMap<FString, TArray<TArray<uint8>>> Loaded;
+	Reader << Version;
+	if (Version != ResponseCacheVersion) {
+		return;
+	}
+	Reader << Epochs << Loaded;
+	if (Reader.IsError()) {
+		UE_LOG(NeuralInteractionClient, Warning, TEXT("Response cache %s is corrupt and will be ignored."), *GetFilename());
+		return;
+	}
+	// The stored epochs are not trusted, entries are only replayed once their server confirms them
+	int32 Number = 0;
+	for (TPair<FString, TArray<TArray<uint8>>>& Pair : Loaded) {
+		const FString* Epoch = Epochs.Find(Pair.Key);
+		FString Server;
+		if (!Epoch || !Pair.Key.Split(TEXT(" "), &Server, nullptr) || Entries.Contains(Pair.Key)) {
+			continue;
+		}
+		// Epochs received meanwhile are newer than the file
+		const FLiveEpoch* LiveEpoch = LiveEpochs.Find(Server);
+		if (LiveEpoch && LiveEpoch->Epoch != *Epoch) {
+			continue;
+		}
+		FEntry& Entry = Entries.Add(Pair.Key);
+		Entry.Server = Server;
+		Entry.Epoch = *Epoch;
+		Entry.Messages = MakeShared<const TArray<TArray<uint8>>, ESPMode::ThreadSafe>(MoveTemp(Pair.Value));
+		Number++;
+	}
+	UE_LOG(NeuralInteractionClient, Log, TEXT("Loaded %d cached responses."), Number);
+}
+
+void FNeuralResponseCache::MarkDirty()
+{
+	if (!bPersistent || bSaveScheduled) {
+		return;
+	}
+	bSaveScheduled = true;
+	Async(EAsyncExecution::ThreadPool, [this]()
+	{
+		SaveToDisk();
+	});
+}
+
+void FNeuralResponseCache::SaveToDisk()
+{
+	FScopeLock SaveScopeLock(&SaveLock);
+	TMap<FString, FString> Epochs;
+	TMap<FString, FMessages> Snapshot;
+	{
+		// Changes from here on schedule another save, which waits for this one
+		FScopeLock ScopeLock(&Lock);
+		bSaveScheduled = false;
+		for (const TPair<FString, FEntry>& Pair : Entries) {
+			Epochs.Add(Pair.Key, Pair.Value.Epoch);
+			Snapshot.Add(Pair.Key, Pair.Value.Messages);
+		}
+	}
+	TMap<FString, TArray<TArray<uint8>>> Saved;
+	for (const TPair<FString, FMessages>& Pair : Snapshot) {
+		Saved.Add(Pair.Key, *Pair.Value);
+	}
+	TArray<uint8> Bytes;
+	FMemoryWriter Writer(Bytes);
+	int32 Version = ResponseCacheVersion;
+	Writer << Version << Epochs << Saved;
+	FFileHelper::SaveArrayToFile(Bytes, *GetFilename());
+}
+
+void UNeuralResponseCacheBPLibrary::SetResponseCacheEnabled(bool bEnabled)
+{
+	FNeuralResponseCache::Get().SetEnabled(bEnabled);
+}
+
+void UNeuralResponseCacheBPLibrary::SetResponseCachePersistent(bool bPersistent)
+{
+	FNeuralResponseCache::Get().SetPersistent(bPersistent);
+}
+
+void UNeuralResponseCacheBPLibrary::ClearResponseCache()
+{
+	FNeuralResponseCache::Get().Clear();
+}
+
+void UNeuralResponseCacheBPLibrary::SetResponseCacheEpochValidity(float Seconds)
+{
+	FNeuralResponseCache::Get().SetEpochValidity(Seconds);
+}
+
+bool UNeuralResponseCacheBPLibrary::IsResponseCached(const FString& Command)
+{
+	const FNeuralRoute Route = FNeuralEndpointRouter::Get().Route(Command);
+	const FString Server = FString::Printf(TEXT("%s:%d"), *Route.Endpoint.Host, Route.Endpoint.Port);
+	TArray<TArray<uint8>> Messages;
+	return FNeuralResponseCache::Get().Find(Server, Route.Command, Messages);
+}
+
+FString UNeuralResponseCacheBPLibrary::GetModelEpoch()
+{
+	return FNeuralResponseCache::Get().GetCurrentEpoch();
+}
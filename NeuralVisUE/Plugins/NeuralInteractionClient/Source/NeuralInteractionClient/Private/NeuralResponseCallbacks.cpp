@@ -0,0 +1,180 @@
+/*
+This file NeuralResponseCallbacks.cpp is part of NeuralVisUAL.
+
+NeuralVisUAL is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+NeuralVisUAL is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with NeuralVisUAL.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "NeuralResponseCallbacks.h"
+#include "Async/Async.h"
+
+namespace
+{
+	// Bytes as characters, like the Blueprint delegates always got them
+	void AssignBytes(FString& Out, TArrayView<const uint8> Value)
+	{
+		Out.Reset(Value.Num());
+		for (const uint8 Byte : Value) {
+			Out.AppendChar((TCHAR)Byte);
+		}
+	}
+}
+
+bool FNeuralResponseCallbacks::HasElementCallbacks() const
+{
+	return OnParseError || OnStartOrEndOfMap || OnStartOrEndOfArray || OnNil || OnString || OnBinary ||
+		OnExtension || OnBoolean || OnInteger || OnFloat || OnFloatArray;
+}
+
+FNeuralResponseCallbacks FNeuralResponseCallbacks::FromDelegate(const FReadResponse& Callback)
+{
+	FNeuralResponseCallbacks Callbacks;
+	if (Callback.IsBound()) {
+		// The string is kept by the callback, so that it keeps its allocation from one call to the next
+		Callbacks.OnString = [Callback, String = FString()](const FString&, const FString&, const FString&,
+			TArrayView<const uint8> Value) mutable
+		{
+			AssignBytes(String, Value);
+			Callback.Execute(String);
+		};
+	}
+	return Callbacks;
+}
+
+FNeuralResponseCallbacks FNeuralResponseCallbacks::FromDelegates(
+	const FEndOfConnection& CallbackEndOfConnection,
+	const FStartOrEndOfResponse& CallbackStartOrEndOfResponse,
+	const FParseError& CallbackParseError,
+	const FStartOrEndOfMap& CallbackStartOrEndOfMap,
+	const FStartOrEndOfArray& CallbackStartOrEndOfArray,
+	const FFoundAtomNil& CallbackFoundAtomNil,
+	const FFoundAtomString& CallbackFoundAtomString,
+	const FFoundAtomBinary& CallbackFoundAtomBinary,
+	const FFoundAtomExternal& CallbackFoundAtomExternal,
+	const FFoundAtomBoolean& CallbackFoundAtomBoolean,
+	const FFoundAtomInteger& CallbackFoundAtomInteger,
+	const FFoundAtomInteger64& CallbackFoundAtomInteger64,
+	const FFoundAtomFloat& CallbackFoundAtomFloat)
+{
+	FNeuralResponseCallbacks Callbacks;
+	if (CallbackEndOfConnection.IsBound()) {
+		Callbacks.OnEndOfConnection = [CallbackEndOfConnection](const FString& Command, bool bForciblyClosed)
+		{
+			CallbackEndOfConnection.Execute(Command, bForciblyClosed);
+		};
+	}
+	if (CallbackStartOrEndOfResponse.IsBound()) {
+		Callbacks.OnStartOrEndOfResponse = [CallbackStartOrEndOfResponse](const FString& Command, const FString& FirstString, bool bEnd)
+		{
+			CallbackStartOrEndOfResponse.Execute(Command, FirstString, bEnd);
+		};
+	}
+	if (CallbackParseError.IsBound()) {
+		Callbacks.OnParseError = [CallbackParseError](const FString& Command, const FString& FirstString,
+			const FString& ArrayPosition, bool bDueToInsufficientBytes)
+		{
+			CallbackParseError.Execute(Command, FirstString, ArrayPosition, bDueToInsufficientBytes);
+		};
+	}
+	if (CallbackStartOrEndOfMap.IsBound()) {
+		Callbacks.OnStartOrEndOfMap = [CallbackStartOrEndOfMap](const FString& Command, const FString& FirstString,
+			const FString& ArrayPosition, bool bEnd)
+		{
+			CallbackStartOrEndOfMap.Execute(Command, FirstString, ArrayPosition, bEnd);
+		};
+	}
+	if (CallbackStartOrEndOfArray.IsBound()) {
+		Callbacks.OnStartOrEndOfArray = [CallbackStartOrEndOfArray](const FString& Command, const FString& FirstString,
+			const FString& ArrayPosition, bool bEnd)
+		{
+			CallbackStartOrEndOfArray.Execute(Command, FirstString, ArrayPosition, bEnd);
+		};
+	}
+	if (CallbackFoundAtomNil.IsBound()) {
+		Callbacks.OnNil = [CallbackFoundAtomNil](const FString& Command, const FString& FirstString, const FString& ArrayPosition)
+		{
+			CallbackFoundAtomNil.Execute(Command, FirstString, ArrayPosition);
+		};
+	}
+	if (CallbackFoundAtomString.IsBound()) {
+		Callbacks.OnString = [CallbackFoundAtomString, String = FString()](const FString& Command, const FString& FirstString,
+			const FString& ArrayPosition, TArrayView<const uint8> Value) mutable
+		{
+			AssignBytes(String, Value);
+			CallbackFoundAtomString.Execute(Command, FirstString, ArrayPosition, String);
+		};
+	}
+	if (CallbackFoundAtomBinary.IsBound()) {
+		Callbacks.OnBinary = [CallbackFoundAtomBinary, String = FString()](const FString& Command, const FString& FirstString,
+			const FString& ArrayPosition, TArrayView<const uint8> Value) mutable
+		{
+			AssignBytes(String, Value);
+			CallbackFoundAtomBinary.Execute(Command, FirstString, ArrayPosition, String);
+		};
+	}
+	if (CallbackFoundAtomExternal.IsBound()) {
+		Callbacks.OnExtension = [CallbackFoundAtomExternal, String = FString()](const FString& Command, const FString& FirstString,
+			const FString& ArrayPosition, TArrayView<const uint8> Value) mutable
+		{
+			AssignBytes(String, Value);
+			CallbackFoundAtomExternal.Execute(Command, FirstString, ArrayPosition, String);
+		};
+	}
+	if (CallbackFoundAtomBoolean.IsBound()) {
+		Callbacks.OnBoolean = [CallbackFoundAtomBoolean](const FString& Command, const FString& FirstString,
+			const FString& ArrayPosition, bool Value)
+		{
+			CallbackFoundAtomBoolean.Execute(Command, FirstString, ArrayPosition, Value);
+		};
+	}
+	// Blueprints only have int32 and int64 pins, integers go to the one they fit into
+	if (CallbackFoundAtomInteger.IsBound() || CallbackFoundAtomInteger64.IsBound()) {
+		Callbacks.OnInteger = [CallbackFoundAtomInteger, CallbackFoundAtomInteger64](const FString& Command,
+			const FString& FirstString, const FString& ArrayPosition, int64 Value)
+		{
+			if (Value >= MIN_int32 && Value <= MAX_int32) {
+				CallbackFoundAtomInteger.ExecuteIfBound(Command, FirstString, ArrayPosition, (int32)Value);
+			} else {
+				CallbackFoundAtomInteger64.ExecuteIfBound(Command, FirstString, ArrayPosition, Value);
+			}
+		};
+	}
+	if (CallbackFoundAtomFloat.IsBound()) {
+		Callbacks.OnFloat = [CallbackFoundAtomFloat](const FString& Command, const FString& FirstString,
+			const FString& ArrayPosition, double Value)
+		{
+			CallbackFoundAtomFloat.Execute(Command, FirstString, ArrayPosition, (float)Value);
+		};
+	}
+	return Callbacks;
+}
+
+FNeuralResponseCallbacks FNeuralResponseCallbacks::FromDelegateOnGameThread(const FFoundAtomString& CallbackFoundAtomString)
+{
+	FNeuralResponseCallbacks Callbacks;
+	if (CallbackFoundAtomString.IsBound()) {
+		Callbacks.OnString = [CallbackFoundAtomString](const FString& Command, const FString& FirstString,
+			const FString& ArrayPosition, TArrayView<const uint8> Value)
+		{
+			// Copied, as the view is only valid during the call
+			FString String;
+			AssignBytes(String, Value);
+			AsyncTask(ENamedThreads::GameThread, [CallbackFoundAtomString, Command, FirstString, ArrayPosition,
+				String = MoveTemp(String)]()
+			{
+				CallbackFoundAtomString.ExecuteIfBound(Command, FirstString, ArrayPosition, String);
+			});
+		};
+	}
+	return Callbacks;
+}
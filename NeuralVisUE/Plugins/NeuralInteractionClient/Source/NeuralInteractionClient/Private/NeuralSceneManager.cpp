@@ -0,0 +1,623 @@
+/*
+This file NeuralSceneManager.cpp is part of NeuralVisUAL.
+
+NeuralVisUAL is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+NeuralVisUAL is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with NeuralVisUAL.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "NeuralSceneManager.h"
+#include "NeuralCommandScheduler.h"
+#include "NeuralInteractionClientLog.h"
+#include "NeuralInteractionEvents.h"
+#include "NeuralLayerGraph.h"
+#include "NeuralLayoutCache.h"
+#include "NeuralModelContext.h"
+#include "Components/StaticMeshComponent.h"
+#include "Components/InstancedStaticMeshComponent.h"
+#include "Materials/MaterialInstanceDynamic.h"
+#include "Engine/StaticMesh.h"
+#include "Async/Async.h"
+#include "Async/ParallelFor.h"
+
+namespace
+{
+	// Whether a response parsed on this thread belongs to the model context of a manager
+	bool IsResponseOfContext(const FString& ModelContext)
+	{
+		if (ModelContext.IsEmpty()) {
+			return true;
+		}
+		const FNeuralModelContext* Context = FNeuralModelContexts::GetContextOfResponse();
+		return Context && Context->GetName().Equals(ModelContext, ESearchCase::IgnoreCase);
+	}
+}
+
+bool FNeuralSceneKey::Parse(const FString& Identity, FNeuralSceneKey& OutKey, bool bAllowPartial)
+{
+	TArray<FString> Parts;
+	Identity.ParseIntoArrayWS(Parts);
+	if (Parts.Num() == 0) {
+		return false;
+	}
+
+	ENeuralSceneObjectKind Kind;
+	int32 ExpectedNumbers;
+	if (Parts[0] == TEXT("layer")) {
+		Kind = ENeuralSceneObjectKind::Layer;
+		ExpectedNumbers = 1;
+	} else if (Parts[0] == TEXT("connection")) {
+		Kind = ENeuralSceneObjectKind::Connection;
+		ExpectedNumbers = 2;
+	} else if (Parts[0] == TEXT("kernel")) {
+		Kind = ENeuralSceneObjectKind::KernelTile;
+		ExpectedNumbers = 3;
+	} else {
+		return false;
+	}
+	if (Parts.Num() > ExpectedNumbers + 1 || (!bAllowPartial && Parts.Num() != ExpectedNumbers + 1)) {
+		return false;
+	}
+
+	int32 Numbers[3] = { -1, -1, -1 };
+	for (int32 i = 0; i < Parts.Num() - 1; i++) {
+		if (!Parts[i + 1].IsNumeric()) {
+			return false;
+		}
+		Numbers[i] = FCString::Atoi(*Parts[i + 1]);
+	}
+	OutKey = FNeuralSceneKey(Kind, Numbers[0], Numbers[1], Numbers[2]);
+	return true;
+}
+
+bool FNeuralSceneKey::IsWithin(const FNeuralSceneKey& Scope) const
+{
+	return Kind == Scope.Kind &&
+		(Scope.Primary < 0 || Primary == Scope.Primary) &&
+		(Scope.Secondary < 0 || Secondary == Scope.Secondary) &&
+		(Scope.Tertiary < 0 || Tertiary == Scope.Tertiary);
+}
+
+FString FNeuralSceneKey::ToString() const
+{
+	switch (Kind) {
+	case ENeuralSceneObjectKind::Layer:
+		return FString::Printf(TEXT("layer %d"), Primary);
+	case ENeuralSceneObjectKind::Connection:
+		return FString::Printf(TEXT("connection %d %d"), Primary, Secondary);
+	case ENeuralSceneObjectKind::KernelTile:
+		return FString::Printf(TEXT("kernel %d %d %d"), Primary, Secondary, Tertiary);
+	default:
+		return FString::Printf(TEXT("unkeyed %d"), Primary);
+	}
+}
+
+ANeuralSceneManager::ANeuralSceneManager()
+{
+	PrimaryActorTick.bCanEverTick = false;
+	SceneRoot = CreateDefaultSubobject<USceneComponent>(TEXT("SceneRoot"));
+	SceneRoot->SetMobility(EComponentMobility::Movable);
+	RootComponent = SceneRoot;
+
+	ConnectionInstances = CreateDefaultSubobject<UInstancedStaticMeshComponent>(TEXT("ConnectionInstances"));
+	ConnectionInstances->SetMobility(EComponentMobility::Movable);
+	ConnectionInstances->SetupAttachment(SceneRoot);
+	ConnectionInstances->SetCollisionEnabled(ECollisionEnabled::NoCollision);
+}
+
+void ANeuralSceneManager::BeginPlay()
+{
+	Super::BeginPlay();
+	if (!bApplyServerInstructions) {
+		return;
+	}
+
+	// Called on the threads of the commands, the instructions are applied on the game thread in order
+	TWeakObjectPtr<ANeuralSceneManager> WeakThis(this);
+	SceneRedrawListener = FNeuralInteractionEvents::AddSceneRedrawListener(FOnNeuralSceneRedraw::FDelegate::CreateLambda(
+		[WeakThis, Context = ModelContext](const FString& OriginalCommand, bool bBegin, const TArray<FString>& Scopes)
+	{
+		if (!IsResponseOfContext(Context)) {
+			return;
+		}
+		AsyncTask(ENamedThreads::GameThread, [WeakThis, bBegin, Scopes]()
+		{
+			if (ANeuralSceneManager* This = WeakThis.Get()) {
+				if (bBegin) {
+					This->BeginRedraw(Scopes);
+				} else {
+					This->EndRedraw(Scopes);
+				}
+			}
+		});
+	}));
+	CuboidSpawnListener = FNeuralInteractionEvents::AddCuboidSpawnListener(FOnNeuralCuboidsSpawned::FDelegate::CreateLambda(
+		[WeakThis, Context = ModelContext](const FString& OriginalCommand, const TArray<FNeuralCuboidInstruction>& Cuboids)
+	{
+		if (!IsResponseOfContext(Context)) {
+			return;
+		}
+		// The server waits for "server draw next" before it sends the next batch, see waitForServerDrawNext
+		const FNeuralModelContext* ResponseContext = FNeuralModelContexts::GetContextOfResponse();
+		const FString DrawNext = ResponseContext ? ResponseContext->MakeCommand(TEXT("server draw next")) : TEXT("server draw next");
+		AsyncTask(ENamedThreads::GameThread, [WeakThis, Cuboids, DrawNext]()
+		{
+			if (ANeuralSceneManager* This = WeakThis.Get()) {
+				for (const FNeuralCuboidInstruction& Cuboid : Cuboids) {
+					This->ApplyCuboidInstruction(Cuboid.Identity, Cuboid.Properties);
+				}
+			}
+			FNeuralCommandScheduler::Get().Schedule(DrawNext, ENeuralCommandPriority::Interactive);
+		});
+	}));
+	// Applied after the layer cuboids sent before, BuildConnections takes their boxes
+	ConnectionSpawnListener = FNeuralInteractionEvents::AddConnectionSpawnListener(FOnNeuralConnectionsSpawned::FDelegate::CreateLambda(
+		[WeakThis, Context = ModelContext](const FString& OriginalCommand, const TArray<float>& Style, const TArray<int32>& Edges)
+	{
+		if (!IsResponseOfContext(Context)) {
+			return;
+		}
+		AsyncTask(ENamedThreads::GameThread, [WeakThis, Style, Edges]()
+		{
+			if (ANeuralSceneManager* This = WeakThis.Get()) {
+				This->ApplyConnectionInstruction(Style, Edges);
+			}
+		});
+	}));
+}
+
+void ANeuralSceneManager::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	FNeuralInteractionEvents::RemoveListener(SceneRedrawListener);
+	FNeuralInteractionEvents::RemoveListener(CuboidSpawnListener);
+	FNeuralInteractionEvents::RemoveListener(ConnectionSpawnListener);
+	SceneRedrawListener.Reset();
+	CuboidSpawnListener.Reset();
+	ConnectionSpawnListener.Reset();
+	Super::EndPlay(EndPlayReason);
+}
+
+void ANeuralSceneManager::BeginRedraw(const TArray<FString>& Scopes)
+{
+	// Objects touched from now on are at least as new as the generation of the scopes
+	CurrentGeneration++;
+	const TArray<FString> EffectiveScopes = Scopes.Num() > 0 ? Scopes : TArray<FString>{ FString() };
+	for (const FString& Scope : EffectiveScopes) {
+		const FString Trimmed = Scope.TrimStartAndEnd();
+		RedrawGenerations.Add(Trimmed, CurrentGeneration);
+		if (Trimmed.IsEmpty()) {
+			UnkeyedCounter = 0;
+		}
+	}
+}
+
+void ANeuralSceneManager::EndRedraw(const TArray<FString>& Scopes)
+{
+	const TArray<FString> EffectiveScopes = Scopes.Num() > 0 ? Scopes : TArray<FString>{ FString() };
+	bool bLayersRedrawn = false;
+	// Collect first, releasing modifies ActiveObjects
+	TArray<int32> Untouched;
+	for (const FString& Scope : EffectiveScopes) {
+		const FString Trimmed = Scope.TrimStartAndEnd();
+		uint32 BeginGeneration;
+		if (!RedrawGenerations.RemoveAndCopyValue(Trimmed, BeginGeneration)) {
+			UE_LOG(NeuralInteractionClient, Warning, TEXT("Redraw of \"%s\" ended without BeginRedraw."), *Trimmed);
+			continue;
+		}
+		FNeuralSceneKey ScopeKey;
+		const bool bEverything = Trimmed.IsEmpty();
+		if (!bEverything && !FNeuralSceneKey::Parse(Trimmed, ScopeKey, true)) {
+			UE_LOG(NeuralInteractionClient, Warning, TEXT("Unknown redraw scope \"%s\"."), *Trimmed);
+			continue;
+		}
+		for (const TPair<FNeuralSceneKey, int32>& Entry : ActiveObjects) {
+			if (Slots[Entry.Value].Generation < BeginGeneration &&
+				(bEverything || Entry.Key.IsWithin(ScopeKey))) {
+				Untouched.Add(Entry.Value);
+			}
+		}
+		bLayersRedrawn |= bEverything || ScopeKey.Kind == ENeuralSceneObjectKind::Layer;
+	}
+	// Nested scopes may both contain a slot, released slots are skipped by ReleaseSlot
+	for (int32 Slot : Untouched) {
+		ReleaseSlot(Slot);
+	}
+	UE_LOG(NeuralInteractionClient, Verbose, TEXT("Redraw finished: %d active, %d released, %d pooled objects."),
+		ActiveObjects.Num(), Untouched.Num(), FreeSlots.Num());
+
+	if (bAutoSaveLayoutSnapshots && bLayersRedrawn) {
+		const FString LayoutKey = GetLayoutKey();
+		if (!LayoutKey.IsEmpty()) {
+			SaveLayoutSnapshot(LayoutKey);
+		}
+	}
+}
+
+int32 ANeuralSceneManager::AcquireSlot()
+{
+	if (FreeSlots.Num() > 0) {
+		return FreeSlots.Pop(false);
+	}
+
+	UStaticMeshComponent* Component = NewObject<UStaticMeshComponent>(this);
+	Component->SetMobility(EComponentMobility::Movable);
+	Component->SetupAttachment(SceneRoot);
+	Component->SetStaticMesh(CuboidMesh);
+	UMaterialInstanceDynamic* Material = nullptr;
+	if (CuboidMaterial) {
+		Material = UMaterialInstanceDynamic::Create(CuboidMaterial, this);
+		Component->SetMaterial(0, Material);
+	}
+	Component->RegisterComponent();
+
+	const int32 Slot = Components.Add(Component);
+	Materials.Add(Material);
+	Slots.AddDefaulted();
+	SlotOfComponent.Add(Component, Slot);
+	return Slot;
+}
+
+void ANeuralSceneManager::ReleaseSlot(int32 Slot)
+{
+	FSlotState& State = Slots[Slot];
+	if (!State.bActive) {
+		return;
+	}
+	UStaticMeshComponent* Component = Components[Slot];
+	Component->SetVisibility(false);
+	Component->SetCollisionEnabled(ECollisionEnabled::NoCollision);
+	ActiveObjects.Remove(State.Key);
+	State.bActive = false;
+	FreeSlots.Add(Slot);
+}
+
+UStaticMeshComponent* ANeuralSceneManager::SpawnOrUpdateCuboid(const FNeuralSceneKey& Key, FVector Position,
+	FVector Scale, FLinearColor Color, FRotator Rotation)
+{
+	FNeuralSceneKey EffectiveKey = Key;
+	if (EffectiveKey.Kind == ENeuralSceneObjectKind::Unkeyed) {
+		// Without identity, the n-th unkeyed object of this redraw reuses the n-th one of the last redraw
+		EffectiveKey.Primary = UnkeyedCounter++;
+	}
+
+	int32 Slot;
+	if (const int32* Existing = ActiveObjects.Find(EffectiveKey)) {
+		Slot = *Existing;
+	} else {
+		Slot = AcquireSlot();
+		FSlotState& State = Slots[Slot];
+		State.Key = EffectiveKey;
+		State.bActive = true;
+		// Force the color to be written for reused objects
+		State.Color = FLinearColor(-1.f, -1.f, -1.f, -1.f);
+		ActiveObjects.Add(EffectiveKey, Slot);
+		Components[Slot]->SetVisibility(true);
+		Components[Slot]->SetCollisionEnabled(ECollisionEnabled::QueryOnly);
+	}
+
+	FSlotState& State = Slots[Slot];
+	State.Generation = CurrentGeneration;
+	UStaticMeshComponent* Component = Components[Slot];
+	Component->SetRelativeTransform(FTransform(Rotation, Position, Scale));
+
+	// Only touch the material if the color really changed, parameter updates are not free
+	if (State.Color != Color && Materials[Slot]) {
+		Materials[Slot]->SetVectorParameterValue(ColorParameterName, Color);
+		Materials[Slot]->SetScalarParameterValue(OpacityParameterName, Color.A);
+		State.Color = Color;
+	}
+	return Component;
+}
+
+UStaticMeshComponent* ANeuralSceneManager::ApplyCuboidInstruction(const FString& Identity, const TArray<float>& Properties)
+{
+	// position (3), size (3), color and opacity (4), rotator (3)
+	if (Properties.Num() < 13) {
+		UE_LOG(NeuralInteractionClient, Warning, TEXT("Cuboid instruction for \"%s\" only has %d instead of 13 values."),
+			*Identity, Properties.Num());
+		return nullptr;
+	}
+	FNeuralSceneKey Key;
+	if (!Identity.IsEmpty() && !FNeuralSceneKey::Parse(Identity, Key)) {
+		UE_LOG(NeuralInteractionClient, Warning, TEXT("Unknown identity \"%s\", treating cuboid as unkeyed."), *Identity);
+	}
+	const float* P = Properties.GetData();
+	// Rotator values are X = roll, Y = pitch, Z = yaw, same as the "Make Rotator" node
+	return SpawnOrUpdateCuboid(Key,
+		FVector(P[0], P[1], P[2]),
+		FVector(P[3], P[4], P[5]),
+		FLinearColor(P[6], P[7], P[8], P[9]),
+		FRotator(P[11], P[12], P[10]));
+}
+
+bool ANeuralSceneManager::ReleaseObject(const FNeuralSceneKey& Key)
+{
+	if (const int32* Slot = ActiveObjects.Find(Key)) {
+		ReleaseSlot(*Slot);
+		return true;
+	}
+	return false;
+}
+
+void ANeuralSceneManager::ReleaseAll()
+{
+	TArray<int32> Active;
+	ActiveObjects.GenerateValueArray(Active);
+	for (int32 Slot : Active) {
+		ReleaseSlot(Slot);
+	}
+}
+
+void ANeuralSceneManager::Prewarm(int32 NumberOfObjects)
+{
+	const int32 ToCreate = NumberOfObjects - Components.Num();
+	for (int32 i = 0; i < ToCreate; i++) {
+		const int32 Slot = AcquireSlot();
+		Components[Slot]->SetVisibility(false);
+		Components[Slot]->SetCollisionEnabled(ECollisionEnabled::NoCollision);
+		FreeSlots.Add(Slot);
+	}
+}
+
+UStaticMeshComponent* ANeuralSceneManager::FindObject(const FNeuralSceneKey& Key) const
+{
+	const int32* Slot = ActiveObjects.Find(Key);
+	return Slot ? Components[*Slot] : nullptr;
+}
+
+bool ANeuralSceneManager::GetKeyOfComponent(const UPrimitiveComponent* Component, FNeuralSceneKey& OutKey) const
+{
+	const int32* Slot = SlotOfComponent.Find(Component);
+	if (!Slot || !Slots[*Slot].bActive) {
+		return false;
+	}
+	OutKey = Slots[*Slot].Key;
+	return true;
+}
+
+void ANeuralSceneManager::BuildConnections(const TArray<int32>& Edges, float Strength, FLinearColor Color)
+{
+	// Snapshot the layer boxes on the game thread, workers must not touch components
+	struct FLayerBox
+	{
+		FVector Center = FVector::ZeroVector;
+		FVector Size = FVector::ZeroVector;
+		bool bValid = false;
+	};
+	TArray<FLayerBox> Boxes;
+	for (const TPair<FNeuralSceneKey, int32>& Entry : ActiveObjects) {
+		if (Entry.Key.Kind != ENeuralSceneObjectKind::Layer || Entry.Key.Primary < 0) {
+			continue;
+		}
+		if (Boxes.Num() <= Entry.Key.Primary) {
+			Boxes.SetNum(Entry.Key.Primary + 1);
+		}
+		const FTransform& Transform = Components[Entry.Value]->GetRelativeTransform();
+		FLayerBox& Box = Boxes[Entry.Key.Primary];
+		Box.Center = Transform.GetLocation();
+		// Cuboids are scaled 1 m cubes, see transformCoordinates() of the python server
+		Box.Size = Transform.GetScale3D() * 100.f;
+		Box.bValid = true;
+	}
+
+	LastConnectionEdges = Edges;
+	LastConnectionStrength = Strength;
+	LastConnectionColor = Color;
+
+	const uint32 Serial = ++ConnectionBuildSerial;
+	TWeakObjectPtr<ANeuralSceneManager> WeakThis(this);
+	Async(EAsyncExecution::ThreadPool, [WeakThis, Serial, Boxes = MoveTemp(Boxes), Edges, Strength, Color]()
+	{
+		TArray<FTransform> Transforms;
+		Transforms.SetNum(Edges.Num() / 2);
+		ParallelFor(Transforms.Num(), [&](int32 i)
+		{
+			const int32 ParentIndex = Edges[2 * i];
+			const int32 ChildIndex = Edges[2 * i + 1];
+			if (!Boxes.IsValidIndex(ParentIndex) || !Boxes.IsValidIndex(ChildIndex) ||
+				!Boxes[ParentIndex].bValid || !Boxes[ChildIndex].bValid) {
+				Transforms[i] = FTransform(FQuat::Identity, FVector::ZeroVector, FVector::ZeroVector);
+				return;
+			}
+			const FLayerBox& Parent = Boxes[ParentIndex];
+			const FLayerBox& Child = Boxes[ChildIndex];
+			// Same geometry as the server used to send: the beam lies in the plane of the child
+			// layer (constant X) and connects both layer centers
+			const FVector Start(Child.Center.X, Parent.Center.Y, Parent.Center.Z);
+			const FVector Delta = Child.Center - Start;
+			const float Length = Delta.Size();
+			const float Thickness = FMath::Min(
+				FMath::Min3(Strength, Parent.Size.X / 2.f, Parent.Size.Z / 2.f),
+				FMath::Min(Child.Size.X / 2.f, Child.Size.Z / 2.f));
+			if (Length < KINDA_SMALL_NUMBER) {
+				Transforms[i] = FTransform(FQuat::Identity, Start, FVector::ZeroVector);
+				return;
+			}
+			Transforms[i] = FTransform(
+				FRotationMatrix::MakeFromX(Delta).ToQuat(),
+				Start + Delta / 2.f,
+				FVector(Length, Thickness, Thickness) / 100.f);
+		});
+
+		AsyncTask(ENamedThreads::GameThread, [WeakThis, Serial, Transforms = MoveTemp(Transforms), Color]()
+		{
+			ANeuralSceneManager* This = WeakThis.Get();
+			if (This && This->ConnectionBuildSerial == Serial) {
+				This->ApplyConnectionTransforms(Transforms, Color);
+			}
+		});
+	});
+}
+
+void ANeuralSceneManager::ApplyConnectionTransforms(const TArray<FTransform>& Transforms, const FLinearColor& Color)
+{
+	if (ConnectionInstances->GetStaticMesh() != CuboidMesh) {
+		ConnectionInstances->SetStaticMesh(CuboidMesh);
+	}
+	if (!ConnectionMaterial && CuboidMaterial) {
+		ConnectionMaterial = UMaterialInstanceDynamic::Create(CuboidMaterial, this);
+		ConnectionInstances->SetMaterial(0, ConnectionMaterial);
+	}
+	if (ConnectionMaterial) {
+		ConnectionMaterial->SetVectorParameterValue(ColorParameterName, Color);
+		ConnectionMaterial->SetScalarParameterValue(OpacityParameterName, Color.A);
+	}
+
+	// Same number of connections as before: update the instances in place
+	if (ConnectionInstances->GetInstanceCount() == Transforms.Num()) {
+		ConnectionInstances->BatchUpdateInstancesTransforms(0, Transforms, false, true);
+		return;
+	}
+	ConnectionInstances->ClearInstances();
+	for (const FTransform& Transform : Transforms) {
+		ConnectionInstances->AddInstance(Transform);
+	}
+	UE_LOG(NeuralInteractionClient, Verbose, TEXT("Built %d connection instances."), Transforms.Num());
+}
+
+void ANeuralSceneManager::ApplyConnectionInstruction(const TArray<float>& Style, const TArray<int32>& Edges)
+{
+	if (Style.Num() < 5) {
+		UE_LOG(NeuralInteractionClient, Warning, TEXT("Connection instruction only has %d instead of 5 style values."),
+			Style.Num());
+		return;
+	}
+	BuildConnections(Edges, Style[0], FLinearColor(Style[1], Style[2], Style[3], Style[4]));
+}
+
+void ANeuralSceneManager::BuildConnectionsFromLayerGraph(float Strength, FLinearColor Color)
+{
+	TSharedPtr<const FNeuralLayerGraph, ESPMode::ThreadSafe> Graph = GetLayerGraph();
+	if (!Graph.IsValid()) {
+		UE_LOG(NeuralInteractionClient, Warning, TEXT("Cannot build connections, no layer graph has been received yet."));
+		return;
+	}
+	TArray<int32> Edges;
+	Graph->GetEdges(Edges);
+	BuildConnections(Edges, Strength, Color);
+}
+
+void ANeuralSceneManager::ClearConnections()
+{
+	// Also drops the results of builds which are still running
+	ConnectionBuildSerial++;
+	ConnectionInstances->ClearInstances();
+	LastConnectionEdges.Empty();
+}
+
+bool ANeuralSceneManager::SaveLayoutSnapshot(const FString& Key)
+{
+	FNeuralLayoutSnapshot Snapshot;
+	for (const TPair<FNeuralSceneKey, int32>& Entry : ActiveObjects) {
+		if (Entry.Key.Kind != ENeuralSceneObjectKind::Layer) {
+			continue;
+		}
+		FNeuralCachedLayerBox& Box = Snapshot.Layers.AddDefaulted_GetRef();
+		Box.Layer = Entry.Key.Primary;
+		Box.Transform = Components[Entry.Value]->GetRelativeTransform();
+		Box.Color = Slots[Entry.Value].Color;
+	}
+	if (Snapshot.Layers.Num() == 0) {
+		return false;
+	}
+	Snapshot.ConnectionEdges = LastConnectionEdges;
+	Snapshot.ConnectionStrength = LastConnectionStrength;
+	Snapshot.ConnectionColor = LastConnectionColor;
+	return FNeuralLayoutCache::StoreSnapshot(Key, Snapshot);
+}
+
+bool ANeuralSceneManager::RestoreLayoutSnapshot(const FString& Key)
+{
+	FNeuralLayoutSnapshot Snapshot;
+	if (!FNeuralLayoutCache::LoadSnapshot(Key, Snapshot)) {
+		return false;
+	}
+	// Saving again on EndRedraw would only rewrite the same file
+	TGuardValue<bool> NoAutoSave(bAutoSaveLayoutSnapshots, false);
+	// Connections drawn as single cuboids by the server are not part of the snapshot and released
+	const TArray<FString> Scopes = { TEXT("layer"), TEXT("connection") };
+	BeginRedraw(Scopes);
+	for (const FNeuralCachedLayerBox& Box : Snapshot.Layers) {
+		SpawnOrUpdateCuboid(FNeuralSceneKey(ENeuralSceneObjectKind::Layer, Box.Layer), Box.Transform.GetLocation(),
+			Box.Transform.GetScale3D(), Box.Color, Box.Transform.Rotator());
+	}
+	EndRedraw(Scopes);
+	if (Snapshot.ConnectionEdges.Num() > 0) {
+		BuildConnections(Snapshot.ConnectionEdges, Snapshot.ConnectionStrength, Snapshot.ConnectionColor);
+	} else {
+		ClearConnections();
+	}
+	UE_LOG(NeuralInteractionClient, Log, TEXT("Restored layout %s with %d layers from the layout cache."),
+		*Key, Snapshot.Layers.Num());
+	return true;
+}
+
+TSharedPtr<const FNeuralLayerGraph, ESPMode::ThreadSafe> ANeuralSceneManager::GetLayerGraph() const
+{
+	if (ModelContext.IsEmpty()) {
+		return FNeuralLayerGraph::GetCurrent();
+	}
+	const FNeuralModelContext* Context = FNeuralModelContexts::Get().Find(ModelContext);
+	return Context ? Context->GetLayerGraph() : nullptr;
+}
+
+FString ANeuralSceneManager::GetLayoutKey() const
+{
+	if (ModelContext.IsEmpty()) {
+		return FNeuralLayoutCache::GetLastLayoutKey();
+	}
+	const FNeuralModelContext* Context = FNeuralModelContexts::Get().Find(ModelContext);
+	return Context ? Context->GetLayoutKey() : FString();
+}
+
+FString ANeuralSceneManager::GetLastLayoutKey()
+{
+	return FNeuralLayoutCache::GetLastLayoutKey();
+}
+
+bool ANeuralSceneManager::GetCachedLayoutPositions(const FString& Key, TArray<FVector2D>& Positions)
+{
+	return FNeuralLayoutCache::LoadPositions(Key, Positions);
+}
+
+TMap<int32, FBox> ANeuralSceneManager::GetLayerBounds() const
+{
+	TMap<int32, FBox> Bounds;
+	for (const TPair<FNeuralSceneKey, int32>& Entry : ActiveObjects) {
+		if (Entry.Key.Kind == ENeuralSceneObjectKind::Layer) {
+			Bounds.Add(Entry.Key.Primary, Components[Entry.Value]->Bounds.GetBox());
+		}
+	}
+	return Bounds;
+}
+
+bool ANeuralSceneManager::GetLayerOfComponent(const UPrimitiveComponent* Component, int32& LayerIndex, FString& LayerName) const
+{
+	FNeuralSceneKey Key;
+	if (!GetKeyOfComponent(Component, Key)) {
+		return false;
+	}
+	switch (Key.Kind) {
+	case ENeuralSceneObjectKind::Layer:
+	case ENeuralSceneObjectKind::KernelTile:
+		LayerIndex = Key.Primary;
+		break;
+	case ENeuralSceneObjectKind::Connection:
+		LayerIndex = Key.Secondary;
+		break;
+	default:
+		return false;
+	}
+	TSharedPtr<const FNeuralLayerGraph, ESPMode::ThreadSafe> Graph = GetLayerGraph();
+	LayerName = Graph.IsValid() && Graph->IsValidLayer(LayerIndex) ? Graph->GetName(LayerIndex) : FString();
+	return true;
+}
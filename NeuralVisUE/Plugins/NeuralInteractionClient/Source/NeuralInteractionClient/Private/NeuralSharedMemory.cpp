@@ -0,0 +1,171 @@
+/*
+This file NeuralSharedMemory.cpp is part of NeuralVisUAL.
+
+NeuralVisUAL is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+NeuralVisUAL is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with NeuralVisUAL.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "NeuralSharedMemory.h"
+#include "NeuralInteractionClientLog.h"
+#include "Misc/ScopeLock.h"
+
+#if PLATFORM_WINDOWS
+#include "Windows/AllowWindowsPlatformTypes.h"
+#include <windows.h>
+#include "Windows/HideWindowsPlatformTypes.h"
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+	const uint8 DescriptorVersion = 1;
+	const int32 DescriptorSize = 32;
+	const int32 RegionHeaderSize = 16;
+	const int64 DataOffset = 64;
+}
+
+// The engine only offers read only file mappings, the client has to write the released flags
+struct FNeuralSharedMemoryRegion::FMapping
+{
+	uint8* Address = nullptr;
+	int64 Size = 0;
+#if PLATFORM_WINDOWS
+	HANDLE File = INVALID_HANDLE_VALUE;
+	HANDLE Section = nullptr;
+#endif
+
+	~FMapping()
+	{
+#if PLATFORM_WINDOWS
+		if (Address) {
+			UnmapViewOfFile(Address);
+		}
+		if (Section) {
+			CloseHandle(Section);
+		}
+		if (File != INVALID_HANDLE_VALUE) {
+			CloseHandle(File);
+		}
+#else
+		if (Address) {
+			munmap(Address, Size);
+		}
+#endif
+	}
+};
+
+FNeuralSharedMemoryRegion::~FNeuralSharedMemoryRegion()
+{
+	// Released flag, read by the server when it needs space
+	if (Header) {
+		FPlatformAtomics::InterlockedExchange((volatile int32*)(Header + 4), 1);
+	}
+}
+
+const char* FNeuralSharedMemory::HandshakeHeader = "X-NeuralVisUAL-Shared-Memory";
+
+FNeuralSharedMemory& FNeuralSharedMemory::Get()
+{
+	static FNeuralSharedMemory Instance;
+	return Instance;
+}
+
+TSharedPtr<FNeuralSharedMemoryRegion::FMapping, ESPMode::ThreadSafe> FNeuralSharedMemory::Map(const FString& Path, int64 Size)
+{
+	TSharedPtr<FNeuralSharedMemoryRegion::FMapping, ESPMode::ThreadSafe> Result =
+		MakeShared<FNeuralSharedMemoryRegion::FMapping, ESPMode::ThreadSafe>();
+	Result->Size = Size;
+#if PLATFORM_WINDOWS
+	Result->File = CreateFileW(*Path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+		nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (Result->File == INVALID_HANDLE_VALUE) {
+		return nullptr;
+	}
+	Result->Section = CreateFileMappingW(Result->File, nullptr, PAGE_READWRITE, (DWORD)(Size >> 32), (DWORD)Size, nullptr);
+	if (!Result->Section) {
+		return nullptr;
+	}
+	Result->Address = (uint8*)MapViewOfFile(Result->Section, FILE_MAP_READ | FILE_MAP_WRITE, 0, 0, Size);
+#else
+	const int File = open(TCHAR_TO_UTF8(*Path), O_RDWR);
+	if (File < 0) {
+		return nullptr;
+	}
+	void* Address = mmap(nullptr, Size, PROT_READ | PROT_WRITE, MAP_SHARED, File, 0);
+	// The mapping stays valid without the descriptor
+	close(File);
+	if (Address == MAP_FAILED) {
+		return nullptr;
+	}
+	Result->Address = (uint8*)Address;
+#endif
+	if (!Result->Address || FMemory::Memcmp(Result->Address, "NVSHM001", 8) != 0) {
+		return nullptr;
+	}
+	return Result;
+}
+
+FNeuralSharedMemoryRegionPtr FNeuralSharedMemory::Resolve(const FString& Path, const uint8* Descriptor, int32 Size)
+{
+	if (Size != DescriptorSize || Descriptor[0] != DescriptorVersion) {
+		UE_LOG(NeuralInteractionClient, Warning, TEXT("Received shared memory descriptor with unsupported format."));
+		return nullptr;
+	}
+	// Little endian, like all platforms the client runs on
+	uint32 Generation;
+	uint64 Offset, Length, MappingSize;
+	FMemory::Memcpy(&Generation, Descriptor + 4, sizeof(Generation));
+	FMemory::Memcpy(&Offset, Descriptor + 8, sizeof(Offset));
+	FMemory::Memcpy(&Length, Descriptor + 16, sizeof(Length));
+	FMemory::Memcpy(&MappingSize, Descriptor + 24, sizeof(MappingSize));
+	if (Offset < DataOffset + RegionHeaderSize || Length > (uint64)MAX_int32 || Offset + Length > MappingSize) {
+		UE_LOG(NeuralInteractionClient, Warning, TEXT("Received shared memory descriptor outside of the ring."));
+		return nullptr;
+	}
+
+	TSharedPtr<FNeuralSharedMemoryRegion::FMapping, ESPMode::ThreadSafe> CurrentMapping;
+	{
+		FScopeLock ScopeLock(&Lock);
+		TSharedPtr<FNeuralSharedMemoryRegion::FMapping, ESPMode::ThreadSafe>& Mapping = Mappings.FindOrAdd(Path);
+		if (!Mapping.IsValid() || Mapping->Size != (int64)MappingSize) {
+			Mapping = Map(Path, MappingSize);
+			if (!Mapping.IsValid()) {
+				UE_LOG(NeuralInteractionClient, Warning, TEXT("Could not map the shared memory file %s."), *Path);
+				Mappings.Remove(Path);
+				return nullptr;
+			}
+		}
+		CurrentMapping = Mapping;
+	}
+
+	uint8* Header = CurrentMapping->Address + Offset - RegionHeaderSize;
+	uint32 RegionGeneration;
+	uint64 RegionLength;
+	FMemory::Memcpy(&RegionGeneration, Header, sizeof(RegionGeneration));
+	FMemory::Memcpy(&RegionLength, Header + 8, sizeof(RegionLength));
+	if (RegionGeneration != Generation || RegionLength != Length) {
+		UE_LOG(NeuralInteractionClient, Warning, TEXT("Shared memory region %u has already been reused by the server."), Generation);
+		return nullptr;
+	}
+
+	FNeuralSharedMemoryRegionPtr Region = MakeShared<FNeuralSharedMemoryRegion, ESPMode::ThreadSafe>();
+	Region->Mapping = CurrentMapping;
+	Region->Header = Header;
+	Region->Data = Header + RegionHeaderSize;
+	Region->Size = (int32)Length;
+	Region->InnerType = Descriptor[1];
+	return Region;
+}
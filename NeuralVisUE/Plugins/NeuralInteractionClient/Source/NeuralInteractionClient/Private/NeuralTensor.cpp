@@ -0,0 +1,340 @@
+/*
+This file NeuralTensor.cpp is part of NeuralVisUAL.
+
+NeuralVisUAL is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+NeuralVisUAL is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with NeuralVisUAL.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "NeuralTensor.h"
+#include "NeuralInteractionClientLog.h"
+#include "NeuralModelContext.h"
+#include "Engine/Texture2D.h"
+#include "Misc/ScopeLock.h"
+
+namespace
+{
+	const uint8 TensorFormatVersion = 1;
+
+	int32 GetElementSize(ENeuralTensorEncoding Encoding)
+	{
+		switch (Encoding) {
+		case ENeuralTensorEncoding::Float16:
+			return 2;
+		case ENeuralTensorEncoding::Int8:
+			return 1;
+		default:
+			return 4;
+		}
+	}
+}
+
+bool FNeuralTensor::Parse(const uint8* Payload, int32 Size, FNeuralTensor& OutTensor)
+{
+	int32 Offset;
+	if (!ParseHeader(Payload, Size, OutTensor, Offset)) {
+		return false;
+	}
+	const int64 Bytes = OutTensor.GetNumberOfValues() * GetElementSize(OutTensor.Encoding);
+	if (Bytes != Size - Offset) {
+		UE_LOG(NeuralInteractionClient, Warning, TEXT("Received tensor has %d bytes of values instead of %lld."),
+			Size - Offset, Bytes);
+		return false;
+	}
+	OutTensor.Data = TArray<uint8>(Payload + Offset, Size - Offset);
+	OutTensor.SharedValues.Reset();
+	return true;
+}
+
+bool FNeuralTensor::Parse(const FNeuralSharedMemoryRegionPtr& Region, FNeuralTensor& OutTensor)
+{
+	const TArrayView<const uint8> Payload = Region->GetView();
+	int32 Offset;
+	if (!ParseHeader(Payload.GetData(), Payload.Num(), OutTensor, Offset)) {
+		return false;
+	}
+	const int64 Bytes = OutTensor.GetNumberOfValues() * GetElementSize(OutTensor.Encoding);
+	if (Bytes != Payload.Num() - Offset) {
+		UE_LOG(NeuralInteractionClient, Warning, TEXT("Received tensor has %d bytes of values instead of %lld."),
+			Payload.Num() - Offset, Bytes);
+		return false;
+	}
+	OutTensor.Data.Empty();
+	OutTensor.SharedValues = Region;
+	OutTensor.SharedValuesOffset = Offset;
+	return true;
+}
+
+TArrayView<const uint8> FNeuralTensor::GetValues() const
+{
+	if (SharedValues.IsValid()) {
+		return SharedValues->GetView().Slice(SharedValuesOffset, SharedValues->GetView().Num() - SharedValuesOffset);
+	}
+	return Data;
+}
+
+bool FNeuralTensor::ParseHeader(const uint8* Payload, int32 Size, FNeuralTensor& OutTensor, int32& OutValuesOffset)
+{
+	if (Size < 4 || Payload[0] != TensorFormatVersion || Payload[1] > (uint8)ENeuralTensorEncoding::Int8) {
+		UE_LOG(NeuralInteractionClient, Warning, TEXT("Received tensor with unsupported format."));
+		return false;
+	}
+	OutTensor.Encoding = (ENeuralTensorEncoding)Payload[1];
+	const int32 Rank = Payload[2];
+	int32 Offset = 4 + 4 * Rank;
+	if (Size < Offset) {
+		return false;
+	}
+	// The payload is little endian, like all platforms the client runs on
+	OutTensor.Shape.SetNum(Rank);
+	// Up to MAX_int32 values, so that GetNumberOfValues can't overflow and the values fit into arrays.
+	// Not checked against Size, the payload of a delta frame is smaller than the values
+	int64 Values = 1;
+	for (int32 i = 0; i < Rank; i++) {
+		uint32 Dimension;
+		FMemory::Memcpy(&Dimension, Payload + 4 + 4 * i, sizeof(Dimension));
+		if (Dimension > (uint32)MAX_int32 || (Dimension > 0 && Values > MAX_int32 / (int64)Dimension)) {
+			UE_LOG(NeuralInteractionClient, Warning, TEXT("Received tensor with more than %d values."), MAX_int32);
+			return false;
+		}
+		Values *= Dimension;
+		OutTensor.Shape[i] = Dimension;
+	}
+
+	const int32 Channels = OutTensor.GetNumberOfChannels();
+	OutTensor.Scales.Reset();
+	OutTensor.Offsets.Reset();
+	if (OutTensor.Encoding == ENeuralTensorEncoding::Int8) {
+		// The last dimension may be up to MAX_int32, so the size of the scales overflows int32
+		if ((int64)Size < (int64)Offset + 8 * (int64)Channels) {
+			return false;
+		}
+		OutTensor.Scales.SetNumUninitialized(Channels);
+		OutTensor.Offsets.SetNumUninitialized(Channels);
+		FMemory::Memcpy(OutTensor.Scales.GetData(), Payload + Offset, 4 * Channels);
+		FMemory::Memcpy(OutTensor.Offsets.GetData(), Payload + Offset + 4 * Channels, 4 * Channels);
+		Offset += 8 * Channels;
+	}
+	OutValuesOffset = Offset;
+	return true;
+}
+
+int64 FNeuralTensor::GetNumberOfValues() const
+{
+	int64 Count = 1;
+	for (int32 Dimension : Shape) {
+		Count *= Dimension;
+	}
+	return Count;
+}
+
+int32 FNeuralTensor::GetNumberOfChannels() const
+{
+	return Shape.Num() > 0 ? Shape.Last() : 1;
+}
+
+void FNeuralTensor::Dequantize(TArray<float>& OutValues) const
+{
+	const int64 Count = GetNumberOfValues();
+	OutValues.SetNumUninitialized(Count);
+	float* Out = OutValues.GetData();
+	switch (Encoding) {
+	case ENeuralTensorEncoding::Float32:
+		FMemory::Memcpy(Out, GetValues().GetData(), Count * sizeof(float));
+		break;
+	case ENeuralTensorEncoding::Float16: {
+		const uint16* In = (const uint16*)GetValues().GetData();
+		for (int64 i = 0; i < Count; i++) {
+			FFloat16 Half;
+			Half.Encoded = In[i];
+			Out[i] = Half.GetFloat();
+		}
+		break;
+	}
+	case ENeuralTensorEncoding::Int8: {
+		// Row by row, so that the inner loop runs over contiguous channels and gets vectorized
+		const int32 Channels = GetNumberOfChannels();
+		const uint8* In = GetValues().GetData();
+		const float* Scale = Scales.GetData();
+		const float* Bias = Offsets.GetData();
+		for (int64 Row = 0; Row < Count; Row += Channels) {
+			for (int32 c = 0; c < Channels; c++) {
+				Out[Row + c] = In[Row + c] * Scale[c] + Bias[c];
+			}
+		}
+		break;
+	}
+	}
+}
+
+UTexture2D* FNeuralTensor::CreateChannelTexture(int32 Channel, FVector2D& OutScaleOffset) const
+{
+	check(IsInGameThread());
+	const int32 Channels = GetNumberOfChannels();
+	if (Shape.Num() < 3 || Channel < 0 || Channel >= Channels || Shape[Shape.Num() - 2] == 0) {
+		UE_LOG(NeuralInteractionClient, Warning, TEXT("Tensor %s has no channel %d that could be drawn as texture."), *Name, Channel);
+		return nullptr;
+	}
+	const int32 Width = Shape[Shape.Num() - 2];
+	const int32 Height = GetNumberOfValues() / ((int64)Width * Channels);
+	const EPixelFormat Format = Encoding == ENeuralTensorEncoding::Float32 ? PF_R32_FLOAT :
+		Encoding == ENeuralTensorEncoding::Float16 ? PF_R16F : PF_G8;
+	UTexture2D* Texture = UTexture2D::CreateTransient(Width, Height, Format);
+	if (!Texture) {
+		return nullptr;
+	}
+	Texture->SRGB = false;
+
+	// Picks the channel out of the interleaved values, they keep their encoding
+	const int32 ElementSize = GetElementSize(Encoding);
+	FTexture2DMipMap& Mip = Texture->PlatformData->Mips[0];
+	uint8* Out = (uint8*)Mip.BulkData.Lock(LOCK_READ_WRITE);
+	const uint8* In = GetValues().GetData() + Channel * ElementSize;
+	const int64 Pixels = (int64)Width * Height;
+	if (Channels == 1) {
+		FMemory::Memcpy(Out, In, Pixels * ElementSize);
+	}
+	else {
+		for (int64 i = 0; i < Pixels; i++) {
+			FMemory::Memcpy(Out + i * ElementSize, In + i * Channels * ElementSize, ElementSize);
+		}
+	}
+	Mip.BulkData.Unlock();
+	Texture->UpdateResource();
+
+	OutScaleOffset = Encoding == ENeuralTensorEncoding::Int8 ?
+		FVector2D(Scales[Channel], Offsets[Channel]) : FVector2D(1.f, 0.f);
+	return Texture;
+}
+
+FNeuralTensorStreams& FNeuralTensorStreams::Get()
+{
+	return FNeuralModelContexts::Get().GetDefault().GetTensorStreams();
+}
+
+uint32 FNeuralTensorStreams::GetFrame(const FString& Name) const
+{
+	FScopeLock ScopeLock(&Lock);
+	const FStream* Stream = Streams.Find(Name);
+	return Stream ? Stream->Frame : 0;
+}
+
+bool FNeuralTensorStreams::ApplyFrame(const FString& Name, const uint8* Payload, int32 Size,
+	TFunctionRef<void(const FNeuralTensor&)> OnApplied)
+{
+	const int32 FrameHeaderSize = 12;
+	if (Size < FrameHeaderSize || Payload[0] != TensorFormatVersion) {
+		UE_LOG(NeuralInteractionClient, Warning, TEXT("Received tensor frame of %s with unsupported format."), *Name);
+		return false;
+	}
+	const bool bKeyframe = (Payload[1] & 1) != 0;
+	uint32 Frame, BaseFrame;
+	FMemory::Memcpy(&Frame, Payload + 4, sizeof(Frame));
+	FMemory::Memcpy(&BaseFrame, Payload + 8, sizeof(BaseFrame));
+	Payload += FrameHeaderSize;
+	Size -= FrameHeaderSize;
+
+	FScopeLock ScopeLock(&Lock);
+	if (bKeyframe) {
+		FStream& Stream = Streams.FindOrAdd(Name);
+		if (!FNeuralTensor::Parse(Payload, Size, Stream.Tensor)) {
+			Streams.Remove(Name);
+			return false;
+		}
+		Stream.Tensor.Name = Name;
+		Stream.Frame = Frame;
+		OnApplied(Stream.Tensor);
+		return true;
+	}
+
+	// Deltas only apply to exactly the frame they were encoded against
+	FStream* Stream = Streams.Find(Name);
+	FNeuralTensor Header;
+	int32 Offset;
+	if (!Stream || Stream->Frame != BaseFrame || !FNeuralTensor::ParseHeader(Payload, Size, Header, Offset) ||
+		Header.Encoding != Stream->Tensor.Encoding || Header.Shape != Stream->Tensor.Shape) {
+		UE_LOG(NeuralInteractionClient, Warning, TEXT("Tensor frame %u of %s does not match the frame %u it was based on, "
+			"the next request gets a keyframe."), Frame, *Name, BaseFrame);
+		Streams.Remove(Name);
+		return false;
+	}
+
+	// Runs of elements XORed into the previous values in place. XORing byte by byte gives the same result
+	// as element by element, so the runs are applied in words regardless of the encoding. A frame that
+	// turns out to be invalid halfway resets the stream, so the values changed until then do not matter
+	const int32 ElementSize = GetElementSize(Header.Encoding);
+	const int64 Elements = Stream->Tensor.GetNumberOfValues();
+	uint8* Values = Stream->Tensor.Data.GetData();
+	const uint8* Runs = Payload + Offset;
+	const uint8* RunsEnd = Payload + Size;
+	uint32 RunCount;
+	if (RunsEnd - Runs < 4) {
+		Streams.Remove(Name);
+		return false;
+	}
+	FMemory::Memcpy(&RunCount, Runs, sizeof(RunCount));
+	Runs += 4;
+	int64 Position = 0;
+	for (uint32 Run = 0; Run < RunCount; Run++) {
+		uint32 Skip, Count;
+		if (RunsEnd - Runs < 8) {
+			break;
+		}
+		FMemory::Memcpy(&Skip, Runs, sizeof(Skip));
+		FMemory::Memcpy(&Count, Runs + 4, sizeof(Count));
+		Runs += 8;
+		Position += Skip;
+		const int64 Bytes = (int64)Count * ElementSize;
+		if (Position + Count > Elements || RunsEnd - Runs < Bytes) {
+			UE_LOG(NeuralInteractionClient, Warning, TEXT("Tensor frame %u of %s is truncated."), Frame, *Name);
+			Streams.Remove(Name);
+			return false;
+		}
+		uint8* Out = Values + Position * ElementSize;
+		int64 i = 0;
+		for (; i + 8 <= Bytes; i += 8) {
+			uint64 Word, Delta;
+			FMemory::Memcpy(&Word, Out + i, 8);
+			FMemory::Memcpy(&Delta, Runs + i, 8);
+			Word ^= Delta;
+			FMemory::Memcpy(Out + i, &Word, 8);
+		}
+		for (; i < Bytes; i++) {
+			Out[i] ^= Runs[i];
+		}
+		Runs += Bytes;
+		Position += Count;
+	}
+	if (Runs != RunsEnd) {
+		UE_LOG(NeuralInteractionClient, Warning, TEXT("Tensor frame %u of %s has an invalid size."), Frame, *Name);
+		Streams.Remove(Name);
+		return false;
+	}
+
+	Stream->Tensor.Scales = MoveTemp(Header.Scales);
+	Stream->Tensor.Offsets = MoveTemp(Header.Offsets);
+	Stream->Frame = Frame;
+	OnApplied(Stream->Tensor);
+	return true;
+}
+
+void FNeuralTensorStreams::Reset(const FString& Name)
+{
+	FScopeLock ScopeLock(&Lock);
+	Streams.Remove(Name);
+}
+
+void FNeuralTensorStreams::Clear()
+{
+	FScopeLock ScopeLock(&Lock);
+	Streams.Empty();
+}
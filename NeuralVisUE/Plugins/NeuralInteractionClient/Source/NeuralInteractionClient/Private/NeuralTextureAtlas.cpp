@@ -0,0 +1,268 @@
+/*
+This file NeuralTextureAtlas.cpp is part of NeuralVisUAL.
+
+NeuralVisUAL is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+NeuralVisUAL is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with NeuralVisUAL.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "NeuralTextureAtlas.h"
+#include "NeuralInteractionClientLog.h"
+#include "NeuralTextureDecoding.h"
+#include "Engine/Texture2D.h"
+
+namespace
+{
+	UTexture2D* CreateClearedTexture(int32 Width, int32 Height, EPixelFormat Format, int32 BytesPerPixel)
+	{
+		UTexture2D* Texture = UTexture2D::CreateTransient(Width, Height, Format);
+		if (!Texture) {
+			return nullptr;
+		}
+		Texture->NeverStream = true;
+		Texture->AddressX = TA_Clamp;
+		Texture->AddressY = TA_Clamp;
+		FTexture2DMipMap& Mip = Texture->PlatformData->Mips[0];
+		FMemory::Memzero(Mip.BulkData.Lock(LOCK_READ_WRITE), (SIZE_T)Width * Height * BytesPerPixel);
+		Mip.BulkData.Unlock();
+		return Texture;
+	}
+}
+
+bool UNeuralTextureAtlas::AddTile(FName Key, const FNeuralDecodedImage& Image, FNeuralAtlasTile& OutTile)
+{
+	check(IsInGameThread());
+	RemoveTile(Key);
+	if (Image.Width <= 0 || Image.Height <= 0 || Image.Pixels.Num() < Image.Width * Image.Height * 4) {
+		return false;
+	}
+	const FIntPoint PaddedSize(Image.Width + 2 * Padding, Image.Height + 2 * Padding);
+	if (PaddedSize.X > PageSize || PaddedSize.Y > PageSize) {
+		return false;
+	}
+
+	int32 Index;
+	if (FreeTileIndices.Num() > 0) {
+		Index = FreeTileIndices.Pop(false);
+	}
+	else if (NextTileIndex < TileCapacity) {
+		Index = NextTileIndex++;
+	}
+	else {
+		UE_LOG(NeuralInteractionClient, Warning, TEXT("Texture atlas is full, all %d tile indices are in use."), TileCapacity);
+		return false;
+	}
+	if (!TileIndexTexture) {
+		TileIndexTexture = CreateClearedTexture(TileCapacity, 1, PF_A32B32G32R32F, sizeof(FLinearColor));
+		// Exact lookups of the rectangles, no filtering between neighboring tiles
+		TileIndexTexture->SRGB = false;
+		TileIndexTexture->Filter = TF_Nearest;
+		TileIndexTexture->UpdateResource();
+	}
+
+	int32 Page;
+	FIntPoint Position;
+	if (!Allocate(PaddedSize, Page, Position)) {
+		FreeTileIndices.Add(Index);
+		UE_LOG(NeuralInteractionClient, Verbose, TEXT("No space left in the texture atlas for %s (%dx%d)."),
+			*Key.ToString(), Image.Width, Image.Height);
+		return false;
+	}
+
+	FNeuralAtlasTile Tile;
+	Tile.Index = Index;
+	Tile.Page = Page;
+	Tile.Position = Position + FIntPoint(Padding, Padding);
+	Tile.Size = FIntPoint(Image.Width, Image.Height);
+	Tile.UVRect = FVector4(Tile.Position.X, Tile.Position.Y, Tile.Size.X, Tile.Size.Y) / (float)PageSize;
+	Pages[Page].NumTiles++;
+	UsedTexels += (int64)PaddedSize.X * PaddedSize.Y;
+
+	UploadTile(Tile, Image);
+	UploadTileIndex(Index, Tile.UVRect);
+	Tiles.Add(Key, Tile);
+	OutTile = Tile;
+	return true;
+}
+
+void UNeuralTextureAtlas::RemoveTile(FName Key)
+{
+	FNeuralAtlasTile Tile;
+	if (!Tiles.RemoveAndCopyValue(Key, Tile)) {
+		return;
+	}
+	Free(Tile);
+	FreeTileIndices.Add(Tile.Index);
+	UsedTexels -= (int64)(Tile.Size.X + 2 * Padding) * (Tile.Size.Y + 2 * Padding);
+}
+
+bool UNeuralTextureAtlas::FindTile(FName Key, FNeuralAtlasTile& OutTile) const
+{
+	const FNeuralAtlasTile* Tile = Tiles.Find(Key);
+	if (Tile) {
+		OutTile = *Tile;
+	}
+	return Tile != nullptr;
+}
+
+void UNeuralTextureAtlas::Clear()
+{
+	Tiles.Empty();
+	FreeTileIndices.Empty();
+	NextTileIndex = 0;
+	UsedTexels = 0;
+	for (FPage& Page : Pages) {
+		Page = FPage();
+	}
+}
+
+UTexture2D* UNeuralTextureAtlas::GetPageTexture(int32 Page) const
+{
+	return PageTextures.IsValidIndex(Page) ? PageTextures[Page] : nullptr;
+}
+
+float UNeuralTextureAtlas::GetOccupancy() const
+{
+	const int64 Texels = (int64)Pages.Num() * PageSize * PageSize;
+	return Texels > 0 ? (float)((double)UsedTexels / Texels) : 0.f;
+}
+
+bool UNeuralTextureAtlas::Allocate(const FIntPoint& PaddedSize, int32& OutPage, FIntPoint& OutPosition)
+{
+	// Prefer shelves of a fitting height, only then accept wasting space in higher ones
+	for (bool bAllowWaste : { false, true }) {
+		for (int32 i = 0; i < Pages.Num(); i++) {
+			if (AllocateInPage(Pages[i], PaddedSize, bAllowWaste, OutPosition)) {
+				OutPage = i;
+				return true;
+			}
+		}
+	}
+	if (Pages.Num() >= MaxPages) {
+		return false;
+	}
+	OutPage = AddPage();
+	return OutPage != INDEX_NONE && AllocateInPage(Pages[OutPage], PaddedSize, true, OutPosition);
+}
+
+bool UNeuralTextureAtlas::AllocateInPage(FPage& Page, const FIntPoint& PaddedSize, bool bAllowWaste, FIntPoint& OutPosition)
+{
+	for (FShelf& Shelf : Page.Shelves) {
+		if (Shelf.Height < PaddedSize.Y || (!bAllowWaste && Shelf.Height > PaddedSize.Y * 2)) {
+			continue;
+		}
+		for (int32 i = 0; i < Shelf.FreeSpans.Num(); i++) {
+			FIntPoint& Span = Shelf.FreeSpans[i];
+			if (Span.Y < PaddedSize.X) {
+				continue;
+			}
+			OutPosition = FIntPoint(Span.X, Shelf.Y);
+			Span.X += PaddedSize.X;
+			Span.Y -= PaddedSize.X;
+			if (Span.Y == 0) {
+				Shelf.FreeSpans.RemoveAt(i);
+			}
+			return true;
+		}
+	}
+	if (Page.UsedHeight + PaddedSize.Y > PageSize) {
+		return false;
+	}
+	FShelf& Shelf = Page.Shelves.AddDefaulted_GetRef();
+	Shelf.Y = Page.UsedHeight;
+	Shelf.Height = PaddedSize.Y;
+	if (PaddedSize.X < PageSize) {
+		Shelf.FreeSpans.Add(FIntPoint(PaddedSize.X, PageSize - PaddedSize.X));
+	}
+	Page.UsedHeight += PaddedSize.Y;
+	OutPosition = FIntPoint(0, Shelf.Y);
+	return true;
+}
+
+void UNeuralTextureAtlas::Free(const FNeuralAtlasTile& Tile)
+{
+	FPage& Page = Pages[Tile.Page];
+	if (--Page.NumTiles == 0) {
+		Page = FPage();
+		return;
+	}
+	const int32 Y = Tile.Position.Y - Padding;
+	FShelf* Shelf = Page.Shelves.FindByPredicate([Y](const FShelf& Candidate) { return Candidate.Y == Y; });
+	if (!Shelf) {
+		return;
+	}
+	// Spans are (X, width), merged with their neighbors to keep them as wide as possible
+	Shelf->FreeSpans.Add(FIntPoint(Tile.Position.X - Padding, Tile.Size.X + 2 * Padding));
+	Shelf->FreeSpans.Sort([](const FIntPoint& A, const FIntPoint& B) { return A.X < B.X; });
+	for (int32 i = Shelf->FreeSpans.Num() - 1; i > 0; i--) {
+		FIntPoint& Previous = Shelf->FreeSpans[i - 1];
+		if (Previous.X + Previous.Y == Shelf->FreeSpans[i].X) {
+			Previous.Y += Shelf->FreeSpans[i].Y;
+			Shelf->FreeSpans.RemoveAt(i);
+		}
+	}
+	// Empty shelves at the top of the page are given back, so that they can be reused with another height
+	while (Page.Shelves.Num() > 0) {
+		const FShelf& Last = Page.Shelves.Last();
+		if (Last.FreeSpans.Num() != 1 || Last.FreeSpans[0] != FIntPoint(0, PageSize)) {
+			break;
+		}
+		Page.UsedHeight = Last.Y;
+		Page.Shelves.Pop(false);
+	}
+}
+
+int32 UNeuralTextureAtlas::AddPage()
+{
+	UTexture2D* Texture = CreateClearedTexture(PageSize, PageSize, PF_B8G8R8A8, 4);
+	if (!Texture) {
+		UE_LOG(NeuralInteractionClient, Error, TEXT("Could not create a texture atlas page of %dx%d."), PageSize, PageSize);
+		return INDEX_NONE;
+	}
+	Texture->UpdateResource();
+	PageTextures.Add(Texture);
+	return Pages.AddDefaulted();
+}
+
+void UNeuralTextureAtlas::UploadTile(const FNeuralAtlasTile& Tile, const FNeuralDecodedImage& Image)
+{
+	// The padding is uploaded as well, it may still contain parts of an evicted tile
+	const int32 Width = Tile.Size.X + 2 * Padding;
+	const int32 Height = Tile.Size.Y + 2 * Padding;
+	uint8* Data = new uint8[Width * Height * 4];
+	FMemory::Memzero(Data, Width * Height * 4);
+	for (int32 Row = 0; Row < Image.Height; Row++) {
+		FMemory::Memcpy(Data + ((Row + Padding) * Width + Padding) * 4, Image.Pixels.GetData() + Row * Image.Width * 4,
+			Image.Width * 4);
+	}
+	FUpdateTextureRegion2D* Region = new FUpdateTextureRegion2D(Tile.Position.X - Padding, Tile.Position.Y - Padding,
+		0, 0, Width, Height);
+	// Only the tile region is copied to the GPU, the buffers are freed once the render thread is done
+	PageTextures[Tile.Page]->UpdateTextureRegions(0, 1, Region, Width * 4, 4, Data,
+		[](uint8* SourceData, const FUpdateTextureRegion2D* Regions)
+		{
+			delete[] SourceData;
+			delete Regions;
+		});
+}
+
+void UNeuralTextureAtlas::UploadTileIndex(int32 Index, const FVector4& UVRect)
+{
+	FLinearColor* Texel = new FLinearColor(UVRect.X, UVRect.Y, UVRect.Z, UVRect.W);
+	FUpdateTextureRegion2D* Region = new FUpdateTextureRegion2D(Index, 0, 0, 0, 1, 1);
+	TileIndexTexture->UpdateTextureRegions(0, 1, Region, sizeof(FLinearColor), sizeof(FLinearColor), (uint8*)Texel,
+		[](uint8* SourceData, const FUpdateTextureRegion2D* Regions)
+		{
+			delete (FLinearColor*)SourceData;
+			delete Regions;
+		});
+}
@@ -0,0 +1,286 @@
+/*
+This file NeuralTextureCache.cpp is part of NeuralVisUAL.
+
+NeuralVisUAL is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+NeuralVisUAL is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with NeuralVisUAL.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "NeuralTextureCache.h"
+#include "NeuralInteractionClientLog.h"
+#include "Engine/Texture2D.h"
+#include "HAL/FileManager.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Misc/ScopeLock.h"
+#include "Misc/SecureHash.h"
+
+FNeuralTextureCache& FNeuralTextureCache::Get()
+{
+	static FNeuralTextureCache Instance;
+	return Instance;
+}
+
+FString FNeuralTextureCache::HashContent(const uint8* Data, int32 Size)
+{
+	uint8 Digest[20];
+	FSHA1::HashBuffer(Data, Size, Digest);
+	return BytesToHex(Digest, sizeof(Digest)).ToLower();
+}
+
+FString FNeuralTextureCache::GetCacheDirectory()
+{
+	return FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("NeuralVisUAL"), TEXT("TextureCache"));
+}
+
+bool FNeuralTextureCache::IsValidHash(const FString& Hash)
+{
+	// Hashes end up in file paths
+	if (Hash.Len() != 40) {
+		return false;
+	}
+	for (TCHAR Character : Hash) {
+		if (!FChar::IsHexDigit(Character)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+void FNeuralTextureCache::StoreFile(const FString& Filename, const FString& Hash, const uint8* Data, int32 Size)
+{
+	if (!IsValidHash(Hash)) {
+		return;
+	}
+	const FString Path = FPaths::Combine(GetCacheDirectory(), Hash);
+	IFileManager& FileManager = IFileManager::Get();
+	const bool bExists = FileManager.FileExists(*Path);
+	if (bExists) {
+		// Counts as a use for trimming
+		FileManager.SetTimeStamp(*Path, FDateTime::UtcNow());
+	}
+	else if (!FFileHelper::SaveArrayToFile(TArrayView<const uint8>(Data, Size), *Path)) {
+		UE_LOG(NeuralInteractionClient, Warning, TEXT("Could not write %s to the texture cache."), *Filename);
+		return;
+	}
+
+	FScopeLock ScopeLock(&Lock);
+	FilenameHashes.Add(Filename, Hash);
+	if (!bExists && DiskUsage >= 0) {
+		DiskUsage += Size;
+	}
+	TrimDisk();
+}
+
+bool FNeuralTextureCache::LoadFile(const FString& Hash, TArray<uint8>& OutData)
+{
+	if (!IsValidHash(Hash)) {
+		return false;
+	}
+	const FString Path = FPaths::Combine(GetCacheDirectory(), Hash);
+	if (!FFileHelper::LoadFileToArray(OutData, *Path, FILEREAD_Silent)) {
+		return false;
+	}
+	// Files may have been modified or truncated outside of the client
+	if (HashContent(OutData.GetData(), OutData.Num()) != Hash.ToLower()) {
+		UE_LOG(NeuralInteractionClient, Warning, TEXT("Cached file %s is corrupt and will be deleted."), *Path);
+		IFileManager::Get().Delete(*Path, false, false, true);
+		FScopeLock ScopeLock(&Lock);
+		DiskUsage = -1;
+		return false;
+	}
+	IFileManager::Get().SetTimeStamp(*Path, FDateTime::UtcNow());
+	return true;
+}
+
+FString FNeuralTextureCache::GetHashForFilename(const FString& Filename) const
+{
+	FScopeLock ScopeLock(&Lock);
+	const FString* Hash = FilenameHashes.Find(Filename);
+	return Hash ? *Hash : FString();
+}
+
+bool FNeuralTextureCache::HasTexture(const FString& Hash) const
+{
+	FScopeLock ScopeLock(&Lock);
+	return Textures.Contains(Hash);
+}
+
+UTexture2D* FNeuralTextureCache::FindTexture(const FString& Hash)
+{
+	check(IsInGameThread());
+	FScopeLock ScopeLock(&Lock);
+	FTextureEntry* Entry = Textures.Find(Hash);
+	if (!Entry) {
+		return nullptr;
+	}
+	Entry->LastUse = ++UseCounter;
+	return Entry->Texture;
+}
+
+void FNeuralTextureCache::StoreTexture(const FString& Hash, UTexture2D* Texture)
+{
+	check(IsInGameThread());
+	if (Hash.IsEmpty() || !Texture) {
+		return;
+	}
+	FScopeLock ScopeLock(&Lock);
+	FTextureEntry& Entry = Textures.FindOrAdd(Hash);
+	if (Entry.Texture == Texture) {
+		Entry.LastUse = ++UseCounter;
+		return;
+	}
+	if (Entry.Texture) {
+		Entry.Texture->RemoveFromRoot();
+		MemoryUsage -= Entry.Bytes;
+	}
+	Texture->AddToRoot();
+	Entry.Texture = Texture;
+	Entry.Bytes = (int64)Texture->GetSizeX() * Texture->GetSizeY() * GPixelFormats[Texture->GetPixelFormat()].BlockBytes;
+	Entry.LastUse = ++UseCounter;
+	MemoryUsage += Entry.Bytes;
+	EvictTextures();
+}
+
+void FNeuralTextureCache::EvictTextures()
+{
+	// The most recently stored texture stays, even if it exceeds the budget on its own
+	while (MemoryUsage > MemoryBudget && Textures.Num() > 1) {
+		auto Oldest = Textures.CreateIterator();
+		for (auto It = Textures.CreateIterator(); It; ++It) {
+			if (It.Value().LastUse < Oldest.Value().LastUse) {
+				Oldest = It;
+			}
+		}
+		// Objects still using it keep it alive, otherwise it is garbage collected
+		Oldest.Value().Texture->RemoveFromRoot();
+		MemoryUsage -= Oldest.Value().Bytes;
+		Oldest.RemoveCurrent();
+	}
+}
+
+void FNeuralTextureCache::TrimDisk()
+{
+	struct FCachedFile
+	{
+		FString Path;
+		FDateTime LastUse;
+		int64 Size;
+	};
+	if (DiskUsage >= 0 && DiskUsage <= DiskBudget) {
+		return;
+	}
+	TArray<FCachedFile> Files;
+	int64 Usage = 0;
+	IFileManager::Get().IterateDirectoryStat(*GetCacheDirectory(),
+		[&Files, &Usage](const TCHAR* Path, const FFileStatData& Stat)
+		{
+			if (!Stat.bIsDirectory) {
+				Files.Add({ Path, Stat.ModificationTime, Stat.FileSize });
+				Usage += Stat.FileSize;
+			}
+			return true;
+		});
+	DiskUsage = Usage;
+	if (DiskUsage <= DiskBudget) {
+		return;
+	}
+	// Trimmed below the budget, so that not every following file triggers another directory scan
+	const int64 Target = DiskBudget * 9 / 10;
+	Files.Sort([](const FCachedFile& A, const FCachedFile& B) { return A.LastUse < B.LastUse; });
+	int32 Deleted = 0;
+	for (int32 i = 0; i < Files.Num() - 1 && DiskUsage > Target; i++) {
+		if (IFileManager::Get().Delete(*Files[i].Path, false, false, true)) {
+			DiskUsage -= Files[i].Size;
+			Deleted++;
+		}
+	}
+	UE_LOG(NeuralInteractionClient, Verbose, TEXT("Trimmed %d files from the texture cache, %lld bytes remain."), Deleted, DiskUsage);
+}
+
+void FNeuralTextureCache::SetMemoryBudget(int64 Bytes)
+{
+	FScopeLock ScopeLock(&Lock);
+	MemoryBudget = FMath::Max<int64>(0, Bytes);
+	EvictTextures();
+}
+
+int64 FNeuralTextureCache::GetMemoryBudget() const
+{
+	FScopeLock ScopeLock(&Lock);
+	return MemoryBudget;
+}
+
+int64 FNeuralTextureCache::GetMemoryUsage() const
+{
+	FScopeLock ScopeLock(&Lock);
+	return MemoryUsage;
+}
+
+void FNeuralTextureCache::SetDiskBudget(int64 Bytes)
+{
+	FScopeLock ScopeLock(&Lock);
+	DiskBudget = FMath::Max<int64>(0, Bytes);
+	TrimDisk();
+}
+
+int64 FNeuralTextureCache::GetDiskBudget() const
+{
+	FScopeLock ScopeLock(&Lock);
+	return DiskBudget;
+}
+
+int32 FNeuralTextureCache::GetNumberOfTextures() const
+{
+	FScopeLock ScopeLock(&Lock);
+	return Textures.Num();
+}
+
+void FNeuralTextureCache::Clear(bool bIncludingDisk)
+{
+	FScopeLock ScopeLock(&Lock);
+	for (TPair<FString, FTextureEntry>& Entry : Textures) {
+		Entry.Value.Texture->RemoveFromRoot();
+	}
+	Textures.Empty();
+	MemoryUsage = 0;
+	if (bIncludingDisk) {
+		IFileManager::Get().DeleteDirectory(*GetCacheDirectory(), false, true);
+		FilenameHashes.Empty();
+		DiskUsage = 0;
+	}
+}
+
+void UNeuralTextureCacheBPLibrary::SetTextureCacheMemoryBudget(int32 Megabytes)
+{
+	FNeuralTextureCache::Get().SetMemoryBudget((int64)Megabytes * 1024 * 1024);
+}
+
+void UNeuralTextureCacheBPLibrary::SetTextureCacheDiskBudget(int32 Megabytes)
+{
+	FNeuralTextureCache::Get().SetDiskBudget((int64)Megabytes * 1024 * 1024);
+}
+
+void UNeuralTextureCacheBPLibrary::ClearTextureCache(bool bIncludingDisk)
+{
+	FNeuralTextureCache::Get().Clear(bIncludingDisk);
+}
+
+float UNeuralTextureCacheBPLibrary::GetTextureCacheMemoryUsage()
+{
+	return FNeuralTextureCache::Get().GetMemoryUsage() / (1024.f * 1024.f);
+}
+
+int32 UNeuralTextureCacheBPLibrary::GetNumberOfCachedTextures()
+{
+	return FNeuralTextureCache::Get().GetNumberOfTextures();
+}
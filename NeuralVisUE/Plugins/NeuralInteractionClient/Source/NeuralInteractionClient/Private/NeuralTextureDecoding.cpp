@@ -0,0 +1,64 @@
+/*
+This file NeuralTextureDecoding.cpp is part of NeuralVisUAL.
+
+NeuralVisUAL is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+NeuralVisUAL is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with NeuralVisUAL.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "NeuralTextureDecoding.h"
+#include "NeuralInteractionClientLog.h"
+#include "Engine/Texture2D.h"
+#include "IImageWrapper.h"
+#include "IImageWrapperModule.h"
+#include "Modules/ModuleManager.h"
+
+void NeuralTextureDecoding::Initialize()
+{
+	FModuleManager::LoadModuleChecked<IImageWrapperModule>(TEXT("ImageWrapper"));
+}
+
+bool NeuralTextureDecoding::Decode(const TArray<uint8>& Compressed, FNeuralDecodedImage& OutImage)
+{
+	IImageWrapperModule& ImageWrapperModule = FModuleManager::GetModuleChecked<IImageWrapperModule>(TEXT("ImageWrapper"));
+	const EImageFormat Format = ImageWrapperModule.DetectImageFormat(Compressed.GetData(), Compressed.Num());
+	if (Format == EImageFormat::Invalid) {
+		return false;
+	}
+	TSharedPtr<IImageWrapper> ImageWrapper = ImageWrapperModule.CreateImageWrapper(Format);
+	if (!ImageWrapper.IsValid() || !ImageWrapper->SetCompressed(Compressed.GetData(), Compressed.Num()) ||
+		!ImageWrapper->GetRaw(ERGBFormat::BGRA, 8, OutImage.Pixels)) {
+		UE_LOG(NeuralInteractionClient, Warning, TEXT("Received image of %d bytes could not be decoded."), Compressed.Num());
+		return false;
+	}
+	OutImage.Width = ImageWrapper->GetWidth();
+	OutImage.Height = ImageWrapper->GetHeight();
+	return true;
+}
+
+UTexture2D* NeuralTextureDecoding::CreateTexture(const FNeuralDecodedImage& Image)
+{
+	check(IsInGameThread());
+	if (Image.Width <= 0 || Image.Height <= 0 || Image.Pixels.Num() < Image.Width * Image.Height * 4) {
+		return nullptr;
+	}
+	UTexture2D* Texture = UTexture2D::CreateTransient(Image.Width, Image.Height, PF_B8G8R8A8);
+	if (!Texture) {
+		return nullptr;
+	}
+	FTexture2DMipMap& Mip = Texture->PlatformData->Mips[0];
+	void* Data = Mip.BulkData.Lock(LOCK_READ_WRITE);
+	FMemory::Memcpy(Data, Image.Pixels.GetData(), Image.Width * Image.Height * 4);
+	Mip.BulkData.Unlock();
+	Texture->UpdateResource();
+	return Texture;
+}
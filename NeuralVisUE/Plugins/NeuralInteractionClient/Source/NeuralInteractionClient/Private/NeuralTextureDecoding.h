@@ -0,0 +1,42 @@
+/*
+This file NeuralTextureDecoding.h is part of NeuralVisUAL.
+
+NeuralVisUAL is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+NeuralVisUAL is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with NeuralVisUAL.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+class UTexture2D;
+
+// Uncompressed 8 bit BGRA pixels of an image sent by the server
+struct FNeuralDecodedImage
+{
+	int32 Width = 0;
+	int32 Height = 0;
+	TArray<uint8> Pixels;
+};
+
+namespace NeuralTextureDecoding
+{
+	// Has to be called once on the game thread before decoding on other threads
+	void Initialize();
+
+	// Decodes PNG, JPEG or BMP data, can be called from any thread
+	bool Decode(const TArray<uint8>& Compressed, FNeuralDecodedImage& OutImage);
+
+	// Creates a transient texture from decoded pixels, game thread only
+	UTexture2D* CreateTexture(const FNeuralDecodedImage& Image);
+}
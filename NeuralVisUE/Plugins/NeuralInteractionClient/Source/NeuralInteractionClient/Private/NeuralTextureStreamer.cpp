@@ -0,0 +1,415 @@
+/*
+This file NeuralTextureStreamer.cpp is part of NeuralVisUAL.
+
+NeuralVisUAL is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+NeuralVisUAL is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with NeuralVisUAL.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "NeuralTextureStreamer.h"
+#include "INeuralInteractionClient.h"
+#include "NeuralInteractionClientLog.h"
+#include "NeuralSceneManager.h"
+#include "NeuralTextureCache.h"
+#include "NeuralTextureDecoding.h"
+#include "Async/Async.h"
+#include "Camera/PlayerCameraManager.h"
+#include "Components/InstancedStaticMeshComponent.h"
+#include "Components/StaticMeshComponent.h"
+#include "Engine/Texture2D.h"
+#include "Kismet/GameplayStatics.h"
+#include "Materials/MaterialInstanceDynamic.h"
+
+namespace
+{
+	FName GetAtlasKey(const FIntPoint& Key)
+	{
+		return *FString::Printf(TEXT("%d_%d"), Key.X, Key.Y);
+	}
+}
+
+ANeuralTextureStreamer::ANeuralTextureStreamer()
+{
+	PrimaryActorTick.bCanEverTick = true;
+	RootComponent = CreateDefaultSubobject<USceneComponent>(TEXT("SceneRoot"));
+}
+
+void ANeuralTextureStreamer::BeginPlay()
+{
+	Super::BeginPlay();
+	NeuralTextureDecoding::Initialize();
+	if (!SceneManager) {
+		UE_LOG(NeuralInteractionClient, Warning, TEXT("%s has no scene manager, no textures will be streamed."), *GetName());
+	}
+}
+
+void ANeuralTextureStreamer::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	// Requests still running drop their results
+	StreamingSerial++;
+	Super::EndPlay(EndPlayReason);
+}
+
+void ANeuralTextureStreamer::ResetStreaming()
+{
+	StreamingSerial++;
+	PendingRequests = 0;
+	for (TPair<FIntPoint, FNeuralStreamedTexture>& Entry : Textures) {
+		Evict(Entry.Key, Entry.Value);
+	}
+	Textures.Empty();
+	RebuildAtlasInstances();
+}
+
+ENeuralTextureLOD ANeuralTextureStreamer::GetLayerLOD(int32 Layer, ENeuralStreamedTextureKind Kind) const
+{
+	const FNeuralStreamedTexture* State = Textures.Find(FIntPoint(Layer, (int32)Kind));
+	return State ? State->Current : ENeuralTextureLOD::None;
+}
+
+int32 ANeuralTextureStreamer::GetNumberOfStreamedTextures() const
+{
+	int32 Count = 0;
+	for (const TPair<FIntPoint, FNeuralStreamedTexture>& Entry : Textures) {
+		Count += Entry.Value.Current != ENeuralTextureLOD::None;
+	}
+	return Count;
+}
+
+void ANeuralTextureStreamer::Tick(float DeltaSeconds)
+{
+	Super::Tick(DeltaSeconds);
+	TimeSinceUpdate += DeltaSeconds;
+	if (TimeSinceUpdate < UpdateInterval || !SceneManager) {
+		return;
+	}
+	const float Elapsed = TimeSinceUpdate;
+	TimeSinceUpdate = 0.f;
+
+	APlayerCameraManager* Camera = UGameplayStatics::GetPlayerCameraManager(this, 0);
+	if (!Camera) {
+		return;
+	}
+	const FVector CameraLocation = Camera->GetCameraLocation();
+	const FVector Forward = Camera->GetCameraRotation().Vector();
+	const float HalfFOV = FMath::Min(FMath::DegreesToRadians(Camera->GetFOVAngle() / 2.f) * FieldOfViewMargin, PI);
+	if (bHasLastCameraLocation && Elapsed > KINDA_SMALL_NUMBER) {
+		// Smoothed, so that single jerky frames don't prefetch in random directions
+		CameraVelocity = FMath::Lerp(CameraVelocity, (CameraLocation - LastCameraLocation) / Elapsed, 0.5f);
+	}
+	LastCameraLocation = CameraLocation;
+	bHasLastCameraLocation = true;
+	const FVector PredictedLocation = CameraLocation + CameraVelocity * PrefetchSeconds;
+
+	const double Now = GetWorld()->GetTimeSeconds();
+	const TMap<int32, FBox> LayerBounds = SceneManager->GetLayerBounds();
+	TArray<FCandidate> Candidates;
+	for (const TPair<int32, FBox>& Layer : LayerBounds) {
+		for (ENeuralStreamedTextureKind Kind : { ENeuralStreamedTextureKind::Kernels, ENeuralStreamedTextureKind::Activations }) {
+			if ((Kind == ENeuralStreamedTextureKind::Kernels && !bStreamKernels) ||
+				(Kind == ENeuralStreamedTextureKind::Activations && !bStreamActivations)) {
+				continue;
+			}
+			const FIntPoint Key(Layer.Key, (int32)Kind);
+			FNeuralStreamedTexture* State = Textures.Find(Key);
+			if (State && (State->bUnavailable || State->Requested != ENeuralTextureLOD::None)) {
+				continue;
+			}
+			const ENeuralTextureLOD Desired = GetDesiredLOD(State, Layer.Value, CameraLocation, PredictedLocation, Forward, HalfFOV);
+			const ENeuralTextureLOD Current = State ? State->Current : ENeuralTextureLOD::None;
+			if (Desired == ENeuralTextureLOD::None) {
+				continue;
+			}
+			if (State) {
+				State->LastNeededTime = Now;
+			}
+			// Full resolution textures of layers which moved far away are replaced after a while
+			const bool bDowngrade = State && Current == ENeuralTextureLOD::Full && Desired == ENeuralTextureLOD::Low &&
+				Now - State->LastFullNeededTime > EvictAfterSeconds;
+			if (State && Desired == ENeuralTextureLOD::Full) {
+				State->LastFullNeededTime = Now;
+			}
+			if (Desired > Current || bDowngrade) {
+				Candidates.Add({ Key, Desired, FMath::Sqrt(Layer.Value.ComputeSquaredDistanceToPoint(CameraLocation)) });
+			}
+		}
+	}
+
+	// Evict what has not been needed for a while, or whose layer is gone
+	for (TPair<FIntPoint, FNeuralStreamedTexture>& Entry : Textures) {
+		FNeuralStreamedTexture& State = Entry.Value;
+		if (State.Current != ENeuralTextureLOD::None &&
+			(Now - State.LastNeededTime > EvictAfterSeconds || !LayerBounds.Contains(Entry.Key.X))) {
+			Evict(Entry.Key, State);
+		}
+	}
+
+	// Closest first
+	Candidates.Sort([](const FCandidate& A, const FCandidate& B) { return A.Distance < B.Distance; });
+	for (const FCandidate& Candidate : Candidates) {
+		if (PendingRequests >= MaxConcurrentRequests) {
+			break;
+		}
+		Request(Candidate.Key, Candidate.LOD);
+		FNeuralStreamedTexture& State = Textures.FindChecked(Candidate.Key);
+		State.LastNeededTime = Now;
+		if (Candidate.LOD == ENeuralTextureLOD::Full) {
+			State.LastFullNeededTime = Now;
+		}
+	}
+
+	if (bAtlasInstancesDirty) {
+		RebuildAtlasInstances();
+	}
+}
+
+ENeuralTextureLOD ANeuralTextureStreamer::GetDesiredLOD(const FNeuralStreamedTexture* State, const FBox& Bounds,
+	const FVector& CameraLocation, const FVector& PredictedLocation, const FVector& Forward, float HalfFOV) const
+{
+	const FVector Center = Bounds.GetCenter();
+	const float Radius = Bounds.GetExtent().Size();
+	// Bounding sphere against the view cone
+	auto IsInView = [&](const FVector& From)
+	{
+		const FVector ToCenter = Center - From;
+		const float Distance = ToCenter.Size();
+		if (Distance <= Radius) {
+			return true;
+		}
+		const float Angle = FMath::Acos(FMath::Clamp(FVector::DotProduct(ToCenter / Distance, Forward), -1.f, 1.f));
+		return Angle - FMath::Asin(Radius / Distance) <= HalfFOV;
+	};
+	if (!IsInView(CameraLocation) && !IsInView(PredictedLocation)) {
+		return ENeuralTextureLOD::None;
+	}
+
+	const float Distance = FMath::Sqrt(FMath::Min(
+		Bounds.ComputeSquaredDistanceToPoint(CameraLocation), Bounds.ComputeSquaredDistanceToPoint(PredictedLocation)));
+	const ENeuralTextureLOD Current = State ? State->Current : ENeuralTextureLOD::None;
+	const float Near = NearDistance * (Current == ENeuralTextureLOD::Full ? 1.f + Hysteresis : 1.f);
+	const float Far = FarDistance * (Current != ENeuralTextureLOD::None ? 1.f + Hysteresis : 1.f);
+	if (Distance <= Near) {
+		return ENeuralTextureLOD::Full;
+	}
+	return Distance <= Far ? ENeuralTextureLOD::Low : ENeuralTextureLOD::None;
+}
+
+FString ANeuralTextureStreamer::MakeCommand(const FIntPoint& Key, ENeuralTextureLOD LOD) const
+{
+	const int32 Resolution = LOD == ENeuralTextureLOD::Full ? FullResolution : LowResolution;
+	if ((ENeuralStreamedTextureKind)Key.Y == ENeuralStreamedTextureKind::Activations) {
+		return FString::Printf(TEXT("tf draw activations %d -1 %s %d"), Key.X,
+			ActivationInput.IsEmpty() ? TEXT("default") : *ActivationInput, Resolution);
+	}
+	return FString::Printf(TEXT("tf draw kernel %d false %d"), Key.X, Resolution);
+}
+
+void ANeuralTextureStreamer::Request(const FIntPoint& Key, ENeuralTextureLOD LOD)
+{
+	FNeuralStreamedTexture& State = Textures.FindOrAdd(Key);
+	State.Requested = LOD;
+	PendingRequests++;
+
+	const FString Command = MakeCommand(Key, LOD);
+	const uint32 Serial = StreamingSerial;
+	const bool bUseAtlas = Atlas && AtlasMaterial;
+	INeuralInteractionClient* Client = &INeuralInteractionClient::Get();
+	TWeakObjectPtr<ANeuralTextureStreamer> WeakThis(this);
+	UE_LOG(NeuralInteractionClient, Verbose, TEXT("Streaming texture: %s"), *Command);
+
+	Async(EAsyncExecution::ThreadPool, [WeakThis, Client, Key, LOD, Command, Serial, bUseAtlas]()
+	{
+		// Called on this thread while the command runs
+		TArray<uint8> File;
+		TArray<FTransform> Placements;
+		FNeuralResponseCallbacks Callbacks;
+		Callbacks.OnFile = [&File](const FString& Filename, TArrayView<const uint8> Data)
+		{
+			File = TArray<uint8>(Data.GetData(), Data.Num());
+		};
+		Callbacks.OnImageSpawned = [&Placements](const FString& Path, const FTransform& Transform)
+		{
+			Placements.Add(Transform);
+		};
+		Client->ExecuteCommand(Command, Callbacks);
+
+		// Decoding stays on the worker, only the upload needs the game thread.
+		// Textures still in the texture cache are not decoded again.
+		FString Hash = File.Num() > 0 ? FNeuralTextureCache::HashContent(File.GetData(), File.Num()) : FString();
+		FNeuralDecodedImage Image;
+		bool bDecoded = false;
+		if (!Hash.IsEmpty() && (bUseAtlas || !FNeuralTextureCache::Get().HasTexture(Hash))) {
+			bDecoded = NeuralTextureDecoding::Decode(File, Image);
+			if (!bDecoded) {
+				Hash.Empty();
+			}
+		}
+		AsyncTask(ENamedThreads::GameThread, [WeakThis, Key, LOD, Serial, Hash, bDecoded, Image = MoveTemp(Image),
+			Placements = MoveTemp(Placements)]()
+		{
+			ANeuralTextureStreamer* This = WeakThis.Get();
+			if (!This || This->StreamingSerial != Serial) {
+				return;
+			}
+			This->OnRequestFinished(Key, LOD, Hash, bDecoded ? &Image : nullptr, Placements);
+		});
+	});
+}
+
+void ANeuralTextureStreamer::OnRequestFinished(const FIntPoint& Key, ENeuralTextureLOD LOD, const FString& Hash,
+	const FNeuralDecodedImage* Image, const TArray<FTransform>& Placements)
+{
+	PendingRequests = FMath::Max(0, PendingRequests - 1);
+	FNeuralStreamedTexture* State = Textures.Find(Key);
+	if (!State) {
+		return;
+	}
+	State->Requested = ENeuralTextureLOD::None;
+	if (Hash.IsEmpty() || Placements.Num() == 0) {
+		UE_LOG(NeuralInteractionClient, Log, TEXT("No texture of kind %d available for layer %d, it won't be requested again."),
+			Key.Y, Key.X);
+		State->bUnavailable = true;
+		return;
+	}
+
+	// Replaces the previous level of detail
+	Evict(Key, *State);
+	FNeuralAtlasTile Tile;
+	if (Image && Atlas && AtlasMaterial && Atlas->AddTile(GetAtlasKey(Key), *Image, Tile)) {
+		State->Tile = Tile;
+		State->Placements = Placements;
+		bAtlasInstancesDirty = true;
+	}
+	else {
+		FNeuralTextureCache& Cache = FNeuralTextureCache::Get();
+		UTexture2D* Texture = Cache.FindTexture(Hash);
+		if (!Texture && Image) {
+			Texture = NeuralTextureDecoding::CreateTexture(*Image);
+			Cache.StoreTexture(Hash, Texture);
+		}
+		// Evicted from the cache since the request finished, requested again with the next update
+		if (!Texture) {
+			return;
+		}
+		ShowPlanes(*State, Texture, Placements);
+	}
+	State->Current = LOD;
+}
+
+void ANeuralTextureStreamer::ShowPlanes(FNeuralStreamedTexture& State, UTexture2D* Texture, const TArray<FTransform>& Placements)
+{
+	State.Texture = Texture;
+	// Image instructions are relative to the visualization, like the cuboids of the scene manager
+	const FTransform SceneTransform = SceneManager ? SceneManager->GetActorTransform() : FTransform::Identity;
+	for (int32 i = 0; i < Placements.Num(); i++) {
+		if (!State.Planes.IsValidIndex(i)) {
+			UStaticMeshComponent* Plane = NewObject<UStaticMeshComponent>(this);
+			Plane->SetMobility(EComponentMobility::Movable);
+			Plane->SetupAttachment(RootComponent);
+			Plane->SetStaticMesh(PlaneMesh);
+			Plane->SetCollisionEnabled(ECollisionEnabled::NoCollision);
+			UMaterialInstanceDynamic* Material = TextureMaterial ? UMaterialInstanceDynamic::Create(TextureMaterial, this) : nullptr;
+			if (Material) {
+				Plane->SetMaterial(0, Material);
+			}
+			Plane->RegisterComponent();
+			State.Planes.Add(Plane);
+			State.Materials.Add(Material);
+		}
+		State.Planes[i]->SetWorldTransform(Placements[i] * SceneTransform);
+		State.Planes[i]->SetVisibility(true);
+		if (State.Materials[i]) {
+			State.Materials[i]->SetTextureParameterValue(TextureParameterName, Texture);
+		}
+	}
+	for (int32 i = Placements.Num(); i < State.Planes.Num(); i++) {
+		State.Planes[i]->SetVisibility(false);
+	}
+}
+
+void ANeuralTextureStreamer::Evict(const FIntPoint& Key, FNeuralStreamedTexture& State)
+{
+	for (UStaticMeshComponent* Plane : State.Planes) {
+		Plane->SetVisibility(false);
+	}
+	for (UMaterialInstanceDynamic* Material : State.Materials) {
+		if (Material) {
+			Material->SetTextureParameterValue(TextureParameterName, nullptr);
+		}
+	}
+	// Unreferenced now, the garbage collector frees it together with its GPU memory
+	State.Texture = nullptr;
+	if (State.Tile.IsValid()) {
+		if (Atlas) {
+			Atlas->RemoveTile(GetAtlasKey(Key));
+		}
+		State.Tile = FNeuralAtlasTile();
+		State.Placements.Empty();
+		bAtlasInstancesDirty = true;
+	}
+	State.Current = ENeuralTextureLOD::None;
+}
+
+UInstancedStaticMeshComponent* ANeuralTextureStreamer::GetAtlasInstances(int32 Page)
+{
+	if (AtlasInstances.IsValidIndex(Page) && AtlasInstances[Page]) {
+		return AtlasInstances[Page];
+	}
+	UInstancedStaticMeshComponent* Instances = NewObject<UInstancedStaticMeshComponent>(this);
+	Instances->SetMobility(EComponentMobility::Movable);
+	Instances->SetupAttachment(RootComponent);
+	Instances->SetStaticMesh(PlaneMesh);
+	Instances->SetCollisionEnabled(ECollisionEnabled::NoCollision);
+	Instances->NumCustomDataFloats = 1;
+	UMaterialInstanceDynamic* Material = UMaterialInstanceDynamic::Create(AtlasMaterial, this);
+	Material->SetTextureParameterValue(PageParameterName, Atlas->GetPageTexture(Page));
+	Material->SetTextureParameterValue(TileIndexParameterName, Atlas->GetTileIndexTexture());
+	Material->SetScalarParameterValue(TileCapacityParameterName, Atlas->TileCapacity);
+	Instances->SetMaterial(0, Material);
+	Instances->RegisterComponent();
+	if (AtlasInstances.Num() <= Page) {
+		AtlasInstances.SetNum(Page + 1);
+	}
+	AtlasInstances[Page] = Instances;
+	return Instances;
+}
+
+void ANeuralTextureStreamer::RebuildAtlasInstances()
+{
+	// A few hundred instances at most, so rebuilding is cheaper than tracking instance indices
+	bAtlasInstancesDirty = false;
+	for (UInstancedStaticMeshComponent* Instances : AtlasInstances) {
+		if (Instances) {
+			Instances->ClearInstances();
+		}
+	}
+	if (!Atlas) {
+		return;
+	}
+	const FTransform SceneTransform = SceneManager ? SceneManager->GetActorTransform() : FTransform::Identity;
+	for (const TPair<FIntPoint, FNeuralStreamedTexture>& Entry : Textures) {
+		const FNeuralAtlasTile& Tile = Entry.Value.Tile;
+		if (!Tile.IsValid()) {
+			continue;
+		}
+		UInstancedStaticMeshComponent* Instances = GetAtlasInstances(Tile.Page);
+		for (const FTransform& Placement : Entry.Value.Placements) {
+			const int32 Instance = Instances->AddInstanceWorldSpace(Placement * SceneTransform);
+			Instances->SetCustomDataValue(Instance, 0, Tile.Index, false);
+		}
+	}
+	for (UInstancedStaticMeshComponent* Instances : AtlasInstances) {
+		if (Instances) {
+			Instances->MarkRenderStateDirty();
+		}
+	}
+}
@@ -0,0 +1,121 @@
+/*
+This file SNeuralConsoleView.cpp is part of NeuralVisUAL.
+
+NeuralVisUAL is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+NeuralVisUAL is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with NeuralVisUAL.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "SNeuralConsoleView.h"
+#include "Fonts/FontMeasure.h"
+#include "Framework/Application/SlateApplication.h"
+#include "Styling/CoreStyle.h"
+#include "Widgets/Text/STextBlock.h"
+#include "Widgets/Views/STableRow.h"
+
+void SNeuralConsoleView::Construct(const FArguments& InArgs)
+{
+	Font = FCoreStyle::GetDefaultFontStyle("Mono", InArgs._FontSize);
+	bAutoScroll = InArgs._AutoScroll;
+	LastSequence = FNeuralConsole::Get().GetLinesSince(0, Items);
+
+	ChildSlot
+	[
+		SAssignNew(ListView, SListView<FNeuralConsoleLinePtr>)
+		.ListItemsSource(&Items)
+		.ItemHeight(GetLineHeight())
+		.SelectionMode(ESelectionMode::None)
+		.OnGenerateRow(this, &SNeuralConsoleView::GenerateRow)
+		.OnListViewScrolled(this, &SNeuralConsoleView::OnListScrolled)
+	];
+	ScrollToEnd();
+}
+
+void SNeuralConsoleView::Tick(const FGeometry& AllottedGeometry, const double InCurrentTime, const float InDeltaTime)
+{
+	SCompoundWidget::Tick(AllottedGeometry, InCurrentTime, InDeltaTime);
+
+	FNeuralConsole& Console = FNeuralConsole::Get();
+	const uint64 Last = Console.GetLastSequence();
+	const uint64 First = Console.GetFirstSequence();
+	// Cleared
+	if (Last < LastSequence || (Items.Num() > 0 && First > Last)) {
+		Items.Reset();
+		LastSequence = Last;
+		ListView->RequestListRefresh();
+		return;
+	}
+	if (Last == LastSequence && (Items.Num() == 0 || Items[0]->Sequence >= First)) {
+		return;
+	}
+	LastSequence = Console.GetLinesSince(LastSequence, Items);
+	// Lines that dropped out of the ring buffer
+	int32 Dropped = 0;
+	while (Dropped < Items.Num() && Items[Dropped]->Sequence < First) {
+		Dropped++;
+	}
+	if (Dropped > 0) {
+		Items.RemoveAt(0, Dropped, false);
+	}
+	ListView->RequestListRefresh();
+	if (bAutoScroll && bFollowing) {
+		ListView->RequestScrollIntoView(Items.Num() > 0 ? Items.Last() : nullptr);
+	}
+}
+
+void SNeuralConsoleView::SetFontSize(int32 InFontSize)
+{
+	if (Font.Size == InFontSize) {
+		return;
+	}
+	Font = FCoreStyle::GetDefaultFontStyle("Mono", InFontSize);
+	ListView->SetItemHeight(GetLineHeight());
+	ListView->RebuildList();
+}
+
+void SNeuralConsoleView::SetAutoScroll(bool bInAutoScroll)
+{
+	bAutoScroll = bInAutoScroll;
+}
+
+void SNeuralConsoleView::ScrollToEnd()
+{
+	bFollowing = true;
+	if (Items.Num() > 0) {
+		ListView->RequestScrollIntoView(Items.Last());
+	}
+}
+
+TSharedRef<ITableRow> SNeuralConsoleView::GenerateRow(FNeuralConsoleLinePtr Line, const TSharedRef<STableViewBase>& OwnerTable)
+{
+	return SNew(STableRow<FNeuralConsoleLinePtr>, OwnerTable)
+	[
+		SNew(STextBlock)
+		.Text(FText::FromString(Line->Text))
+		.Font(Font)
+		.ColorAndOpacity(FSlateColor(Line->Color))
+	];
+}
+
+void SNeuralConsoleView::OnListScrolled(double ScrollOffset)
+{
+	// The offset is measured in lines
+	const float LineHeight = GetLineHeight();
+	const double VisibleLines = LineHeight > 0.f ? GetCachedGeometry().GetLocalSize().Y / LineHeight : 0.0;
+	bFollowing = ScrollOffset + VisibleLines >= Items.Num() - 0.5;
+}
+
+float SNeuralConsoleView::GetLineHeight() const
+{
+	const TSharedRef<FSlateFontMeasure> FontMeasure = FSlateApplication::Get().GetRenderer()->GetFontMeasureService();
+	return FontMeasure->GetMaxCharacterHeight(Font);
+}
@@ -0,0 +1,60 @@
+/*
+This file SNeuralConsoleView.h is part of NeuralVisUAL.
+
+NeuralVisUAL is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+NeuralVisUAL is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with NeuralVisUAL.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "NeuralConsole.h"
+#include "Widgets/SCompoundWidget.h"
+#include "Widgets/Views/SListView.h"
+
+/*
+*	List of the lines of FNeuralConsole. Only the visible rows are created and laid out, so the number
+*	of lines in the buffer does not matter. Follows new lines while scrolled to the end.
+*/
+class SNeuralConsoleView : public SCompoundWidget
+{
+public:
+	SLATE_BEGIN_ARGS(SNeuralConsoleView)
+		: _FontSize(9)
+		, _AutoScroll(true)
+	{}
+		SLATE_ARGUMENT(int32, FontSize)
+		SLATE_ARGUMENT(bool, AutoScroll)
+	SLATE_END_ARGS()
+
+	void Construct(const FArguments& InArgs);
+
+	virtual void Tick(const FGeometry& AllottedGeometry, const double InCurrentTime, const float InDeltaTime) override;
+
+	void SetFontSize(int32 InFontSize);
+	void SetAutoScroll(bool bInAutoScroll);
+	void ScrollToEnd();
+
+private:
+	TSharedRef<ITableRow> GenerateRow(FNeuralConsoleLinePtr Line, const TSharedRef<STableViewBase>& OwnerTable);
+	void OnListScrolled(double ScrollOffset);
+	float GetLineHeight() const;
+
+	TSharedPtr<SListView<FNeuralConsoleLinePtr>> ListView;
+	TArray<FNeuralConsoleLinePtr> Items;
+	uint64 LastSequence = 0;
+	FSlateFontInfo Font;
+	bool bAutoScroll = true;
+	// Whether the end of the list is visible, only then new lines scroll the list
+	bool bFollowing = true;
+};
@@ -20,6 +20,7 @@ along with NeuralVisUAL.  If not, see <https://www.gnu.org/licenses/>.
 #include "Modules/ModuleInterface.h"
 #include "Modules/ModuleManager.h"
 #include "INeuralInteractionClientBPLibrary.h"
+#include "NeuralResponseCallbacks.h"
 
 class INeuralInteractionClient : public IModuleInterface
 {
@@ -58,4 +59,9 @@ public:
 		const FFoundAtomInteger64& CallbackFoundAtomInteger64,
 		const FFoundAtomFloat& CallbackFoundAtomFloat
 	) = 0;
+
+	// For C++ callers, which get the response through native callbacks instead of the dynamic delegates
+	// the functions above are adapted to. Blocks until the connection is closed, like them.
+	// Returns whether the server closed it gracefully
+	virtual bool ExecuteCommand(const FString& Command, const FNeuralResponseCallbacks& Callbacks) = 0;
 };
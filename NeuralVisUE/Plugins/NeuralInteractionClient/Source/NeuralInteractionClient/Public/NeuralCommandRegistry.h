@@ -0,0 +1,110 @@
+/*
+This file NeuralCommandRegistry.h is part of NeuralVisUAL.
+
+NeuralVisUAL is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+NeuralVisUAL is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with NeuralVisUAL.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Kismet/BlueprintFunctionLibrary.h"
+#include "NeuralCommandRegistry.generated.h"
+
+// Identifies one execution of a command, valid from sending it until the end of connection delegate
+USTRUCT(BlueprintType)
+struct NEURALINTERACTIONCLIENT_API FNeuralCommandHandle
+{
+	GENERATED_BODY()
+
+	UPROPERTY(BlueprintReadOnly, Category = "Neural Interaction Client|Commands")
+	int32 Id = 0;
+
+	UPROPERTY(BlueprintReadOnly, Category = "Neural Interaction Client|Commands")
+	FString Command;
+
+	bool IsValid() const { return Id != 0; }
+};
+
+/*
+*	Keeps track of the commands currently executed, so that they can be cancelled from any thread.
+*
+*	Cancelling sends a cancel frame on the connection of the command. The server stops the command
+*	and closes the connection, see runCancellable in websocketServer.py. From the moment of
+*	cancelling, no further responses are parsed or passed to delegates and listeners; only the end
+*	of connection delegate is still called, with forciblyClosed set. Commands which have not reached
+*	the server yet are not sent at all.
+*
+*	All functions are thread-safe.
+*/
+class NEURALINTERACTIONCLIENT_API FNeuralCommandRegistry
+{
+public:
+	static FNeuralCommandRegistry& Get();
+
+	// Called by the connection for every command it executes
+	FNeuralCommandHandle Register(const FString& Command);
+	void Unregister(const FNeuralCommandHandle& Handle);
+	// Called by the connection with the function that cancels its current attempt, or nullptr
+	// once the attempt is over. Canceller is called while the lock is held
+	void SetCanceller(const FNeuralCommandHandle& Handle, TFunction<void()>&& Canceller);
+
+	// Returns false if the command is no longer running
+	bool Cancel(const FNeuralCommandHandle& Handle);
+	// Cancels all running executions of Command, returns how many
+	int32 CancelCommand(const FString& Command);
+	int32 CancelAll();
+
+	bool IsCancelled(const FNeuralCommandHandle& Handle) const;
+	TArray<FNeuralCommandHandle> GetRunningCommands() const;
+	// Running executions of Command, oldest first
+	TArray<FNeuralCommandHandle> Find(const FString& Command) const;
+
+private:
+	FNeuralCommandRegistry() = default;
+
+	struct FEntry
+	{
+		FString Command;
+		TFunction<void()> Canceller;
+		bool bCancelled = false;
+	};
+
+	void CancelEntry(FEntry& Entry);
+
+	mutable FCriticalSection Lock;
+	// Ordered by id, which are increasing
+	TSortedMap<int32, FEntry> Entries;
+	int32 NextId = 1;
+};
+
+UCLASS()
+class NEURALINTERACTIONCLIENT_API UNeuralCommandRegistryBPLibrary : public UBlueprintFunctionLibrary
+{
+	GENERATED_BODY()
+
+public:
+	// Cancels all running executions of Command and returns how many there were.
+	// Their end of connection delegates are called with forciblyClosed set
+	UFUNCTION(BlueprintCallable, Category = "Neural Interaction Client|Commands")
+	static int32 CancelCommand(const FString& Command);
+
+	UFUNCTION(BlueprintCallable, Category = "Neural Interaction Client|Commands")
+	static bool CancelCommandByHandle(const FNeuralCommandHandle& Handle);
+
+	UFUNCTION(BlueprintCallable, Category = "Neural Interaction Client|Commands")
+	static int32 CancelAllCommands();
+
+	UFUNCTION(BlueprintPure, Category = "Neural Interaction Client|Commands")
+	static TArray<FNeuralCommandHandle> GetRunningCommands();
+};
@@ -0,0 +1,107 @@
+/*
+This file NeuralCommandScheduler.h is part of NeuralVisUAL.
+
+NeuralVisUAL is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+NeuralVisUAL is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with NeuralVisUAL.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Kismet/BlueprintFunctionLibrary.h"
+#include "INeuralInteractionClientBPLibrary.h"
+#include "NeuralCommandRegistry.h"
+#include "NeuralInteractionClientSettings.h"
+#include "NeuralResponseCallbacks.h"
+#include "NeuralCommandScheduler.generated.h"
+
+/*
+*	Executes commands in the background, in three lanes by priority.
+*
+*	The ExecuteCommand nodes block the calling thread until the response is complete, so a query
+*	issued after a texture transfer waits for all of it. Scheduled commands run on a pool of worker
+*	threads with a connection of their own instead. Commands of each lane are queued once
+*	MaxConcurrentInteractiveCommands, MaxConcurrentNormalCommands or MaxConcurrentBulkCommands of them
+*	are running, see UNeuralInteractionClientSettings. The pool has a thread for every command the
+*	lanes may run at once, so that a running command never waits for a thread. The bulk window shrinks to a single command while
+*	FNeuralLinkTelemetry measures a congested link. The server sends responses to bulk commands in fragments,
+*	so that it can answer interactive commands in between.
+*
+*	Responses reach the callbacks passed along and the native listeners of FNeuralInteractionEvents
+*	on the thread of the command.
+*	Queued commands are registered in FNeuralCommandRegistry right away and can be cancelled before
+*	they start. All functions are thread-safe.
+*/
+class NEURALINTERACTIONCLIENT_API FNeuralCommandScheduler
+{
+public:
+	// Called on the game thread with whether the connection was closed forcibly or cancelled
+	using FOnFinished = TFunction<void(bool /*bForciblyClosed*/)>;
+
+	static FNeuralCommandScheduler& Get();
+
+	FNeuralCommandHandle Schedule(const FString& Command, ENeuralCommandPriority Priority, FOnFinished&& OnFinished = nullptr);
+	FNeuralCommandHandle Schedule(const FString& Command, ENeuralCommandPriority Priority,
+		const FNeuralResponseCallbacks& Callbacks, FOnFinished&& OnFinished = nullptr);
+	// Priority as configured for the command, see UNeuralInteractionClientSettings::GetCommandPriority
+	FNeuralCommandHandle Schedule(const FString& Command, FOnFinished&& OnFinished = nullptr);
+	FNeuralCommandHandle Schedule(const FString& Command, const FNeuralResponseCallbacks& Callbacks,
+		FOnFinished&& OnFinished = nullptr);
+
+	int32 GetNumberOfQueued(ENeuralCommandPriority Priority) const;
+	int32 GetNumberOfRunning(ENeuralCommandPriority Priority) const;
+
+private:
+	FNeuralCommandScheduler() = default;
+
+	struct FQueuedCommand
+	{
+		FNeuralCommandHandle Handle;
+		FNeuralResponseCallbacks Callbacks;
+		FOnFinished OnFinished;
+	};
+
+	struct FLane
+	{
+		TArray<FQueuedCommand> Queue;
+		int32 Running = 0;
+	};
+
+	// Starts queued commands of the lane as long as it has capacity, Lock has to be held
+	void StartQueued(ENeuralCommandPriority Priority);
+	void Execute(ENeuralCommandPriority Priority, FQueuedCommand&& Queued);
+	static int32 GetCapacity(ENeuralCommandPriority Priority);
+
+	mutable FCriticalSection Lock;
+	FLane Lanes[3];
+	// Created with the first command and kept for the lifetime of the process
+	FQueuedThreadPool* Workers = nullptr;
+};
+
+UCLASS()
+class NEURALINTERACTIONCLIENT_API UNeuralCommandSchedulerBPLibrary : public UBlueprintFunctionLibrary
+{
+	GENERATED_BODY()
+
+public:
+	// Executes the command in the background without blocking. OnString and OnFinished are called on the game thread
+	UFUNCTION(BlueprintCallable, Category = "Neural Interaction Client|Scheduling", meta = (AutoCreateRefTerm = "OnString"))
+	static FNeuralCommandHandle ScheduleCommand(const FString& Command, ENeuralCommandPriority Priority,
+		const FFoundAtomString& OnString, const FEndOfConnection& OnFinished);
+
+	UFUNCTION(BlueprintPure, Category = "Neural Interaction Client|Scheduling")
+	static ENeuralCommandPriority GetCommandPriority(const FString& Command);
+
+	UFUNCTION(BlueprintPure, Category = "Neural Interaction Client|Scheduling")
+	static int32 GetNumberOfQueuedCommands(ENeuralCommandPriority Priority);
+};
@@ -0,0 +1,110 @@
+/*
+This file NeuralConsole.h is part of NeuralVisUAL.
+
+NeuralVisUAL is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+NeuralVisUAL is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with NeuralVisUAL.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Kismet/BlueprintFunctionLibrary.h"
+#include "NeuralConsole.generated.h"
+
+UENUM(BlueprintType)
+enum class ENeuralConsoleLineKind : uint8
+{
+	// ["STATUS", level, text]
+	Status,
+	// ["DEBUG", level, text]
+	Debug,
+	// Added by the client, e.g. the commands typed by the user
+	Local,
+};
+
+// One line of the console, immutable once added
+struct NEURALINTERACTIONCLIENT_API FNeuralConsoleLine
+{
+	// Increases by one per line, over all lines ever added
+	uint64 Sequence = 0;
+	ENeuralConsoleLineKind Kind = ENeuralConsoleLineKind::Local;
+	int32 Level = 0;
+	// Without ANSI escape sequences
+	FString Text;
+	// Foreground color at the first visible character of the line, white without color codes
+	FLinearColor Color = FLinearColor::White;
+	FString Command;
+};
+
+using FNeuralConsoleLinePtr = TSharedPtr<const FNeuralConsoleLine, ESPMode::ThreadSafe>;
+
+/*
+*	Console output of all commands, kept in a ring buffer of the last ConsoleCapacity lines, see
+*	UNeuralInteractionClientSettings. Status and debug messages are added by the connections as they
+*	arrive, split into lines and stripped of ANSI escape sequences once, so that views only copy
+*	pointers to the lines that are new since they last looked, see UNeuralConsoleView.
+*
+*	All functions are thread-safe.
+*/
+class NEURALINTERACTIONCLIENT_API FNeuralConsole
+{
+public:
+	static FNeuralConsole& Get();
+
+	void AddMessage(ENeuralConsoleLineKind Kind, int32 Level, const FString& Command, const char* Utf8Text, int32 Size);
+	void AddMessage(ENeuralConsoleLineKind Kind, int32 Level, const FString& Command, const FString& Text);
+
+	// Appends the lines after Sequence that are still in the buffer, returns the sequence of the last line
+	uint64 GetLinesSince(uint64 Sequence, TArray<FNeuralConsoleLinePtr>& OutLines) const;
+	// Sequence of the oldest line still in the buffer
+	uint64 GetFirstSequence() const;
+	uint64 GetLastSequence() const;
+
+	void Clear();
+	// Everything in the buffer, one line per line
+	FString GetText() const;
+
+	// Removes ANSI escape sequences, OutColor is the color of the first line as in FNeuralConsoleLine
+	static FString StripAnsi(const FString& Text, FLinearColor* OutColor = nullptr);
+
+private:
+	FNeuralConsole() = default;
+
+	void AddLine(TSharedRef<FNeuralConsoleLine, ESPMode::ThreadSafe>&& Line);
+
+	mutable FCriticalSection Lock;
+	TArray<FNeuralConsoleLinePtr> Lines;
+	// Index of the oldest line in Lines once the ring is full
+	int32 Head = 0;
+	uint64 LastSequence = 0;
+};
+
+UCLASS()
+class NEURALINTERACTIONCLIENT_API UNeuralConsoleBPLibrary : public UBlueprintFunctionLibrary
+{
+	GENERATED_BODY()
+
+public:
+	UFUNCTION(BlueprintCallable, Category = "Neural Interaction Client|Console")
+	static void AddConsoleLine(const FString& Text);
+
+	UFUNCTION(BlueprintCallable, Category = "Neural Interaction Client|Console")
+	static void ClearConsole();
+
+	// For copying the console, expensive with a full buffer
+	UFUNCTION(BlueprintPure, Category = "Neural Interaction Client|Console")
+	static FString GetConsoleText();
+
+	UFUNCTION(BlueprintPure, Category = "Neural Interaction Client|Console")
+	static FString StripAnsiEscapeSequences(const FString& Text);
+};
@@ -0,0 +1,64 @@
+/*
+This file NeuralConsoleView.h is part of NeuralVisUAL.
+
+NeuralVisUAL is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+NeuralVisUAL is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with NeuralVisUAL.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Components/Widget.h"
+#include "NeuralConsoleView.generated.h"
+
+class SNeuralConsoleView;
+
+/*
+*	Shows the output of FNeuralConsole. Replaces text blocks that get the whole output appended: lines
+*	are stripped of ANSI escape sequences once when they arrive, and only the visible ones are laid out.
+*/
+UCLASS(meta = (DisplayName = "Neural Console View"))
+class NEURALINTERACTIONCLIENT_API UNeuralConsoleView : public UWidget
+{
+	GENERATED_BODY()
+
+public:
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Console", meta = (ClampMin = "1"))
+	int32 FontSize = 9;
+
+	// Follows new lines while scrolled to the end
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Console")
+	bool bAutoScroll = true;
+
+	UFUNCTION(BlueprintCallable, Category = "Neural Interaction Client|Console")
+	void SetFontSize(int32 InFontSize);
+
+	UFUNCTION(BlueprintCallable, Category = "Neural Interaction Client|Console")
+	void SetAutoScroll(bool bInAutoScroll);
+
+	UFUNCTION(BlueprintCallable, Category = "Neural Interaction Client|Console")
+	void ScrollToEnd();
+
+	virtual void SynchronizeProperties() override;
+	virtual void ReleaseSlateResources(bool bReleaseChildren) override;
+
+#if WITH_EDITOR
+	virtual const FText GetPaletteCategory() override;
+#endif
+
+protected:
+	virtual TSharedRef<SWidget> RebuildWidget() override;
+
+private:
+	TSharedPtr<SNeuralConsoleView> ConsoleView;
+};
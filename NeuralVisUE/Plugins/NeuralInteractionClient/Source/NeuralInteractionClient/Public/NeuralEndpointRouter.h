@@ -0,0 +1,113 @@
+/*
+This file NeuralEndpointRouter.h is part of NeuralVisUAL.
+
+NeuralVisUAL is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+NeuralVisUAL is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with NeuralVisUAL.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Kismet/BlueprintFunctionLibrary.h"
+#include "NeuralInteractionClientSettings.h"
+#include "NeuralEndpointRouter.generated.h"
+
+// Server a command is sent to
+struct NEURALINTERACTIONCLIENT_API FNeuralRoute
+{
+	FNeuralServerEndpoint Endpoint;
+	// Command without the "@Name " prefix
+	FString Command;
+};
+
+/*
+*	Spreads commands across several server processes, e.g. one per loaded model or one for the
+*	expensive visualizations, configured as Endpoints in UNeuralInteractionClientSettings.
+*
+*	A command is routed
+*	- to the server named by an "@Name " prefix, which is removed before sending it. Models are loaded
+*	  per server, so this is how commands reach the server holding a certain model
+*	- otherwise to the servers with the longest matching prefix in their Commands. Chained commands
+*	  run on one connection and go where their first part goes
+*	- otherwise to the servers without any Commands, or the first server if all of them have some.
+*	Among several servers matching equally well, StatelessCommands go to the one running the fewest
+*	commands of this client. The servers keep state though, e.g. the loaded model and the drawing in
+*	progress, so all other commands go to the same one of them, picked by the first such command.
+*	Endpoints set at runtime replace those of the project settings. All functions are thread-safe.
+*/
+class NEURALINTERACTIONCLIENT_API FNeuralEndpointRouter
+{
+public:
+	static FNeuralEndpointRouter& Get();
+
+	// Selects the server and counts the command as running on it until Release
+	FNeuralRoute Acquire(const FString& Command);
+	void Release(const FNeuralRoute& Route);
+	// Selects the server without counting the command or pinning stateful commands to it
+	FNeuralRoute Route(const FString& Command) const;
+
+	TArray<FNeuralServerEndpoint> GetEndpoints() const;
+	void SetEndpoints(const TArray<FNeuralServerEndpoint>& InEndpoints);
+	// Replaces the server of the same name, or adds it
+	void AddEndpoint(const FNeuralServerEndpoint& Endpoint);
+	bool RemoveEndpoint(const FString& Name);
+	// Back to the endpoints of the project settings
+	void ResetEndpoints();
+
+	// Command without the "@Name " prefix, e.g. to look up its priority
+	static FString RemoveEndpointName(const FString& Command);
+
+private:
+	FNeuralEndpointRouter() = default;
+
+	// OutStickyKey is set to the key of the candidate set if stateful commands are to stay on the
+	// selected server, which is only recorded once a command is sent there, see Acquire
+	FNeuralRoute Select(const FString& Command, FString& OutStickyKey) const;
+	const TArray<FNeuralServerEndpoint>& GetEndpointsLocked() const;
+	static FString GetKey(const FNeuralServerEndpoint& Endpoint);
+	// Splits "@Name command", returns false if the command has no prefix
+	static bool SplitEndpointName(const FString& Command, FString& OutName, FString& OutCommand);
+
+	mutable FCriticalSection Lock;
+	TOptional<TArray<FNeuralServerEndpoint>> Overrides;
+	// Commands running per "host:port"
+	TMap<FString, int32> Running;
+	// "host:port" the stateful commands of a set of equally suited servers go to, keyed by their keys
+	TMap<FString, FString> StickyEndpoints;
+};
+
+UCLASS()
+class NEURALINTERACTIONCLIENT_API UNeuralEndpointRouterBPLibrary : public UBlueprintFunctionLibrary
+{
+	GENERATED_BODY()
+
+public:
+	UFUNCTION(BlueprintPure, Category = "Neural Interaction Client|Endpoints")
+	static TArray<FNeuralServerEndpoint> GetServerEndpoints();
+
+	UFUNCTION(BlueprintCallable, Category = "Neural Interaction Client|Endpoints")
+	static void SetServerEndpoints(const TArray<FNeuralServerEndpoint>& Endpoints);
+
+	UFUNCTION(BlueprintCallable, Category = "Neural Interaction Client|Endpoints")
+	static void AddServerEndpoint(const FNeuralServerEndpoint& Endpoint);
+
+	UFUNCTION(BlueprintCallable, Category = "Neural Interaction Client|Endpoints")
+	static bool RemoveServerEndpoint(const FString& Name);
+
+	UFUNCTION(BlueprintCallable, Category = "Neural Interaction Client|Endpoints")
+	static void ResetServerEndpoints();
+
+	// Server the command would be sent to right now
+	UFUNCTION(BlueprintPure, Category = "Neural Interaction Client|Endpoints")
+	static FNeuralServerEndpoint GetServerEndpointForCommand(const FString& Command);
+};
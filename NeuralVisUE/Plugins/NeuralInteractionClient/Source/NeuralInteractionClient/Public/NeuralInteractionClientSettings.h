@@ -0,0 +1,225 @@
+/*
+This file NeuralInteractionClientSettings.h is part of NeuralVisUAL.
+
+NeuralVisUAL is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+NeuralVisUAL is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with NeuralVisUAL.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Engine/DeveloperSettings.h"
+#include "NeuralInteractionClientSettings.generated.h"
+
+UENUM()
+enum class ENeuralTransport : uint8
+{
+	// TCP and a websocket handshake per command, works with local and remote servers
+	WebSocket,
+	// Length prefixed frames on a unix domain socket, only for servers on the same machine.
+	// Falls back to WebSocket on platforms without unix domain sockets
+	LocalSocket,
+};
+
+// Lanes of FNeuralCommandScheduler. Every command has its own connection, lanes only differ in how
+// many of their commands may run at once and in how the server sends the responses
+UENUM(BlueprintType)
+enum class ENeuralCommandPriority : uint8
+{
+	// Small control commands and queries, never queued and sent without delay (TCP_NODELAY)
+	Interactive,
+	Normal,
+	// Textures, tensors and large cuboid batches, which the server sends in fragments so that it can
+	// answer interactive commands in between
+	Bulk,
+};
+
+// Python server the client connects to, see FNeuralEndpointRouter
+USTRUCT(BlueprintType)
+struct NEURALINTERACTIONCLIENT_API FNeuralServerEndpoint
+{
+	GENERATED_BODY()
+
+	// Commands starting with "@Name " are sent to this server, without the prefix
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Neural Interaction Client|Endpoints")
+	FString Name = TEXT("default");
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Neural Interaction Client|Endpoints")
+	FString Host = TEXT("localhost");
+
+	// Start further servers with --port
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Neural Interaction Client|Endpoints", meta = (ClampMin = "1", ClampMax = "65535"))
+	int32 Port = 80;
+
+	// Prefixes of the commands this server handles, compared without case and spaces.
+	// Empty handles all commands no other server has a prefix for
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Neural Interaction Client|Endpoints")
+	TArray<FString> Commands;
+};
+
+/*
+*	Project settings of the client, stored in DefaultGame.ini and shown under Plugins in the editor.
+*	Read on every connection, so changes apply to the next command.
+*/
+UCLASS(config = Game, defaultconfig, meta = (DisplayName = "Neural Interaction Client"))
+class NEURALINTERACTIONCLIENT_API UNeuralInteractionClientSettings : public UDeveloperSettings
+{
+	GENERATED_BODY()
+
+public:
+	// Servers the commands are spread across. Without any, commands go to localhost:80
+	UPROPERTY(config, EditAnywhere, Category = "Connection")
+	TArray<FNeuralServerEndpoint> Endpoints = { FNeuralServerEndpoint() };
+
+	// Prefixes of commands that do not depend on the model a server has loaded, compared without case
+	// and spaces. Only these are spread across equally suited servers, all other commands stay with
+	// one of them, see FNeuralEndpointRouter
+	UPROPERTY(config, EditAnywhere, Category = "Connection")
+	TArray<FString> StatelessCommands = {
+		TEXT("server info"),
+		TEXT("server status"),
+		TEXT("help"),
+		TEXT("echo"),
+	};
+
+	UPROPERTY(config, EditAnywhere, Category = "Connection")
+	ENeuralTransport Transport = ENeuralTransport::WebSocket;
+
+	// Must match LOCAL_SOCKET_PATH of the server. Empty uses NeuralVisUAL.sock in the temp directory,
+	// or NeuralVisUAL-<port>.sock for ports other than 80, which is the default of the server as well
+	UPROPERTY(config, EditAnywhere, Category = "Connection", meta = (EditCondition = "Transport == ENeuralTransport::LocalSocket"))
+	FString LocalSocketPath;
+
+	// Receives files and tensors through a memory mapped file instead of the connection if the server
+	// runs on the same machine, see FNeuralSharedMemory
+	UPROPERTY(config, EditAnywhere, Category = "Connection")
+	bool bUseSharedMemory = true;
+
+	// Must match SHARED_MEMORY_PATH of the server. Empty uses NeuralVisUAL.shm in the temp directory,
+	// or NeuralVisUAL-<port>.shm for ports other than 80, which is the default of the server as well
+	UPROPERTY(config, EditAnywhere, Category = "Connection", meta = (EditCondition = "bUseSharedMemory"))
+	FString SharedMemoryPath;
+
+	// Seconds without any message after which a connection is pinged, to measure the round trip time
+	// and to keep it alive. 0 disables pings, see FNeuralLinkTelemetry
+	UPROPERTY(config, EditAnywhere, Category = "Connection", meta = (ClampMin = "0.0"))
+	float KeepAliveInterval = 5.0f;
+
+	// Reconnects if the connection fails or drops before the response is complete, e.g. while the server
+	// restarts. Commands the server may already have received are only sent again if they are idempotent
+	UPROPERTY(config, EditAnywhere, Category = "Reconnect")
+	bool bReconnect = true;
+
+	UPROPERTY(config, EditAnywhere, Category = "Reconnect", meta = (EditCondition = "bReconnect", ClampMin = "0"))
+	int32 ReconnectAttempts = 5;
+
+	// Also retries if the server could not be reached for the first attempt. Off by default, as then
+	// the server is usually not running and every command would wait for all attempts.
+	// Commands executed on the game thread are never retried
+	UPROPERTY(config, EditAnywhere, Category = "Reconnect", meta = (EditCondition = "bReconnect"))
+	bool bRetryFailedConnect = false;
+
+	// Waiting time before the first reconnect in seconds, doubled with every further attempt
+	UPROPERTY(config, EditAnywhere, Category = "Reconnect", meta = (EditCondition = "bReconnect", ClampMin = "0.0"))
+	float ReconnectInitialDelay = 0.25f;
+
+	UPROPERTY(config, EditAnywhere, Category = "Reconnect", meta = (EditCondition = "bReconnect", ClampMin = "0.0"))
+	float ReconnectMaxDelay = 8.0f;
+
+	// Prefixes of commands that may safely be executed twice, compared without case and spaces.
+	// If the connection dropped in the middle of their response, the messages already received are
+	// skipped when the server sends the response again, so each message is delivered once
+	UPROPERTY(config, EditAnywhere, Category = "Reconnect", meta = (EditCondition = "bReconnect"))
+	TArray<FString> IdempotentCommands = {
+		TEXT("tf get"),
+		TEXT("server info"),
+		TEXT("server status"),
+		TEXT("help"),
+		TEXT("echo"),
+	};
+
+	// Prefixes of commands in the interactive and the bulk lane, compared without case and spaces.
+	// All other commands are normal
+	UPROPERTY(config, EditAnywhere, Category = "Scheduling")
+	TArray<FString> InteractiveCommands = {
+		TEXT("server draw next"),
+		TEXT("server info"),
+		TEXT("server status"),
+		TEXT("server stop"),
+		TEXT("echo"),
+	};
+
+	UPROPERTY(config, EditAnywhere, Category = "Scheduling")
+	TArray<FString> BulkCommands = {
+		TEXT("tf draw"),
+		TEXT("tf get activations"),
+		TEXT("tf get kernel"),
+		TEXT("get file"),
+	};
+
+	UPROPERTY(config, EditAnywhere, Category = "Scheduling", meta = (ClampMin = "1"))
+	int32 MaxConcurrentInteractiveCommands = 4;
+
+	UPROPERTY(config, EditAnywhere, Category = "Scheduling", meta = (ClampMin = "1"))
+	int32 MaxConcurrentNormalCommands = 4;
+
+	UPROPERTY(config, EditAnywhere, Category = "Scheduling", meta = (ClampMin = "1"))
+	int32 MaxConcurrentBulkCommands = 1;
+
+	// Lines of status and debug output kept for UNeuralConsoleView, the oldest are dropped first.
+	// 0 disables the console
+	UPROPERTY(config, EditAnywhere, Category = "Console", meta = (ClampMin = "0"))
+	int32 ConsoleCapacity = 10000;
+
+	// Filters status and debug messages before they are unpacked, see FNeuralMessageFilter
+	UPROPERTY(config, EditAnywhere, Category = "Message Filter")
+	bool bFilterMessages = true;
+
+	// Lower levels are more verbose. The echo of drawn objects (debugWhenDrawingObject) is -9
+	UPROPERTY(config, EditAnywhere, Category = "Message Filter", meta = (EditCondition = "bFilterMessages"))
+	int32 MinDebugLevel = -8;
+
+	// Seconds within which further progress statuses of the same level on a connection are dropped
+	UPROPERTY(config, EditAnywhere, Category = "Message Filter", meta = (EditCondition = "bFilterMessages", ClampMin = "0.0"))
+	float StatusCoalescingInterval = 0.25f;
+
+	// Over all connections, 0 is unlimited. Completions, warnings and failures are never limited
+	UPROPERTY(config, EditAnywhere, Category = "Message Filter", meta = (EditCondition = "bFilterMessages", ClampMin = "0.0"))
+	float MaxStatusMessagesPerSecond = 20.0f;
+
+	// Over all connections, 0 is unlimited. Warnings and errors (level 1 and above) are never limited
+	UPROPERTY(config, EditAnywhere, Category = "Message Filter", meta = (EditCondition = "bFilterMessages", ClampMin = "0.0"))
+	float MaxDebugMessagesPerSecond = 50.0f;
+
+	// Paths for the server listening on the given port
+	FString GetLocalSocketPath(int32 Port) const;
+	FString GetSharedMemoryPath(int32 Port) const;
+
+	// Chained commands are interactive if all of their parts are, and bulk if any part is
+	ENeuralCommandPriority GetCommandPriority(const FString& Command) const;
+
+	// Chained commands are idempotent if all of their parts are
+	bool IsIdempotentCommand(const FString& Command) const;
+	// Chained commands are stateless if all of their parts are
+	bool IsStatelessCommand(const FString& Command) const;
+	// Seconds to wait before the given reconnect attempt, starting at 0
+	float GetReconnectDelay(int32 Attempt) const;
+
+	// Commands are compared like the server matches them: lower case and without spaces
+	static FString NormalizeCommand(const FString& Command);
+
+private:
+	static bool MatchesAnyPrefix(const FString& Command, const TArray<FString>& Prefixes);
+
+	virtual FName GetCategoryName() const override;
+};
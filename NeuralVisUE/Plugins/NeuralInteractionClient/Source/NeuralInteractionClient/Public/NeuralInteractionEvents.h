@@ -0,0 +1,91 @@
+/*
+This file NeuralInteractionEvents.h is part of NeuralVisUAL.
+
+NeuralVisUAL is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+NeuralVisUAL is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with NeuralVisUAL.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "NeuralTensor.h"
+
+DECLARE_MULTICAST_DELEGATE_ThreeParams(FOnNeuralFileReceived,
+	const FString& /*OriginalCommand*/, const FString& /*Filename*/, const TArray<uint8>& /*Data*/);
+DECLARE_MULTICAST_DELEGATE_ThreeParams(FOnNeuralImageSpawned,
+	const FString& /*OriginalCommand*/, const FString& /*Path*/, const FTransform& /*Transform*/);
+DECLARE_MULTICAST_DELEGATE_TwoParams(FOnNeuralTensorReceived,
+	const FString& /*OriginalCommand*/, const FNeuralTensor& /*Tensor*/);
+
+// Values of a "SPAWN CUBOID pos size color opacity rot" instruction, see ANeuralSceneManager::ApplyCuboidInstruction.
+// Identity is empty for cuboids the server didn't attach an identity to
+struct FNeuralCuboidInstruction
+{
+	FString Identity;
+	TArray<float> Properties;
+};
+
+DECLARE_MULTICAST_DELEGATE_ThreeParams(FOnNeuralSceneRedraw,
+	const FString& /*OriginalCommand*/, bool /*bBegin*/, const TArray<FString>& /*Scopes*/);
+DECLARE_MULTICAST_DELEGATE_TwoParams(FOnNeuralCuboidsSpawned,
+	const FString& /*OriginalCommand*/, const TArray<FNeuralCuboidInstruction>& /*Cuboids*/);
+DECLARE_MULTICAST_DELEGATE_ThreeParams(FOnNeuralConnectionsSpawned,
+	const FString& /*OriginalCommand*/, const TArray<float>& /*Style*/, const TArray<int32>& /*Edges*/);
+
+/*
+*	Native hooks into the response stream for C++ consumers of responses which can't be passed
+*	through the Blueprint delegates without loss, like the binary data of ["FILE", filename, data].
+*	Listeners are called for the responses to every command, on the thread executing the command,
+*	and are expected to filter by the original command themselves. With several servers,
+*	FNeuralModelContexts::GetContextOfResponse tells which model the response belongs to.
+*	To only get the responses to a command of your own, pass FNeuralResponseCallbacks instead.
+*
+*	As long as scene listeners are registered, the client announces them in the handshake header
+*	NativeSceneHeader. Only then the server attaches identities to cuboids and sends
+*	["SCENE REDRAW", phase, scopes] and ["SPAWN CONNECTIONS", style, edges], so that Blueprints parsing the instructions themselves
+*	keep receiving ["SPAWN CUBOID pos size color opacity rot", values] unchanged.
+*/
+class NEURALINTERACTIONCLIENT_API FNeuralInteractionEvents
+{
+public:
+	static FDelegateHandle AddFileListener(FOnNeuralFileReceived::FDelegate&& Listener);
+	static FDelegateHandle AddImageSpawnListener(FOnNeuralImageSpawned::FDelegate&& Listener);
+	static FDelegateHandle AddTensorListener(FOnNeuralTensorReceived::FDelegate&& Listener);
+	static FDelegateHandle AddSceneRedrawListener(FOnNeuralSceneRedraw::FDelegate&& Listener);
+	static FDelegateHandle AddCuboidSpawnListener(FOnNeuralCuboidsSpawned::FDelegate&& Listener);
+	static FDelegateHandle AddConnectionSpawnListener(FOnNeuralConnectionsSpawned::FDelegate&& Listener);
+	static void RemoveListener(FDelegateHandle Handle);
+
+	// Copying binary data is skipped as long as nobody listens
+	static bool HasFileListeners();
+	static bool HasTensorListeners();
+	// Cuboids are only collected while parsing if somebody listens
+	static bool HasSceneListeners();
+
+	static void BroadcastFileReceived(const FString& OriginalCommand, const FString& Filename, const TArray<uint8>& Data);
+	// Values of a "SPAWN IMAGE path pos size rot" instruction: position (3), size (3), rotator (3)
+	static void BroadcastImageSpawned(const FString& OriginalCommand, const FString& Path, const TArray<float>& Values);
+	static void BroadcastTensorReceived(const FString& OriginalCommand, const FNeuralTensor& Tensor);
+	// Phase "begin" or "end" of a redraw of the scopes, e.g. "layer" or "kernel 5", see ANeuralSceneManager::BeginRedraw
+	static void BroadcastSceneRedraw(const FString& OriginalCommand, bool bBegin, const TArray<FString>& Scopes);
+	// All cuboids of a "SPAWN CUBOID BATCH" or a single "SPAWN CUBOID pos size color opacity rot"
+	static void BroadcastCuboidsSpawned(const FString& OriginalCommand, const TArray<FNeuralCuboidInstruction>& Cuboids);
+	// Values of a "SPAWN CONNECTIONS" message, see ANeuralSceneManager::ApplyConnectionInstruction
+	static void BroadcastConnectionsSpawned(const FString& OriginalCommand, const TArray<float>& Style, const TArray<int32>& Edges);
+
+	// Handshake header telling the server that scene listeners are registered, see HasSceneListeners
+	static const char* NativeSceneHeader;
+
+	// Transform of the values of a "SPAWN IMAGE path pos size rot" instruction, false if there are too few
+	static bool GetImageTransform(const TArray<float>& Values, FTransform& OutTransform);
+};
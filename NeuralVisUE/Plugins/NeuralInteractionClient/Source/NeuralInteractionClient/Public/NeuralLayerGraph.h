@@ -0,0 +1,157 @@
+/*
+This file NeuralLayerGraph.h is part of NeuralVisUAL.
+
+NeuralVisUAL is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+NeuralVisUAL is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with NeuralVisUAL.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Kismet/BlueprintFunctionLibrary.h"
+#include "NeuralLayerGraph.generated.h"
+
+/*
+*	Layer graph of the currently loaded network, built natively from the
+*	"TF STRUCTURE" response: ["TF STRUCTURE", [[name, type, shape, params, connectedTo, vars]*]]
+*
+*	All per-layer data is stored in contiguous arrays indexed by layer index,
+*	parent and child adjacency in CSR form (offsets + indices). Ancestor and
+*	descendant relations are precomputed as one bitset row per layer, so that
+*	each query is a single bit test.
+*
+*	A graph is immutable once built and shared between threads.
+*/
+class NEURALINTERACTIONCLIENT_API FNeuralLayerGraph
+{
+public:
+	int32 Num() const { return Names.Num(); }
+	bool IsValidLayer(int32 Layer) const { return Names.IsValidIndex(Layer); }
+
+	const FString& GetName(int32 Layer) const { return Names[Layer]; }
+	const FString& GetType(int32 Layer) const { return Types[Layer]; }
+	// First three positive dimensions of the output shape, missing ones are 1
+	const FIntVector& GetDimensions(int32 Layer) const { return Dimensions[Layer]; }
+	int64 GetParameterCount(int32 Layer) const { return ParameterCounts[Layer]; }
+
+	TArrayView<const int32> GetParents(int32 Layer) const
+	{
+		return TArrayView<const int32>(ParentIndices.GetData() + ParentOffsets[Layer], ParentOffsets[Layer + 1] - ParentOffsets[Layer]);
+	}
+	TArrayView<const int32> GetChildren(int32 Layer) const
+	{
+		return TArrayView<const int32>(ChildIndices.GetData() + ChildOffsets[Layer], ChildOffsets[Layer + 1] - ChildOffsets[Layer]);
+	}
+
+	bool IsAncestorOf(int32 Ancestor, int32 Descendant) const
+	{
+		return TestBit(AncestorBits, Descendant, Ancestor);
+	}
+	bool IsDescendantOf(int32 Descendant, int32 Ancestor) const
+	{
+		return IsAncestorOf(Ancestor, Descendant);
+	}
+
+	void GetAncestors(int32 Layer, TArray<int32>& OutLayers) const { CollectBits(AncestorBits, Layer, OutLayers); }
+	void GetDescendants(int32 Layer, TArray<int32>& OutLayers) const { CollectBits(DescendantBits, Layer, OutLayers); }
+
+	// Returns INDEX_NONE for unknown names
+	int32 FindLayer(const FString& Name) const;
+
+	// Flat list of parent and child layer index pairs, as used by ANeuralSceneManager::BuildConnections
+	void GetEdges(TArray<int32>& OutEdges) const;
+	int32 GetNumberOfEdges() const { return ParentIndices.Num(); }
+
+	// Graph of the most recently received "TF STRUCTURE" response, may be null
+	static TSharedPtr<const FNeuralLayerGraph, ESPMode::ThreadSafe> GetCurrent();
+	static void SetCurrent(TSharedPtr<const FNeuralLayerGraph, ESPMode::ThreadSafe> Graph);
+
+private:
+	friend class FNeuralLayerGraphBuilder;
+
+	bool TestBit(const TArray<uint64>& Bits, int32 Row, int32 Column) const
+	{
+		if (!IsValidLayer(Row) || !IsValidLayer(Column)) {
+			return false;
+		}
+		return (Bits[Row * WordsPerRow + (Column >> 6)] >> (Column & 63)) & 1;
+	}
+	void CollectBits(const TArray<uint64>& Bits, int32 Row, TArray<int32>& OutLayers) const;
+
+	TArray<FString> Names;
+	TArray<FString> Types;
+	TArray<FIntVector> Dimensions;
+	TArray<int64> ParameterCounts;
+
+	// CSR adjacency: the parents of layer i are ParentIndices[ParentOffsets[i] .. ParentOffsets[i + 1]]
+	TArray<int32> ParentOffsets;
+	TArray<int32> ParentIndices;
+	TArray<int32> ChildOffsets;
+	TArray<int32> ChildIndices;
+
+	// One row of WordsPerRow words per layer, bit j of row i is set if j is an ancestor/descendant of i
+	int32 WordsPerRow = 0;
+	TArray<uint64> AncestorBits;
+	TArray<uint64> DescendantBits;
+
+	TMap<FString, int32> IndexOfName;
+};
+
+// Blueprint access to the layer graph of the most recently received "TF STRUCTURE" response.
+// All functions return empty results as long as no structure has been received.
+UCLASS()
+class NEURALINTERACTIONCLIENT_API UNeuralLayerGraphBPLibrary : public UBlueprintFunctionLibrary
+{
+	GENERATED_BODY()
+
+public:
+	UFUNCTION(BlueprintPure, Category = "Neural Interaction Client|Layer Graph")
+	static bool HasLayerGraph();
+
+	UFUNCTION(BlueprintPure, Category = "Neural Interaction Client|Layer Graph")
+	static int32 GetLayerCount();
+
+	UFUNCTION(BlueprintPure, Category = "Neural Interaction Client|Layer Graph")
+	static FString GetLayerName(int32 Layer);
+
+	UFUNCTION(BlueprintPure, Category = "Neural Interaction Client|Layer Graph")
+	static FString GetLayerType(int32 Layer);
+
+	UFUNCTION(BlueprintPure, Category = "Neural Interaction Client|Layer Graph")
+	static FIntVector GetLayerDimensions(int32 Layer);
+
+	UFUNCTION(BlueprintPure, Category = "Neural Interaction Client|Layer Graph")
+	static int64 GetLayerParameterCount(int32 Layer);
+
+	UFUNCTION(BlueprintPure, Category = "Neural Interaction Client|Layer Graph")
+	static int32 FindLayerByName(const FString& Name);
+
+	UFUNCTION(BlueprintPure, Category = "Neural Interaction Client|Layer Graph")
+	static TArray<int32> GetLayerParents(int32 Layer);
+
+	UFUNCTION(BlueprintPure, Category = "Neural Interaction Client|Layer Graph")
+	static TArray<int32> GetLayerChildren(int32 Layer);
+
+	UFUNCTION(BlueprintPure, Category = "Neural Interaction Client|Layer Graph")
+	static bool IsLayerAncestorOf(int32 Ancestor, int32 Descendant);
+
+	UFUNCTION(BlueprintPure, Category = "Neural Interaction Client|Layer Graph")
+	static TArray<int32> GetLayerAncestors(int32 Layer);
+
+	UFUNCTION(BlueprintPure, Category = "Neural Interaction Client|Layer Graph")
+	static TArray<int32> GetLayerDescendants(int32 Layer);
+
+	// Flat list of parent and child layer index pairs
+	UFUNCTION(BlueprintPure, Category = "Neural Interaction Client|Layer Graph")
+	static TArray<int32> GetLayerEdges();
+};
@@ -0,0 +1,86 @@
+/*
+This file NeuralLayoutCache.h is part of NeuralVisUAL.
+
+NeuralVisUAL is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+NeuralVisUAL is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with NeuralVisUAL.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "NeuralLayoutCache.generated.h"
+
+// One drawn layer cuboid as stored in a layout snapshot
+USTRUCT(BlueprintType)
+struct NEURALINTERACTIONCLIENT_API FNeuralCachedLayerBox
+{
+	GENERATED_BODY()
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Neural Interaction Client")
+	int32 Layer = -1;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Neural Interaction Client")
+	FTransform Transform;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Neural Interaction Client")
+	FLinearColor Color = FLinearColor::White;
+
+	friend FArchive& operator<<(FArchive& Ar, FNeuralCachedLayerBox& Box)
+	{
+		return Ar << Box.Layer << Box.Transform << Box.Color;
+	}
+};
+
+// Everything needed to redraw a network structure without the server
+struct NEURALINTERACTIONCLIENT_API FNeuralLayoutSnapshot
+{
+	TArray<FNeuralCachedLayerBox> Layers;
+	// Flat parent/child pairs and style as used by ANeuralSceneManager::BuildConnections
+	TArray<int32> ConnectionEdges;
+	float ConnectionStrength = 0.f;
+	FLinearColor ConnectionColor = FLinearColor::White;
+
+	friend FArchive& operator<<(FArchive& Ar, FNeuralLayoutSnapshot& Snapshot)
+	{
+		return Ar << Snapshot.Layers << Snapshot.ConnectionEdges << Snapshot.ConnectionStrength << Snapshot.ConnectionColor;
+	}
+};
+
+/*
+*	Client side part of the layout cache. The server identifies each layout by a key
+*	(hash of the layer DAG plus the layouting settings) and sends it with "TF LAYOUT".
+*	The raw layout positions as well as the drawn scene are persisted per key in
+*	Saved/NeuralVisUAL/LayoutCache, so a previously seen architecture can be shown
+*	instantly, even before the server has answered.
+*
+*	All functions are thread-safe.
+*/
+class NEURALINTERACTIONCLIENT_API FNeuralLayoutCache
+{
+public:
+	static FString GetCacheDirectory();
+
+	static bool StorePositions(const FString& Key, const TArray<FVector2D>& Positions);
+	static bool LoadPositions(const FString& Key, TArray<FVector2D>& OutPositions);
+
+	static bool StoreSnapshot(const FString& Key, const FNeuralLayoutSnapshot& Snapshot);
+	static bool LoadSnapshot(const FString& Key, FNeuralLayoutSnapshot& OutSnapshot);
+
+	// Key of the most recently received layout, persisted across sessions
+	static FString GetLastLayoutKey();
+	static void SetLastLayoutKey(const FString& Key);
+
+private:
+	static FString GetFilename(const FString& Key, const TCHAR* Extension);
+	static bool IsValidKey(const FString& Key);
+};
@@ -0,0 +1,132 @@
+/*
+This file NeuralLinkTelemetry.h is part of NeuralVisUAL.
+
+NeuralVisUAL is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+NeuralVisUAL is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with NeuralVisUAL.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Kismet/BlueprintFunctionLibrary.h"
+#include "NeuralInteractionClientSettings.h"
+#include "NeuralLinkTelemetry.generated.h"
+
+USTRUCT(BlueprintType)
+struct NEURALINTERACTIONCLIENT_API FNeuralLinkStatistics
+{
+	GENERATED_BODY()
+
+	// Smoothed round trip time, 0 before the first measurement
+	UPROPERTY(BlueprintReadOnly, Category = "Neural Interaction Client|Telemetry")
+	float RoundTripMs = 0.f;
+
+	UPROPERTY(BlueprintReadOnly, Category = "Neural Interaction Client|Telemetry")
+	float RoundTripVariationMs = 0.f;
+
+	// Lowest round trip time of the last minute, the link without any queueing
+	UPROPERTY(BlueprintReadOnly, Category = "Neural Interaction Client|Telemetry")
+	float MinRoundTripMs = 0.f;
+
+	// Averaged over the last four seconds, over all connections
+	UPROPERTY(BlueprintReadOnly, Category = "Neural Interaction Client|Telemetry")
+	float ReceivedBytesPerSecond = 0.f;
+
+	UPROPERTY(BlueprintReadOnly, Category = "Neural Interaction Client|Telemetry")
+	float SentBytesPerSecond = 0.f;
+
+	UPROPERTY(BlueprintReadOnly, Category = "Neural Interaction Client|Telemetry")
+	int64 TotalBytesReceived = 0;
+
+	UPROPERTY(BlueprintReadOnly, Category = "Neural Interaction Client|Telemetry")
+	int64 TotalBytesSent = 0;
+
+	// Commands of FNeuralCommandScheduler per lane, indexed by ENeuralCommandPriority
+	UPROPERTY(BlueprintReadOnly, Category = "Neural Interaction Client|Telemetry")
+	TArray<int32> QueuedCommands;
+
+	UPROPERTY(BlueprintReadOnly, Category = "Neural Interaction Client|Telemetry")
+	TArray<int32> RunningCommands;
+};
+
+/*
+*	Health of the link to the server, fed by all connections: round trip times of TCP connects and of
+*	pings on connections that have been idle for KeepAliveInterval, and the bytes read and written.
+*	Also shown in the engine stats with "stat NeuralInteractionClient".
+*
+*	FNeuralCommandScheduler sizes its bulk window with it, and the server sizes the fragments of bulk
+*	responses by the bandwidth-delay product. All functions are thread-safe.
+*/
+class NEURALINTERACTIONCLIENT_API FNeuralLinkTelemetry
+{
+public:
+	static FNeuralLinkTelemetry& Get();
+
+	void AddRoundTripSample(double Seconds);
+	void AddBytesReceived(int64 Bytes);
+	void AddBytesSent(int64 Bytes);
+	void SetQueueDepth(ENeuralCommandPriority Priority, int32 Queued, int32 Running);
+
+	FNeuralLinkStatistics GetStatistics() const;
+
+	// Bulk commands that may run at once. Shrinks to 1 while the round trip time is well above its
+	// minimum, as the running transfers already fill up the buffers along the link then
+	int32 GetBulkWindow(int32 MaxWindow) const;
+	// Bytes the link transfers within one round trip, clamped to a sensible fragment size.
+	// 0 as long as nothing has been measured
+	int32 GetFragmentSize() const;
+
+	void Reset();
+
+private:
+	FNeuralLinkTelemetry() = default;
+
+	// Bytes per quarter of a second over the last four seconds
+	static constexpr int32 NumberOfBuckets = 16;
+	static constexpr double BucketSeconds = 0.25;
+
+	struct FRate
+	{
+		int64 Bytes[NumberOfBuckets] = {};
+		int64 BucketIndex[NumberOfBuckets] = {};
+		int64 Total = 0;
+
+		void Add(int64 InBytes, double Now);
+		double GetPerSecond(double Now) const;
+	};
+
+	void UpdateStats() const;
+
+	mutable FCriticalSection Lock;
+	double SmoothedRoundTrip = 0.0;
+	double RoundTripVariation = 0.0;
+	double MinRoundTrip = 0.0;
+	double MinRoundTripTime = 0.0;
+	FRate Received;
+	FRate Sent;
+	int32 Queued[3] = {};
+	int32 Running[3] = {};
+};
+
+UCLASS()
+class NEURALINTERACTIONCLIENT_API UNeuralLinkTelemetryBPLibrary : public UBlueprintFunctionLibrary
+{
+	GENERATED_BODY()
+
+public:
+	UFUNCTION(BlueprintPure, Category = "Neural Interaction Client|Telemetry")
+	static FNeuralLinkStatistics GetLinkStatistics();
+
+	UFUNCTION(BlueprintCallable, Category = "Neural Interaction Client|Telemetry")
+	static void ResetLinkStatistics();
+};
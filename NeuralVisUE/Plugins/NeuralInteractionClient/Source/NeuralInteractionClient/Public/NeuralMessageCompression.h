@@ -0,0 +1,100 @@
+/*
+This file NeuralMessageCompression.h is part of NeuralVisUAL.
+
+NeuralVisUAL is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+NeuralVisUAL is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with NeuralVisUAL.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Kismet/BlueprintFunctionLibrary.h"
+#include "NeuralMessageCompression.generated.h"
+
+/*
+*	Decompression of messages the server compressed, see messageCompression.py on the server.
+*
+*	The client lists the codecs it accepts in the handshake header CodecsHeader of every connection.
+*	The server compresses messages above its threshold with the first of its codecs the client
+*	accepts and wraps them in an envelope: 0xC1, codec id, uint32 uncompressed size, compressed data.
+*	0xC1 is never used by msgpack, so plain messages are passed through unchanged.
+*
+*	Zstandard is not part of the engine, so only lz4 and zlib are accepted.
+*	Thread-safe. Messages are decompressed into pooled buffers, so that receiving them does not
+*	allocate once the buffers have grown to the message size.
+*/
+class NEURALINTERACTIONCLIENT_API FNeuralMessageCompression
+{
+public:
+	static constexpr uint8 EnvelopeMarker = 0xC1;
+	static constexpr int32 EnvelopeHeaderSize = 6;
+	static const char* CodecsHeader;
+
+	static FNeuralMessageCompression& Get();
+
+	static bool IsEnvelope(const uint8* Data, int64 Size);
+
+	// Value of CodecsHeader, e.g. "lz4, zlib". Empty if compression is disabled
+	FString GetAcceptedCodecs() const;
+	// Codecs by preference, unknown ones are ignored. An empty list disables compression
+	void SetAcceptedCodecs(const TArray<FString>& Codecs);
+
+	// Decompresses an envelope into OutBuffer, ideally one from AcquireBuffer.
+	// Returns false if the envelope is corrupt or uses an unsupported codec
+	bool Decompress(const uint8* Data, int64 Size, TArray<uint8>& OutBuffer);
+	// Sessions may be nested while parsing, so every message takes a buffer of its own
+	TArray<uint8> AcquireBuffer();
+	void ReleaseBuffer(TArray<uint8>&& Buffer);
+
+	// Statistics per message type, the first string of the message
+	void RecordMessage(const FString& MessageType, int64 ReceivedBytes, int64 Bytes, double DecompressionSeconds);
+	FString GetStatistics() const;
+	void ResetStatistics();
+
+private:
+	FNeuralMessageCompression();
+
+	struct FMessageStatistics
+	{
+		int64 Messages = 0;
+		int64 CompressedMessages = 0;
+		int64 ReceivedBytes = 0;
+		int64 Bytes = 0;
+		double DecompressionSeconds = 0;
+	};
+
+	mutable FCriticalSection Lock;
+	TArray<FString> AcceptedCodecs;
+	TMap<FString, FMessageStatistics> Statistics;
+	static constexpr int32 MaxPooledBuffers = 4;
+	TArray<TArray<uint8>> BufferPool;
+};
+
+UCLASS()
+class NEURALINTERACTIONCLIENT_API UNeuralMessageCompressionBPLibrary : public UBlueprintFunctionLibrary
+{
+	GENERATED_BODY()
+
+public:
+	// Codecs offered to the server for new connections by preference, "lz4" and "zlib" are supported.
+	// An empty list disables compression
+	UFUNCTION(BlueprintCallable, Category = "Neural Interaction Client|Compression")
+	static void SetAcceptedCompressionCodecs(const TArray<FString>& Codecs);
+
+	// Received and decompressed bytes and the decompression time per message type, one line each
+	UFUNCTION(BlueprintPure, Category = "Neural Interaction Client|Compression")
+	static FString GetCompressionStatistics();
+
+	UFUNCTION(BlueprintCallable, Category = "Neural Interaction Client|Compression")
+	static void ResetCompressionStatistics();
+};
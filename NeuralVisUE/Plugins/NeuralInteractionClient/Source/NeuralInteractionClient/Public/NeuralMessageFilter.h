@@ -0,0 +1,112 @@
+/*
+This file NeuralMessageFilter.h is part of NeuralVisUAL.
+
+NeuralVisUAL is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+NeuralVisUAL is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with NeuralVisUAL.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Kismet/BlueprintFunctionLibrary.h"
+#include "NeuralConsole.h"
+#include "NeuralMessageFilter.generated.h"
+
+USTRUCT(BlueprintType)
+struct NEURALINTERACTIONCLIENT_API FNeuralMessageFilterStatistics
+{
+	GENERATED_BODY()
+
+	UPROPERTY(BlueprintReadOnly, Category = "Neural Interaction Client|Message Filter")
+	int64 PassedMessages = 0;
+
+	// Debug messages below MinDebugLevel
+	UPROPERTY(BlueprintReadOnly, Category = "Neural Interaction Client|Message Filter")
+	int64 DroppedBelowLevel = 0;
+
+	// Progress statuses that repeated the previous one
+	UPROPERTY(BlueprintReadOnly, Category = "Neural Interaction Client|Message Filter")
+	int64 CoalescedStatuses = 0;
+
+	UPROPERTY(BlueprintReadOnly, Category = "Neural Interaction Client|Message Filter")
+	int64 DroppedOverRate = 0;
+};
+
+/*
+*	Filters ["STATUS", level, text] and ["DEBUG", level, text] by looking at the packed bytes of a
+*	message, before the message is unpacked, converted or passed to any delegate:
+*
+*	-	Debug messages below MinDebugLevel are dropped, e.g. the echo of every drawn object (level -9).
+*	-	Progress statuses (idle and processing, levels -29 to -1) of a connection are coalesced: repeats
+*		of the previous one are dropped, as are new ones within StatusCoalescingInterval of it.
+*	-	Progress statuses and debug messages below level 1 are capped at MaxStatusMessagesPerSecond and
+*		MaxDebugMessagesPerSecond over all connections.
+*
+*	Completions (-30), warnings and failures always pass. Settings are in UNeuralInteractionClientSettings.
+*	All functions are thread-safe.
+*/
+class NEURALINTERACTIONCLIENT_API FNeuralMessageFilter
+{
+public:
+	static FNeuralMessageFilter& Get();
+
+	// What the filter remembers about the statuses of one connection
+	struct FConnectionState
+	{
+		bool bHasStatus = false;
+		int64 LastStatusLevel = 0;
+		uint32 LastStatusHash = 0;
+		double LastStatusTime = 0.0;
+	};
+
+	// False if the message is to be dropped
+	bool Accept(const uint8* Data, int64 Size, FConnectionState& Connection);
+
+	// Reads ["STATUS", level, text] or ["DEBUG", level, text] from a packed message, without copying.
+	// False for all other messages
+	static bool Peek(const uint8* Data, int64 Size, ENeuralConsoleLineKind& OutKind, int64& OutLevel,
+		const uint8*& OutText, int64& OutTextSize);
+
+	FNeuralMessageFilterStatistics GetStatistics() const;
+	void ResetStatistics();
+
+private:
+	FNeuralMessageFilter() = default;
+
+	// Token bucket, refilled with Rate tokens per second up to one second worth of them
+	struct FRateLimit
+	{
+		double Tokens = 0.0;
+		double LastRefill = 0.0;
+
+		bool TryTake(double Rate, double Now);
+	};
+
+	mutable FCriticalSection Lock;
+	FRateLimit StatusRate;
+	FRateLimit DebugRate;
+	FNeuralMessageFilterStatistics Statistics;
+};
+
+UCLASS()
+class NEURALINTERACTIONCLIENT_API UNeuralMessageFilterBPLibrary : public UBlueprintFunctionLibrary
+{
+	GENERATED_BODY()
+
+public:
+	UFUNCTION(BlueprintPure, Category = "Neural Interaction Client|Message Filter")
+	static FNeuralMessageFilterStatistics GetMessageFilterStatistics();
+
+	UFUNCTION(BlueprintCallable, Category = "Neural Interaction Client|Message Filter")
+	static void ResetMessageFilterStatistics();
+};
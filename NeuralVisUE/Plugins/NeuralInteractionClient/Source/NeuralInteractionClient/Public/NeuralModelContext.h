@@ -0,0 +1,135 @@
+/*
+This file NeuralModelContext.h is part of NeuralVisUAL.
+
+NeuralVisUAL is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+NeuralVisUAL is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with NeuralVisUAL.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Kismet/BlueprintFunctionLibrary.h"
+#include "INeuralInteractionClientBPLibrary.h"
+#include "NeuralCommandRegistry.h"
+#include "NeuralLayerGraph.h"
+#include "NeuralTensor.h"
+#include "NeuralModelContext.generated.h"
+
+/*
+*	Everything the client knows about the model of one server: its layer graph, the key of its
+*	layout and its tensor streams. A server process holds one model, so there is one context per
+*	server endpoint, named like the endpoint, see FNeuralServerEndpoint.
+*
+*	To compare two networks side by side, run a server per network, send commands to a context
+*	with "@Name command" (or MakeCommand) and give each ANeuralSceneManager the name of its context.
+*	Responses then update only the context of the server they came from. All functions are thread-safe.
+*/
+class NEURALINTERACTIONCLIENT_API FNeuralModelContext
+{
+public:
+	explicit FNeuralModelContext(const FString& InName) : Name(InName) {}
+
+	const FString& GetName() const { return Name; }
+	// Command routed to the server of this context
+	FString MakeCommand(const FString& Command) const { return TEXT("@") + Name + TEXT(" ") + Command; }
+
+	// Graph of the most recent "TF STRUCTURE" response of the server, may be null
+	TSharedPtr<const FNeuralLayerGraph, ESPMode::ThreadSafe> GetLayerGraph() const;
+	void SetLayerGraph(TSharedPtr<const FNeuralLayerGraph, ESPMode::ThreadSafe> Graph);
+
+	// Key of the most recent "TF LAYOUT" response of the server, see FNeuralLayoutCache
+	FString GetLayoutKey() const;
+	void SetLayoutKey(const FString& Key);
+
+	FNeuralTensorStreams& GetTensorStreams() { return TensorStreams; }
+
+	// Forgets the model, e.g. before the server loads another one
+	void Reset();
+
+private:
+	const FString Name;
+	mutable FCriticalSection Lock;
+	TSharedPtr<const FNeuralLayerGraph, ESPMode::ThreadSafe> LayerGraph;
+	FString LayoutKey;
+	FNeuralTensorStreams TensorStreams;
+};
+
+// All model contexts. Contexts are never destroyed, so references to them stay valid
+class NEURALINTERACTIONCLIENT_API FNeuralModelContexts
+{
+public:
+	static FNeuralModelContexts& Get();
+
+	// Created on first use, names are compared without case
+	FNeuralModelContext& FindOrAdd(const FString& Name);
+	FNeuralModelContext* Find(const FString& Name) const;
+	// Context of the endpoint with this host and port. Servers which are not configured as endpoints
+	// get a context named "host:port"
+	FNeuralModelContext& FindOrAddForServer(const FString& Host, int32 Port);
+	// Context of the first endpoint, where commands without a matching prefix go
+	FNeuralModelContext& GetDefault();
+	TArray<FString> GetNames() const;
+
+	// Context whose response is parsed on this thread, for listeners of FNeuralInteractionEvents.
+	// Null outside of responses
+	static FNeuralModelContext* GetContextOfResponse();
+
+	// Sets the context of the response for the lifetime of the scope
+	class NEURALINTERACTIONCLIENT_API FResponseScope
+	{
+	public:
+		explicit FResponseScope(FNeuralModelContext* Context);
+		~FResponseScope();
+
+	private:
+		FNeuralModelContext* Previous;
+	};
+
+private:
+	FNeuralModelContexts() = default;
+
+	mutable FCriticalSection Lock;
+	TMap<FString, TUniquePtr<FNeuralModelContext>> Contexts;
+};
+
+UCLASS()
+class NEURALINTERACTIONCLIENT_API UNeuralModelContextBPLibrary : public UBlueprintFunctionLibrary
+{
+	GENERATED_BODY()
+
+public:
+	UFUNCTION(BlueprintPure, Category = "Neural Interaction Client|Model Contexts")
+	static TArray<FString> GetModelContexts();
+
+	// Schedules the command for the server of the context, see FNeuralCommandScheduler.
+	// OnString and OnFinished are called on the game thread
+	UFUNCTION(BlueprintCallable, Category = "Neural Interaction Client|Model Contexts", meta = (AutoCreateRefTerm = "OnString"))
+	static FNeuralCommandHandle ExecuteCommandInModelContext(const FString& Context, const FString& Command,
+		const FFoundAtomString& OnString, const FEndOfConnection& OnFinished);
+
+	UFUNCTION(BlueprintPure, Category = "Neural Interaction Client|Model Contexts")
+	static bool HasModelContextLayerGraph(const FString& Context);
+
+	UFUNCTION(BlueprintPure, Category = "Neural Interaction Client|Model Contexts")
+	static int32 GetModelContextLayerCount(const FString& Context);
+
+	// Flat list of parent and child layer index pairs
+	UFUNCTION(BlueprintPure, Category = "Neural Interaction Client|Model Contexts")
+	static TArray<int32> GetModelContextLayerEdges(const FString& Context);
+
+	UFUNCTION(BlueprintPure, Category = "Neural Interaction Client|Model Contexts")
+	static FString GetModelContextLayoutKey(const FString& Context);
+
+	UFUNCTION(BlueprintCallable, Category = "Neural Interaction Client|Model Contexts")
+	static void ResetModelContext(const FString& Context);
+};
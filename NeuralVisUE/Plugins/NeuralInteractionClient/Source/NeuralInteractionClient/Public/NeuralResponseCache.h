@@ -0,0 +1,148 @@
+/*
+This file NeuralResponseCache.h is part of NeuralVisUAL.
+
+NeuralVisUAL is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+NeuralVisUAL is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with NeuralVisUAL.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Kismet/BlueprintFunctionLibrary.h"
+#include "NeuralResponseCache.generated.h"
+
+/*
+*	Caches the raw msgpack messages the server answered to idempotent commands like
+*	"tf get structure" or "tf get version". A cached response is replayed through the same
+*	delegates as a live one, without opening a connection.
+*
+*	Entries are keyed by the server, the command and the model epoch. The server sends
+*	["MODEL EPOCH", epoch] after each command and changes the epoch whenever a network
+*	is loaded or the stored structure is reset. Receiving another epoch from a server drops
+*	its entries, as does sending one of the invalidating commands from this client.
+*
+*	A hit never contacts the server, so another client loading a network or a restart of the
+*	server would go unnoticed. Entries are therefore only replayed while the epoch of their
+*	server has been received by this process within the last EpochValiditySeconds. Entries
+*	loaded from disk wait for the first live epoch as well.
+*
+*	All functions are thread-safe.
+*/
+class NEURALINTERACTIONCLIENT_API FNeuralResponseCache
+{
+public:
+	static FNeuralResponseCache& Get();
+
+	// Whether responses to this command may be cached
+	bool IsCacheable(const FString& Command) const;
+
+	// Drops all entries if this command changes the model on the server
+	void NotifyCommandSent(const FString& Command);
+
+	// Called for every "MODEL EPOCH" message received from the server, never for replayed ones
+	void ObserveEpoch(const FString& Server, const FString& Epoch);
+	// Most recently received epoch of any server, empty before the first one
+	FString GetCurrentEpoch() const;
+
+	// Server is "host:port", servers may have loaded different models, see FNeuralEndpointRouter
+	bool Find(const FString& Server, const FString& Command, TArray<TArray<uint8>>& OutMessages) const;
+	void Store(const FString& Server, const FString& Command, const FString& Epoch, TArray<TArray<uint8>>&& Messages);
+	void Clear();
+
+	void SetEnabled(bool bInEnabled);
+	bool IsEnabled() const;
+
+	// Seconds after receiving the epoch of a server during which its entries are replayed
+	void SetEpochValidity(double Seconds);
+	double GetEpochValidity() const;
+
+	// Keeps the cache in Saved/NeuralVisUAL/ResponseCache.bin, so that it survives restarts of the
+	// client as long as the server keeps running with the same model. Changes are written on the
+	// thread pool, several changes in a row are written at once
+	void SetPersistent(bool bInPersistent);
+	bool IsPersistent() const;
+
+	int32 Num() const;
+
+private:
+	FNeuralResponseCache();
+
+	// Commands are compared like the server matches them: lower case and without spaces
+	static FString NormalizeCommand(const FString& Command);
+	static FString GetKey(const FString& Server, const FString& Command);
+	static FString GetFilename();
+
+	void LoadFromDisk();
+	// Schedules SaveToDisk, must be called with Lock held
+	void MarkDirty();
+	void SaveToDisk();
+
+	using FMessages = TSharedPtr<const TArray<TArray<uint8>>, ESPMode::ThreadSafe>;
+
+	struct FEntry
+	{
+		FString Server;
+		FString Epoch;
+		// Shared with pending saves, which serialize it outside of Lock
+		FMessages Messages;
+	};
+
+	struct FLiveEpoch
+	{
+		FString Epoch;
+		double ReceivedAt = 0.0;
+	};
+
+	// Epoch of the server, if it has been received recently enough to trust its entries
+	const FString* FindLiveEpoch(const FString& Server) const;
+
+	mutable FCriticalSection Lock;
+	// Held while writing the file, so that an older snapshot never overwrites a newer one
+	FCriticalSection SaveLock;
+	bool bSaveScheduled = false;
+	TMap<FString, FEntry> Entries;
+	// Keyed by server, only filled by messages received in this process
+	TMap<FString, FLiveEpoch> LiveEpochs;
+	FString CurrentEpoch;
+	double EpochValiditySeconds = 5.0;
+	TArray<FString> CacheablePrefixes;
+	TArray<FString> InvalidatingPrefixes;
+	bool bEnabled = true;
+	bool bPersistent = false;
+};
+
+UCLASS()
+class NEURALINTERACTIONCLIENT_API UNeuralResponseCacheBPLibrary : public UBlueprintFunctionLibrary
+{
+	GENERATED_BODY()
+
+public:
+	UFUNCTION(BlueprintCallable, Category = "Neural Interaction Client|Response Cache")
+	static void SetResponseCacheEnabled(bool bEnabled);
+
+	UFUNCTION(BlueprintCallable, Category = "Neural Interaction Client|Response Cache")
+	static void SetResponseCachePersistent(bool bPersistent);
+
+	UFUNCTION(BlueprintCallable, Category = "Neural Interaction Client|Response Cache")
+	static void ClearResponseCache();
+
+	UFUNCTION(BlueprintCallable, Category = "Neural Interaction Client|Response Cache")
+	static void SetResponseCacheEpochValidity(float Seconds);
+
+	UFUNCTION(BlueprintPure, Category = "Neural Interaction Client|Response Cache")
+	static bool IsResponseCached(const FString& Command);
+
+	// Model epoch of the most recently received "MODEL EPOCH" message, empty before the first one
+	UFUNCTION(BlueprintPure, Category = "Neural Interaction Client|Response Cache")
+	static FString GetModelEpoch();
+};
@@ -0,0 +1,108 @@
+/*
+This file NeuralResponseCallbacks.h is part of NeuralVisUAL.
+
+NeuralVisUAL is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+NeuralVisUAL is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with NeuralVisUAL.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "INeuralInteractionClientBPLibrary.h"
+#include "NeuralLayerGraph.h"
+#include "NeuralTensor.h"
+
+/*
+*	Native callbacks for the response to one command, see INeuralInteractionClient::ExecuteCommand.
+*	They are called on the thread executing the command, without going through UFunction reflection,
+*	and unset callbacks cost nothing, not even the conversion of their arguments.
+*
+*	The element callbacks report every element of every message as the parser visits it, like the
+*	Blueprint delegates do, which are adapted to them with FromDelegates. Strings and bytes passed as
+*	views are only valid during the call. The typed callbacks get whole messages of known types,
+*	decoded as the rest of the client uses them.
+*/
+struct NEURALINTERACTIONCLIENT_API FNeuralResponseCallbacks
+{
+	// Element callbacks, with the original command, the first string of the message and the position
+	// of the element in it like "1.0.2"
+
+	TFunction<void(const FString& OriginalCommand, bool bForciblyClosed)> OnEndOfConnection;
+	TFunction<void(const FString& OriginalCommand, const FString& FirstString, bool bEnd)> OnStartOrEndOfResponse;
+	TFunction<void(const FString& OriginalCommand, const FString& FirstString, const FString& ArrayPosition,
+		bool bDueToInsufficientBytes)> OnParseError;
+	TFunction<void(const FString& OriginalCommand, const FString& FirstString, const FString& ArrayPosition,
+		bool bEnd)> OnStartOrEndOfMap;
+	TFunction<void(const FString& OriginalCommand, const FString& FirstString, const FString& ArrayPosition,
+		bool bEnd)> OnStartOrEndOfArray;
+	TFunction<void(const FString& OriginalCommand, const FString& FirstString, const FString& ArrayPosition)> OnNil;
+	// UTF-8
+	TFunction<void(const FString& OriginalCommand, const FString& FirstString, const FString& ArrayPosition,
+		TArrayView<const uint8> Value)> OnString;
+	TFunction<void(const FString& OriginalCommand, const FString& FirstString, const FString& ArrayPosition,
+		TArrayView<const uint8> Value)> OnBinary;
+	// Starts with the extension type
+	TFunction<void(const FString& OriginalCommand, const FString& FirstString, const FString& ArrayPosition,
+		TArrayView<const uint8> Value)> OnExtension;
+	TFunction<void(const FString& OriginalCommand, const FString& FirstString, const FString& ArrayPosition,
+		bool Value)> OnBoolean;
+	TFunction<void(const FString& OriginalCommand, const FString& FirstString, const FString& ArrayPosition,
+		int64 Value)> OnInteger;
+	TFunction<void(const FString& OriginalCommand, const FString& FirstString, const FString& ArrayPosition,
+		double Value)> OnFloat;
+	// Longer arrays of numbers of one type, with the position of the array, instead of the callbacks
+	// of the array and its elements. Only used while OnStartOrEndOfArray, OnInteger and OnFloat are
+	// unset, and for responses without native handling of their numbers. Integers are exact up to 2^24
+	TFunction<void(const FString& OriginalCommand, const FString& FirstString, const FString& ArrayPosition,
+		TArrayView<const float> Values)> OnFloatArray;
+
+	// Typed callbacks
+
+	// ["STATUS", level, text] and ["DEBUG", level, text], unless FNeuralMessageFilter drops them
+	TFunction<void(int32 Level, const FString& Text)> OnStatus;
+	TFunction<void(int32 Level, const FString& Text)> OnDebug;
+	// ["FILE", filename, data], and ["FILE REF", filename, sha1] once resolved
+	TFunction<void(const FString& Filename, TArrayView<const uint8> Data)> OnFile;
+	// ["TENSOR", name, tensor] and the tensors of ["TENSOR FRAME", name, frame]
+	TFunction<void(const FNeuralTensor& Tensor)> OnTensor;
+	// ["TF STRUCTURE", layers]
+	TFunction<void(const TSharedPtr<const FNeuralLayerGraph, ESPMode::ThreadSafe>& Graph)> OnLayerGraph;
+	// ["TF LAYOUT", key, [[x, y]*]]
+	TFunction<void(const FString& Key, const TArray<FVector2D>& Positions)> OnLayout;
+	// ["SPAWN IMAGE path pos size rot", [path, values*]]
+	TFunction<void(const FString& Path, const FTransform& Transform)> OnImageSpawned;
+
+	// Whether any element callback besides the end of the connection and of responses is set.
+	// The position of elements is only tracked then
+	bool HasElementCallbacks() const;
+
+	// Adapters for the Blueprint functions of UNeuralInteractionClientBPLibrary
+	static FNeuralResponseCallbacks FromDelegate(const FReadResponse& Callback);
+	static FNeuralResponseCallbacks FromDelegates(
+		const FEndOfConnection& CallbackEndOfConnection,
+		const FStartOrEndOfResponse& CallbackStartOrEndOfResponse,
+		const FParseError& CallbackParseError,
+		const FStartOrEndOfMap& CallbackStartOrEndOfMap,
+		const FStartOrEndOfArray& CallbackStartOrEndOfArray,
+		const FFoundAtomNil& CallbackFoundAtomNil,
+		const FFoundAtomString& CallbackFoundAtomString,
+		const FFoundAtomBinary& CallbackFoundAtomBinary,
+		const FFoundAtomExternal& CallbackFoundAtomExternal,
+		const FFoundAtomBoolean& CallbackFoundAtomBoolean,
+		const FFoundAtomInteger& CallbackFoundAtomInteger,
+		const FFoundAtomInteger64& CallbackFoundAtomInteger64,
+		const FFoundAtomFloat& CallbackFoundAtomFloat);
+	// Executes the delegate on the game thread, in the order of the strings, for commands running in
+	// the background, see FNeuralCommandScheduler
+	static FNeuralResponseCallbacks FromDelegateOnGameThread(const FFoundAtomString& CallbackFoundAtomString);
+};
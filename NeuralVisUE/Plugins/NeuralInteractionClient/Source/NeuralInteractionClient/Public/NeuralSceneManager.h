@@ -0,0 +1,293 @@
+/*
+This file NeuralSceneManager.h is part of NeuralVisUAL.
+
+NeuralVisUAL is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+NeuralVisUAL is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with NeuralVisUAL.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "GameFramework/Actor.h"
+#include "NeuralSceneManager.generated.h"
+
+class UStaticMesh;
+class UStaticMeshComponent;
+class UInstancedStaticMeshComponent;
+class UMaterialInterface;
+class UMaterialInstanceDynamic;
+class UPrimitiveComponent;
+class FNeuralLayerGraph;
+
+// What a pooled scene object represents in the visualization
+UENUM(BlueprintType)
+enum class ENeuralSceneObjectKind : uint8
+{
+	// Objects without identity, they are matched by their spawn order within one redraw
+	Unkeyed,
+	// Cuboid of a layer, Primary = layer index
+	Layer,
+	// Connection beam, Primary = parent layer index, Secondary = child layer index
+	Connection,
+	// Single kernel pixel, Primary = layer index, Secondary/Tertiary = pixel x/y
+	KernelTile,
+};
+
+// Stable identity of a scene object which survives redraws.
+// The server attaches it as identity string to its spawn instructions,
+// e.g. "layer 3", "connection 2 3" or "kernel 5 12 7"
+USTRUCT(BlueprintType)
+struct NEURALINTERACTIONCLIENT_API FNeuralSceneKey
+{
+	GENERATED_BODY()
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Neural Interaction Client")
+	ENeuralSceneObjectKind Kind = ENeuralSceneObjectKind::Unkeyed;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Neural Interaction Client")
+	int32 Primary = -1;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Neural Interaction Client")
+	int32 Secondary = -1;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Neural Interaction Client")
+	int32 Tertiary = -1;
+
+	FNeuralSceneKey() {}
+	FNeuralSceneKey(ENeuralSceneObjectKind InKind, int32 InPrimary, int32 InSecondary = -1, int32 InTertiary = -1)
+		: Kind(InKind), Primary(InPrimary), Secondary(InSecondary), Tertiary(InTertiary) {}
+
+	// Parses identity strings as sent by the python server. Returns false for unknown identities.
+	// With bAllowPartial, trailing numbers may be omitted (they stay -1), which is used for scopes
+	static bool Parse(const FString& Identity, FNeuralSceneKey& OutKey, bool bAllowPartial = false);
+
+	// Whether this key lies within the partial key Scope, see Parse
+	bool IsWithin(const FNeuralSceneKey& Scope) const;
+
+	FString ToString() const;
+
+	bool operator==(const FNeuralSceneKey& Other) const
+	{
+		return Kind == Other.Kind && Primary == Other.Primary &&
+			Secondary == Other.Secondary && Tertiary == Other.Tertiary;
+	}
+
+	friend uint32 GetTypeHash(const FNeuralSceneKey& Key)
+	{
+		uint32 Hash = HashCombine(::GetTypeHash((uint8)Key.Kind), ::GetTypeHash(Key.Primary));
+		Hash = HashCombine(Hash, ::GetTypeHash(Key.Secondary));
+		return HashCombine(Hash, ::GetTypeHash(Key.Tertiary));
+	}
+};
+
+/*
+*	Owns every cuboid of the visualization and keeps them across redraws.
+*	Instead of destroying and respawning actors on each "tf draw structure",
+*	objects are looked up by their stable FNeuralSceneKey and only their transform
+*	and color are updated in place. Objects which are not touched during a redraw
+*	are hidden and returned to a free list, from which later spawns are served.
+*
+*	With bApplyServerInstructions, the manager applies the cuboid and redraw instructions
+*	of the server itself, see FNeuralInteractionEvents. All functions have to be called from the game thread.
+*/
+UCLASS(BlueprintType, Blueprintable)
+class NEURALINTERACTIONCLIENT_API ANeuralSceneManager : public AActor
+{
+	GENERATED_BODY()
+
+public:
+	ANeuralSceneManager();
+
+	// Mesh used for all cuboids, expected to be a cube of 100 units (like 1M_Cube)
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Neural Interaction Client")
+	UStaticMesh* CuboidMesh = nullptr;
+
+	// Material with a vector parameter for the color, a dynamic instance is created per object
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Neural Interaction Client")
+	UMaterialInterface* CuboidMaterial = nullptr;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Neural Interaction Client")
+	FName ColorParameterName = TEXT("Color");
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Neural Interaction Client")
+	FName OpacityParameterName = TEXT("Opacity");
+
+	// Model context the scene shows, see FNeuralModelContext. Place one manager per context to show
+	// several networks side by side. Empty uses the most recently received structure and layout
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Neural Interaction Client")
+	FString ModelContext;
+
+	// Stores the layer cuboids and connections in the layout cache whenever a redraw of the layers
+	// finishes, keyed by the layout key the server sent last with "TF LAYOUT"
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Neural Interaction Client")
+	bool bAutoSaveLayoutSnapshots = true;
+
+	// Spawns the cuboids and connections the server sends and redraws natively from BeginPlay on, for responses of the
+	// server of ModelContext. Blueprints which spawn cuboids from the response themselves must not
+	// do so as well. The server only attaches identities and redraw markers while a manager applies them
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Neural Interaction Client")
+	bool bApplyServerInstructions = false;
+
+	// Marks the beginning of a redraw of the scopes, e.g. "layer", "connection", "kernel 5" or "" for everything.
+	// Every object within a scope which is touched until EndRedraw of that scope stays visible.
+	// Redraws of different scopes may overlap, no scope means everything
+	UFUNCTION(BlueprintCallable, Category = "Neural Interaction Client")
+	void BeginRedraw(const TArray<FString>& Scopes);
+
+	// Releases all objects within the scopes which have not been spawned or updated since BeginRedraw
+	// of the same scope into the pool
+	UFUNCTION(BlueprintCallable, Category = "Neural Interaction Client")
+	void EndRedraw(const TArray<FString>& Scopes);
+
+	// Spawns a cuboid or updates the existing one with the same identity
+	UFUNCTION(BlueprintCallable, Category = "Neural Interaction Client")
+	UStaticMeshComponent* SpawnOrUpdateCuboid(const FNeuralSceneKey& Key, FVector Position, FVector Scale,
+		FLinearColor Color, FRotator Rotation);
+
+	// Same as SpawnOrUpdateCuboid, with the identity string sent by the server.
+	// Properties are the floats of a "SPAWN CUBOID pos size color opacity rot" instruction
+	UFUNCTION(BlueprintCallable, Category = "Neural Interaction Client")
+	UStaticMeshComponent* ApplyCuboidInstruction(const FString& Identity, const TArray<float>& Properties);
+
+	// Builds all connection beams between layers natively from the layer DAG, instead of receiving
+	// one cuboid per connection. Edges holds pairs of parent and child layer indices, the layer boxes
+	// are taken from the currently active layer cuboids. Beam transforms are calculated on worker
+	// threads and applied as instances of a single instanced mesh component afterwards.
+	UFUNCTION(BlueprintCallable, Category = "Neural Interaction Client")
+	void BuildConnections(const TArray<int32>& Edges, float Strength, FLinearColor Color);
+
+	// Same as BuildConnections with the values of a "SPAWN CONNECTIONS" message,
+	// Style is [strength, r, g, b, opacity]. Called natively with bApplyServerInstructions
+	UFUNCTION(BlueprintCallable, Category = "Neural Interaction Client")
+	void ApplyConnectionInstruction(const TArray<float>& Style, const TArray<int32>& Edges);
+
+	// Same as BuildConnections with all edges of the layer graph received with "TF STRUCTURE"
+	UFUNCTION(BlueprintCallable, Category = "Neural Interaction Client")
+	void BuildConnectionsFromLayerGraph(float Strength, FLinearColor Color);
+
+	UFUNCTION(BlueprintCallable, Category = "Neural Interaction Client")
+	void ClearConnections();
+
+	// Stores the currently active layer cuboids and connections in the layout cache under Key
+	UFUNCTION(BlueprintCallable, Category = "Neural Interaction Client|Layout Cache")
+	bool SaveLayoutSnapshot(const FString& Key);
+
+	// Redraws the layers and connections stored under Key, without any server round trip.
+	// Returns false if nothing has been cached for Key
+	UFUNCTION(BlueprintCallable, Category = "Neural Interaction Client|Layout Cache")
+	bool RestoreLayoutSnapshot(const FString& Key);
+
+	// Key of the most recently received layout, also from previous sessions. Empty if there is none
+	UFUNCTION(BlueprintPure, Category = "Neural Interaction Client|Layout Cache")
+	static FString GetLastLayoutKey();
+
+	// Raw 2D layout positions per layer as calculated by the server
+	UFUNCTION(BlueprintCallable, Category = "Neural Interaction Client|Layout Cache")
+	static bool GetCachedLayoutPositions(const FString& Key, TArray<FVector2D>& Positions);
+
+	// Hides the object with this identity and returns it to the pool
+	UFUNCTION(BlueprintCallable, Category = "Neural Interaction Client")
+	bool ReleaseObject(const FNeuralSceneKey& Key);
+
+	// Hides all objects and returns them to the pool
+	UFUNCTION(BlueprintCallable, Category = "Neural Interaction Client")
+	void ReleaseAll();
+
+	// Creates hidden objects upfront, so that the first redraw doesn't need to register components
+	UFUNCTION(BlueprintCallable, Category = "Neural Interaction Client")
+	void Prewarm(int32 NumberOfObjects);
+
+	UFUNCTION(BlueprintPure, Category = "Neural Interaction Client")
+	UStaticMeshComponent* FindObject(const FNeuralSceneKey& Key) const;
+
+	// Picking: retrieves the identity of a component hit by a trace
+	UFUNCTION(BlueprintPure, Category = "Neural Interaction Client")
+	bool GetKeyOfComponent(const UPrimitiveComponent* Component, FNeuralSceneKey& OutKey) const;
+
+	// Picking: retrieves the layer a component belongs to, kernel tiles and connections count to their (child) layer.
+	// LayerName is taken from the layer graph and stays empty if no graph has been received
+	UFUNCTION(BlueprintPure, Category = "Neural Interaction Client")
+	bool GetLayerOfComponent(const UPrimitiveComponent* Component, int32& LayerIndex, FString& LayerName) const;
+
+	// World space bounds of all active layer cuboids by layer index
+	UFUNCTION(BlueprintPure, Category = "Neural Interaction Client")
+	TMap<int32, FBox> GetLayerBounds() const;
+
+	UFUNCTION(BlueprintPure, Category = "Neural Interaction Client")
+	int32 GetNumberOfActiveObjects() const { return ActiveObjects.Num(); }
+
+	UFUNCTION(BlueprintPure, Category = "Neural Interaction Client")
+	int32 GetNumberOfPooledObjects() const { return FreeSlots.Num(); }
+
+protected:
+	virtual void BeginPlay() override;
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
+	UPROPERTY()
+	USceneComponent* SceneRoot;
+
+	// All components ever created by this manager, index = slot
+	UPROPERTY(Transient)
+	TArray<UStaticMeshComponent*> Components;
+
+	UPROPERTY(Transient)
+	TArray<UMaterialInstanceDynamic*> Materials;
+
+	// All natively built connection beams
+	UPROPERTY()
+	UInstancedStaticMeshComponent* ConnectionInstances;
+
+	UPROPERTY(Transient)
+	UMaterialInstanceDynamic* ConnectionMaterial = nullptr;
+
+	int32 AcquireSlot();
+	void ReleaseSlot(int32 Slot);
+	void ApplyConnectionTransforms(const TArray<FTransform>& Transforms, const FLinearColor& Color);
+
+	// Layer graph and layout key of ModelContext
+	TSharedPtr<const FNeuralLayerGraph, ESPMode::ThreadSafe> GetLayerGraph() const;
+	FString GetLayoutKey() const;
+
+private:
+	struct FSlotState
+	{
+		FNeuralSceneKey Key;
+		FLinearColor Color = FLinearColor::Transparent;
+		uint32 Generation = 0;
+		bool bActive = false;
+	};
+
+	TArray<FSlotState> Slots;
+	TArray<int32> FreeSlots;
+	TMap<FNeuralSceneKey, int32> ActiveObjects;
+	TMap<const UPrimitiveComponent*, int32> SlotOfComponent;
+
+	// Incremented with each BeginRedraw, slots remember when they were touched the last time.
+	// Objects of a scope which are older than the generation its redraw began with are released
+	uint32 CurrentGeneration = 0;
+	TMap<FString, uint32> RedrawGenerations;
+	int32 UnkeyedCounter = 0;
+
+	// Listeners for bApplyServerInstructions
+	FDelegateHandle SceneRedrawListener;
+	FDelegateHandle CuboidSpawnListener;
+	FDelegateHandle ConnectionSpawnListener;
+
+	// Incremented with each BuildConnections, results of outdated worker jobs are dropped
+	uint32 ConnectionBuildSerial = 0;
+
+	// Arguments of the last BuildConnections, stored with layout snapshots
+	TArray<int32> LastConnectionEdges;
+	float LastConnectionStrength = 0.f;
+	FLinearColor LastConnectionColor = FLinearColor::White;
+};
@@ -0,0 +1,83 @@
+/*
+This file NeuralSharedMemory.h is part of NeuralVisUAL.
+
+NeuralVisUAL is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+NeuralVisUAL is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with NeuralVisUAL.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/*
+*	Payload the server placed in the shared memory ring, viewed without copying.
+*	The region is released to the server when the last reference is gone, so keep references
+*	only as long as needed: the server reuses regions after SHARED_MEMORY_TIMEOUT regardless.
+*/
+class NEURALINTERACTIONCLIENT_API FNeuralSharedMemoryRegion
+{
+public:
+	~FNeuralSharedMemoryRegion();
+
+	TArrayView<const uint8> GetView() const { return TArrayView<const uint8>(Data, Size); }
+	// 0 for binary data, otherwise the extension type of the payload
+	uint8 GetInnerType() const { return InnerType; }
+
+private:
+	friend class FNeuralSharedMemory;
+	struct FMapping;
+
+	TSharedPtr<FMapping, ESPMode::ThreadSafe> Mapping;
+	// Region header in front of the payload: uint32 generation, uint32 released, uint64 length
+	uint8* Header = nullptr;
+	const uint8* Data = nullptr;
+	int32 Size = 0;
+	uint8 InnerType = 0;
+};
+
+using FNeuralSharedMemoryRegionPtr = TSharedPtr<FNeuralSharedMemoryRegion, ESPMode::ThreadSafe>;
+
+/*
+*	Client side of the shared memory ring of the server, see sharedMemory.py.
+*
+*	Servers on the same machine write files and tensors into a memory mapped file and only send
+*	a descriptor (msgpack extension type 2) of where to find them. The client announces the file
+*	it maps in the handshake header HandshakeHeader, the server only sends descriptors if it is
+*	the same file it writes, with either transport. Descriptors which cannot be resolved are reported
+*	through OnParseError of FNeuralResponseCallbacks. Every server has its own file, see GetSharedMemoryPath of the settings.
+*	A file is mapped on the first descriptor, and mapped again if the
+*	server has been restarted with a different size. Thread-safe.
+*/
+class NEURALINTERACTIONCLIENT_API FNeuralSharedMemory
+{
+public:
+	static constexpr int8 ExtensionType = 2;
+	static const char* HandshakeHeader;
+
+	static FNeuralSharedMemory& Get();
+
+	// Resolves the payload of the extension type, without the type byte, into a view of the ring in
+	// the file at Path, the one announced to the server. Returns nullptr if the descriptor does not
+	// match the ring, e.g. because the server restarted
+	FNeuralSharedMemoryRegionPtr Resolve(const FString& Path, const uint8* Descriptor, int32 Size);
+
+private:
+	FNeuralSharedMemory() = default;
+
+	TSharedPtr<FNeuralSharedMemoryRegion::FMapping, ESPMode::ThreadSafe> Map(const FString& Path, int64 Size);
+
+	FCriticalSection Lock;
+	// One per server on this machine, by path. Regions keep their mapping alive, so it is only
+	// unmapped once all of them are released
+	TMap<FString, TSharedPtr<FNeuralSharedMemoryRegion::FMapping, ESPMode::ThreadSafe>> Mappings;
+};
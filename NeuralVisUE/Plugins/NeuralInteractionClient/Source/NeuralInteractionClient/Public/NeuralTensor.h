@@ -0,0 +1,120 @@
+/*
+This file NeuralTensor.h is part of NeuralVisUAL.
+
+NeuralVisUAL is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+NeuralVisUAL is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with NeuralVisUAL.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "NeuralSharedMemory.h"
+#include "NeuralTensor.generated.h"
+
+class UTexture2D;
+
+// Transport encoding of tensors, see tensorEncoding.py on the server
+UENUM(BlueprintType)
+enum class ENeuralTensorEncoding : uint8
+{
+	Float32,
+	Float16,
+	// Quantized to 0..255 with a scale and offset per channel
+	Int8,
+};
+
+/*
+*	Tensor of a ["TENSOR", name, tensor] response, where tensor is the msgpack extension type 1.
+*	The values are kept in their transport encoding until they are needed, either dequantized
+*	into a float buffer or uploaded as they are into a single channel texture.
+*	The last axis is the channel axis, like in tensorflow.
+*	Tensors received through shared memory keep viewing it instead of copying their values,
+*	which releases the region once the last copy of the tensor is gone.
+*/
+struct NEURALINTERACTIONCLIENT_API FNeuralTensor
+{
+	static constexpr int8 ExtensionType = 1;
+
+	FString Name;
+	ENeuralTensorEncoding Encoding = ENeuralTensorEncoding::Float32;
+	TArray<int32> Shape;
+	// Int8 only, one per channel: value = quantized * scale + offset
+	TArray<float> Scales;
+	TArray<float> Offsets;
+	// Values in their transport encoding, empty if they are in SharedValues
+	TArray<uint8> Data;
+	FNeuralSharedMemoryRegionPtr SharedValues;
+	int32 SharedValuesOffset = 0;
+
+	// Parses the payload of the extension type, without the type byte
+	static bool Parse(const uint8* Payload, int32 Size, FNeuralTensor& OutTensor);
+	// Parses a payload in shared memory without copying the values
+	static bool Parse(const FNeuralSharedMemoryRegionPtr& Region, FNeuralTensor& OutTensor);
+	// Parses everything but the values, which start at OutValuesOffset
+	static bool ParseHeader(const uint8* Payload, int32 Size, FNeuralTensor& OutTensor, int32& OutValuesOffset);
+
+	TArrayView<const uint8> GetValues() const;
+	int64 GetNumberOfValues() const;
+	int32 GetNumberOfChannels() const;
+
+	// Any thread
+	void Dequantize(TArray<float>& OutValues) const;
+
+	// Uploads one channel of a tensor of rank 3 or more as R32F, R16F or G8 texture, without converting
+	// the values. Width is the second to last axis, all leading axes are stacked vertically.
+	// OutScaleOffset is (1, 0) for float encodings, for Int8 a material restores the value as
+	// sample * 255 * X + Y. Game thread only.
+	UTexture2D* CreateChannelTexture(int32 Channel, FVector2D& OutScaleOffset) const;
+};
+
+/*
+*	Tensor streams of ["TENSOR FRAME", name, frame] responses, where frame is the msgpack extension type 3.
+*	Successive frames of a stream, like the activations of a layer while the input changes, mostly differ
+*	in few values. The server thus only sends keyframes now and then and otherwise the runs of values
+*	that changed since the frame the client requested against, see tensorEncoding.py on the server.
+*
+*	Request a frame with "tf get activations <layer> <input> <encoding> <GetFrame(name)>". When a delta
+*	does not match the last frame of the stream, the stream is reset and the next request gets a keyframe.
+*	Every model context has its own streams, see FNeuralModelContext. Thread-safe.
+*/
+class NEURALINTERACTIONCLIENT_API FNeuralTensorStreams
+{
+public:
+	static constexpr int8 ExtensionType = 3;
+
+	FNeuralTensorStreams() = default;
+
+	// Streams of the default model context
+	static FNeuralTensorStreams& Get();
+
+	// Last frame received of the stream, 0 if there is none
+	uint32 GetFrame(const FString& Name) const;
+
+	// Parses the payload of the extension type and applies it to the values of the stream in place.
+	// OnApplied is called with the resulting frame, the tensor of the stream itself, while the stream
+	// is locked. Listeners which keep the frame copy it, so that there is no copy per frame otherwise
+	bool ApplyFrame(const FString& Name, const uint8* Payload, int32 Size, TFunctionRef<void(const FNeuralTensor&)> OnApplied);
+
+	void Reset(const FString& Name);
+	void Clear();
+
+private:
+	struct FStream
+	{
+		uint32 Frame = 0;
+		FNeuralTensor Tensor;
+	};
+
+	mutable FCriticalSection Lock;
+	TMap<FString, FStream> Streams;
+};
@@ -0,0 +1,147 @@
+/*
+This file NeuralTextureAtlas.h is part of NeuralVisUAL.
+
+NeuralVisUAL is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+NeuralVisUAL is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with NeuralVisUAL.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "UObject/NoExportTypes.h"
+#include "NeuralTextureAtlas.generated.h"
+
+class UTexture2D;
+struct FNeuralDecodedImage;
+
+// Location of one image inside the atlas
+USTRUCT(BlueprintType)
+struct FNeuralAtlasTile
+{
+	GENERATED_BODY()
+
+	// Index into the tile index texture, passed to materials as per instance custom data
+	UPROPERTY(BlueprintReadOnly, Category = "Neural Interaction Client|Atlas")
+	int32 Index = INDEX_NONE;
+
+	UPROPERTY(BlueprintReadOnly, Category = "Neural Interaction Client|Atlas")
+	int32 Page = INDEX_NONE;
+
+	// Texel rectangle inside the page, without padding
+	UPROPERTY(BlueprintReadOnly, Category = "Neural Interaction Client|Atlas")
+	FIntPoint Position = FIntPoint::ZeroValue;
+
+	UPROPERTY(BlueprintReadOnly, Category = "Neural Interaction Client|Atlas")
+	FIntPoint Size = FIntPoint::ZeroValue;
+
+	// (U, V, width, height) in normalized page coordinates, as stored in the tile index texture
+	UPROPERTY(BlueprintReadOnly, Category = "Neural Interaction Client|Atlas")
+	FVector4 UVRect = FVector4(0.f, 0.f, 0.f, 0.f);
+
+	bool IsValid() const { return Index != INDEX_NONE; }
+};
+
+/*
+*	Packs kernel and activation images into a few large page textures instead of creating one
+*	texture and material per image. Pages are filled shelf by shelf and only the changed region
+*	is uploaded. Next to the pages, a tile index texture of TileCapacity x 1 float texels holds the
+*	UV rectangle of every tile, so a single material per page can draw any tile: it reads the tile
+*	index from per instance custom data, fetches texel (index + 0.5) / TileCapacity of the tile
+*	index texture and maps its UVs to XY + UV * ZW before sampling the page.
+*	All functions have to be called on the game thread.
+*/
+UCLASS(BlueprintType, EditInlineNew)
+class NEURALINTERACTIONCLIENT_API UNeuralTextureAtlas : public UObject
+{
+	GENERATED_BODY()
+
+public:
+	// Width and height of each page, images that don't fit are not added. Can't change after the first tile was added.
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Neural Interaction Client|Atlas", meta = (ClampMin = "256"))
+	int32 PageSize = 4096;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Neural Interaction Client|Atlas", meta = (ClampMin = "1"))
+	int32 MaxPages = 4;
+
+	// Width of the tile index texture, can't change after the first tile was added
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Neural Interaction Client|Atlas", meta = (ClampMin = "1"))
+	int32 TileCapacity = 1024;
+
+	// Empty texels around each tile against bleeding when filtering
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Neural Interaction Client|Atlas", meta = (ClampMin = "0"))
+	int32 Padding = 2;
+
+	// Adds an image, replacing the one added before with the same key. Returns false if it doesn't fit.
+	bool AddTile(FName Key, const FNeuralDecodedImage& Image, FNeuralAtlasTile& OutTile);
+
+	UFUNCTION(BlueprintCallable, Category = "Neural Interaction Client|Atlas")
+	void RemoveTile(FName Key);
+
+	UFUNCTION(BlueprintCallable, Category = "Neural Interaction Client|Atlas")
+	bool FindTile(FName Key, FNeuralAtlasTile& OutTile) const;
+
+	// Removes all tiles, the page textures are kept and overwritten by new tiles
+	UFUNCTION(BlueprintCallable, Category = "Neural Interaction Client|Atlas")
+	void Clear();
+
+	UFUNCTION(BlueprintPure, Category = "Neural Interaction Client|Atlas")
+	UTexture2D* GetPageTexture(int32 Page) const;
+
+	UFUNCTION(BlueprintPure, Category = "Neural Interaction Client|Atlas")
+	UTexture2D* GetTileIndexTexture() const { return TileIndexTexture; }
+
+	UFUNCTION(BlueprintPure, Category = "Neural Interaction Client|Atlas")
+	int32 GetNumberOfPages() const { return Pages.Num(); }
+
+	UFUNCTION(BlueprintPure, Category = "Neural Interaction Client|Atlas")
+	int32 GetNumberOfTiles() const { return Tiles.Num(); }
+
+	// Share of all allocated page texels covered by tiles, including padding
+	UFUNCTION(BlueprintPure, Category = "Neural Interaction Client|Atlas")
+	float GetOccupancy() const;
+
+private:
+	// A row of tiles of at most Height texels, with the unused horizontal spans
+	struct FShelf
+	{
+		int32 Y = 0;
+		int32 Height = 0;
+		TArray<FIntPoint> FreeSpans;
+	};
+
+	struct FPage
+	{
+		TArray<FShelf> Shelves;
+		int32 UsedHeight = 0;
+		int32 NumTiles = 0;
+	};
+
+	UPROPERTY(Transient)
+	TArray<UTexture2D*> PageTextures;
+
+	UPROPERTY(Transient)
+	UTexture2D* TileIndexTexture = nullptr;
+
+	TArray<FPage> Pages;
+	TMap<FName, FNeuralAtlasTile> Tiles;
+	TArray<int32> FreeTileIndices;
+	int32 NextTileIndex = 0;
+	int64 UsedTexels = 0;
+
+	bool Allocate(const FIntPoint& PaddedSize, int32& OutPage, FIntPoint& OutPosition);
+	bool AllocateInPage(FPage& Page, const FIntPoint& PaddedSize, bool bAllowWaste, FIntPoint& OutPosition);
+	void Free(const FNeuralAtlasTile& Tile);
+	int32 AddPage();
+	void UploadTile(const FNeuralAtlasTile& Tile, const FNeuralDecodedImage& Image);
+	void UploadTileIndex(int32 Index, const FVector4& UVRect);
+};
@@ -0,0 +1,120 @@
+/*
+This file NeuralTextureCache.h is part of NeuralVisUAL.
+
+NeuralVisUAL is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+NeuralVisUAL is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with NeuralVisUAL.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Kismet/BlueprintFunctionLibrary.h"
+#include "NeuralTextureCache.generated.h"
+
+class UTexture2D;
+
+/*
+*	Content addressed cache of the images the server sends with ["FILE", filename, data].
+*
+*	Every received file is stored compressed, as sent, in Saved/NeuralVisUAL/TextureCache/<sha1>,
+*	trimmed to DiskBudget by last use. When the server sent a file with the same content before,
+*	it only sends ["FILE REF", filename, sha1]. The client then takes the data from the disk tier,
+*	or requests it again with "get file" if it has been trimmed meanwhile, so that native
+*	listeners always see a complete FILE either way.
+*
+*	Decoded textures are kept on the GPU under MemoryBudget and evicted least recently used
+*	first, so revisiting a layer costs neither network transfer nor decoding.
+*
+*	The disk tier and the hash lookups are thread-safe, textures can only be used on the game thread.
+*/
+class NEURALINTERACTIONCLIENT_API FNeuralTextureCache
+{
+public:
+	static FNeuralTextureCache& Get();
+
+	// Lower case hex SHA-1, like hashlib.sha1(data).hexdigest() on the server
+	static FString HashContent(const uint8* Data, int32 Size);
+
+	// Compressed tier
+	void StoreFile(const FString& Filename, const FString& Hash, const uint8* Data, int32 Size);
+	bool LoadFile(const FString& Hash, TArray<uint8>& OutData);
+	// Hash of the content most recently received under this filename, empty if unknown
+	FString GetHashForFilename(const FString& Filename) const;
+
+	// GPU tier
+	bool HasTexture(const FString& Hash) const;
+	UTexture2D* FindTexture(const FString& Hash);
+	void StoreTexture(const FString& Hash, UTexture2D* Texture);
+
+	void SetMemoryBudget(int64 Bytes);
+	int64 GetMemoryBudget() const;
+	int64 GetMemoryUsage() const;
+	void SetDiskBudget(int64 Bytes);
+	int64 GetDiskBudget() const;
+	int32 GetNumberOfTextures() const;
+
+	void Clear(bool bIncludingDisk);
+
+private:
+	FNeuralTextureCache() = default;
+
+	static FString GetCacheDirectory();
+	static bool IsValidHash(const FString& Hash);
+
+	// Both expect Lock to be held
+	void EvictTextures();
+	void TrimDisk();
+
+	struct FTextureEntry
+	{
+		// Rooted while in the cache
+		UTexture2D* Texture = nullptr;
+		int64 Bytes = 0;
+		uint64 LastUse = 0;
+	};
+
+	mutable FCriticalSection Lock;
+	TMap<FString, FTextureEntry> Textures;
+	TMap<FString, FString> FilenameHashes;
+	uint64 UseCounter = 0;
+	int64 MemoryUsage = 0;
+	int64 MemoryBudget = 256ll * 1024 * 1024;
+	// Unknown until the directory has been scanned once
+	int64 DiskUsage = -1;
+	int64 DiskBudget = 1024ll * 1024 * 1024;
+};
+
+UCLASS()
+class NEURALINTERACTIONCLIENT_API UNeuralTextureCacheBPLibrary : public UBlueprintFunctionLibrary
+{
+	GENERATED_BODY()
+
+public:
+	// Budget for decoded textures in megabytes
+	UFUNCTION(BlueprintCallable, Category = "Neural Interaction Client|Texture Cache")
+	static void SetTextureCacheMemoryBudget(int32 Megabytes);
+
+	// Budget for the compressed files on disk in megabytes
+	UFUNCTION(BlueprintCallable, Category = "Neural Interaction Client|Texture Cache")
+	static void SetTextureCacheDiskBudget(int32 Megabytes);
+
+	UFUNCTION(BlueprintCallable, Category = "Neural Interaction Client|Texture Cache")
+	static void ClearTextureCache(bool bIncludingDisk);
+
+	// Memory used by decoded textures in megabytes
+	UFUNCTION(BlueprintPure, Category = "Neural Interaction Client|Texture Cache")
+	static float GetTextureCacheMemoryUsage();
+
+	UFUNCTION(BlueprintPure, Category = "Neural Interaction Client|Texture Cache")
+	static int32 GetNumberOfCachedTextures();
+};
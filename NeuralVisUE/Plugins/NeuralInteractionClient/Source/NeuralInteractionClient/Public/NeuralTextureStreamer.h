@@ -0,0 +1,234 @@
+/*
+This file NeuralTextureStreamer.h is part of NeuralVisUAL.
+
+NeuralVisUAL is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+NeuralVisUAL is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with NeuralVisUAL.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "GameFramework/Actor.h"
+#include "NeuralTextureAtlas.h"
+#include "NeuralTextureStreamer.generated.h"
+
+class ANeuralSceneManager;
+class UStaticMesh;
+class UStaticMeshComponent;
+class UInstancedStaticMeshComponent;
+class UMaterialInterface;
+class UMaterialInstanceDynamic;
+class UTexture2D;
+struct FNeuralDecodedImage;
+
+UENUM(BlueprintType)
+enum class ENeuralTextureLOD : uint8
+{
+	None,
+	// Requested with LowResolution, for layers far away
+	Low,
+	// Requested with FullResolution, for layers close to the camera
+	Full,
+};
+
+UENUM(BlueprintType)
+enum class ENeuralStreamedTextureKind : uint8
+{
+	// "tf draw kernel"
+	Kernels,
+	// "tf draw activations"
+	Activations,
+};
+
+// Streaming state of one texture of one layer
+USTRUCT()
+struct FNeuralStreamedTexture
+{
+	GENERATED_BODY()
+
+	UPROPERTY(Transient)
+	UTexture2D* Texture = nullptr;
+
+	// One plane per "SPAWN IMAGE" instruction of the response
+	UPROPERTY(Transient)
+	TArray<UStaticMeshComponent*> Planes;
+
+	UPROPERTY(Transient)
+	TArray<UMaterialInstanceDynamic*> Materials;
+
+	// Set instead of Texture when the image went into the atlas
+	UPROPERTY(Transient)
+	FNeuralAtlasTile Tile;
+
+	// "SPAWN IMAGE" transforms relative to the scene manager, used for the atlas instances
+	TArray<FTransform> Placements;
+
+	ENeuralTextureLOD Current = ENeuralTextureLOD::None;
+	ENeuralTextureLOD Requested = ENeuralTextureLOD::None;
+	// The server had nothing to draw, e.g. a layer without kernels
+	bool bUnavailable = false;
+	double LastNeededTime = 0.0;
+	double LastFullNeededTime = 0.0;
+};
+
+/*
+*	Streams kernel and activation textures of the layers depending on the camera, instead of
+*	requesting all of them explicitly at full resolution. Each update, the layer bounds of the
+*	scene manager are tested against the camera frustum, both for the current camera position
+*	and the one predicted along the flight direction. Visible layers get a low resolution
+*	texture, close ones the full resolution, and textures of layers which stay out of view
+*	are evicted. Requests run on worker threads, at most MaxConcurrentRequests at once.
+*/
+UCLASS(BlueprintType, Blueprintable)
+class NEURALINTERACTIONCLIENT_API ANeuralTextureStreamer : public AActor
+{
+	GENERATED_BODY()
+
+public:
+	ANeuralTextureStreamer();
+
+	// Provides the layer bounds, required
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Neural Interaction Client")
+	ANeuralSceneManager* SceneManager = nullptr;
+
+	// Plane of 100 units used to display textures, placed with the transforms of "SPAWN IMAGE" instructions
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Neural Interaction Client")
+	UStaticMesh* PlaneMesh = nullptr;
+
+	// Material with a texture parameter, a dynamic instance is created per plane
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Neural Interaction Client")
+	UMaterialInterface* TextureMaterial = nullptr;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Neural Interaction Client")
+	FName TextureParameterName = TEXT("Texture");
+
+	// Packs the streamed images into shared pages, images which don't fit fall back to their own texture
+	UPROPERTY(EditAnywhere, Instanced, BlueprintReadWrite, Category = "Neural Interaction Client|Atlas")
+	UNeuralTextureAtlas* Atlas = nullptr;
+
+	// Material drawing atlas tiles, see UNeuralTextureAtlas. One instanced mesh is created per atlas page.
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Neural Interaction Client|Atlas")
+	UMaterialInterface* AtlasMaterial = nullptr;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Neural Interaction Client|Atlas")
+	FName PageParameterName = TEXT("Page");
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Neural Interaction Client|Atlas")
+	FName TileIndexParameterName = TEXT("TileIndex");
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Neural Interaction Client|Atlas")
+	FName TileCapacityParameterName = TEXT("TileCapacity");
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Neural Interaction Client|Streaming")
+	bool bStreamKernels = true;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Neural Interaction Client|Streaming")
+	bool bStreamActivations = false;
+
+	// Input passed to "tf draw activations", empty uses the default input of the server
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Neural Interaction Client|Streaming")
+	FString ActivationInput;
+
+	// Maximum texture resolution requested for far layers
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Neural Interaction Client|Streaming", meta = (ClampMin = "16"))
+	int32 LowResolution = 256;
+
+	// Maximum texture resolution requested for near layers, 0 uses the visualization settings of the server
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Neural Interaction Client|Streaming", meta = (ClampMin = "0"))
+	int32 FullResolution = 0;
+
+	// Layers closer than this get full resolution textures
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Neural Interaction Client|Streaming")
+	float NearDistance = 3000.f;
+
+	// Layers further away than this don't get any texture
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Neural Interaction Client|Streaming")
+	float FarDistance = 20000.f;
+
+	// Relative margin around NearDistance and FarDistance before the level of detail drops again
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Neural Interaction Client|Streaming", meta = (ClampMin = "0"))
+	float Hysteresis = 0.15f;
+
+	// How far ahead along the flight direction layers are prefetched
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Neural Interaction Client|Streaming", meta = (ClampMin = "0"))
+	float PrefetchSeconds = 1.5f;
+
+	// Widens the camera field of view for the visibility test, so that textures are ready when turning
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Neural Interaction Client|Streaming", meta = (ClampMin = "1"))
+	float FieldOfViewMargin = 1.2f;
+
+	// Textures which have not been needed for this long are evicted
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Neural Interaction Client|Streaming", meta = (ClampMin = "0"))
+	float EvictAfterSeconds = 5.f;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Neural Interaction Client|Streaming", meta = (ClampMin = "1"))
+	int32 MaxConcurrentRequests = 2;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Neural Interaction Client|Streaming", meta = (ClampMin = "0"))
+	float UpdateInterval = 0.2f;
+
+	// Evicts all textures and forgets which layers had nothing to draw, e.g. after loading another network
+	UFUNCTION(BlueprintCallable, Category = "Neural Interaction Client|Streaming")
+	void ResetStreaming();
+
+	UFUNCTION(BlueprintPure, Category = "Neural Interaction Client|Streaming")
+	ENeuralTextureLOD GetLayerLOD(int32 Layer, ENeuralStreamedTextureKind Kind) const;
+
+	UFUNCTION(BlueprintPure, Category = "Neural Interaction Client|Streaming")
+	int32 GetNumberOfStreamedTextures() const;
+
+	UFUNCTION(BlueprintPure, Category = "Neural Interaction Client|Streaming")
+	int32 GetNumberOfPendingRequests() const { return PendingRequests; }
+
+	virtual void Tick(float DeltaSeconds) override;
+
+protected:
+	virtual void BeginPlay() override;
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
+	// Key is (layer index, ENeuralStreamedTextureKind)
+	UPROPERTY(Transient)
+	TMap<FIntPoint, FNeuralStreamedTexture> Textures;
+
+	// One per atlas page, the tile index is the first custom data value of each instance
+	UPROPERTY(Transient)
+	TArray<UInstancedStaticMeshComponent*> AtlasInstances;
+
+private:
+	struct FCandidate
+	{
+		FIntPoint Key;
+		ENeuralTextureLOD LOD;
+		float Distance;
+	};
+
+	ENeuralTextureLOD GetDesiredLOD(const FNeuralStreamedTexture* State, const FBox& Bounds,
+		const FVector& CameraLocation, const FVector& PredictedLocation, const FVector& Forward, float HalfFOV) const;
+	FString MakeCommand(const FIntPoint& Key, ENeuralTextureLOD LOD) const;
+	void Request(const FIntPoint& Key, ENeuralTextureLOD LOD);
+	void OnRequestFinished(const FIntPoint& Key, ENeuralTextureLOD LOD, const FString& Hash, const FNeuralDecodedImage* Image,
+		const TArray<FTransform>& Placements);
+	void ShowPlanes(FNeuralStreamedTexture& State, UTexture2D* Texture, const TArray<FTransform>& Placements);
+	void Evict(const FIntPoint& Key, FNeuralStreamedTexture& State);
+	UInstancedStaticMeshComponent* GetAtlasInstances(int32 Page);
+	void RebuildAtlasInstances();
+
+	float TimeSinceUpdate = 0.f;
+	FVector LastCameraLocation = FVector::ZeroVector;
+	FVector CameraVelocity = FVector::ZeroVector;
+	bool bHasLastCameraLocation = false;
+	int32 PendingRequests = 0;
+	bool bAtlasInstancesDirty = false;
+	// Incremented by ResetStreaming, results of older requests are dropped
+	uint32 StreamingSerial = 0;
+};
@@ -65,6 +65,10 @@ tfnet = SimpleNamespace()
 pytorchnet = SimpleNamespace()
 tf = None
 gradientCache = dict()
+# The model epoch changes whenever another network is loaded or the stored structure is reset.
+# Clients key their response caches by it, the random token keeps epochs of server runs apart
+modelEpochToken = "%08x" % random.getrandbits(32)
+modelEpochCounter = 0
 # Structure of tfnet.layers: (layername, ltype, shape, params, connectedTo, trainableVariables)
 # trainableVariables is a (maybe empty) dict of lists. Lists have same indices as tfnet.layers:
 # e.g. {'kernel': [ndarrays], 'bias': [ndarrays], 'gamma': [ndarrays], 'beta': [ndarrays]}
@@ -106,6 +110,15 @@ def externalImagePath(filenameOrSubfolder="", filename="", timestamp=True):
 
 # MAIN FUNCTIONS FOR AI INTERACTION
 
+# Returns the current model epoch as string, see modelEpochToken
+def modelEpoch():
+	return f"{modelEpochToken}.{modelEpochCounter}"
+
+# Invalidates all responses cached by clients for the previous model epoch
+def advanceModelEpoch():
+	global modelEpochCounter
+	modelEpochCounter += 1
+
 # Prepares a python module and execs it.
 # Does not throw errors but returns strings with the error message!
 # Afterwards, if no error was thrown, call importtf for tensorflow networks
@@ -137,6 +150,7 @@ def preparemodule(path, allowPreparingNewModuleOnTop = False):
 		'servers centralController.py')
 
 	# Importing the network python file
+	advanceModelEpoch()
 	loggingFunctions.printlog("Loading network from " + path)
 	nn_spec = importlib.util.spec_from_file_location("", path)
 	if nn_spec is None:
@@ -233,8 +247,9 @@ tfStructureTypes = [
 # resets the saved structure information of tfnet
 def tfresetstructure():
 	removeAttributes = ["layers", "modelname", "structureType", "totalparams", "trainableparams",
-		"nontrainableparams", "layerCount", "layoutPositions", "trainableVariables"]
+		"nontrainableparams", "layerCount", "layoutPositions", "layoutKey", "trainableVariables"]
 	global tfnet
+	advanceModelEpoch()
 	tfnet.validstructure = False
 	for attr in removeAttributes:
 		if hasattr(tfnet, attr):
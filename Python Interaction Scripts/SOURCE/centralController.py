@@ -22,6 +22,7 @@
 # Most of work is done by the locally imported modules
 
 # USED LIBRARIES
+import argparse
 import asyncio
 import os
 import sys
@@ -60,6 +61,14 @@ def SCRIPT_PATH():
 	
 # MAIN SECTION THAT CALLS EVERYTHING ELSE
 if __name__ == '__main__':
+	# Several servers can run side by side, e.g. one per model, see the endpoints of the client settings
+	parser = argparse.ArgumentParser(description="NeuralVisUAL websocket server")
+	parser.add_argument("--ip", default=setting.SERVER.IP, help="address to listen on")
+	parser.add_argument("--port", type=int, default=setting.SERVER.PORT, help="port to listen on")
+	arguments = parser.parse_args()
+	setting.SERVER.IP = arguments.ip
+	setting.SERVER.PORT = arguments.port
+
 	# verify user settings and check for warnings / recommendations
 	setting.checkSettings()
 	design.checkSettings()
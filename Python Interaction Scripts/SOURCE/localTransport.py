@@ -0,0 +1,151 @@
+#!/usr/bin/env python
+
+"""
+ This file localTransport.py is part of NeuralVisUAL.
+
+ NeuralVisUAL is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ NeuralVisUAL is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with NeuralVisUAL.  If not, see <https://www.gnu.org/licenses/>.
+"""
+
+# This module offers the websocket server on a unix domain socket for clients on the same machine.
+# There is no websocket framing, every message in either direction is a frame of
+#	uint32 length (little endian), payload
+# Clients first send the headers of the websocket handshake in a frame of utf-8 text
+#	#HEADERS#\r\nName: value\r\n...
+# and then their commands as utf-8 text. Clients without it start with the command and get no
+# header-negotiated features. The server responds with the same msgpack messages it sends over
+# websocket. LocalConnection provides the interface of a websocket connection that the rest
+# of the server uses, so commands cannot tell both transports apart.
+
+# USED LIBRARIES
+import asyncio
+import os
+import struct
+import tempfile
+
+import serverSettings as setting
+
+FRAME_HEADER = struct.Struct("<I")
+# First line of the frame with the headers
+HEADER_FRAME = "#HEADERS#"
+
+class ConnectionClosedOK(Exception):
+	pass
+
+class ConnectionClosedError(Exception):
+	pass
+
+def isSupported():
+	return hasattr(asyncio, "start_unix_server")
+
+def socketPath():
+	if setting.SERVER.LOCAL_SOCKET_PATH:
+		return setting.SERVER.LOCAL_SOCKET_PATH
+	return os.path.join(tempfile.gettempdir(), setting.portSpecificName("NeuralVisUAL", ".sock"))
+
+# Header names are compared without case, like those of the websocket handshake
+class LocalHeaders(dict):
+	def get(self, name, default = None):
+		return super().get(name.lower(), default)
+
+class LocalConnection:
+	# Clients of unix domain sockets are on the same machine
+	isLocal = True
+
+	def __init__(self, reader, writer):
+		self.reader = reader
+		self.writer = writer
+		# Read as request_headers of the websocket handshake, see handshakeHeader in websocketServer.py
+		self.request_headers = LocalHeaders()
+		# First frame of clients which send no headers
+		self.pendingMessage = None
+
+	# Reads the frame with the headers, which clients send right after connecting
+	async def readHeaders(self):
+		message = await self.recv()
+		lines = message.split("\r\n")
+		if lines[0] != HEADER_FRAME:
+			self.pendingMessage = message
+			return
+		for line in lines[1:]:
+			name, separator, value = line.partition(":")
+			if separator:
+				self.request_headers[name.strip().lower()] = value.strip()
+
+	async def recv(self):
+		if self.pendingMessage is not None:
+			message, self.pendingMessage = self.pendingMessage, None
+			return message
+		try:
+			header = await self.reader.readexactly(FRAME_HEADER.size)
+		except asyncio.IncompleteReadError as e:
+			# Closing between two frames is the regular way to disconnect
+			if len(e.partial) == 0:
+				raise ConnectionClosedOK()
+			raise ConnectionClosedError()
+		except ConnectionError:
+			raise ConnectionClosedError()
+		(length,) = FRAME_HEADER.unpack(header)
+		if length > setting.SERVER.MAX_MESSAGE_SIZE:
+			raise ConnectionClosedError()
+		try:
+			payload = await self.reader.readexactly(length)
+		except (asyncio.IncompleteReadError, ConnectionError):
+			raise ConnectionClosedError()
+		return payload.decode("utf-8")
+
+	async def send(self, data):
+		if type(data) is str:
+			data = data.encode("utf-8")
+		try:
+			self.writer.write(FRAME_HEADER.pack(len(data)))
+			self.writer.write(data)
+			await self.writer.drain()
+		except ConnectionError:
+			raise ConnectionClosedError()
+
+	# Same frame as send, written in pieces that give other coroutines a chance in between
+	async def sendFragments(self, data, fragmentSize):
+		view = memoryview(data)
+		try:
+			self.writer.write(FRAME_HEADER.pack(len(view)))
+			for start in range(0, len(view), fragmentSize):
+				self.writer.write(view[start:start + fragmentSize])
+				await self.writer.drain()
+				await asyncio.sleep(0)
+		except ConnectionError:
+			raise ConnectionClosedError()
+
+	async def close(self):
+		if not self.writer.is_closing():
+			self.writer.close()
+			try:
+				await self.writer.wait_closed()
+			except ConnectionError:
+				pass
+
+# Returns the coroutine that starts serving handler(connection, path) on the unix domain socket
+def serve(handler):
+	path = socketPath()
+	# Left over by a previous server that has not been shut down properly
+	if os.path.exists(path):
+		os.remove(path)
+	async def accept(reader, writer):
+		connection = LocalConnection(reader, writer)
+		try:
+			await connection.readHeaders()
+		except (ConnectionClosedOK, ConnectionClosedError):
+			await connection.close()
+			return
+		await handler(connection, path)
+	return asyncio.start_unix_server(accept, path=path)
@@ -0,0 +1,120 @@
+#!/usr/bin/env python
+
+"""
+ This file messageCompression.py is part of NeuralVisUAL.
+
+ NeuralVisUAL is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ NeuralVisUAL is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with NeuralVisUAL.  If not, see <https://www.gnu.org/licenses/>.
+"""
+
+# This module compresses packed messages before they are sent to the client.
+# Clients announce the codecs they can decompress in the handshake header CODECS_HEADER,
+# e.g. "lz4, zlib". The server uses the first codec of SERVER.COMPRESSION_CODECS which the
+# client accepts and which is available here. Compressed messages are wrapped in an envelope:
+#	uint8 ENVELOPE_MARKER, uint8 codec id, uint32 uncompressed size (little endian), compressed data
+# ENVELOPE_MARKER is never used by msgpack, so clients can tell envelopes and plain messages apart.
+
+# USED LIBRARIES
+import struct
+import time
+import zlib
+
+import serverSettings as setting
+import beautifulDebug
+import websocketServer as server
+
+# Optional codecs, only offered when the library is installed
+try:
+	import lz4.block
+except ImportError:
+	lz4 = None
+try:
+	import zstandard
+except ImportError:
+	zstandard = None
+
+CODECS_HEADER = "X-NeuralVisUAL-Compression"
+ENVELOPE_MARKER = 0xC1
+CODEC_IDS = {
+	"zlib": 1,
+	"lz4": 2,
+	"zstd": 3,
+}
+
+def isCodecAvailable(codec):
+	if codec == "lz4":
+		return lz4 is not None
+	if codec == "zstd":
+		return zstandard is not None
+	return codec in CODEC_IDS
+
+# Returns the codec to use for the websocket connection, None for uncompressed messages
+def negotiateCodec(websocket):
+	if not setting.SERVER.COMPRESSION_CODECS:
+		return None
+	accepted = [codec.strip().lower() for codec in server.handshakeHeader(websocket, CODECS_HEADER, "").split(",")]
+	for codec in setting.SERVER.COMPRESSION_CODECS:
+		if codec in accepted and isCodecAvailable(codec):
+			return codec
+	return None
+
+def compress(data, codec):
+	if codec == "zlib":
+		return zlib.compress(data, setting.SERVER.COMPRESSION_LEVEL)
+	if codec == "lz4":
+		return lz4.block.compress(data, store_size=False)
+	if codec == "zstd":
+		return zstandard.ZstdCompressor(level=setting.SERVER.COMPRESSION_LEVEL).compress(data)
+	raise ValueError(f"Unknown compression codec {codec}")
+
+# Compression statistics per message type: messageStats[type] = [messages, compressed messages,
+# uncompressed bytes, sent bytes, seconds spent compressing]
+messageStats = {}
+
+def messageType(data):
+	if type(data) in (list, tuple) and len(data) > 0 and type(data[0]) is str:
+		return data[0]
+	return type(data).__name__
+
+# Returns packed wrapped in an envelope if it is larger than SERVER.COMPRESSION_THRESHOLD and
+# the compressed data is actually smaller, otherwise packed as it is
+def envelop(packed, codec, data=None):
+	stats = messageStats.setdefault(messageType(data), [0, 0, 0, 0, 0.0])
+	stats[0] += 1
+	stats[2] += len(packed)
+	if codec is None or len(packed) < setting.SERVER.COMPRESSION_THRESHOLD:
+		stats[3] += len(packed)
+		return packed
+	start = time.perf_counter()
+	compressed = compress(packed, codec)
+	stats[4] += time.perf_counter() - start
+	if len(compressed) + 6 >= len(packed):
+		stats[3] += len(packed)
+		return packed
+	stats[1] += 1
+	stats[3] += len(compressed) + 6
+	return struct.pack("<BBI", ENVELOPE_MARKER, CODEC_IDS[codec], len(packed)) + compressed
+
+# Readable summary of messageStats, one line per message type
+def statsToText():
+	if not messageStats:
+		return "No messages have been sent yet."
+	lines = {}
+	for name, (count, compressedCount, rawBytes, sentBytes, seconds) in sorted(messageStats.items()):
+		ratio = rawBytes / sentBytes if sentBytes > 0 else 1
+		lines[name] = f"{count} messages, {compressedCount} compressed, {rawBytes} -> {sentBytes} bytes " + \
+			f"(ratio {ratio:.2f}), {seconds * 1000:.2f} ms compressing ({seconds * 1e6 / count:.0f} µs per message)"
+	return beautifulDebug.mapToText(lines)
+
+def resetStats():
+	messageStats.clear()
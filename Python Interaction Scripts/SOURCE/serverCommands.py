@@ -42,6 +42,8 @@ from types import SimpleNamespace
 import ast
 import random
 import types
+import hashlib
+import collections
 
 # LOCAL IMPORTS
 import beautifulDebug
@@ -54,6 +56,9 @@ import loggingFunctions
 import debugAndTesting
 import visualizationSettings as design
 import fileHandling
+import tensorEncoding
+import messageCompression
+import sharedMemory
 
 def onModuleReload(): Request(None, None) # initialize command list
 
@@ -71,6 +76,20 @@ preparedCommands = []
 
 # Other definitions / initializations
 clientVersionVerifiedAndConnected = False
+# Files sent from disk during this server session: sentFiles[filename] = (path, sha1 of the content)
+sentFiles = {}
+# Files each client has received: clientFiles[client id] = {filename: sha1 of the content}.
+# Clients announce their id in the handshake header CLIENT_ID_HEADER, connections without one only
+# get references to files sent on the same connection
+CLIENT_ID_HEADER = "X-NeuralVisUAL-Client"
+# Sent by clients which apply identities of cuboids, "SCENE REDRAW" and "SPAWN CONNECTIONS" natively,
+# see nativeScene in visualizationFunctions.py
+NATIVE_SCENE_HEADER = "X-NeuralVisUAL-Native-Scene"
+MAX_CLIENTS_WITH_FILES = 64
+clientFiles = collections.OrderedDict()
+# Last frame sent of each tensor stream: tensorStreams[name] = dict(frame, header, values, encoding, sinceKeyframe)
+tensorStreams = {}
+tensorFrameCounter = 0
 
 
 # The request class is instantiated by every new client command from websocketServer.py
@@ -79,6 +98,33 @@ class Request:
 	def __init__(self, websocketref, commandref):
 		self.websocket = websocketref
 		self.command = commandref
+		# Codec the client accepted in its handshake, None if messages are sent uncompressed
+		self.compressionCodec = messageCompression.negotiateCodec(websocketref)
+		# Whether bulk payloads may be passed through shared memory, see sharedMemory.py
+		self.sharedMemory = sharedMemory.isAccepted(websocketref)
+		# Files the client has received, which may be sent as FILE REF
+		clientId = server.handshakeHeader(websocketref, CLIENT_ID_HEADER)
+		# Only clients announcing an id know "MODEL EPOCH", see sendModelEpoch
+		self.knowsModelEpoch = bool(clientId)
+		if clientId:
+			self.receivedFiles = clientFiles.setdefault(clientId, {})
+			clientFiles.move_to_end(clientId)
+			while len(clientFiles) > MAX_CLIENTS_WITH_FILES:
+				clientFiles.popitem(last=False)
+		else:
+			self.receivedFiles = {}
+		# Whether the client applies scene instructions natively, other clients get the legacy instructions
+		self.nativeScene = server.handshakeHeader(websocketref, NATIVE_SCENE_HEADER, "") == "1"
+		# Priority class the client assigned to the command, bulk responses are sent in fragments
+		self.priority = str(server.handshakeHeader(websocketref, server.PRIORITY_HEADER, "normal")).lower()
+		self.fragmentSize = setting.SERVER.BULK_FRAGMENT_SIZE
+		try:
+			# The client suggests what its link transfers within one round trip
+			suggested = int(server.handshakeHeader(websocketref, server.FRAGMENT_SIZE_HEADER, 0))
+			if suggested > 0:
+				self.fragmentSize = min(max(suggested, 2**14), 2**22)
+		except ValueError:
+			pass
 		
 		# Initializing the command list if that hasn't happened yet:
 		global commandList
@@ -222,7 +268,12 @@ class Request:
 					await self.senddebug(-9, beautifulDebug.removeAnsiEscapeCharacters(str(printText)))
 				else:
 					await self.senddebug(-9, beautifulDebug.removeAnsiEscapeCharacters(str(data)))
-			await self.websocket.send(packed) # actually send it via websocket
+			# compress large messages if the client supports it and actually send it via websocket
+			if self.priority == "bulk" and len(packed) >= self.fragmentSize:
+				await self.sendBulk(await asyncio.get_event_loop().run_in_executor(None,
+					messageCompression.envelop, packed, self.compressionCodec, data))
+			else:
+				await self.websocket.send(messageCompression.envelop(packed, self.compressionCodec, data))
 			if printText not in (None, False, ""):
 				# and print it in the console and debug
 				loggingFunctions.printlog("> " + str(printText), -3)
@@ -236,14 +287,97 @@ class Request:
 				f"you were trying to send: {str(data)[0:min(256, setting.SERVER.MAX_MESSAGE_SIZE-246)]}...")
 			return False
 	
+	# Sends ("TENSOR", name, ext) with the array packed as msgpack extension type, see tensorEncoding.py
+	# encoding is float32, float16 or int8, None uses the SERVER.TENSOR_ENCODING setting
+	async def sendtensor(self, name, array, encoding=None):
+		if encoding in (None, "", "default"):
+			encoding = setting.SERVER.TENSOR_ENCODING
+		if not tensorEncoding.isValidEncoding(encoding):
+			await self.sendstatus(12, f"Unknown tensor encoding {encoding}, " +
+				f"available are {', '.join(tensorEncoding.ENCODINGS)}.")
+			return False
+		array = np.asarray(array)
+		ext = tensorEncoding.encodeTensor(array, encoding)
+		msg = beautifulDebug.B_GREEN + f"Sent tensor {name} {tuple(array.shape)} as {encoding.lower()} "
+		msg += beautifulDebug.special(0, 2, 0) + f"({fileHandling.formatFilesize(ext.data)})" + beautifulDebug.RESET
+		return await self.send(("TENSOR", name, self.bulk(ext)), printText=msg)
+
+	# Sends ("TENSOR FRAME", name, ext) as the next frame of the tensor stream name, see tensorEncoding.py
+	# baseFrame is the last frame the client has of this stream. If it is the last frame sent, only the
+	# values which changed since then are sent, otherwise and every TENSOR_KEYFRAME_INTERVAL frames a keyframe
+	async def sendtensorframe(self, name, array, encoding=None, baseFrame=0):
+		global tensorFrameCounter
+		if encoding in (None, "", "default"):
+			encoding = setting.SERVER.TENSOR_ENCODING
+		if not tensorEncoding.isValidEncoding(encoding):
+			await self.sendstatus(12, f"Unknown tensor encoding {encoding}, " +
+				f"available are {', '.join(tensorEncoding.ENCODINGS)}.")
+			return False
+		encoding = encoding.lower()
+		array = np.asarray(array)
+		stream = tensorStreams.get(name)
+		if stream is not None and (stream["frame"] != baseFrame or stream["encoding"] != encoding or
+			stream["sinceKeyframe"] + 1 >= setting.SERVER.TENSOR_KEYFRAME_INTERVAL):
+			stream = None
+		header, values = tensorEncoding.encodeTensorParts(array, encoding, stream["header"] if stream else None)
+		keyframe = True
+		body = values
+		if stream is not None and len(stream["values"]) == len(values) and \
+			stream["header"][:4 + 4 * array.ndim] == header[:4 + 4 * array.ndim]:
+			delta = tensorEncoding.encodeDeltaRuns(stream["values"], values, encoding)
+			# Completely changed frames are cheaper as keyframe
+			if len(delta) < len(values):
+				keyframe = False
+				body = delta
+		tensorFrameCounter += 1
+		ext = tensorEncoding.encodeTensorFrame(tensorFrameCounter, baseFrame, header, body, keyframe)
+		tensorStreams[name] = dict(frame=tensorFrameCounter, header=header, values=values, encoding=encoding,
+			sinceKeyframe=0 if keyframe else stream["sinceKeyframe"] + 1)
+		msg = beautifulDebug.B_GREEN + f"Sent tensor {name} {tuple(array.shape)} as {encoding} "
+		msg += "keyframe " if keyframe else f"delta to frame {baseFrame} "
+		msg += beautifulDebug.special(0, 2, 0) + f"({fileHandling.formatFilesize(ext.data)})" + beautifulDebug.RESET
+		return await self.send(("TENSOR FRAME", name, self.bulk(ext)), printText=msg)
+
+	# Sends a message in fragments, yielding to other coroutines after each one
+	async def sendBulk(self, message):
+		size = self.fragmentSize
+		if getattr(self.websocket, "isLocal", False):
+			return await self.websocket.sendFragments(message, size)
+		async def fragments():
+			view = memoryview(message)
+			for start in range(0, len(view), size):
+				yield view[start:start + size]
+				await asyncio.sleep(0)
+		await self.websocket.send(fragments())
+
+	# Returns the descriptor of payload in shared memory if the client accepts it and there is space,
+	# payload itself otherwise. payload is either bytes or a msgpack.ExtType
+	def bulk(self, payload):
+		if not self.sharedMemory:
+			return payload
+		if type(payload) is msgpack.ExtType:
+			descriptor = sharedMemory.place(payload.data, payload.code)
+		else:
+			descriptor = sharedMemory.place(payload)
+		return payload if descriptor is None else descriptor
+
+	# Tells the client the current model epoch, so that it can invalidate its cached responses
+	async def sendModelEpoch(self):
+		if not self.knowsModelEpoch:
+			return
+		return await self.send(("MODEL EPOCH", ai.modelEpoch()), printText=False)
+
 	# Sends the file specified by path over binary data via msgpack to the websocket client
 	# Optionally sends the already specified data and path is only used as the filename
+	# If the same content has been sent to this client before, only ("FILE REF", filename, sha1) is sent,
+	# clients take it from their texture cache or request it again with "get file"
 	# File cannot be larger than MAX_MESSAGE_SIZE
 	# TODO: chop up large files and send them in chunks to the client
-	async def sendfile(self, path, data = None, sendAlsoAsDebugMsg = True):
+	async def sendfile(self, path, data = None, sendAlsoAsDebugMsg = True, allowReference = True):
 		assert type(path) is str
+		readFromPath = data is None
 		try:
-			if data is None:
+			if readFromPath:
 				# Try to retrieve data from path
 				file = open(path, "rb")
 				data = file.read()
@@ -259,10 +393,22 @@ class Request:
 
 		assert type(data) is bytes
 		filesize = fileHandling.formatFilesize(data)
+		fullPath = path
 		# get the filename itself
 		path, filename = fileHandling.separateFilename(path)
+		contentHash = hashlib.sha1(data).hexdigest()
+		if allowReference and setting.SERVER.SEND_FILE_REFERENCES and self.receivedFiles.get(filename) == contentHash:
+			msg = beautifulDebug.B_GREEN + "Referenced file "
+			msg += beautifulDebug.special(0, 2, 0) + path + os.path.sep
+			msg += beautifulDebug.B_GREEN + filename
+			msg += beautifulDebug.special(0, 2, 0) + f" ({filesize} not sent again)"
+			msg += beautifulDebug.RESET
+			return await self.send(("FILE REF", filename, contentHash), printText=msg, sendAlsoAsDebugMsg=sendAlsoAsDebugMsg)
+		if readFromPath:
+			sentFiles[filename] = (fullPath, contentHash)
+		self.receivedFiles[filename] = contentHash
 		# Structure of a sent file tuple:
-		struct = ("FILE", filename, data)
+		struct = ("FILE", filename, self.bulk(data))
 		# Some formatting fun
 		#filename = beautifulDebug.underline(filename)
 		msg = beautifulDebug.B_GREEN + "Sent file "
@@ -1014,6 +1160,20 @@ class Request:
 	commandList["server cache info"] = (infoFilecache, "Gives information about the files in the servers filecache",
 		"Will print out available information about the files stored in the servers filecache.")
 	commandList["server filecache info"] = commandAlias("server cache info")
+
+	async def compressionStats(self, **kwargs):
+		if not await self.checkParams(0, 1): return False
+		reset = await self.getParam(1, False)
+		codec = self.compressionCodec if self.compressionCodec is not None else "none"
+		await self.sendstatus(-30, f"Compression codec of this connection: {codec}, threshold " +
+			f"{setting.SERVER.COMPRESSION_THRESHOLD} bytes. Sent messages by type:\n" + messageCompression.statsToText())
+		if reset:
+			messageCompression.resetStats()
+	commandList["server compression stats"] = (compressionStats,
+		"Shows the compression ratio and time per message type",
+		"$[reset=False]$ Lists how many messages of each type have been sent and compressed during this session, " +
+		"their size before and after compression and the time spent compressing them. " +
+		"If reset is positive, the statistics are reset afterwards")
 	
 	async def deleteFilecache(self, **kwargs):
 		if await self.checkParams(warnUser=False): # specific folder
@@ -1088,6 +1248,19 @@ class Request:
 		'preferred\nResponds with a struct of type ["FILE", filename, binarydata]')
 
 
+	async def getfile(self, **kwargs):
+		filename = await self.getParam(1, "")
+		if filename not in sentFiles:
+			await self.sendstatus(14, f"File {filename} has not been sent before!")
+			return False
+		result = await self.sendfile(sentFiles[filename][0], allowReference=False)
+		if result is False:
+			return False
+	commandList["get file"] = (getfile, "Transmits a file which has been sent before again",
+		"§[filename]§ used by clients when a file referenced by a FILE REF struct is missing " +
+		'in their cache\nResponds with a struct of type ["FILE", filename, binarydata]')
+
+
 	async def sendstruct(self, **kwargs):
 		struct = (1, 'text', 5.234, (1, 'more', 3, ()), ('b', 'a', 'c'), None, {"hi": 1, "there": 2})
 		if await self.checkParams(warnUser=False):
@@ -1560,7 +1733,7 @@ class Request:
 		await self.checkParams(0)
 		ai.tfresetstructure()
 		await self.sendstatus(-30, f"Saved structure information of the loaded tf network has been reset.")
-	commandList["tf reset structure"] = (tf_getstructure, "Resets the stored tensorflow network structure",
+	commandList["tf reset structure"] = (tf_resetstructure, "Resets the stored tensorflow network structure",
 		'Takes no parameters. Just resets the stored structure information of tfnet.')
 
 
@@ -1618,15 +1791,60 @@ class Request:
 	commandList["tf get trainable variables"] = commandAlias("tf get train vars")
 
 
+	async def tf_getkerneltensor(self, **kwargs):
+		if not await self.assertTf(): return False
+		if not await self.checkParams(1, 2): return False
+		layerIndex = await self.getParam(1, 0)
+		encoding = await self.getParam(2, "default", warnOnEmptyString=False)
+		if not hasattr(ai.tfnet, "validstructure") or ai.tfnet.validstructure == False:
+			if await self.tf_getstructure(False, False) == False:
+				return False
+		if type(ai.tfnet.layers[layerIndex][5]) is not dict:
+			ai.tfRefreshTrainableVars()
+		trainableVars = ai.tfnet.layers[layerIndex][5]
+		if not 'kernel' in trainableVars or len(trainableVars['kernel']) == 0:
+			await self.sendstatus(16, f"Layer {layerIndex} does not have any kernels!")
+			return False
+		return await self.sendtensor(f"kernel {layerIndex}", trainableVars['kernel'][0], encoding)
+	commandList["tf get kernel"] = (tf_getkerneltensor, "Sends the kernel weights of a layer as tensor",
+		'§[int:layer] [encoding=default]§ encoding is float32, float16 or int8 with a scale and offset per ' +
+		'output channel, default uses the TENSOR_ENCODING server setting\n' +
+		'Responds with a struct of type ["TENSOR", name, tensor], see tensorEncoding.py')
+
+	async def tf_getactivationtensor(self, **kwargs):
+		if not await self.assertTf(): return False
+		if not await self.checkParams(1, 4): return False
+		layerIndex = await self.getParam(1, 0)
+		input = await self.getParam(2, setting.DEBUG.DEFAULT_INPUT_IMAGE, warnOnEmptyString=False)
+		if input == "default":
+			input = setting.DEBUG.DEFAULT_INPUT_IMAGE
+		encoding = await self.getParam(3, "default", warnOnEmptyString=False)
+		baseFrame = await self.getParam(4, -1)
+		out = np.asarray(ai.tfKerasGetLayerOutput(layerIndex, input))
+		while len(out.shape) > 1 and out.shape[0] == 1:
+			out = np.reshape(out, out.shape[1:])
+		if type(baseFrame) is int and baseFrame >= 0:
+			return await self.sendtensorframe(f"activations {layerIndex}", out, encoding, baseFrame)
+		return await self.sendtensor(f"activations {layerIndex}", out, encoding)
+	commandList["tf get activations"] = (tf_getactivationtensor, "Sends the activations of a layer as tensor",
+		'§[int:layer] [input=default] [encoding=default] [int:frame=-1]§ encoding is float32, float16 or int8 ' +
+		'with a scale and offset per channel, default uses the TENSOR_ENCODING server setting\n' +
+		'Responds with a struct of type ["TENSOR", name, tensor], see tensorEncoding.py\n' +
+		'If frame is 0 or larger, the activations are sent as the next frame of a stream instead, ' +
+		'frame being the last one the client received (0 for none). Only the changes to that frame are sent ' +
+		'as struct of type ["TENSOR FRAME", name, frame]')
+
+
 	async def tf_drawkernel(self, **kwargs):
 		if not await self.assertTf(): return False
-		if not await self.checkParams(0, 2): return False
+		if not await self.checkParams(0, 3): return False
 		precacheAll = (await self.getParam(warnOnEmptyString=False)).lower() == "all"
 		if precacheAll:
 			index = -1
 		else:
 			index = await self.getParam(1, -1, warnOnEmptyString=False)
 			refresh = await self.getParam(2, False, warnOnEmptyString=False)
+			maxResolution = await self.getParam(3, 0, warnOnEmptyString=False)
 		if index == -1: # just printing out all kernel shapes without drawing anything
 			await self.sendstatus(-10, f"Refreshing trainable variables of the network...")
 			shapeDict = await self.tf_refreshtrainablevars(returnShapeDict=True)
@@ -1657,7 +1875,7 @@ class Request:
 			'Use "tf draw structure" to render the network itself before any kernels can be visualized.')
 			return False
 		try:
-			await vis.drawKernels(self, index, canUseCachedFile=not refresh)
+			await vis.drawKernels(self, index, canUseCachedFile=not refresh, maxResolution=maxResolution)
 		except asyncio.CancelledError:
 			raise asyncio.CancelledError
 		except:
@@ -1670,6 +1888,8 @@ class Request:
 		'network layer with that index to display it in the game engine.\n' +
 		'§[int:index] [refresh=False]§ If refresh is true or no kernel data can be found, ' +
 		'data of trainable variables will be refreshed first and kernel will be recalculated.\n' +
+		'§[int:index] [refresh] [int:resolution]§ limits the texture to this resolution, 0 uses ' +
+		'the visualization settings. Used by clients to stream lower levels of detail for far layers.\n' +
 		"§all§ will recalculate and cache all kernel textures that have not been cached yet without drawing")
 	commandList["tf draw kernels"] = commandAlias("tf draw kernel")
 
@@ -1679,9 +1899,13 @@ class Request:
 		if selection == -1:
 			selection = None
 		input = await self.getParam(3, setting.DEBUG.DEFAULT_INPUT_IMAGE)
-		await vis.drawKernelActivations(self, layerIndex, selection, input)
+		if input == "default":
+			input = setting.DEBUG.DEFAULT_INPUT_IMAGE
+		maxResolution = await self.getParam(4, 0, warnOnEmptyString=False)
+		await vis.drawKernelActivations(self, layerIndex, selection, input, maxResolution=maxResolution)
 	commandList["tf draw activations"] = (tf_drawkernelactivations, "Draws the activations of a certain kernel",
-		'TODO')
+		'§[int:layer] [int:kernel] [input] [int:resolution]§ input "default" uses the default input image, ' +
+		'resolution limits the texture size, 0 keeps the full resolution')
 
 	async def tf_drawinputprediction(self, **kwargs):
 		input = await self.getParam(1, setting.DEBUG.DEFAULT_INPUT_IMAGE)
@@ -46,14 +46,57 @@ class DEBUG:
 
 class SERVER:
 	# WEBSOCKET SERVER ADDRESS
+	# Can be overridden with --ip and --port, to run several servers that the client spreads commands across
 	IP = "localhost"
 	PORT = 80
 
+	# Additionally listens on a unix domain socket for clients on the same machine, which skips
+	# TCP and the websocket handshake. Clients select it with the LocalSocket transport setting.
+	# Requires an asyncio event loop supporting unix sockets, which excludes the default loop on Windows
+	LOCAL_SOCKET = True
+	# None uses NeuralVisUAL.sock in the temp directory, like the client does by default
+	LOCAL_SOCKET_PATH = None
+
+	# Files and tensors of at least SHARED_MEMORY_THRESHOLD bytes are passed to clients on the same machine
+	# through a ring buffer in a memory mapped file, the message only describes where to find them.
+	# Clients have to map the same file. Payloads are sent within the message if the ring is full.
+	# Regions the client has not released after SHARED_MEMORY_TIMEOUT seconds are reused anyway
+	SHARED_MEMORY = True
+	# None uses NeuralVisUAL.shm in the temp directory, like the client does by default
+	SHARED_MEMORY_PATH = None
+	SHARED_MEMORY_SIZE = 256 * 2**20
+	SHARED_MEMORY_THRESHOLD = 64 * 2**10
+	SHARED_MEMORY_TIMEOUT = 300
+
 	# OTHER WEBSOCKET SERVER SETTINGS
 	MAX_MESSAGE_SIZE = 2**24 # in bytes. should not be larger than 2**24 without changing msgpack specs
 	TIMES_TO_RETRY_ESTABLISHING_SERVER = 10 # needs to be at least 1, otherwise the server won't run
 	SECONDS_BETWEEN_TRIES = 1 # should be at least 1
 	TIMES_TO_RETRY_STOPPING_COROUTINES = 40
+	# Sends ("MODEL EPOCH", epoch) after each command. The epoch changes whenever a network is loaded
+	# or its structure is reset, clients use it to invalidate their cached responses.
+	# Only sent to clients announcing an id in their handshake, older clients do not know the message
+	SEND_MODEL_EPOCH = True
+	# Sends ("FILE REF", filename, sha1) instead of files which have already been sent to the same client
+	# with the same content during this session. Clients then use their texture cache instead of receiving it again
+	SEND_FILE_REFERENCES = True
+	# Encoding of tensors sent with "tf get kernel" or "tf get activations" unless the command specifies one:
+	# "float32", "float16" or "int8" (quantized with a scale and offset per channel)
+	TENSOR_ENCODING = "float16"
+	# Tensor streams ("tf get activations" with a frame) send a complete keyframe at least every this many
+	# frames, all frames in between only contain the values that changed since the previous one
+	TENSOR_KEYFRAME_INTERVAL = 30
+	# Messages of at least COMPRESSION_THRESHOLD bytes are compressed with the first of these codecs which the
+	# client accepts: "lz4" (requires the lz4 package), "zstd" (requires zstandard) or "zlib".
+	# An empty list disables compression. Only the compressed message is sent if it is actually smaller
+	COMPRESSION_CODECS = ["lz4", "zstd", "zlib"]
+	COMPRESSION_THRESHOLD = 4096
+	# Level of zlib (1-9) and zstd (1-22), lz4 always uses its fast mode
+	COMPRESSION_LEVEL = 1
+	# Responses to commands the client sends with bulk priority are compressed in a worker thread and sent
+	# in fragments of this many bytes, so that interactive commands of other connections get their turn in between.
+	# Clients that measured their link suggest a fragment size in the handshake, which is used instead
+	BULK_FRAGMENT_SIZE = 256 * 2**10
 
 class FILEPATHS:
 	# Available neural networks that can be loaded via keywords
@@ -160,6 +203,13 @@ class FORMAT_OUTPUT:
 FILEPATHS.OUTPUT_IMAGES = file.createFilepath(file.ensureFolderEnding(file.addServerScriptPath(FILEPATHS.OUTPUT_IMAGES)))
 FILEPATHS.FILECACHE = file.createFilepath(file.ensureFolderEnding(file.addServerScriptPath(FILEPATHS.FILECACHE)))
 
+# Default file names of the local socket and the shared memory ring, which get the port unless it is 80
+# so that several servers can run on the same machine. Matches the defaults of the client
+def portSpecificName(name, extension):
+	if SERVER.PORT == 80:
+		return name + extension
+	return name + "-" + str(SERVER.PORT) + extension
+
 # this gets called manually after all modules are loaded or whenever serverSettings are reloaded
 # WarningFunction is of type warn(string: message, int: verbosityLevel)
 def checkSettings():
@@ -0,0 +1,170 @@
+#!/usr/bin/env python
+
+"""
+ This file sharedMemory.py is part of NeuralVisUAL.
+
+ NeuralVisUAL is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ NeuralVisUAL is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with NeuralVisUAL.  If not, see <https://www.gnu.org/licenses/>.
+"""
+
+# This module passes bulk payloads (files, tensors) to clients on the same machine through a ring
+# buffer in a memory mapped file instead of the connection. The file starts with a header of
+# DATA_OFFSET bytes, only containing the magic NVSHM001 so far.
+# The message only carries a descriptor, msgpack extension type DESCRIPTOR_EXT_TYPE, all values little endian:
+#	uint8 version, uint8 inner type, uint16 reserved, uint32 generation,
+#	uint64 offset, uint64 length, uint64 size of the file
+# inner type is 0 for binary data and the extension type of the payload otherwise.
+# Every payload in the ring is preceded by a region header:
+#	uint32 generation, uint32 released, uint64 length
+# The client sets released to 1 once it no longer uses the payload. Regions are reclaimed in the
+# order they were written, so a region that is still in use blocks the ones after it. When the
+# ring is full, payloads are sent within the message as usual.
+
+# USED LIBRARIES
+import collections
+import mmap
+import os
+import random
+import struct
+import tempfile
+import time
+import traceback
+import msgpack
+
+import serverSettings as setting
+import beautifulDebug
+import loggingFunctions
+import websocketServer as server
+
+DESCRIPTOR_EXT_TYPE = 2
+DESCRIPTOR_VERSION = 1
+SHARED_MEMORY_HEADER = "X-NeuralVisUAL-Shared-Memory"
+DATA_OFFSET = 64
+REGION_HEADER = struct.Struct("<IIQ")
+ALIGNMENT = 64
+
+def sharedMemoryPath():
+	if setting.SERVER.SHARED_MEMORY_PATH:
+		return setting.SERVER.SHARED_MEMORY_PATH
+	return os.path.join(tempfile.gettempdir(), setting.portSpecificName("NeuralVisUAL", ".shm"))
+
+def normalizePath(path):
+	return os.path.normcase(os.path.realpath(path))
+
+class SharedMemoryRing:
+	def __init__(self, path, size):
+		# Reused rather than recreated, clients may still have the file of a previous session mapped
+		open(path, "ab").close()
+		self.file = open(path, "r+b")
+		self.file.truncate(size)
+		self.memory = mmap.mmap(self.file.fileno(), size)
+		self.size = size
+		self.capacity = size - DATA_OFFSET
+		self.buffer = self.memory
+		self.buffer[:8] = b"NVSHM001"
+		self.head = 0
+		# Written regions in order: (offset, total size, generation, time written)
+		self.regions = collections.deque()
+		# Random start, so that descriptors of a previous server session never match
+		self.generation = random.getrandbits(31)
+
+	def isReleased(self, region):
+		offset, _, generation, written = region
+		start = DATA_OFFSET + offset
+		regionGeneration, released, _ = REGION_HEADER.unpack_from(self.buffer, start)
+		if regionGeneration != generation or released != 0:
+			return True
+		# Clients that disconnected without releasing must not block the ring forever
+		return time.monotonic() - written > setting.SERVER.SHARED_MEMORY_TIMEOUT
+
+	def reclaim(self):
+		while self.regions and self.isReleased(self.regions[0]):
+			self.regions.popleft()
+		if not self.regions:
+			self.head = 0
+
+	# Returns the offset of total free bytes, None if the ring is too full
+	def allocate(self, total):
+		self.reclaim()
+		if not self.regions:
+			return 0 if total <= self.capacity else None
+		tail = self.regions[0][0]
+		if self.head >= tail:
+			if self.head + total <= self.capacity:
+				return self.head
+			# Wraps around, strictly below the tail so that a full ring is not mistaken for an empty one
+			return 0 if total < tail else None
+		return self.head if self.head + total < tail else None
+
+	# Returns msgpack.ExtType(DESCRIPTOR_EXT_TYPE, descriptor) for payload, None if there is no space
+	def write(self, payload, innerType):
+		total = -(-(REGION_HEADER.size + len(payload)) // ALIGNMENT) * ALIGNMENT
+		offset = self.allocate(total)
+		if offset is None:
+			return None
+		self.generation = (self.generation + 1) & 0xFFFFFFFF
+		start = DATA_OFFSET + offset
+		REGION_HEADER.pack_into(self.buffer, start, self.generation, 0, len(payload))
+		self.buffer[start + REGION_HEADER.size:start + REGION_HEADER.size + len(payload)] = payload
+		self.regions.append((offset, total, self.generation, time.monotonic()))
+		self.head = offset + total
+		descriptor = struct.pack("<BBHIQQQ", DESCRIPTOR_VERSION, innerType, 0, self.generation,
+			start + REGION_HEADER.size, len(payload), self.size)
+		return msgpack.ExtType(DESCRIPTOR_EXT_TYPE, descriptor)
+
+	def usage(self):
+		self.reclaim()
+		return sum(region[1] for region in self.regions)
+
+	def close(self):
+		self.buffer = None
+		self.memory.close()
+		self.file.close()
+
+ring = None
+# Set when the shared memory could not be created, payloads are then always sent within the message
+ringFailed = False
+
+def isSupported():
+	return not ringFailed
+
+def getRing():
+	global ring, ringFailed
+	if ring is None and setting.SERVER.SHARED_MEMORY and isSupported():
+		try:
+			ring = SharedMemoryRing(sharedMemoryPath(), setting.SERVER.SHARED_MEMORY_SIZE)
+		except OSError:
+			ringFailed = True
+			loggingFunctions.printlog(beautifulDebug.special(5, 3, 0) + "Cannot map shared memory file " +
+				f"{sharedMemoryPath()}, payloads are sent within the messages instead.\n" +
+				traceback.format_exc() + beautifulDebug.RESET, verbosity = 15)
+	return ring
+
+# Clients on the same machine map the shared memory. They announce the file they map in their
+# handshake, local socket clients in their header frame. Payloads are sent inline to all others
+def isAccepted(websocket):
+	if not setting.SERVER.SHARED_MEMORY or not isSupported():
+		return False
+	mappedPath = server.handshakeHeader(websocket, SHARED_MEMORY_HEADER)
+	if not mappedPath:
+		return False
+	return normalizePath(mappedPath) == normalizePath(sharedMemoryPath())
+
+# Returns the descriptor of payload in shared memory, or None if it should be sent within the message
+def place(payload, innerType=0):
+	if len(payload) < setting.SERVER.SHARED_MEMORY_THRESHOLD:
+		return None
+	ring = getRing()
+	if ring is None:
+		return None
+	return ring.write(payload, innerType)
@@ -0,0 +1,139 @@
+#!/usr/bin/env python
+
+"""
+ This file tensorEncoding.py is part of NeuralVisUAL.
+
+ NeuralVisUAL is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ NeuralVisUAL is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with NeuralVisUAL.  If not, see <https://www.gnu.org/licenses/>.
+"""
+
+# This module packs tensors into msgpack extension types, optionally with reduced precision.
+# Payload of the extension type TENSOR_EXT_TYPE, all values little endian:
+#	uint8 version, uint8 encoding, uint8 rank, uint8 reserved
+#	uint32 shape[rank]
+#	for int8 only: float32 scale[channels], float32 offset[channels]
+#	values in C order: float32, float16 or uint8 with value = quantized * scale + offset
+# channels is the size of the last axis, which is the channel axis of tensorflow tensors
+#
+# Successive frames of a tensor stream use the extension type TENSOR_FRAME_EXT_TYPE:
+#	uint8 version, uint8 flags (1 = keyframe), uint16 reserved, uint32 frame, uint32 base frame
+#	tensor header as above, including scale and offset for int8
+#	keyframes: the values as above
+#	deltas: uint32 run count, then per run uint32 skipped elements, uint32 element count and the
+#	elements XORed with the ones of the base frame. Skipped elements are unchanged.
+
+# USED LIBRARIES
+import struct
+import msgpack
+import numpy as np
+
+TENSOR_EXT_TYPE = 1
+TENSOR_FRAME_EXT_TYPE = 3
+TENSOR_FORMAT_VERSION = 1
+ENCODINGS = {
+	"float32": 0,
+	"float16": 1,
+	"int8": 2,
+}
+
+def isValidEncoding(encoding):
+	return str(encoding).lower() in ENCODINGS
+
+ELEMENT_TYPES = {
+	"float32": np.dtype("<u4"),
+	"float16": np.dtype("<u2"),
+	"int8": np.dtype(np.uint8),
+}
+FRAME_FLAG_KEYFRAME = 1
+
+# Returns the tensor header (including scale and offset for int8) and the encoded values separately
+# For int8, the scale and offset of previousHeader are kept if all values are still within its range,
+# so that successive frames of a stream only differ where the values changed
+def encodeTensorParts(array, encoding="float32", previousHeader=None):
+	encoding = str(encoding).lower()
+	if encoding not in ENCODINGS:
+		raise ValueError(f"Unknown tensor encoding {encoding}, available are {', '.join(ENCODINGS)}")
+	array = np.ascontiguousarray(array, dtype=np.float32)
+	header = struct.pack("<BBBB", TENSOR_FORMAT_VERSION, ENCODINGS[encoding], array.ndim, 0)
+	header += struct.pack(f"<{array.ndim}I", *array.shape)
+	if encoding == "float32":
+		values = array.astype("<f4").tobytes()
+	elif encoding == "float16":
+		values = array.astype("<f2").tobytes()
+	else:
+		# Affine quantization per channel, so that channels of different magnitude keep their precision
+		channels = array.reshape(-1, array.shape[-1] if array.ndim > 0 else 1)
+		low = channels.min(axis=0) if channels.size else np.zeros(channels.shape[1], np.float32)
+		high = channels.max(axis=0) if channels.size else low
+		scale = (high - low) / 255
+		scale[scale == 0] = 1
+		if previousHeader is not None and previousHeader[:len(header)] == header and \
+			len(previousHeader) == len(header) + 8 * channels.shape[1]:
+			previousScale = np.frombuffer(previousHeader, "<f4", channels.shape[1], len(header))
+			previousLow = np.frombuffer(previousHeader, "<f4", channels.shape[1], len(header) + 4 * channels.shape[1])
+			# Half a step of tolerance, the values are rounded to the nearest step anyway
+			if np.all((low - previousLow) / previousScale >= -0.5) and \
+				np.all((high - previousLow) / previousScale <= 255.5):
+				scale, low = previousScale, previousLow
+		quantized = np.clip(np.rint((channels - low) / scale), 0, 255).astype(np.uint8)
+		header += scale.astype("<f4").tobytes() + low.astype("<f4").tobytes()
+		values = quantized.tobytes()
+	return header, values
+
+# Returns msgpack.ExtType(TENSOR_EXT_TYPE, payload) of the array in the given encoding
+def encodeTensor(array, encoding="float32"):
+	header, values = encodeTensorParts(array, encoding)
+	return msgpack.ExtType(TENSOR_EXT_TYPE, header + values)
+
+# Encodes which elements changed between two frames of encoded values as XOR runs.
+# Unchanged gaps shorter than a run header are merged into the surrounding runs
+def encodeDeltaRuns(previousValues, values, encoding):
+	elementType = ELEMENT_TYPES[str(encoding).lower()]
+	difference = np.frombuffer(values, elementType) ^ np.frombuffer(previousValues, elementType)
+	changed = np.flatnonzero(difference)
+	if len(changed) == 0:
+		return struct.pack("<I", 0)
+	mergeGap = max(1, 8 // elementType.itemsize)
+	breaks = np.flatnonzero(np.diff(changed) > mergeGap)
+	starts = np.concatenate(([changed[0]], changed[breaks + 1]))
+	ends = np.concatenate((changed[breaks], [changed[-1]])) + 1
+	parts = [struct.pack("<I", len(starts))]
+	position = 0
+	for start, end in zip(starts, ends):
+		parts.append(struct.pack("<II", start - position, end - start))
+		parts.append(difference[start:end].tobytes())
+		position = end
+	return b"".join(parts)
+
+# Returns msgpack.ExtType(TENSOR_FRAME_EXT_TYPE, payload), body are the values for keyframes
+# and the result of encodeDeltaRuns otherwise
+def encodeTensorFrame(frame, baseFrame, header, body, keyframe):
+	frameHeader = struct.pack("<BBHII", TENSOR_FORMAT_VERSION, FRAME_FLAG_KEYFRAME if keyframe else 0, 0,
+		frame, 0 if keyframe else baseFrame)
+	return msgpack.ExtType(TENSOR_FRAME_EXT_TYPE, frameHeader + header + body)
+
+# Inverse of encodeTensor, mainly for testing
+def decodeTensor(data):
+	version, encoding, rank, _ = struct.unpack_from("<BBBB", data, 0)
+	assert version == TENSOR_FORMAT_VERSION
+	shape = struct.unpack_from(f"<{rank}I", data, 4)
+	offset = 4 + 4 * rank
+	if encoding == ENCODINGS["float32"]:
+		return np.frombuffer(data, "<f4", offset=offset).reshape(shape)
+	if encoding == ENCODINGS["float16"]:
+		return np.frombuffer(data, "<f2", offset=offset).astype(np.float32).reshape(shape)
+	channels = shape[-1] if rank > 0 else 1
+	scale = np.frombuffer(data, "<f4", channels, offset)
+	low = np.frombuffer(data, "<f4", channels, offset + 4 * channels)
+	quantized = np.frombuffer(data, np.uint8, offset=offset + 8 * channels).reshape(-1, channels)
+	return (quantized * scale + low).astype(np.float32).reshape(shape)
@@ -41,6 +41,8 @@ import matplotlib.pyplot as plt
 from matplotlib import cm
 import itertools
 import functools
+import hashlib
+import json
 import networkx as nx
 from PIL import Image
 from scipy.ndimage import gaussian_filter
@@ -253,8 +255,17 @@ def colorToHex(color):
 		hex += "%0.2X" % part
 	return hex
 
+# Whether the client applies identities of cuboids, redraw markers, "SPAWN CONNECTIONS" and "TF LAYOUT"
+# natively (ANeuralSceneManager).
+# Clients parsing the instructions in Blueprints only understand the tuples without identity
+def nativeScene(connection):
+	return bool(getattr(connection, "nativeScene", False))
+
 # Packs cuboid drawing instructions into a list, that can be sent alone or in a batch via websocket later
-async def packCuboid(position, size, color, rotator = 0, positionIsCenterPoint = False):
+# The optional identity (e.g. "layer 3", "connection 2 3", "kernel 5 12 7") lets the client
+# reuse and update the same object across redraws instead of spawning a new one.
+# Only pass it if the client supports it, see nativeScene
+async def packCuboid(position, size, color, rotator = 0, positionIsCenterPoint = False, identity = None):
 	if type(position) is not Coordinates:
 		position = Coordinates(position)
 	if type(size) is not Coordinates:
@@ -267,6 +278,8 @@ async def packCuboid(position, size, color, rotator = 0, positionIsCenterPoint =
 	# Append them into one large array and send them away as instruction
 	propertyList = [float(i) for i in
 		position.list() + size.list() + formatColor(color) + rotator.list()]
+	if identity is not None:
+		return ("SPAWN CUBOID pos size color opacity rot", propertyList, identity)
 	return ("SPAWN CUBOID pos size color opacity rot", propertyList)
 
 # Packs image drawing instructions into a list, that can be sent alone or in a batch via websocket later
@@ -361,7 +374,7 @@ async def waitForServerDrawNext(processDescription):
 # Spawns a cuboid at the specified coordinates with the specified color via a client-connection
 # Ignores batches and just spawns it directly.
 async def spawnCuboidDirectly(connection, position, size, color, rotator = None,
-	positionIsCenterPoint = False, processDescription = None, waitAfterwardsForServerDrawNext = True):
+	positionIsCenterPoint = False, processDescription = None, waitAfterwardsForServerDrawNext = True, identity = None):
 
 	if not connection:
 		return await debugDrawCuboidInPlot(position, size, color, rotator)
@@ -373,7 +386,8 @@ async def spawnCuboidDirectly(connection, position, size, color, rotator = None,
 
 	await waitUntilReadyToDraw(processDescription)
 
-	drawResponse = await packCuboid(position, size, color, rotator, positionIsCenterPoint)
+	drawResponse = await packCuboid(position, size, color, rotator, positionIsCenterPoint,
+		identity if nativeScene(connection) else None)
 	await connection.send(drawResponse, sendAlsoAsDebugMsg=design.debugWhenDrawingObject,
 		printText=f"SPAWN CUBOID at position {position} with size {size}.")
 	if waitAfterwardsForServerDrawNext:
@@ -421,6 +435,16 @@ async def spawnDoubleImagePlaneAlongZ(connection, filepath, position, size,
 	await spawnImage(connection, filepath, position, size, rotator,
 		positionIsCenterPoint, processDescription, waitAfterwardsForServerDrawNext, sleepBefore)
 
+# Tells the client that all objects within scope (an identity prefix like "layer" or "kernel 5")
+# are about to be redrawn. After phase "end", objects of that scope which haven't been
+# spawned again are hidden by the client and kept for reuse. Only sent to clients supporting it, see nativeScene
+async def sendRedrawMarker(connection, phase, scopes):
+	if not nativeScene(connection):
+		return
+	if type(scopes) is not list:
+		scopes = [scopes]
+	await connection.send(("SCENE REDRAW", phase, scopes))
+
 # Sends the whole cuboidQueue as batch or drawing instructions to the client
 async def sendCuboidBatch(connection, processDescription, waitAfterwardsForServerDrawNext=True):
 	if processDescription is None:
@@ -477,10 +501,11 @@ async def checkEmptyQueue(connection, processDescription):
 # Uses batch size as specified in visualization settings
 # You have to call sendCuboidBatch to finally clear the queue after sending the last cuboid!
 async def queueCuboid(connection, position, size, color, rotator = None,
-	positionIsCenterPoint = False, processDescription = None):
+	positionIsCenterPoint = False, processDescription = None, identity = None):
 	if not connection:
 		return await debugDrawCuboidInPlot(position, size, color, rotator)
-	drawResponse = await packCuboid(position, size, color, rotator, positionIsCenterPoint)
+	drawResponse = await packCuboid(position, size, color, rotator, positionIsCenterPoint,
+		identity if nativeScene(connection) else None)
 	cuboidQueue.append(drawResponse)
 	# Give other asyncio threads a chance to pass through
 	await server.sleep(0, "Creating cuboid spawn instructions for " + processDescription)
@@ -654,10 +679,16 @@ async def drawLayout(connection, positions):
 			typeCount[layerType] = 1
 	
 	connectionCount = hiddenConnectionCount = 0
+	# Pairs of parent and child layer index, if the client builds the connections itself
+	connectionEdges = []
+	# Blueprint clients don't know "SPAWN CONNECTIONS" and get one cuboid per connection instead
+	buildConnectionsOnClient = nativeScene(connection) and design.connections.buildOnClient
+	await sendRedrawMarker(connection, "begin", ["layer", "connection"])
 	for index, current in enumerate(Layer.layerList):
 		await queueCuboid(connection, current.position, current.size, current.color,
 			positionIsCenterPoint = True,
-			processDescription = f"layer {index} of {len(Layer.layerList)}")
+			processDescription = f"layer {index} of {len(Layer.layerList)}",
+			identity = f"layer {index}")
 		
 		# connections:
 		if design.connections.display:
@@ -674,6 +705,10 @@ async def drawLayout(connection, positions):
 						math.isclose(deltay, 0):
 							hiddenConnectionCount += 1
 							continue # connection between grouped layers should not be drawn
+				if buildConnectionsOnClient:
+					connectionEdges += [parent.index, index]
+					connectionCount += 1
+					continue
 				thickness = min(design.connections.strength,
 					parent.size.x/2, parent.size.y/2,
 					current.size.x/2, current.size.y/2)
@@ -689,10 +724,17 @@ async def drawLayout(connection, positions):
 					color = design.connections.color,
 					rotator = Coordinates(x = 90-math.degrees(-alpha)),
 					positionIsCenterPoint = True,
-					processDescription = f"connections to layer {index} of {len(Layer.layerList)}")
+					processDescription = f"connections to layer {index} of {len(Layer.layerList)}",
+					identity = f"connection {parent.index} {index}")
 				connectionCount += 1
 
 	await sendCuboidBatch(connection, "last layers of structure", False)
+	if buildConnectionsOnClient:
+		# Style: strength and color, followed by the flat list of edges of the layer DAG
+		await connection.send(("SPAWN CONNECTIONS", [float(i) for i in [design.connections.strength] +
+			formatColor(design.connections.color)], connectionEdges), sendAlsoAsDebugMsg=design.debugWhenDrawingObject,
+			printText=f"SPAWN CONNECTIONS with {connectionCount} connections.")
+	await sendRedrawMarker(connection, "end", ["layer", "connection"])
 	successMsg = f"Successfully drew the neural network with {len(Layer.layerList)} layers.\n" + \
 		f"Composition: " + ', '.join([f"{n} {desc}" for (desc, n) in typeCount.items()])
 	if design.connections.displayBetweenGroupedLayers:
@@ -721,6 +763,51 @@ async def drawLayout(connection, positions):
 
 	return True
 
+# Collects all (nested) settings of a settings class as sorted list, used for cache keys
+def settingsSnapshot(settingsClass, ignore=()):
+	snapshot = []
+	for name in sorted(vars(settingsClass)):
+		if name.startswith('__') or name in ignore:
+			continue
+		value = getattr(settingsClass, name)
+		if isinstance(value, type):
+			snapshot.append((name, settingsSnapshot(value, ignore)))
+		elif not callable(value):
+			snapshot.append((name, repr(value)))
+	return snapshot
+
+# Key of the layout cache: hash of the layer DAG (names, types, shapes, connections)
+# and all layouting settings that could change the result
+def layoutCacheKey():
+	structure = [(layer[0], layer[1], repr(layer[2]), sorted(layer[4])) for layer in ai.tfnet.layers]
+	description = repr((structure, settingsSnapshot(design.layouting, ignore=("renderGif",))))
+	return hashlib.sha1(description.encode("utf-8")).hexdigest()[:24]
+
+def layoutCachePath(key):
+	return fileHandling.createFilepath(fileHandling.ensureFolderEnding(setting.FILEPATHS.FILECACHE) +
+		"layouts" + os.sep + key + ".json")
+
+# Returns the cached layout positions as dict {layer index: (x, y)} or None
+def loadCachedLayout(key):
+	filepath = layoutCachePath(key)
+	if not os.path.exists(filepath):
+		return None
+	try:
+		with open(filepath, "r") as file:
+			cached = json.load(file)
+		if cached.get("key") != key or len(cached["positions"]) != len(ai.tfnet.layers):
+			return None
+		return {index: tuple(position) for index, position in enumerate(cached["positions"])}
+	except:
+		loggingFunctions.warn("Cached layout " + filepath + " could not be read and will be recalculated.\n" +
+			traceback.format_exc())
+		return None
+
+def storeCachedLayout(key, positions):
+	with open(layoutCachePath(key), "w") as file:
+		json.dump({"key": key, "positions": [[float(value) for value in positions[index]]
+			for index in range(len(positions))]}, file)
+
 # Draws the tfnet.layer structure via the client-connection
 # Returns whether we could successfully draw the architecture
 # If not connection, then the cuboids cannot be drawn but will be displayed in a graphic
@@ -732,7 +819,11 @@ async def drawstructure(connection = None):
 		if not hasattr(ai.tfnet, "validstructure") or not ai.tfnet.validstructure:
 			# Wait, we can't draw that, network doesn't have a valid structure...
 			return False
-		
+
+		# A previously seen architecture with the same layouting settings doesn't need the force layout again
+		ai.tfnet.layoutKey = layoutCacheKey()
+		ai.tfnet.layoutPositions = loadCachedLayout(ai.tfnet.layoutKey) if design.layouting.cacheLayouts else None
+	if ai.tfnet.layoutPositions is None:
 		# Creating a graph layout from the layer structure...
 		graph = nx.Graph()
 		graph.add_nodes_from(range(len(ai.tfnet.layers)))
@@ -782,6 +873,18 @@ async def drawstructure(connection = None):
 		)
 		# execute force based algorithm
 		ai.tfnet.layoutPositions = await forceatlas2.forceatlas2_networkx_layout_async(graph, pos=positions, quadsizes=sizes, iterations=NUMBER_OF_ITERATIONS)
+		if design.layouting.cacheLayouts:
+			try:
+				storeCachedLayout(ai.tfnet.layoutKey, ai.tfnet.layoutPositions)
+			except OSError:
+				# The layout is still drawn, it only has to be recalculated next time
+				loggingFunctions.warn("Layout could not be cached in " + layoutCachePath(ai.tfnet.layoutKey) +
+					" and will be recalculated next time.\n" + traceback.format_exc())
+	# Let the client know under which key it can persist and later restore this layout.
+	# Only clients with a scene manager use it, see nativeScene
+	if nativeScene(connection):
+		await connection.send(("TF LAYOUT", ai.tfnet.layoutKey,
+			[[float(value) for value in ai.tfnet.layoutPositions[index]] for index in range(len(ai.tfnet.layers))]))
 	# draw layers at the resulting positions
 	return await drawLayout(connection, ai.tfnet.layoutPositions)
 
@@ -824,7 +927,8 @@ def applyBrightness(image, brightness):
 		return 1 - (1 - image) ** (brightness / 50)
 
 # Will draw all kernels for the selected layer as defined in trainable var "{layername}/kernel:0"
-async def drawKernels(connection, layerIndex, refreshTrainVars=False, canUseCachedFile=True, draw=True):
+# maxResolution optionally lowers design.kernels.renderTexture.maxTextureResolution, e.g. for far layers
+async def drawKernels(connection, layerIndex, refreshTrainVars=False, canUseCachedFile=True, draw=True, maxResolution=0):
 	async def status(verbosity, text):
 		if connection:
 			await connection.sendstatus(verbosity, text)
@@ -834,9 +938,12 @@ async def drawKernels(connection, layerIndex, refreshTrainVars=False, canUseCach
 	
 	design_k = design.kernels
 	design_tx = design_k.renderTexture
+	maxTextureResolution = design_tx.maxTextureResolution
+	if maxResolution and maxResolution > 0:
+		maxTextureResolution = min(maxTextureResolution, maxResolution)
 	filename = settingsToFilename(f"layer-{layerIndex}_settings", [
 		("res", design_tx.defaultPixelResolution),
-		("max", design_tx.maxTextureResolution),
+		("max", maxTextureResolution),
 		("space", design_k.spacingBetweenKernels),
 		("bright", design_k.brightness, 50),
 		("contr", design_k.contrast, 50),
@@ -863,7 +970,7 @@ async def drawKernels(connection, layerIndex, refreshTrainVars=False, canUseCach
 	if not 'kernel' in trainableVars or len(trainableVars['kernel']) == 0:
 		# No kernel found for this layer. Let's try to refresh
 		if not refreshTrainVars:
-			return await drawKernels(connection, layerIndex, True)
+			return await drawKernels(connection, layerIndex, True, canUseCachedFile, draw, maxResolution)
 		# Still no kernel found. Output error msg and return
 		await status(16, f"Layer {layerIndex} does not have any kernels that could be visualized!")
 		return False
@@ -918,8 +1025,8 @@ async def drawKernels(connection, layerIndex, refreshTrainVars=False, canUseCach
 		if renderTexture:
 			resolution = list(design_tx.defaultPixelResolution)
 			# Applying max resolution to texture size
-			resolution[0] = min(resolution[0], design_tx.maxTextureResolution / structureWidth * design_k.defaultPixelDimensions[0])
-			resolution[1] = min(resolution[1], design_tx.maxTextureResolution / structureHeight * design_k.defaultPixelDimensions[1])
+			resolution[0] = min(resolution[0], maxTextureResolution / structureWidth * design_k.defaultPixelDimensions[0])
+			resolution[1] = min(resolution[1], maxTextureResolution / structureHeight * design_k.defaultPixelDimensions[1])
 			# Creating render array to be filled with color (and opacity) values
 			if not design_tx.antiAliasing:
 				render = np.zeros([int(round(structureHeight * resolution[1] / design_k.defaultPixelDimensions[1])),
@@ -966,6 +1073,8 @@ async def drawKernels(connection, layerIndex, refreshTrainVars=False, canUseCach
 		
 		progress = 0
 		updateEvery = 1000 # every how many iterations the progress bar and the coroutine yielding should update
+		if draw and design_k.spawnIndividualCuboids and connection:
+			await sendRedrawMarker(connection, "begin", f"kernel {layerIndex}")
 		totalIterations = groups[1] * groups[0] * pixelsPerGroup[1] * pixelsPerGroup[0]
 		opacity = int(round(design_tx.opacity * 255))
 		with tqdm(total=totalIterations) as pbar:
@@ -1055,13 +1164,16 @@ async def drawKernels(connection, layerIndex, refreshTrainVars=False, canUseCach
 									+ thisLayer.position.z
 									- size.z / 2
 								)
-								await queueCuboid(connection, position, size, color, processDescription = processDesc)
+								await queueCuboid(connection, position, size, color, processDescription = processDesc,
+									identity = f"kernel {layerIndex} {groupx * pixelsPerGroup[0] + pixelx} " +
+										f"{groupy * pixelsPerGroup[1] + pixely}")
 							elif progress % updateEvery:
 								await server.sleep(0, processDesc)
 
 		# After looping through all of the kernels
 		if draw and design_k.spawnIndividualCuboids and connection:
 			await sendCuboidBatch(connection, "last kernels of layer " + str(layerIndex), False)
+			await sendRedrawMarker(connection, "end", f"kernel {layerIndex}")
 		if renderTexture:
 			Image.fromarray(render).save(filepath)
 			if design_tx.saveToRendersFolder:
@@ -1094,7 +1206,15 @@ async def drawInputPrediction(connection, inputData = setting.DEBUG.DEFAULT_INPU
 	await spawnDoubleImagePlaneAlongZ(connection, inputData, position, layer.size, True, description, sleepBefore=.2)
 	
 
-async def drawKernelActivations(connection, layerIndex, selectKernel, inputData, justRenderTextures=False, returnInsteadOfSave=False):
+# Downscales a PIL image so that neither side exceeds maxResolution, 0 keeps the image as is
+def limitResolution(image, maxResolution):
+	if maxResolution and maxResolution > 0 and max(image.size) > maxResolution:
+		image = image.copy()
+		image.thumbnail((maxResolution, maxResolution), Image.BILINEAR)
+	return image
+
+async def drawKernelActivations(connection, layerIndex, selectKernel, inputData, justRenderTextures=False, returnInsteadOfSave=False,
+	maxResolution=0):
 	if type(selectKernel) is int:
 		selectKernel = [selectKernel]
 	def listToStr(l, removeSpaces=False):
@@ -1123,9 +1243,10 @@ async def drawKernelActivations(connection, layerIndex, selectKernel, inputData,
 			out = out[..., ::-1]
 		if returnInsteadOfSave:
 			return out
-		texture = Image.fromarray(out)
+		texture = limitResolution(Image.fromarray(out), maxResolution)
 		filename = settingsToFilename(f"layer-{layerIndex}-kernel-{listToStr(selectKernel, True)}", [
 			("bgr", design.flipRGBtoBGR),
+			("max", maxResolution, 0),
 		])
 		filename = ai.internalCachePath("layerOutput", filename)
 		texture.save(filename)
@@ -1176,8 +1297,10 @@ async def drawKernelActivations(connection, layerIndex, selectKernel, inputData,
 				if image is None:
 					continue
 				texture.paste(image, (x * width, y * height))
+		texture = limitResolution(texture, maxResolution)
 		filename = settingsToFilename(f"layer-{layerIndex}-all-kernels", [
 			("bgr", design.flipRGBtoBGR),
+			("max", maxResolution, 0),
 		])
 		filename = ai.internalCachePath("layerOutput", filename)
 		texture.save(filename)
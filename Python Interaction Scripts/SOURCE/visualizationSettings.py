@@ -61,6 +61,10 @@ class connections:
 	displayBetweenGroupedLayers = False
 	strength = 70
 	color = .3
+	# Only send the layer DAG and let the client build the connection beams natively,
+	# instead of sending one cuboid instruction per connection.
+	# Only applies to clients with a scene manager applying the instructions, see nativeScene
+	buildOnClient = True
 
 # If a kernel setting is changed, the cached kernels will not be used by the algorithm,
 # therefore new kernel textures will need to be recalculated when drawing them.
@@ -173,6 +177,10 @@ class layouting:
 		# without affecting the relative size of text and lines, like plotSizeInches would do
 		animationLength = 2 # in seconds, determines how fast the gif will play
 
+	# Layouts are stored in the filecache, keyed by a hash of the layer structure and these
+	# layouting settings. A previously seen architecture is then laid out instantly
+	cacheLayouts = True
+
 	# SETTINGS FOR THE FORCE ALGORITHM:
 	iterations = 1200 # starting at 0, ending one below
 
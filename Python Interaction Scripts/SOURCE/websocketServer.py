@@ -37,6 +37,7 @@ import beautifulDebug
 import serverCommands
 import serverSettings as setting
 import loggingFunctions
+import localTransport
 
 
 # allows the client to check its version against the server to guarantee feature parity
@@ -90,13 +91,13 @@ async def interactiveServer(websocket, path, *, initialCommand=None, debugDiscon
 			# This would be printed and returns the function. (alternatively, break could be used too)
 			# Then asyncio's run_forever (in main program section at the bottom)
 			# would call this function again, so the server waits for a new client connection
-			except websockets.ConnectionClosedOK:
+			except (websockets.ConnectionClosedOK, localTransport.ConnectionClosedOK):
 				if debugDisconnect:
 					formattedWarning = beautifulDebug.special(5,1,5, f"x DISCONNECT: Client has disconnected ok.\n\n")
 					loggingFunctions.printlog(formattedWarning, verbosity = -4)
 				return True
 
-			except websockets.ConnectionClosedError:
+			except (websockets.ConnectionClosedError, localTransport.ConnectionClosedError):
 				formattedWarning = beautifulDebug.special(5,0,4, f"x DISCONNECT: Client has disconnected unexpectedly!\n\n")
 				loggingFunctions.printlog(formattedWarning, verbosity = -3)
 				return False
@@ -183,17 +184,21 @@ async def interactiveServer(websocket, path, *, initialCommand=None, debugDiscon
 			loadedCommand=[]
 
 			# Execute corresponding function, relaying websocket connection and command
-			# Functions returns whether it wants the connection to be kept open after execution
-			shouldBeKeptOpen = await func(commandInstance,
+			# Functions returns whether it wants the connection to be kept open after execution.
+			# The client may cancel it meanwhile, see runCancellable
+			shouldBeKeptOpen = await runCancellable(websocket, func(commandInstance,
 				# Defining additional parameters needed for certain command functions
 				loadedCommand=loadedCommand, # for console and load
 				calledDirectlyByCommand=True, # for nn is loaded
 				history=command_history, # for history
-			)
+			))
 
 			# adding executed command to history
 			command_history.append((commandInstance.command, shouldBeKeptOpen is not False))
 
+			if setting.SERVER.SEND_MODEL_EPOCH:
+				await commandInstance.sendModelEpoch()
+
 			# Just making sure that func can only returns bool or None:
 			assert shouldBeKeptOpen is None or type(shouldBeKeptOpen) is bool
 
@@ -257,6 +262,18 @@ async def interactiveServer(websocket, path, *, initialCommand=None, debugDiscon
 				else:
 					await sleep(0.001, "websocket connection that has been left open")
 
+		except CommandCancelled:
+			# The client does not want the response anymore, the rest of a chain is dropped as well
+			command_history.append((commandInstance.command, False))
+			loggingFunctions.printlog(beautifulDebug.B_BLUE + f"x Command {commandInstance.command} has been " +
+				"cancelled by the client. Disconnecting client.\n\n" + beautifulDebug.RESET, verbosity = -3)
+			try:
+				await commandInstance.sendstatus(-10, f"Cancelled command {commandInstance.command}.")
+			except (websockets.exceptions.ConnectionClosed, localTransport.ConnectionClosedOK,
+				localTransport.ConnectionClosedError):
+				pass
+			await websocket.close()
+			return True
 		except asyncio.CancelledError:
 			# Command thread has been interrupted from outside, probably by command "server stop"
 			errormsg = f"The coroutine of command " + commandInstance.command + \
@@ -274,7 +291,7 @@ async def interactiveServer(websocket, path, *, initialCommand=None, debugDiscon
 				f"x Terminating connection due to outside interruption.\n\n" + beautifulDebug.RESET, verbosity = -3)
 			await websocket.close()
 			return False
-		except websockets.exceptions.ConnectionClosedError:
+		except (websockets.exceptions.ConnectionClosedError, localTransport.ConnectionClosedError):
 			# Command thread has been interrupted from outside, probably by command "server stop"
 			errormsg = f"ERROR responding to command " + commandInstance.command + \
 				"! The connection has been closed by the client and is no longer available."
@@ -329,6 +346,7 @@ def startServer():
 			newServer = websockets.serve(interactiveServer, setting.SERVER.IP, setting.SERVER.PORT)
 			# asyncio: start specified server
 			asyncio.get_event_loop().run_until_complete(newServer)
+			startLocalServer()
 			# Great, print the success
 			loggingFunctions.printlog(beautifulDebug.B_GREEN + "Websocket server has been started. " +
 				"Listening for incoming connection requests...\n" +
@@ -387,6 +405,81 @@ def startServer():
 				time.sleep(setting.SERVER.SECONDS_BETWEEN_TRIES)
 
 
+# Additionally serves clients on the same machine on a unix domain socket, see localTransport.py
+def startLocalServer():
+	if not setting.SERVER.LOCAL_SOCKET:
+		return
+	if not localTransport.isSupported():
+		loggingFunctions.printlog(beautifulDebug.special(5, 3, 0) + "Unix domain sockets are not supported " +
+			"by the asyncio event loop on this platform. Local clients have to connect via websocket.\n" +
+			beautifulDebug.RESET, verbosity = 5)
+		return
+	try:
+		asyncio.get_event_loop().run_until_complete(localTransport.serve(interactiveServer))
+		loggingFunctions.printlog(beautifulDebug.B_GREEN + "Listening for local clients on " +
+			f"{localTransport.socketPath()}\n" + beautifulDebug.RESET, verbosity = -1)
+	except OSError:
+		# The websocket server keeps running, so this is no reason to give up
+		loggingFunctions.printlog(beautifulDebug.special(5, 3, 0) + "Cannot bind local server to " +
+			f"{localTransport.socketPath()}!\n" + traceback.format_exc() + beautifulDebug.RESET, verbosity = 15)
+
+
+# Sent by the client while a command is executed to cancel it
+CANCEL_FRAME = "#CANCEL#"
+# Handshake header with the priority class of the command: "interactive", "normal" or "bulk"
+PRIORITY_HEADER = "X-NeuralVisUAL-Priority"
+# Handshake header with the fragment size the client measured as bandwidth-delay product
+FRAGMENT_SIZE_HEADER = "X-NeuralVisUAL-Fragment-Size"
+
+# Returns a header of the websocket handshake, default if there is none.
+# Local socket connections send the same headers in their first frame, see localTransport.py
+def handshakeHeader(websocket, name, default = None):
+	# Attribute of the legacy and of the newer websockets server implementation
+	headers = getattr(websocket, "request_headers", None)
+	if headers is None and getattr(websocket, "request", None) is not None:
+		headers = websocket.request.headers
+	if headers is None:
+		return default
+	return headers.get(name, default)
+
+class CommandCancelled(Exception):
+	pass
+
+# Executes the coroutine of a command while listening on the connection for the cancel frame.
+# Clients send nothing else while they wait for the response, so that listening does not take
+# away any commands. Raises CommandCancelled if the client cancelled the command, and cancels it
+# as well if the client disconnects, instead of continuing until the next message fails to send
+async def runCancellable(websocket, coroutine):
+	commandTask = asyncio.ensure_future(coroutine)
+	receiveTask = asyncio.ensure_future(websocket.recv())
+	try:
+		while True:
+			await asyncio.wait({commandTask, receiveTask}, return_when=asyncio.FIRST_COMPLETED)
+			if commandTask.done():
+				# Receiving is cancelled between two frames, so no message gets lost
+				receiveTask.cancel()
+				return commandTask.result()
+			if receiveTask.exception() is None and receiveTask.result() != CANCEL_FRAME:
+				loggingFunctions.warn("Ignoring message received during execution of a command: " +
+					str(receiveTask.result())[:100], 5)
+				receiveTask = asyncio.ensure_future(websocket.recv())
+				continue
+			break
+	except asyncio.CancelledError:
+		# This connection has been interrupted from the outside, the command must not keep running
+		commandTask.cancel()
+		receiveTask.cancel()
+		raise
+	commandTask.cancel()
+	try:
+		await commandTask
+	except (asyncio.CancelledError, websockets.exceptions.ConnectionClosed,
+		localTransport.ConnectionClosedOK, localTransport.ConnectionClosedError):
+		pass
+	# Raises the exception of a disconnected client
+	receiveTask.result()
+	raise CommandCancelled()
+
 yieldingCoroutines = set()
 
 # Sleeps in an asynchronous manner while yielding other threads, can be cancelled with stopCoroutines